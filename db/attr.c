@@ -22,14 +22,13 @@
 #include "rlmngt.h"
 #include "str.h"
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
-/* primary indexes comparison functions behave same like tuple comparison
- * functions; both simply compare the values */
-#define cmpf(type)			cmpf_primar_##type
-#define primary_cmpf(type)		cmpf_primar_##type
-#define def_primary_cmpf(type)		\
-	static int cmpf_primar_##type(const char *a, const char *b, size_t s)\
+/* tuple comparison functions simply compare the values */
+#define cmpf(type)			cmpf_##type
+#define def_cmpf(type)			\
+	static int cmpf_##type(const char *a, const char *b, size_t s)\
 	{\
 		assert(s == sizeof(type));\
 		if (*(type *)a < *(type *)b)		return -1;\
@@ -37,76 +36,83 @@
 		else					return 1;\
 	}
 
-/* secondary index comparison functions compare the value itself, and 
- * if this is equal, they also compare the tuple address which is stored
- * behind the value in secondary indexes */
-#define secondary_cmpf(type)		cmpf_secon_##type
-#define def_secondary_cmpf(type)	\
-	static int cmpf_secon_##type(const char *a, const char *b, size_t s)\
-	{\
-		if (*(type *)a < *(type *)b)\
-			return -1;\
-		else if (*(type *)a == *(type *)b)\
-			return addrcmp(*(blkaddr_t *)(a + sizeof(type)),\
-					*(blkaddr_t *)(b + sizeof(type)));\
-		else return 1;\
-	}
+def_cmpf(db_int_t)
+def_cmpf(db_uint_t)
+def_cmpf(db_long_t)
+def_cmpf(db_ulong_t)
+def_cmpf(db_float_t)
+def_cmpf(db_double_t)
 
-static int addrcmp(blkaddr_t a1, blkaddr_t a2)
+static int cmpf(string)(const char *s1, const char *s2, size_t s)
 {
-	if (a1 == INVALID_ADDR || a2 == INVALID_ADDR)
-		return 0;
-	else if (a1 < a2)
-		return -1;
-	else if (a1 == a2)
-		return 0;
-	else
-		return 1;
+	return strncmp(s1, s2, s);
 }
 
-def_primary_cmpf(db_int_t)
-def_secondary_cmpf(db_int_t)
-def_primary_cmpf(db_uint_t)
-def_secondary_cmpf(db_uint_t)
-def_primary_cmpf(db_long_t)
-def_secondary_cmpf(db_long_t)
-def_primary_cmpf(db_ulong_t)
-def_secondary_cmpf(db_ulong_t)
-def_primary_cmpf(db_float_t)
-def_secondary_cmpf(db_float_t)
-def_primary_cmpf(db_double_t)
-def_secondary_cmpf(db_double_t)
+static int cmpf(bytes)(const char *b1, const char *b2, size_t s)
+{
+	return memcmp((void *)b1, (void *)b2, s);
+}
 
-static int primary_cmpf(string)(const char *s1, const char *s2, size_t s)
+/* index keys are normalized (see normalize_val()), so primary index keys are
+ * compared with memcmp() */
+static int primary_ixcmpf(const char *a, const char *b, size_t s)
 {
-	return strncmp(s1, s2, s);
+	return memcmp(a, b, s);
 }
 
-static int primary_cmpf(bytes)(const char *b1, const char *b2, size_t s)
+/* a normalized address is INVALID_ADDR if all its bytes are 0xff */
+static bool invalid_addr(const char *p)
 {
-	return memcmp((void *)b1, (void *)b2, s);
+	size_t i;
+
+	for (i = 0; i < sizeof(blkaddr_t); i++)
+		if ((unsigned char)p[i] != 0xff)
+			return false;
+	return true;
 }
 
-static int secondary_cmpf(string)(const char *s1, const char *s2, size_t s)
+/* secondary index keys are the normalized value followed by the normalized
+ * tuple address; if the values are equal, the addresses are compared unless
+ * one of them is INVALID_ADDR, which matches any address */
+static int secondary_ixcmpf(const char *a, const char *b, size_t s)
 {
+	const size_t n = s - sizeof(blkaddr_t);
 	int val;
-       
-	if ((val = strncmp((void *)s1, (void *)s2, s - sizeof(blkaddr_t))) != 0)
+
+	if ((val = memcmp(a, b, n)) != 0)
 		return val;
+	else if (invalid_addr(a + n) || invalid_addr(b + n))
+		return 0;
 	else
-		return addrcmp(*(blkaddr_t *)(s1 + s - sizeof(blkaddr_t)),
-				*(blkaddr_t *)(s2 + s - sizeof(blkaddr_t)));
+		return memcmp(a + n, b + n, sizeof(blkaddr_t));
 }
 
-static int secondary_cmpf(bytes)(const char *b1, const char *b2, size_t s)
+/* writes the `size' lowest bytes of `u' big-endian */
+static void put_be(char *dst, uint64_t u, size_t size)
 {
-	int val;
-       
-	if ((val = memcmp((void *)b1, (void *)b2, s - sizeof(blkaddr_t))) != 0)
-		return val;
-	else
-		return addrcmp(*(blkaddr_t *)(b1 + s - sizeof(blkaddr_t)),
-				*(blkaddr_t *)(b2 + s - sizeof(blkaddr_t)));
+	while (size-- > 0) {
+		dst[size] = (char)(u & 0xff);
+		u >>= 8;
+	}
+}
+
+/* the sign bit of signed integers is flipped, so that negative numbers are
+ * smaller than positive ones */
+static void normalize_int(char *key, uint64_t u, size_t size, bool sign)
+{
+	if (sign)
+		u ^= (uint64_t)1 << (8 * size - 1);
+	put_be(key, u, size);
+}
+
+/* positive floating point numbers get the sign bit, negative ones are 
+ * inverted, so that the bits order like the numbers */
+static void normalize_float(char *key, uint64_t u, size_t size)
+{
+	const uint64_t sign = (uint64_t)1 << (8 * size - 1);
+
+	u = (u & sign) ? ~u : (u | sign);
+	put_be(key, u, size);
 }
 
 cmpf_t cmpf_by_sattr(struct sattr *attr)
@@ -147,36 +153,106 @@ cmpf_t ixcmpf_by_sattr(struct sattr *attr)
 			|| attr->at_domain == BYTES);
 	assert(attr->at_indexed == PRIMARY || attr->at_indexed == SECONDARY);
 
-	if (attr->at_indexed == PRIMARY) {
-		switch (attr->at_domain) {
-			case INT:	return primary_cmpf(db_int_t);
-			case UINT:	return primary_cmpf(db_uint_t);
-			case LONG:	return primary_cmpf(db_long_t);
-			case ULONG:	return primary_cmpf(db_ulong_t);
-			case FLOAT:	return primary_cmpf(db_float_t);
-			case DOUBLE:	return primary_cmpf(db_double_t);
-			case STRING:	return primary_cmpf(string);
-			case BYTES:	return primary_cmpf(bytes);
-			default:	return NULL;
-		}
-	} else if (attr->at_indexed == SECONDARY) {
-		switch (attr->at_domain) {
-			case INT:	return secondary_cmpf(db_int_t);
-			case UINT:	return secondary_cmpf(db_uint_t);
-			case LONG:	return secondary_cmpf(db_long_t);
-			case ULONG:	return secondary_cmpf(db_ulong_t);
-			case FLOAT:	return secondary_cmpf(db_float_t);
-			case DOUBLE:	return secondary_cmpf(db_double_t);
-			case STRING:	return secondary_cmpf(string);
-			case BYTES:	return secondary_cmpf(bytes);
-			default:	return NULL;
-		}
-	} else {
+	return ixcmpf_by_type(attr->at_indexed);
+}
+
+cmpf_t ixcmpf_by_type(int type)
+{
+	assert(type == PRIMARY || type == SECONDARY);
+
+	if (type == PRIMARY)
+		return primary_ixcmpf;
+	else if (type == SECONDARY)
+		return secondary_ixcmpf;
+	else {
 		assert(false);
 		return NULL;
 	}
 }
 
+void normalize_val(const struct sattr *attr, char *key, const char *val)
+{
+	assert(attr != NULL);
+	assert(key != NULL);
+	assert(val != NULL);
+	assert(sizeof(db_float_t) == sizeof(uint32_t));
+	assert(sizeof(db_double_t) == sizeof(uint64_t));
+
+	switch (attr->at_domain) {
+		case INT: {
+			db_int_t v;
+
+			memcpy(&v, val, sizeof(v));
+			normalize_int(key, (uint64_t)v, sizeof(v), true);
+			break;
+		}
+		case UINT: {
+			db_uint_t v;
+
+			memcpy(&v, val, sizeof(v));
+			normalize_int(key, (uint64_t)v, sizeof(v), false);
+			break;
+		}
+		case LONG: {
+			db_long_t v;
+
+			memcpy(&v, val, sizeof(v));
+			normalize_int(key, (uint64_t)v, sizeof(v), true);
+			break;
+		}
+		case ULONG: {
+			db_ulong_t v;
+
+			memcpy(&v, val, sizeof(v));
+			normalize_int(key, (uint64_t)v, sizeof(v), false);
+			break;
+		}
+		case FLOAT: {
+			db_float_t v;
+			uint32_t u;
+
+			memcpy(&v, val, sizeof(v));
+			if (v == 0)
+				v = 0; /* -0 equals 0 */
+			memcpy(&u, &v, sizeof(u));
+			if (v != v)
+				u = UINT32_MAX >> 1; /* NaN is greatest */
+			normalize_float(key, u, sizeof(u));
+			break;
+		}
+		case DOUBLE: {
+			db_double_t v;
+			uint64_t u;
+
+			memcpy(&v, val, sizeof(v));
+			if (v == 0)
+				v = 0; /* -0 equals 0 */
+			memcpy(&u, &v, sizeof(u));
+			if (v != v)
+				u = UINT64_MAX >> 1; /* NaN is greatest */
+			normalize_float(key, u, sizeof(u));
+			break;
+		}
+		case STRING:
+			/* zeros behind the string compare like its end */
+			strncpy(key, val, attr->at_size);
+			break;
+		case BYTES:
+			memcpy(key, val, attr->at_size);
+			break;
+		default:
+			assert(false);
+	}
+}
+
+void normalize_addr(const struct sattr *attr, char *key, blkaddr_t addr)
+{
+	assert(attr != NULL);
+	assert(key != NULL);
+
+	put_be(key + attr->at_size, (uint64_t)addr, sizeof(blkaddr_t));
+}
+
 void set_sattr_val(char *tuple, struct sattr *sattr, struct value *value)
 {
 	char *dest;
@@ -34,12 +34,30 @@ typedef int (*cmpf_t)(const char *, const char *, size_t);
 cmpf_t cmpf_by_sattr(struct sattr *attr);
 
 /* Returns a comparison function for a attribute. NOTE: The returned 
- * function is for index's use only! Because index comparision functions
+ * function is for index's use only! It compares normalized keys (see 
+ * normalize_val()) with memcmp(); because index comparision functions
  * distinguish between PRIMARY and SECONDARY indices, the behaviour of 
  * a secondary indexed attribute comparison function might be 
  * inapplicable for normal in-tuple comparison. See cmpf_by_sattr(). */
 cmpf_t ixcmpf_by_sattr(struct sattr *attr);
 
+/* Returns the comparison function of the keys of PRIMARY or SECONDARY 
+ * indexes, which may be composite ones (see ixmngt.h). */
+cmpf_t ixcmpf_by_type(int type);
+
+/* Writes the normalized form of a value of `attr' into `key', which has the
+ * attribute's size: integers are big-endian with the sign bit flipped, the 
+ * bits of floating point numbers are transformed to order like them and 
+ * strings are padded with zeros. Normalized values compare like the values
+ * themselves with memcmp(). */
+void normalize_val(const struct sattr *attr, char *key, const char *val);
+
+/* Writes the normalized form of a tuple address, i.e. the address 
+ * big-endian, behind the normalized value of `attr' in the secondary index 
+ * key `key', where the B+-tree expects it for its posting lists (see 
+ * btree.h). INVALID_ADDR matches any address. */
+void normalize_addr(const struct sattr *attr, char *key, blkaddr_t addr);
+
 /* Sets a value in a tuple. */
 void set_sattr_val(char *tuple, struct sattr *sattr, struct value *value);
 
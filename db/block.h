@@ -25,12 +25,25 @@
 
 #define BLK_SIZE	((size_t)512)		/* data block size on disk */
 
+#define IO_ALIGN	((size_t)4096)		/* max. alignment required by
+						 * direct I/O */
+
+#define IO_ALIGNED(ptr)	((uintptr_t)(ptr) % IO_ALIGN == 0)
+
+#define PG_SIZE_MIN	((size_t)4096)		/* smallest selectable page */
+#define PG_SIZE_MAX	((size_t)65536)		/* largest selectable page */
+
+/* true if `size' is a selectable page size, i.e. a power of two between 
+ * PG_SIZE_MIN and PG_SIZE_MAX */
+#define PG_SIZE_VALID(size) ((size) >= PG_SIZE_MIN && (size) <= PG_SIZE_MAX\
+				&& ((size) & ((size) - 1)) == 0)
+
 #define INVALID_ADDR	((blkaddr_t)-1)		/* invalid tuple address */
 
-typedef	int blkaddr_t;				/* a tuple's address (zero or
+typedef	int64_t blkaddr_t;			/* a tuple's address (zero or
 						 * larger or INVALID_ADDR) */
 
-typedef unsigned int tpcnt_t;			/* count of tuples in a 
+typedef uint64_t tpcnt_t;			/* count of tuples in a 
 						 * relation */
 
 #endif
@@ -14,22 +14,35 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _XOPEN_SOURCE 500	/* ftruncate(), pread(), pwrite() */
+
 #include "btree.h"
 #include "block.h"
 #include "cache.h"
 #include "constants.h"
 #include "mem.h"
 #include "str.h"
+#include "wal.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#ifdef USE_MMAP
+#include <sys/mman.h>
+#endif
 
-/* the maximum size of the database cache */
-#define TOTAL_CACHE_SIZE	(1024 * 10)
+#ifdef USE_MMAP
+/* nodes are accessed in the file mapping instead of the buffer pool */
+#ifndef NO_CACHE
+#define NO_CACHE
+#endif
+#endif
 
-/* minimum order of tree */
+/* minimum count of the largest entries that fit into a node */
 #define MIN_ORDER		11
 
 /* different node types (accessible through TYPE) */
@@ -37,11 +50,8 @@
 #define INNER			1
 #define LEAF			2
 
-/* size of a address/key pair */
-#define ENTRY_SIZE(ix)		(sizeof(blkaddr_t) + (ix)->ix_size)
-
-/* the order of a tree, i.e. the maximum number of keys in a node */
-#define ORDER(ix)		((ix)->ix_order)
+/* size of the offsets and lengths stored in a node */
+#define OFF_SIZE(ix)		((ix)->ix_blksize <= 65536 ? 2 : 4)
 
 #define TYPE_OFFSET		(0)
 #define PREV_DEL_OFFSET		(TYPE_OFFSET + sizeof(char))
@@ -49,6 +59,13 @@
 #define LNBR_OFFSET		(CNT_OFFSET + sizeof(short))
 #define RNBR_OFFSET		(LNBR_OFFSET + sizeof(blkaddr_t))
 #define BLK_OFFSET		(RNBR_OFFSET + sizeof(blkaddr_t))
+#define END_OFFSET		(BLK_OFFSET)
+#define PLEN_OFFSET(ix)		(END_OFFSET + OFF_SIZE(ix))
+#define PREFIX_OFFSET(ix)	(PLEN_OFFSET(ix) + OFF_SIZE(ix))
+
+/* the smallest node size for keys of `size' bytes */
+#define MIN_BLK_SIZE(size)	(BLK_OFFSET + 2 * 4 + (size)		       \
+				+ MIN_ORDER * (sizeof(blkaddr_t) + (size) + 4))
 
 /* type of node: either INNER, LEAF or AVAIL */
 #define TYPE(buf)		(*(char *)(buf + TYPE_OFFSET))
@@ -65,15 +82,43 @@
 /* right neighbor of node */
 #define RNBR(buf)		(*(blkaddr_t *)(buf + RNBR_OFFSET))
 
+/* the end of the entries of a node, i.e. the begin of its free space */
+#define END(ix, buf)		get_off(ix, (buf) + END_OFFSET)
+
+/* the length of the prefix that all keys of a node share */
+#define PLEN(ix, buf)		get_off(ix, (buf) + PLEN_OFFSET(ix))
+
+/* the prefix of the keys of a node, which is stored once */
+#define PREFIX(ix, buf)		((buf) + PREFIX_OFFSET(ix))
+
+/* the position of the i-th slot, which holds the offset of the i-th entry; 
+ * the slots are stored backwards from the end of the node */
+#define SLOT_POS(ix, i)		((ix)->ix_blksize - ((i) + 1) * OFF_SIZE(ix))
+
+/* the offset of the i-th entry of a node */
+#define SLOT(ix, buf, i)	get_off(ix, (buf) + SLOT_POS(ix, i)	       \
+				+ (assert((i) < CNT(buf)),0))
+
 /* the address of the i-th child of a node */
-#define PTR(ix, buf, i)		(*(blkaddr_t *)((buf) + BLK_OFFSET	       \
-				+ (i) * ENTRY_SIZE(ix)			       \
-				+ (assert(i < CNT(buf)),0) ))
+#define PTR(ix, buf, i)		(*(blkaddr_t *)((buf) + SLOT(ix, buf, i)))
+
+/* the end of the i-th entry of a node */
+#define ENTRY_END(ix, buf, i)	(((i) + 1 < CNT(buf))			       \
+				? SLOT(ix, buf, (i) + 1) : END(ix, buf))
 
-/* a pointer to the i-th key of a node */
-#define KEY(ix, buf, i)		((char *)((buf) + BLK_OFFSET		       \
-				+ (i) * ENTRY_SIZE(ix) + sizeof(blkaddr_t)     \
-				+ (assert(i < CNT(buf)),0) ))
+/* the suffix of the i-th key of a node, i.e. the key without the node's 
+ * prefix and its trailing zeros, and the suffix's length */
+#define SUFFIX(ix, buf, i)	((buf) + SLOT(ix, buf, i) + sizeof(blkaddr_t))
+#define SUFFIX_LEN(ix, buf, i)	(ENTRY_END(ix, buf, i) - SLOT(ix, buf, i)      \
+				- sizeof(blkaddr_t))
+
+/* in indexes with posting lists, a key is a value followed by the tuple 
+ * address big-endian */
+#define VAL_SIZE(ix)		((ix)->ix_size - sizeof(blkaddr_t))
+
+/* whether the nodes of a type store posting lists; their entries are groups 
+ * (see post_encode()) */
+#define POSTINGS(ix, type)	((ix)->ix_postings && (type) == LEAF)
 
 /* copies the key 'src' to 'dest' */
 #define KEYCPY(ix, dest, src)	memcpy(dest, src, (ix)->ix_size)
@@ -81,34 +126,491 @@
 /* calls key comparison function */
 #define CMPF(ix, v1, v2)	((ix)->ix_cmpf((v1), (v2), (ix)->ix_size))
 
-/* converts a block address (blkaddr_t) to a file position (off_t) */
-#define ADDR_TO_POS(ix, addr)	(((off_t)(addr) * (ix)->ix_blksize + BLK_SIZE))
+/* the size of the used part of a node, i.e. of its entries and slots */
+#define NODE_SIZE(ix, buf)	(END(ix, buf) + CNT(buf) * OFF_SIZE(ix))
+
+/* a node that is less than half full is merged with a neighbor if possible */
+#define UNDERFULL(ix, buf)	(NODE_SIZE(ix, buf) < (ix)->ix_blksize / 2)
+
+/* a leaf is split where the separator is shortest among the splits whose 
+ * larger node is at most this much larger than with the most balanced one */
+#define SPLIT_SLACK(ix)		((ix)->ix_blksize / 16)
+
+/* the i-th key of a sequence of entries */
+#define EN_KEY(ix, e, i)	((e)->en_keys + (i) * (ix)->ix_size)
 
-/* moves the file cursor to a the (absolute) position (off_t) */
-#define GOTO_POS(ix, pos)	lseek((ix)->ix_fd, pos, SEEK_SET)
+/* the sum of the key lengths of the entries a, ..., b-1 or of their sizes 
+ * in posting lists (see en_sum()) */
+#define EN_SUM(e, a, b)		((e)->en_sums[b] - (e)->en_sums[a])
 
-/* moves the file cursor to the address (blkaddr_t) */
-#define GOTO_ADDR(ix, addr)	GOTO_POS((ix), ADDR_TO_POS((ix),(addr)))
+/* converts a block address (blkaddr_t) to a file position (off_t) */
+#define ADDR_TO_POS(ix, addr)	((off_t)(addr) * (off_t)(ix)->ix_blksize\
+				+ (off_t)(ix)->ix_hdsize)
+
+/* calculates the size of a 'size'-bytes large block aligned to 'align' */
+#define ALIGN_SIZE(size, align)	((size) + ((- (size)) % (align)))
 
 /* fills a buffer from a given offset to another given position with zeros */
 #define FILL_BUF(buf, from, to)	memset((buf)+from, 0, (to)-(from))
 
-/* reads a given amount of bytes from a file into a pointer */
-#define READ(fd, ptr, size)	((bool)(read(fd,ptr,size) == (ssize_t)(size)))
+/* reads a given amount of bytes from a file position into a pointer */
+#define PREAD(fd, ptr, size, pos) ((bool)(pread(fd,ptr,size,pos)	       \
+				== (ssize_t)(size)))
+
+/* writes a given amount of bytes from a pointer to a file position */
+#define PWRITE(fd, ptr, size, pos) ((bool)(pwrite(fd,ptr,size,pos)	       \
+				== (ssize_t)(size)))
 
-/* writes a given amount of bytes from a pointer to a file */
-#define WRITE(fd, ptr, size)	((bool)(write(fd,ptr,size) == (ssize_t)(size)))
+/* starts the header of index files with 64-bit addresses, normalized keys
+ * (see attr.h), compressed nodes and posting lists; the header of files 
+ * without posting lists starts with "\0DBIDX3", of files with uncompressed
+ * nodes with "\0DBIDX2", of files with native keys with "\0DBINDX", the 
+ * header of older files with the key size */
+#define IX_MAGIC		"\0DBIDX4"
+#define IX_MAGIC_SIZE		8
 
 struct ix_header {
+	char		ix_magic[IX_MAGIC_SIZE]; /* IX_MAGIC */
 	size_t		ix_size;	/* a key's size */
 	blkaddr_t	ix_root;	/* root address */
 	blkaddr_t	ix_max;		/* last addressed block */
 	blkaddr_t	ix_avail;	/* last deleted block */
 	bool		ix_closed;	/* do we need to rebuild_header()? */
+	size_t		ix_hdsize;	/* size of the header block */
+	size_t		ix_blksize;	/* size of a node */
+	bool		ix_postings;	/* do leaves store posting lists? */
 };
 
+/* a sequence of entries with expanded keys, from which nodes are built */
+struct ix_entries {
+	size_t		en_cnt;		/* count of entries */
+	size_t		en_max;		/* capacity */
+	blkaddr_t	*en_ptrs;	/* the entries' pointers */
+	char		*en_keys;	/* the entries' keys */
+	size_t		*en_lens;	/* key lengths without trailing zeros */
+	size_t		*en_sums;	/* sums of the key lengths or sizes */
+	size_t		*en_vlens;	/* value lengths for posting lists */
+	size_t		*en_gpos;	/* positions in the posting lists */
+	size_t		*en_groups;	/* sums of the posting lists' begins */
+	size_t		en_valid;	/* count of entries whose sums are valid */
+	char		en_type;	/* type of node of the sums */
+};
+
+/* the header's root, last and deleted block addresses, which are logged 
+ * together */
+#define HD_ADDRS_OFFSET		offsetof(struct ix_header, ix_root)
+
+/* the header's addresses are logged and thus remain valid after a crash,
+ * unless the mapped nodes are written before the log (see wal.h) */
+#ifdef USE_MMAP
+#define HD_LOGGED		false
+#else
+#define HD_LOGGED		true
+#endif
+
+static inline size_t get_off(const struct index *ix, const char *p)
+{
+	if (OFF_SIZE(ix) == 2) {
+		uint16_t off;
+
+		memcpy(&off, p, sizeof(off));
+		return off;
+	} else {
+		uint32_t off;
+
+		memcpy(&off, p, sizeof(off));
+		return off;
+	}
+}
+
+static inline void set_off(const struct index *ix, char *p, size_t off)
+{
+	if (OFF_SIZE(ix) == 2) {
+		uint16_t v = (uint16_t)off;
+
+		memcpy(p, &v, sizeof(v));
+	} else {
+		uint32_t v = (uint32_t)off;
+
+		memcpy(p, &v, sizeof(v));
+	}
+}
+
+/* returns the length of a key without its trailing zeros */
+static inline size_t key_len(const struct index *ix, const char *key)
+{
+	size_t n = ix->ix_size;
+
+	while (n > 0 && key[n-1] == '\0')
+		n--;
+	return n;
+}
+
+/* returns the length of the common prefix of two keys */
+static inline size_t prefix_len(const struct index *ix, const char *k1,
+		const char *k2)
+{
+	size_t n = 0;
+
+	while (n < ix->ix_size && k1[n] == k2[n])
+		n++;
+	return n;
+}
+
+/* returns the length of a key's value without its trailing zeros */
+static inline size_t val_len(const struct index *ix, const char *key)
+{
+	size_t n = VAL_SIZE(ix);
+
+	while (n > 0 && key[n-1] == '\0')
+		n--;
+	return n;
+}
+
+/* returns the tuple address at the end of a key with posting lists */
+static inline uint64_t get_addr(const struct index *ix, const char *key)
+{
+	const unsigned char *p = (const unsigned char *)key + VAL_SIZE(ix);
+	uint64_t addr = 0;
+	size_t i;
+
+	for (i = 0; i < sizeof(blkaddr_t); i++)
+		addr = (addr << 8) | p[i];
+	return addr;
+}
+
+static inline void set_addr(const struct index *ix, char *key, uint64_t addr)
+{
+	size_t i = sizeof(blkaddr_t);
+
+	while (i-- > 0) {
+		key[VAL_SIZE(ix) + i] = (char)(addr & 0xff);
+		addr >>= 8;
+	}
+}
+
+/* variable-length integers store seven bits per byte, the least significant
+ * ones first; the highest bit of a byte tells whether another one follows */
+static inline size_t varint_len(uint64_t v)
+{
+	size_t n = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+static inline size_t put_varint(char *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (char)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (char)v;
+	return n;
+}
+
+static inline size_t get_varint(const char *p, uint64_t *v)
+{
+	size_t n = 0;
+	int shift = 0;
+
+	*v = 0;
+	do {
+		*v |= (uint64_t)(p[n] & 0x7f) << shift;
+		shift += 7;
+	} while (p[n++] & 0x80);
+	return n;
+}
+
+/* expands the i-th key of a node into `key' and returns `key' */
+static inline char *get_key(const struct index *ix, const char *buf, short i,
+		char *key)
+{
+	const size_t plen = PLEN(ix, buf);
+	const size_t slen = SUFFIX_LEN(ix, buf, i);
+
+	memcpy(key, PREFIX(ix, buf), plen);
+	memcpy(key + plen, SUFFIX(ix, buf, i), slen);
+	memset(key + plen + slen, 0, ix->ix_size - plen - slen);
+	return key;
+}
+
+/* initializes an empty node whose keys share the first `plen' bytes of 
+ * `prefix'; its neighbors are kept */
+static void init_node(struct index *ix, char *buf, char type,
+		const char *prefix, size_t plen)
+{
+	TYPE(buf) = type;
+	CNT(buf) = 0;
+	set_off(ix, buf + PLEN_OFFSET(ix), plen);
+	memcpy(PREFIX(ix, buf), prefix, plen);
+	set_off(ix, buf + END_OFFSET, PREFIX_OFFSET(ix) + plen);
+}
+
+/* writes the group of the value of `key' and its `n' ascending addresses 
+ * `addrs' for a leaf with posting lists whose prefix has `plen' bytes into
+ * `entry' and returns its length: the length of the value's suffix, which 
+ * is the value without the prefix and its trailing zeros, the suffix, the 
+ * count of addresses and the addresses, each as the difference to its 
+ * predecessor; all but the suffix are variable-length integers */
+static size_t post_encode(const struct index *ix, size_t plen,
+		const char *key, const blkaddr_t *addrs, size_t n, char *entry)
+{
+	size_t slen, len, i;
+
+	slen = val_len(ix, key);
+	slen = (slen > plen) ? slen - plen : 0;
+	len = put_varint(entry, slen);
+	memcpy(entry + len, key + plen, slen);
+	len += slen;
+	len += put_varint(entry + len, n);
+	for (i = 0; i < n; i++)
+		len += put_varint(entry + len, (uint64_t)addrs[i]
+				- ((i > 0) ? (uint64_t)addrs[i-1] : 0));
+	return len;
+}
+
+/* expands the value of the g-th group of a leaf with posting lists into 
+ * `key' and returns the position of its count of addresses */
+static const char *post_value(const struct index *ix, const char *buf,
+		short g, char *key)
+{
+	const size_t plen = PLEN(ix, buf);
+	const char *p = buf + SLOT(ix, buf, g);
+	uint64_t slen;
+
+	p += get_varint(p, &slen);
+	memcpy(key, PREFIX(ix, buf), plen);
+	memcpy(key + plen, p, slen);
+	memset(key + plen + slen, 0, VAL_SIZE(ix) - plen - slen);
+	return p + slen;
+}
+
+/* expands the first key of the g-th group of a leaf with posting lists into
+ * `key' and returns its address */
+static blkaddr_t post_first(const struct index *ix, const char *buf, short g,
+		char *key)
+{
+	const char *p;
+	uint64_t n, addr;
+
+	p = post_value(ix, buf, g, key);
+	p += get_varint(p, &n);
+	get_varint(p, &addr);
+	set_addr(ix, key, addr);
+	return (blkaddr_t)addr;
+}
+
+static struct ix_entries *en_init(void)
+{
+	struct ix_entries *e;
+
+	e = xmalloc(sizeof(struct ix_entries));
+	e->en_cnt = 0;
+	e->en_max = 0;
+	e->en_ptrs = NULL;
+	e->en_keys = NULL;
+	e->en_lens = NULL;
+	e->en_sums = NULL;
+	e->en_vlens = NULL;
+	e->en_gpos = NULL;
+	e->en_groups = NULL;
+	e->en_valid = 0;
+	e->en_type = AVAIL;
+	return e;
+}
+
+static void en_free(struct ix_entries *e)
+{
+	if (e->en_max > 0) {
+		free(e->en_ptrs);
+		free(e->en_keys);
+		free(e->en_lens);
+		free(e->en_sums);
+		free(e->en_vlens);
+		free(e->en_gpos);
+		free(e->en_groups);
+	}
+	free(e);
+}
+
+/* makes room for `cnt' entries */
+static void en_reserve(const struct index *ix, struct ix_entries *e,
+		size_t cnt)
+{
+	if (cnt <= e->en_max)
+		return;
+	e->en_max = (2 * e->en_max > cnt) ? 2 * e->en_max : cnt + 64;
+	e->en_ptrs = xrealloc(e->en_ptrs, e->en_max * sizeof(blkaddr_t));
+	e->en_keys = xrealloc(e->en_keys, e->en_max * ix->ix_size);
+	e->en_lens = xrealloc(e->en_lens, e->en_max * sizeof(size_t));
+	e->en_sums = xrealloc(e->en_sums, (e->en_max + 1) * sizeof(size_t));
+	e->en_vlens = xrealloc(e->en_vlens, e->en_max * sizeof(size_t));
+	e->en_gpos = xrealloc(e->en_gpos, e->en_max * sizeof(size_t));
+	e->en_groups = xrealloc(e->en_groups,
+			(e->en_max + 1) * sizeof(size_t));
+}
+
+/* inserts an entry as i-th entry */
+static void en_insert(const struct index *ix, struct ix_entries *e, size_t i,
+		blkaddr_t ptr, const char *key)
+{
+	assert(i <= e->en_cnt);
+
+	en_reserve(ix, e, e->en_cnt + 1);
+	memmove(e->en_ptrs + i + 1, e->en_ptrs + i,
+			(e->en_cnt - i) * sizeof(blkaddr_t));
+	memmove(EN_KEY(ix, e, i + 1), EN_KEY(ix, e, i),
+			(e->en_cnt - i) * ix->ix_size);
+	memmove(e->en_lens + i + 1, e->en_lens + i,
+			(e->en_cnt - i) * sizeof(size_t));
+	e->en_ptrs[i] = ptr;
+	KEYCPY(ix, EN_KEY(ix, e, i), key);
+	e->en_lens[i] = key_len(ix, key);
+	e->en_cnt++;
+	if (e->en_valid > i)
+		e->en_valid = i;
+}
+
+/* replaces the key of the i-th entry */
+static void en_set_key(const struct index *ix, struct ix_entries *e, size_t i,
+		const char *key)
+{
+	assert(i < e->en_cnt);
+
+	KEYCPY(ix, EN_KEY(ix, e, i), key);
+	e->en_lens[i] = key_len(ix, key);
+	if (e->en_valid > i)
+		e->en_valid = i;
+}
+
+/* appends the entries of a node */
+static void en_unpack(const struct index *ix, struct ix_entries *e,
+		const char *buf)
+{
+	const size_t plen = PLEN(ix, buf);
+	char val[ix->ix_size], *key;
+	const char *p;
+	uint64_t n, d, addr;
+	size_t slen;
+	short i;
+
+	if (e->en_valid > e->en_cnt)
+		e->en_valid = e->en_cnt;
+
+	if (POSTINGS(ix, TYPE(buf))) {
+		for (i = 0; i < CNT(buf); i++) {
+			p = post_value(ix, buf, i, val);
+			p += get_varint(p, &n);
+			en_reserve(ix, e, e->en_cnt + n);
+			for (addr = 0; n > 0; n--, e->en_cnt++) {
+				p += get_varint(p, &d);
+				addr += d;
+				key = EN_KEY(ix, e, e->en_cnt);
+				memcpy(key, val, VAL_SIZE(ix));
+				set_addr(ix, key, addr);
+				e->en_ptrs[e->en_cnt] = (blkaddr_t)addr;
+				e->en_lens[e->en_cnt] = key_len(ix, key);
+			}
+		}
+		return;
+	}
+
+	en_reserve(ix, e, e->en_cnt + CNT(buf));
+	for (i = 0; i < CNT(buf); i++) {
+		e->en_ptrs[e->en_cnt] = PTR(ix, buf, i);
+		get_key(ix, buf, i, EN_KEY(ix, e, e->en_cnt));
+		/* only the suffix ends with a non-zero byte */
+		slen = SUFFIX_LEN(ix, buf, i);
+		e->en_lens[e->en_cnt] = (slen > 0) ? plen + slen
+			: key_len(ix, EN_KEY(ix, e, e->en_cnt));
+		e->en_cnt++;
+	}
+}
+
+/* computes the sums for EN_SUM() of the entries for a node of the given type,
+ * as far as they are not valid yet: the sums of the key lengths or, for 
+ * posting lists, of the bytes each entry adds to them without the prefix: 
+ * the group, if the entry begins one, otherwise its address and the growth 
+ * of the group's count; en_groups sums up the begins of groups */
+static void en_sum(const struct index *ix, struct ix_entries *e, char type)
+{
+	const char *key;
+	size_t i, gpos;
+
+	if (e->en_max == 0)
+		return;
+	if (e->en_type != type) {
+		e->en_type = type;
+		e->en_valid = 0;
+	} else if (e->en_valid > e->en_cnt)
+		e->en_valid = e->en_cnt;
+	e->en_sums[0] = 0;
+	e->en_groups[0] = 0;
+	for (i = e->en_valid; i < e->en_cnt; i++) {
+		if (!POSTINGS(ix, type)) {
+			e->en_sums[i+1] = e->en_sums[i] + e->en_lens[i];
+			continue;
+		}
+		key = EN_KEY(ix, e, i);
+		e->en_vlens[i] = val_len(ix, key);
+		if (i > 0 && memcmp(key, EN_KEY(ix, e, i-1), VAL_SIZE(ix)) == 0) {
+			gpos = e->en_gpos[i-1] + 1;
+			e->en_sums[i+1] = e->en_sums[i]
+				+ varint_len((uint64_t)e->en_ptrs[i]
+						- (uint64_t)e->en_ptrs[i-1])
+				+ varint_len(gpos + 1) - varint_len(gpos);
+			e->en_groups[i+1] = e->en_groups[i];
+		} else {
+			gpos = 0;
+			e->en_sums[i+1] = e->en_sums[i] + OFF_SIZE(ix)
+				+ varint_len(e->en_vlens[i]) + e->en_vlens[i]
+				+ varint_len(1)
+				+ varint_len((uint64_t)e->en_ptrs[i]);
+			e->en_groups[i+1] = e->en_groups[i] + 1;
+		}
+		e->en_gpos[i] = gpos;
+	}
+	e->en_valid = e->en_cnt;
+}
+
+/* like search_node() for a sequence of entries */
+static size_t en_search(const struct index *ix, const struct ix_entries *e,
+		const char *key, int *cmpval)
+{
+	size_t lo, hi, mid;
+	int c;
+
+	lo = 0;
+	hi = e->en_cnt;
+	if (hi > 0)
+		*cmpval = 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		c = CMPF(ix, key, EN_KEY(ix, e, mid));
+		if (c > 0)
+			lo = mid + 1;
+		else {
+			hi = mid;
+			*cmpval = c;
+		}
+	}
+	return lo;
+}
+
 static inline bool ix_read(struct index *ix, blkaddr_t addr, char *buf)
 {
+#ifdef USE_MMAP
+	if ((off_t)(ADDR_TO_POS(ix, addr) + ix->ix_blksize) > ix->ix_filesize)
+		return false;
+	memcpy(buf, ix->ix_map + ADDR_TO_POS(ix, addr), ix->ix_blksize);
+	return true;
+#else
 	bool retval;
 
 #ifndef NO_CACHE
@@ -116,31 +618,171 @@ static inline bool ix_read(struct index *ix, blkaddr_t addr, char *buf)
 		return true;
 #endif
 
-	GOTO_ADDR(ix, addr);
-	retval = READ(ix->ix_fd, buf, ix->ix_blksize);
+	if (ix->ix_direct && !IO_ALIGNED(buf)) {
+		/* direct I/O needs an aligned buffer */
+		retval = PREAD(ix->ix_fd, ix->ix_iobuf, ix->ix_blksize,
+				ADDR_TO_POS(ix, addr));
+		memcpy(buf, ix->ix_iobuf, ix->ix_blksize);
+	} else
+		retval = PREAD(ix->ix_fd, buf, ix->ix_blksize,
+				ADDR_TO_POS(ix, addr));
 #ifndef NO_CACHE
 	if (retval)
 		cache_push(ix->ix_cache, addr, buf);
 #endif
 	return retval;
+#endif
+}
+
+#ifdef USE_MMAP
+/* maps the file such that at least `size' bytes are mapped; the mapping grows
+ * by at least MAP_EXTENT_SIZE bytes to keep remapping rare */
+static bool ix_map(struct index *ix, off_t size)
+{
+	size_t mapsize;
+	char *map;
+
+	mapsize = (size_t)size + ix->ix_mapsize + MAP_EXTENT_SIZE;
+	map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+			ix->ix_fd, 0);
+	if (map == MAP_FAILED)
+		return false;
+	if (ix->ix_map != NULL)
+		munmap(ix->ix_map, ix->ix_mapsize);
+	ix->ix_map = map;
+	ix->ix_mapsize = mapsize;
+	return true;
 }
 
+/* enlarges the file to `size' bytes and remaps it if necessary */
+static bool ix_extend(struct index *ix, off_t size)
+{
+	if (size <= ix->ix_filesize)
+		return true;
+	if ((size_t)size > ix->ix_mapsize && !ix_map(ix, size))
+		return false;
+	if (ftruncate(ix->ix_fd, size) != 0)
+		return false;
+	ix->ix_filesize = size;
+	return true;
+}
+#endif
+
+/* returns a pointer to the node at addr; with USE_MMAP, this is a pointer 
+ * into the mapping which must not be modified, otherwise the node is read 
+ * into buf */
+static inline const char *ix_node(struct index *ix, blkaddr_t addr, char *buf)
+{
+#ifdef USE_MMAP
+	if ((off_t)(ADDR_TO_POS(ix, addr) + ix->ix_blksize) > ix->ix_filesize)
+		return NULL;
+	return ix->ix_map + ADDR_TO_POS(ix, addr);
+#else
+	return ix_read(ix, addr, buf) ? buf : NULL;
+#endif
+}
+
+/* logs the header's addresses; they are linked with the node's records, 
+ * because they may refer to the node */
+static inline bool hd_log(struct index *ix)
+{
+	blkaddr_t addrs[3];
+
+	addrs[0] = ix->ix_root;
+	addrs[1] = ix->ix_max;
+	addrs[2] = ix->ix_avail;
+	return wal_write(ix->ix_logid, HD_ADDRS_OFFSET, (const char *)addrs,
+			sizeof(addrs), sizeof(addrs));
+}
+
+/* writes a node that has been logged */
+static inline bool ix_store(struct index *ix, blkaddr_t addr, const char *buf)
+{
+#ifdef USE_MMAP
+	if (!ix_extend(ix, ADDR_TO_POS(ix, addr) + ix->ix_blksize))
+		return false;
+	memcpy(ix->ix_map + ADDR_TO_POS(ix, addr), buf, ix->ix_blksize);
+	return true;
+#else
+#ifndef NO_CACHE
+	if (cache_write(ix->ix_cache, addr, 0, buf, ix->ix_blksize))
+		return true;
+#endif
+
+	if (ix->ix_direct && !IO_ALIGNED(buf)) {
+		/* direct I/O needs an aligned buffer */
+		memcpy(ix->ix_iobuf, buf, ix->ix_blksize);
+		buf = ix->ix_iobuf;
+	}
+	return wal_force()
+		&& PWRITE(ix->ix_fd, buf, ix->ix_blksize, ADDR_TO_POS(ix, addr));
+#endif
+}
+
+/* logs and writes a node; the free space between its entries and its slots is
+ * logged as zeros */
 static inline bool ix_write(struct index *ix, blkaddr_t addr, const char *buf)
 {
-	bool retval;
+	const off_t pos = ADDR_TO_POS(ix, addr);
+	size_t len, slots;
+
+	assert(addr != INVALID_ADDR);
+
+	if (TYPE(buf) == AVAIL) {
+		len = BLK_OFFSET;
+		slots = ix->ix_blksize;
+	} else {
+		len = END(ix, buf);
+		slots = SLOT_POS(ix, CNT(buf) - 1);
+	}
+	wal_link((slots < ix->ix_blksize) ? 2 : 1);
+	return wal_write(ix->ix_logid, pos, buf, len, slots)
+		&& (slots == ix->ix_blksize
+				|| wal_write(ix->ix_logid, pos + slots,
+					buf + slots, ix->ix_blksize - slots,
+					ix->ix_blksize - slots))
+		&& hd_log(ix)
+		&& ix_store(ix, addr, buf);
+}
+
+/* like ix_write(), but only the node's header, its entries from the i-th
+ * on and their slots have changed and are logged; inserting ascending keys 
+ * thus logs few bytes per node */
+static inline bool ix_write_from(struct index *ix, blkaddr_t addr,
+		const char *buf, short i)
+{
+	const off_t pos = ADDR_TO_POS(ix, addr);
+	size_t offset, end, slots, slots_end;
 
-	assert(addr == ix->ix_root || TYPE(buf) == AVAIL
-			|| CNT(buf) >= ORDER(ix)/2);
+	assert(TYPE(buf) != AVAIL);
+	assert(i >= 0 && i < CNT(buf));
 	assert(addr != INVALID_ADDR);
 
-	GOTO_ADDR(ix, addr);
-	retval = WRITE(ix->ix_fd, buf, ix->ix_blksize);
+	offset = SLOT(ix, buf, i);
+	end = END(ix, buf);
+	slots = SLOT_POS(ix, CNT(buf) - 1);
+	slots_end = SLOT_POS(ix, i - 1);
+
+	wal_link(3);
+	return wal_write(ix->ix_logid, pos, buf, PREFIX_OFFSET(ix),
+				PREFIX_OFFSET(ix))
+		&& wal_write(ix->ix_logid, pos + offset, buf + offset,
+				end - offset, end - offset)
+		&& wal_write(ix->ix_logid, pos + slots, buf + slots,
+				slots_end - slots, slots_end - slots)
+		&& hd_log(ix)
+		&& ix_store(ix, addr, buf);
+}
+
 #ifndef NO_CACHE
-	if (retval)
-		cache_update(ix->ix_cache, addr, 0, buf, ix->ix_blksize);
-#endif
-	return retval;
+static bool ix_flush(void *ctx, blkaddr_t addr, const char *buf, size_t cnt)
+{
+	struct index *ix = ctx;
+
+	return wal_force() && PWRITE(ix->ix_fd, buf, cnt * ix->ix_blksize,
+			ADDR_TO_POS(ix, addr));
 }
+#endif
 
 static blkaddr_t alloc_blk(struct index *ix)
 {
@@ -165,12 +807,13 @@ static void free_blk(struct index *ix, blkaddr_t addr)
 	assert(addr != INVALID_ADDR);
 	assert(addr <= ix->ix_max);
 
+	/* the header is logged with the node and thus updated before */
 	memset(buf, 0, ix->ix_size);
 	PREV_DEL(buf) = ix->ix_avail;
 	TYPE(buf) = AVAIL;
-	if (!ix_write(ix, addr, buf))
-		return;
 	ix->ix_avail = addr;
+	if (!ix_write(ix, addr, buf))
+		ix->ix_avail = PREV_DEL(buf);
 }
 
 static bool set_lnbr(struct index *ix, blkaddr_t addr, blkaddr_t lnbr_addr)
@@ -191,6 +834,24 @@ static bool set_lnbr(struct index *ix, blkaddr_t addr, blkaddr_t lnbr_addr)
 	return true;
 }
 
+static bool set_rnbr(struct index *ix, blkaddr_t addr, blkaddr_t rnbr_addr)
+{
+	char buf[ix->ix_blksize];
+
+	assert(addr <= ix->ix_max);
+	assert(rnbr_addr <= ix->ix_max);
+
+	if (addr == INVALID_ADDR)
+		return true;
+
+	if (!ix_read(ix, addr, buf))
+		return false;
+	RNBR(buf) = rnbr_addr;
+	if (!ix_write(ix, addr, buf))
+		return false;
+	return true;
+}
+
 static void rebuild_header(struct index *ix, struct ix_header *hd)
 {
 	blkaddr_t addr;
@@ -211,53 +872,145 @@ static void rebuild_header(struct index *ix, struct ix_header *hd)
 	}
 }
 
-static bool init_index(struct index *ix,
+/* switches the index to direct I/O if it is chosen and the header and the
+ * nodes are aligned to the file system's block size */
+static void init_direct_io(struct index *ix)
+{
+#ifdef USE_MMAP
+	ix->ix_direct = false;
+#else
+	size_t align = cache_io_align(ix->ix_fd);
+
+	ix->ix_direct = ix->ix_hdsize % align == 0
+		&& ix->ix_blksize % align == 0
+		&& cache_direct_io(ix->ix_fd);
+#endif
+}
+
+static bool init_index(struct index *ix, const struct ix_header *hd,
 		int (*cmpf)(const char *, const char *, size_t))
 {
-	ix->ix_blksize = BLK_OFFSET + MIN_ORDER * ENTRY_SIZE(ix);
-	ix->ix_blksize = ix->ix_blksize + (-(ix->ix_blksize) % BLK_SIZE);
+	struct stat st;
 
-	ix->ix_order = (ix->ix_blksize - BLK_OFFSET) / ENTRY_SIZE(ix);
-	if (ix->ix_order % 2 == 0)
-		ix->ix_order--; /* order must be uneven */
+	ix->ix_hdsize = hd->ix_hdsize;
+	ix->ix_blksize = hd->ix_blksize;
+	ix->ix_postings = hd->ix_postings;
+
+	assert(ix->ix_blksize / (sizeof(blkaddr_t) + OFF_SIZE(ix)) <= SHRT_MAX);
 
 	ix->ix_cmpf = (cmpf != NULL) ? cmpf
 		: (int (*)(const char *, const char *, size_t))memcmp;
 	
-	ix->ix_buf = xmalloc(ix->ix_blksize);
+	ix->ix_buf = xmemalign(IO_ALIGN, ix->ix_blksize);
 	if (ix->ix_buf == NULL)
 		return false;
 	memset(ix->ix_buf, 0, ix->ix_blksize);
+
+	init_direct_io(ix);
+	ix->ix_iobuf = ix->ix_direct ? xmemalign(IO_ALIGN, ix->ix_blksize)
+		: NULL;
+
+	ix->ix_map = NULL;
+	ix->ix_mapsize = 0;
+	ix->ix_filesize = (fstat(ix->ix_fd, &st) == 0) ? st.st_size : 0;
+#ifdef USE_MMAP
+	if (!ix_map(ix, ix->ix_filesize)) {
+		free(ix->ix_buf);
+		return false;
+	}
+#endif
+	ix->ix_ents = en_init();
+	ix->ix_pieces = en_init();
 	return true;
 }
 
+/* writes the header into the header block of the file; the log is forced
+ * before, because the header may refer to logged nodes */
+static bool write_header(struct index *ix, const struct ix_header *hd)
+{
+	char *buf;
+	bool retval;
+
+	buf = xmemalign(IO_ALIGN, ix->ix_hdsize);
+	memcpy(buf, hd, sizeof(struct ix_header));
+	FILL_BUF(buf, sizeof(struct ix_header), ix->ix_hdsize);
+	retval = wal_force() && PWRITE(ix->ix_fd, buf, ix->ix_hdsize, 0);
+	free(buf);
+	return retval;
+}
+
+/* writes the header of an open index */
+static bool checkpoint(void *ctx)
+{
+	struct index *ix = ctx;
+	struct ix_header hd;
+
+	memcpy(hd.ix_magic, IX_MAGIC, IX_MAGIC_SIZE);
+	hd.ix_size = ix->ix_size;
+	hd.ix_root = ix->ix_root;
+	hd.ix_max = ix->ix_max;
+	hd.ix_avail = ix->ix_avail;
+	hd.ix_closed = HD_LOGGED;
+	hd.ix_hdsize = ix->ix_hdsize;
+	hd.ix_blksize = ix->ix_blksize;
+	hd.ix_postings = ix->ix_postings;
+	return write_header(ix, &hd);
+}
+
+static void free_index(struct index *ix)
+{
+#ifdef USE_MMAP
+	munmap(ix->ix_map, ix->ix_mapsize);
+#endif
+	if (ix->ix_logid != -1)
+		wal_unregister(ix->ix_logid);
+	close(ix->ix_fd);
+	ix->ix_fd = -1;
+#ifndef NO_CACHE
+	cache_free(ix->ix_cache);
+#endif
+	if (ix->ix_iobuf != NULL)
+		free(ix->ix_iobuf);
+	en_free(ix->ix_ents);
+	en_free(ix->ix_pieces);
+	free(ix->ix_buf);
+	free(ix);
+}
+
 struct index *ix_create(const char *ix_name, size_t ix_size,
+		size_t ix_blksize, bool ix_postings,
 		int (*cmpf)(const char *, const char *, size_t))
 {
 	struct index *ix;
 	struct ix_header hd;
-	char buf[BLK_SIZE];
+	size_t align;
 	int fd;
 
 	assert(ix_name != NULL);
 	assert(ix_size > 0);
+	assert(!ix_postings || ix_size > sizeof(blkaddr_t));
 
-	hd.ix_size = ix_size;
-	hd.ix_root = 0;
-	hd.ix_max = 0;
-	hd.ix_avail = INVALID_ADDR;
-	hd.ix_closed = false;
-	memcpy(buf, &hd, sizeof(struct ix_header));
-	FILL_BUF(buf, sizeof(struct ix_header), BLK_SIZE);
+	if (!wal_open())
+		return NULL;
 
 	fd = open(ix_name, CREATE_FLAGS, FILE_MODE);
 	if (fd == -1)
 		return NULL;
 
-	if (!WRITE(fd, buf, BLK_SIZE)) {
-		close(fd);
-		return NULL;
-	}
+	/* align header and nodes to the file system's block size */
+	align = cache_io_align(fd);
+	memcpy(hd.ix_magic, IX_MAGIC, IX_MAGIC_SIZE);
+	hd.ix_size = ix_size;
+	hd.ix_root = 0;
+	hd.ix_max = 0;
+	hd.ix_avail = INVALID_ADDR;
+	hd.ix_closed = HD_LOGGED;
+	hd.ix_hdsize = ALIGN_SIZE(BLK_SIZE, align);
+	hd.ix_blksize = MIN_BLK_SIZE(ix_size);
+	if (ix_blksize > hd.ix_blksize)
+		hd.ix_blksize = ix_blksize;
+	hd.ix_blksize = ALIGN_SIZE(hd.ix_blksize, align);
+	hd.ix_postings = ix_postings;
 
 	ix = xmalloc(sizeof(struct index));
 	if (ix == NULL) {
@@ -267,32 +1020,30 @@ struct index *ix_create(const char *ix_name, size_t ix_size,
 	strntermcpy(ix->ix_name, ix_name, PATH_MAX+1);
 	ix->ix_name[PATH_MAX] = '\0';
 	ix->ix_fd = fd;
+	ix->ix_logid = -1;
 	ix->ix_size = hd.ix_size;
 	ix->ix_root = hd.ix_root;
 	ix->ix_max = hd.ix_max;
 	ix->ix_avail = hd.ix_avail;
 
-	if (!init_index(ix, cmpf)) {
+	if (!init_index(ix, &hd, cmpf)) {
 		close(fd);
 		free(ix);
 		return NULL;
 	}
 
 #ifndef NO_CACHE
-	ix->ix_cache = cache_init(ix->ix_blksize,
-			TOTAL_CACHE_SIZE / ix->ix_blksize);
+	ix->ix_cache = cache_init(ix->ix_blksize, ix, ix_flush);
 #endif
 
-	TYPE(ix->ix_buf) = LEAF;
-	CNT(ix->ix_buf) = 0;
+	init_node(ix, ix->ix_buf, LEAF, "", 0);
 	LNBR(ix->ix_buf) = INVALID_ADDR;
 	RNBR(ix->ix_buf) = INVALID_ADDR;
-	if (!ix_write(ix, 0, ix->ix_buf)) {
-		close(fd);
-#ifndef NO_CACHE
-		cache_free(ix->ix_cache);
-#endif
-		free(ix);
+	if (!write_header(ix, &hd)
+			|| (ix->ix_logid = wal_register(ix_name, fd, checkpoint,
+					ix)) == -1
+			|| !ix_write(ix, 0, ix->ix_buf)) {
+		free_index(ix);
 		return NULL;
 	}
 	return ix;
@@ -307,11 +1058,16 @@ struct index *ix_open(const char *ix_name,
 
 	assert(ix_name != NULL);
 
+	/* the log is redone before the file is read */
+	if (!wal_open())
+		return NULL;
+
 	fd = open(ix_name, OPEN_RW_FLAGS, FILE_MODE);
 	if (fd == -1)
 		return NULL;
 
-	if (!READ(fd, &hd, sizeof(struct ix_header))) {
+	if (!PREAD(fd, &hd, sizeof(struct ix_header), 0)
+			|| memcmp(hd.ix_magic, IX_MAGIC, IX_MAGIC_SIZE) != 0) {
 		close(fd);
 		return NULL;
 	}
@@ -320,172 +1076,775 @@ struct index *ix_open(const char *ix_name,
 	strntermcpy(ix->ix_name, ix_name, PATH_MAX+1);
 	ix->ix_name[PATH_MAX] = '\0';
 	ix->ix_fd = fd;
+	ix->ix_logid = -1;
 	ix->ix_size = hd.ix_size;
 	ix->ix_root = hd.ix_root;
 	ix->ix_max = hd.ix_max;
 	ix->ix_avail = hd.ix_avail;
 
-	if (!init_index(ix, cmpf)) {
+	if (!init_index(ix, &hd, cmpf)) {
 		close(fd);
 		free(ix);
 		return NULL;
 	}
 
-#ifndef NO_CACHE
-	ix->ix_cache = cache_init(ix->ix_blksize,
-			TOTAL_CACHE_SIZE / ix->ix_blksize);
-#endif
+#ifndef NO_CACHE
+	ix->ix_cache = cache_init(ix->ix_blksize, ix, ix_flush);
+#endif
+	ix->ix_logid = wal_register(ix_name, fd, checkpoint, ix);
+
+	/* the addresses are only rebuilt if the index was not closed 
+	 * properly and they were not logged */
+	if (!hd.ix_closed) {
+		rebuild_header(ix, &hd);
+		ix->ix_root = hd.ix_root;
+		ix->ix_max = hd.ix_max;
+		ix->ix_avail = hd.ix_avail;
+	}
+
+	if ((!hd.ix_closed || !HD_LOGGED) && !checkpoint(ix)) {
+		free_index(ix);
+		return NULL;
+	}
+	return ix;
+}
+
+bool ix_outdated(const char *ix_name)
+{
+	char magic[IX_MAGIC_SIZE];
+	bool retval;
+	int fd;
+
+	assert(ix_name != NULL);
+
+	fd = open(ix_name, O_RDONLY);
+	if (fd == -1)
+		return false;
+	retval = PREAD(fd, magic, IX_MAGIC_SIZE, 0)
+		&& memcmp(magic, IX_MAGIC, IX_MAGIC_SIZE) != 0;
+	close(fd);
+	return retval;
+}
+
+bool ix_close(struct index *ix)
+{
+	struct ix_header hd;
+	bool retval;
+
+	memcpy(hd.ix_magic, IX_MAGIC, IX_MAGIC_SIZE);
+	hd.ix_size = ix->ix_size;
+	hd.ix_root = ix->ix_root;
+	hd.ix_max = ix->ix_max;
+	hd.ix_avail = ix->ix_avail;
+#ifndef NO_CACHE
+	hd.ix_closed = cache_flush(ix->ix_cache);
+#else
+	hd.ix_closed = true;
+#endif
+	hd.ix_hdsize = ix->ix_hdsize;
+	hd.ix_blksize = ix->ix_blksize;
+	hd.ix_postings = ix->ix_postings;
+	retval = write_header(ix, &hd) && hd.ix_closed;
+	free_index(ix);
+	return retval;
+}
+
+/* inserts the `len' bytes of `entry' as i-th entry of a node without 
+ * checking whether they fit */
+static void add_raw(struct index *ix, char *buf, short i, const char *entry,
+		size_t len)
+{
+	const size_t os = OFF_SIZE(ix);
+	size_t off, end;
+	short j;
+
+	end = END(ix, buf);
+	off = (i < CNT(buf)) ? SLOT(ix, buf, i) : end;
+
+	memmove(buf + off + len, buf + off, end - off);
+	memcpy(buf + off, entry, len);
+
+	/* the slots of the following entries move down by one */
+	memmove(buf + SLOT_POS(ix, CNT(buf)), buf + SLOT_POS(ix, CNT(buf) - 1),
+			(CNT(buf) - i) * os);
+	CNT(buf)++;
+	set_off(ix, buf + SLOT_POS(ix, i), off);
+	for (j = i + 1; j < CNT(buf); j++)
+		set_off(ix, buf + SLOT_POS(ix, j), SLOT(ix, buf, j) + len);
+	set_off(ix, buf + END_OFFSET, end + len);
+}
+
+/* inserts an entry as i-th entry of a node without checking whether it fits */
+static void add_entry(struct index *ix, char *buf, short i, blkaddr_t ptr,
+		const char *key)
+{
+	const size_t plen = PLEN(ix, buf);
+	char entry[sizeof(blkaddr_t) + ix->ix_size];
+	size_t slen;
+
+	slen = key_len(ix, key);
+	slen = (slen > plen) ? slen - plen : 0;
+	memcpy(entry, &ptr, sizeof(blkaddr_t));
+	memcpy(entry + sizeof(blkaddr_t), key + plen, slen);
+	add_raw(ix, buf, i, entry, sizeof(blkaddr_t) + slen);
+}
+
+/* returns whether a key has the node's prefix and an entry of it fits into
+ * the node, if `old' bytes of it are freed before */
+static bool fits(struct index *ix, const char *buf, const char *key,
+		size_t old)
+{
+	const size_t plen = PLEN(ix, buf);
+	size_t len;
+
+	if (memcmp(key, PREFIX(ix, buf), plen) != 0)
+		return false;
+	len = key_len(ix, key);
+	len = sizeof(blkaddr_t) + ((len > plen) ? len - plen : 0);
+	return NODE_SIZE(ix, buf) - old + len + OFF_SIZE(ix)
+		<= ix->ix_blksize;
+}
+
+/* inserts an entry as i-th entry of a node and returns true if it fits */
+static bool put_entry(struct index *ix, char *buf, short i, blkaddr_t ptr,
+		const char *key)
+{
+	if (!fits(ix, buf, key, 0))
+		return false;
+	add_entry(ix, buf, i, ptr, key);
+	return true;
+}
+
+/* removes the i-th entry of a node */
+static void del_entry(struct index *ix, char *buf, short i)
+{
+	const size_t os = OFF_SIZE(ix);
+	size_t len, off, end;
+	short j;
+
+	off = SLOT(ix, buf, i);
+	len = ENTRY_END(ix, buf, i) - off;
+	end = END(ix, buf);
+
+	memmove(buf + off, buf + off + len, end - off - len);
+
+	/* the slots of the following entries move up by one */
+	memmove(buf + SLOT_POS(ix, CNT(buf) - 2),
+			buf + SLOT_POS(ix, CNT(buf) - 1),
+			(CNT(buf) - 1 - i) * os);
+	CNT(buf)--;
+	for (j = i; j < CNT(buf); j++)
+		set_off(ix, buf + SLOT_POS(ix, j), SLOT(ix, buf, j) - len);
+	set_off(ix, buf + END_OFFSET, end - len);
+}
+
+/* replaces the key of the i-th entry of a node and returns true if the new 
+ * key fits */
+static bool set_key(struct index *ix, char *buf, short i, const char *key)
+{
+	const size_t old = ENTRY_END(ix, buf, i) - SLOT(ix, buf, i)
+		+ OFF_SIZE(ix);
+	blkaddr_t ptr;
+
+	if (!fits(ix, buf, key, old))
+		return false;
+	ptr = PTR(ix, buf, i);
+	del_entry(ix, buf, i);
+	add_entry(ix, buf, i, ptr, key);
+	return true;
+}
+
+/* returns the index of the first group of a leaf with posting lists whose 
+ * value is greater than or equal to the value of `key', or CNT(buf) if there
+ * is none; the groups are searched binary */
+static short post_group(const struct index *ix, const char *buf,
+		const char *key)
+{
+	char tmp[ix->ix_size];
+	short lo, hi, mid;
+
+	lo = 0;
+	hi = CNT(buf);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		post_value(ix, buf, mid, tmp);
+		if (memcmp(key, tmp, VAL_SIZE(ix)) > 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* the position of an entry in a leaf with posting lists */
+struct post_pos {
+	short		g;		/* index of its group */
+	blkaddr_t	addr;		/* its address */
+};
+
+/* like search_node() for leaves with posting lists: returns the position of
+ * the first entry that is greater than or equal to `key', whose group is 
+ * CNT(buf) if there is none; the addresses of the group with the value of 
+ * `key' are searched linearly */
+static struct post_pos post_search(struct index *ix, const char *buf,
+		const char *key, int *cmpval)
+{
+	const uint64_t key_addr = get_addr(ix, key);
+	char tmp[ix->ix_size];
+	struct post_pos pos;
+	const char *p;
+	uint64_t n, d, addr;
+
+	if (CNT(buf) > 0)
+		*cmpval = 1;
+	pos.g = post_group(ix, buf, key);
+	pos.addr = INVALID_ADDR;
+	if (pos.g == CNT(buf))
+		return pos;
+	pos.addr = post_first(ix, buf, pos.g, tmp);
+	if ((*cmpval = CMPF(ix, key, tmp)) <= 0)
+		return pos;
+
+	/* the group has the value of `key', but a smaller first address */
+	p = post_value(ix, buf, pos.g, tmp);
+	p += get_varint(p, &n);
+	p += get_varint(p, &addr);
+	while (--n > 0) {
+		p += get_varint(p, &d);
+		addr += d;
+		if (addr >= key_addr) {
+			set_addr(ix, tmp, addr);
+			pos.addr = (blkaddr_t)addr;
+			*cmpval = CMPF(ix, key, tmp);
+			return pos;
+		}
+	}
+	if (++pos.g == CNT(buf)) {
+		pos.addr = INVALID_ADDR;
+		*cmpval = 1;
+	} else {
+		pos.addr = post_first(ix, buf, pos.g, tmp);
+		*cmpval = CMPF(ix, key, tmp);
+	}
+	return pos;
+}
+
+/* writes the group `src' with `addr' inserted into its posting list or 
+ * removed from it into `dst' and returns its length */
+static size_t post_edit(const char *src, char *dst, uint64_t addr,
+		bool insert)
+{
+	const char *p = src;
+	char *q = dst;
+	uint64_t slen, n, d, a = 0, prev = 0;
+
+	p += get_varint(p, &slen);
+	p += slen;
+	memcpy(q, src, (size_t)(p - src));
+	q += p - src;
+	p += get_varint(p, &n);
+	q += put_varint(q, insert ? n + 1 : n - 1);
+	while (n-- > 0) {
+		p += get_varint(p, &d);
+		a += d;
+		if (insert && addr < a) {
+			q += put_varint(q, addr - prev);
+			prev = addr;
+			insert = false;
+		}
+		if (a != addr) {
+			q += put_varint(q, a - prev);
+			prev = a;
+		}
+	}
+	if (insert)
+		q += put_varint(q, addr - prev);
+	return (size_t)(q - dst);
+}
+
+/* inserts a key whose address is not in a leaf with posting lists into the
+ * group of its value or as a new group and returns the group's index, or -1
+ * if it does not fit or has not the leaf's prefix */
+static short post_put(struct index *ix, char *buf, blkaddr_t tuple_addr,
+		const char *key)
+{
+	char tmp[ix->ix_size], entry[ix->ix_blksize];
+	size_t len, old;
+	short g;
+
+	g = post_group(ix, buf, key);
+	if (g < CNT(buf))
+		post_value(ix, buf, g, tmp);
+	if (g < CNT(buf) && memcmp(key, tmp, VAL_SIZE(ix)) == 0) {
+		old = ENTRY_END(ix, buf, g) - SLOT(ix, buf, g);
+		len = post_edit(buf + SLOT(ix, buf, g), entry,
+				(uint64_t)tuple_addr, true);
+		if (NODE_SIZE(ix, buf) - old + len > ix->ix_blksize)
+			return -1;
+		del_entry(ix, buf, g);
+	} else {
+		if (memcmp(key, PREFIX(ix, buf), PLEN(ix, buf)) != 0)
+			return -1;
+		len = post_encode(ix, PLEN(ix, buf), key, &tuple_addr, 1,
+				entry);
+		if (NODE_SIZE(ix, buf) + len + OFF_SIZE(ix) > ix->ix_blksize)
+			return -1;
+	}
+	add_raw(ix, buf, g, entry, len);
+	return g;
+}
+
+/* removes an address from the g-th group of a leaf with posting lists, and 
+ * the group if it was its only one; the group shrinks in any case */
+static void post_del(struct index *ix, char *buf, short g, blkaddr_t addr)
+{
+	char entry[ix->ix_blksize];
+	const char *p;
+	uint64_t slen, n;
+	size_t len;
+
+	p = buf + SLOT(ix, buf, g);
+	p += get_varint(p, &slen);
+	get_varint(p + slen, &n);
+	len = post_edit(buf + SLOT(ix, buf, g), entry, (uint64_t)addr, false);
+	del_entry(ix, buf, g);
+	if (n > 1)
+		add_raw(ix, buf, g, entry, len);
+}
+
+/* returns the size of a node of the given type of the entries a, ..., b-1 
+ * and sets `*plen' (unless it is NULL) to the length of their prefix: the 
+ * common prefix of the first and the last key, but not longer than the last
+ * key, so that only the first key may be shorter. With posting lists, the
+ * prefix is one of the values and the size is an upper bound, because the 
+ * count of addresses of a group that is cut is estimated */
+static size_t range_size(const struct index *ix, struct ix_entries *e,
+		char type, size_t a, size_t b, size_t *plen)
+{
+	size_t p, size, groups;
+
+	assert(a < b);
+
+	en_sum(ix, e, type);
+	p = prefix_len(ix, EN_KEY(ix, e, a), EN_KEY(ix, e, b-1));
+	if (!POSTINGS(ix, type)) {
+		if (p > e->en_lens[b-1])
+			p = e->en_lens[b-1];
+		size = PREFIX_OFFSET(ix) + p + EN_SUM(e, a, b) - (b - a) * p
+			+ (b - a) * (sizeof(blkaddr_t) + OFF_SIZE(ix));
+		if (e->en_lens[a] < p)
+			size += p - e->en_lens[a];
+	} else {
+		if (p > e->en_vlens[b-1])
+			p = e->en_vlens[b-1];
+		/* the first entry begins a group in any case */
+		groups = 1 + e->en_groups[b] - e->en_groups[a+1];
+		size = PREFIX_OFFSET(ix) + p + OFF_SIZE(ix)
+			+ varint_len(e->en_vlens[a]) + e->en_vlens[a]
+			+ varint_len(e->en_gpos[a] + 1)
+			+ varint_len((uint64_t)e->en_ptrs[a])
+			+ EN_SUM(e, a + 1, b) - groups * p;
+		if (e->en_vlens[a] < p)
+			size += p - e->en_vlens[a];
+	}
+	if (plen != NULL)
+		*plen = p;
+	return size;
+}
+
+/* writes the entries a, ..., b-1 with a prefix of `plen' bytes into a node;
+ * its neighbors are kept */
+static void pack(struct index *ix, char *buf, char type,
+		const struct ix_entries *e, size_t a, size_t b, size_t plen)
+{
+	char entry[ix->ix_blksize];
+	size_t i, j;
+
+	assert(a < b);
+
+	init_node(ix, buf, type, EN_KEY(ix, e, b-1), plen);
+	if (POSTINGS(ix, type)) {
+		for (i = a; i < b; i = j) {
+			for (j = i + 1; j < b && memcmp(EN_KEY(ix, e, i),
+						EN_KEY(ix, e, j),
+						VAL_SIZE(ix)) == 0; j++)
+				;
+			add_raw(ix, buf, CNT(buf), entry, post_encode(ix,
+						plen, EN_KEY(ix, e, i),
+						e->en_ptrs + i, j - i,
+						entry));
+		}
+	} else {
+		for (i = a; i < b; i++)
+			add_entry(ix, buf, CNT(buf), e->en_ptrs[i],
+					EN_KEY(ix, e, i));
+	}
+	assert(NODE_SIZE(ix, buf) <= ix->ix_blksize);
+	FILL_BUF(buf, END(ix, buf), SLOT_POS(ix, CNT(buf) - 1));
+}
+
+/* writes the shortest key `sep' with l <= sep < r of the greatest key l of a
+ * leaf and the least key r of its right neighbor, padded with zeros, and 
+ * returns its length; `sep' may be NULL */
+static size_t separator(const struct index *ix, const char *l, size_t llen,
+		const char *r, size_t rlen, char *sep)
+{
+	const size_t j = prefix_len(ix, l, r);
+
+	assert(j < rlen);
+
+	if (j + 1 < rlen) {
+		if (sep != NULL) {
+			memcpy(sep, r, j + 1);
+			memset(sep + j + 1, 0, ix->ix_size - j - 1);
+		}
+		return j + 1;
+	} else {
+		if (sep != NULL)
+			KEYCPY(ix, sep, l);
+		return llen;
+	}
+}
+
+/* writes the upper bound of a node's keys, which is stored in its parent, 
+ * into `sep': for inner nodes its greatest key `l', for leaves the separator
+ * of `l' and the least key `r' of the right neighbor */
+static void upper_bound(const struct index *ix, char type,
+		const char *l, size_t llen, const char *r, size_t rlen,
+		char *sep)
+{
+	if (type == LEAF)
+		separator(ix, l, llen, r, rlen, sep);
+	else
+		KEYCPY(ix, sep, l);
+}
+
+/* returns the size of the larger node if the entries a, ..., b-1 are split
+ * into a, ..., t-1 and t, ..., b-1 */
+static size_t split_size(const struct index *ix, struct ix_entries *e,
+		char type, size_t a, size_t t, size_t b)
+{
+	size_t l, r;
+
+	l = range_size(ix, e, type, a, t, NULL);
+	r = range_size(ix, e, type, t, b, NULL);
+	return (l > r) ? l : r;
+}
 
-	if (!hd.ix_closed) {
-		rebuild_header(ix, &hd);
-		ix->ix_root = hd.ix_root;
-		ix->ix_max = hd.ix_max;
-		ix->ix_avail = hd.ix_avail;
-	}
+/* returns where the entries a, ..., b-1 are split into two nodes that both 
+ * fit: the larger one is as small as possible, but leaves are split where the
+ * separator is shortest among the splits that are at most SPLIT_SLACK worse;
+ * returns 0 if there is no such split */
+static size_t split_point(const struct index *ix, struct ix_entries *e,
+		size_t a, size_t b, char type)
+{
+	size_t t, best = 0, bestsize = 0, bestlen, size, len;
 
-	hd.ix_closed = false;
-	GOTO_POS(ix, 0);
-	if (!WRITE(ix->ix_fd, &hd, sizeof(struct ix_header))) {
-		close(fd);
-#ifndef NO_CACHE
-		cache_free(ix->ix_cache);
-#endif
-		free(ix);
-		return NULL;
+	for (t = a + 1; t < b; t++) {
+		size = split_size(ix, e, type, a, t, b);
+		if (size <= ix->ix_blksize && (best == 0 || size < bestsize)) {
+			best = t;
+			bestsize = size;
+		}
 	}
-	return ix;
+	if (best == 0 || type != LEAF)
+		return best;
+
+	bestlen = separator(ix, EN_KEY(ix, e, best-1), e->en_lens[best-1],
+			EN_KEY(ix, e, best), e->en_lens[best], NULL);
+	bestsize += SPLIT_SLACK(ix);
+	if (bestsize > ix->ix_blksize)
+		bestsize = ix->ix_blksize;
+	for (t = a + 1; t < b; t++) {
+		size = split_size(ix, e, type, a, t, b);
+		if (size > bestsize)
+			continue;
+		len = separator(ix, EN_KEY(ix, e, t-1), e->en_lens[t-1],
+				EN_KEY(ix, e, t), e->en_lens[t], NULL);
+		if (len < bestlen) {
+			best = t;
+			bestlen = len;
+		}
+	}
+	return best;
 }
 
-bool ix_close(struct index *ix)
+/* rebuilds the node at `addr' of the given type from the entries `e'; if 
+ * they do not fit into it, they are distributed over it and new nodes right 
+ * of it. The addresses of the nodes and the upper bounds of their keys are
+ * returned in `pc', whose last key is the greatest key of `e' */
+static bool rebuild(struct index *ix, blkaddr_t addr, char *buf, char type,
+		struct ix_entries *e, struct ix_entries *pc)
 {
-	struct ix_header hd;
-	bool retval;
+	const size_t n = e->en_cnt;
+	size_t *bounds, cnt, a, t, j, plen;
+	blkaddr_t rnbr, *addrs;
+	char nbuf[ix->ix_blksize], sep[ix->ix_size];
+	bool retval = true;
+
+	assert(n > 0);
+	assert(e != pc);
+
+	/* two nodes are balanced, more are only needed for long keys */
+	bounds = xmalloc((n + 1) * sizeof(size_t));
+	cnt = 0;
+	for (a = 0; a < n; a = t) {
+		if (range_size(ix, e, type, a, n, NULL) <= ix->ix_blksize)
+			t = n;
+		else if ((t = split_point(ix, e, a, n, type)) == 0)
+			for (t = a + 1; t < n && range_size(ix, e, type, a,
+						t + 1, NULL)
+					<= ix->ix_blksize; t++)
+				;
+		bounds[cnt++] = a;
+	}
+	bounds[cnt] = n;
+
+	addrs = xmalloc(cnt * sizeof(blkaddr_t));
+	addrs[0] = addr;
+	for (j = 1; retval && j < cnt; j++)
+		retval = (addrs[j] = alloc_blk(ix)) != INVALID_ADDR;
+
+	/* the first node is written last, because it is built in `buf' */
+	rnbr = RNBR(buf);
+	for (j = cnt; retval && j-- > 0; ) {
+		char *b = (j == 0) ? buf : nbuf;
+
+		range_size(ix, e, type, bounds[j], bounds[j+1], &plen);
+		if (j > 0)
+			LNBR(b) = addrs[j-1];
+		RNBR(b) = (j + 1 < cnt) ? addrs[j+1] : rnbr;
+		pack(ix, b, type, e, bounds[j], bounds[j+1], plen);
+		retval = ix_write(ix, addrs[j], b);
+	}
+	if (retval && cnt > 1)
+		retval = set_lnbr(ix, rnbr, addrs[cnt-1]);
+
+	pc->en_cnt = 0;
+	for (j = 0; retval && j < cnt; j++) {
+		t = bounds[j+1];
+		if (t < n) {
+			upper_bound(ix, type, EN_KEY(ix, e, t-1),
+					e->en_lens[t-1], EN_KEY(ix, e, t),
+					e->en_lens[t], sep);
+			en_insert(ix, pc, j, addrs[j], sep);
+		} else
+			en_insert(ix, pc, j, addrs[j], EN_KEY(ix, e, n-1));
+	}
 
-	hd.ix_size = ix->ix_size;
-	hd.ix_root = ix->ix_root;
-	hd.ix_max = ix->ix_max;
-	hd.ix_avail = ix->ix_avail;
-	hd.ix_closed = true;
-	GOTO_POS(ix, 0);
-	retval = WRITE(ix->ix_fd, &hd, sizeof(struct ix_header));
-	close(ix->ix_fd);
-	ix->ix_fd = -1;
-#ifndef NO_CACHE
-	cache_free(ix->ix_cache);
-#endif
-	free(ix->ix_buf);
-	free(ix);
+	free(bounds);
+	free(addrs);
 	return retval;
 }
 
+/* returns the index of the first key of a node that is greater than or equal
+ * to `key', or CNT(buf) if there is none; the keys are searched binary, so 
+ * that large nodes need few comparisons. `*cmpval' is set to the comparison 
+ * of `key' with that key, or to a positive value if there is none, unless 
+ * the node is empty */
+static inline short search_node(struct index *ix, const char *buf,
+		const char *key, int *cmpval)
+{
+	char tmp[ix->ix_size];
+	short lo, hi, mid;
+	int c;
+
+	lo = 0;
+	hi = CNT(buf);
+	if (hi > 0)
+		*cmpval = 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		c = CMPF(ix, key, get_key(ix, buf, mid, tmp));
+		if (c > 0)
+			lo = mid + 1;
+		else {
+			hi = mid;
+			*cmpval = c;
+		}
+	}
+	return lo;
+}
+
+/* expands the first key of a leaf into `key' and returns its pointer */
+static blkaddr_t leaf_first(const struct index *ix, const char *buf, char *key)
+{
+	if (ix->ix_postings)
+		return post_first(ix, buf, 0, key);
+	get_key(ix, buf, 0, key);
+	return PTR(ix, buf, 0);
+}
+
 blkaddr_t ix_search(struct index *ix, const char *key)
 {
+	struct post_pos pos;
 	short i;
 	int cmpval = -1;
-	char *buf;
-	blkaddr_t addr;
+	const char *buf;
+	char tmp[ix->ix_size];
+	blkaddr_t addr, ptr;
 
 	assert(ix != NULL);
 	assert(key != NULL);
 
-	buf = ix->ix_buf;
 	addr = ix->ix_root;
 
 next_level:
-	if (!ix_read(ix, addr, buf))
+	if ((buf = ix_node(ix, addr, ix->ix_buf)) == NULL)
 		return INVALID_ADDR;
-	for (i = 0; i < CNT(buf)
-			&& (cmpval = CMPF(ix, key, KEY(ix, buf, i))) > 0; i++)
-		;
 
-	if (i < CNT(buf) && TYPE(buf) == INNER) {
+	if (TYPE(buf) == INNER) {
+		i = search_node(ix, buf, key, &cmpval);
+		if (i == CNT(buf))
+			return INVALID_ADDR;
 		addr = PTR(ix, buf, i);
 		goto next_level;
-	} else
-		return (i < CNT(buf) && cmpval == 0) ? PTR(ix, buf, i)
-			: INVALID_ADDR;
+	}
+
+	if (ix->ix_postings) {
+		pos = post_search(ix, buf, key, &cmpval);
+		i = pos.g;
+		ptr = pos.addr;
+	} else {
+		i = search_node(ix, buf, key, &cmpval);
+		ptr = (i < CNT(buf)) ? PTR(ix, buf, i) : INVALID_ADDR;
+	}
+
+	/* the keys of inner nodes are only upper bounds: if `key' is greater 
+	 * than all keys of the leaf, keys that cmpf regards as equal may begin 
+	 * in its right neighbor */
+	if (i == CNT(buf) && RNBR(buf) != INVALID_ADDR) {
+		if ((buf = ix_node(ix, RNBR(buf), ix->ix_buf)) == NULL)
+			return INVALID_ADDR;
+		i = 0;
+		ptr = leaf_first(ix, buf, tmp);
+		cmpval = CMPF(ix, key, tmp);
+	}
+	return (i < CNT(buf) && cmpval == 0) ? ptr : INVALID_ADDR;
+}
+
+/* reads a leaf into an iterator; the entries of posting lists are expanded */
+static bool it_read(struct ix_iter *iter, blkaddr_t addr)
+{
+	if (!ix_read(iter->it_ix, addr, iter->it_buf))
+		return false;
+	if (iter->it_ents != NULL) {
+		iter->it_ents->en_cnt = 0;
+		en_unpack(iter->it_ix, iter->it_ents, iter->it_buf);
+	}
+	return true;
+}
+
+/* the count of entries of the iterator's leaf, the pointer of the i-th entry
+ * and its key, which may be stored in it_val */
+static inline int it_cnt(const struct ix_iter *iter)
+{
+	return (iter->it_ents != NULL) ? (int)iter->it_ents->en_cnt
+		: CNT(iter->it_buf);
+}
+
+static inline blkaddr_t it_ptr(const struct ix_iter *iter, int i)
+{
+	return (iter->it_ents != NULL) ? iter->it_ents->en_ptrs[i]
+		: PTR(iter->it_ix, iter->it_buf, i);
+}
+
+static inline const char *it_key(const struct ix_iter *iter, int i)
+{
+	return (iter->it_ents != NULL) ? EN_KEY(iter->it_ix, iter->it_ents, i)
+		: get_key(iter->it_ix, iter->it_buf, i, iter->it_val);
+}
+
+/* returns a new iterator at the start of the leaf `buf' at `addr' */
+static struct ix_iter *it_new(struct index *ix, blkaddr_t addr,
+		const char *buf)
+{
+	struct ix_iter *iter;
+
+	iter = xmalloc(sizeof(struct ix_iter));
+	iter->it_ix = ix;
+	iter->it_curindex = 0;
+	iter->it_curcmpval = 0;
+	iter->it_key = NULL;
+	iter->it_buf = xmalloc(ix->ix_blksize);
+	memcpy(iter->it_buf, buf, ix->ix_blksize);
+	iter->it_val = xmalloc(ix->ix_size);
+	iter->it_ents = NULL;
+	if (ix->ix_postings) {
+		iter->it_ents = en_init();
+		en_unpack(ix, iter->it_ents, iter->it_buf);
+	}
+	iter->it_origaddr = addr;
+	iter->it_origindex = 0;
+	iter->it_origcmpval = 0;
+	return iter;
 }
 
 struct ix_iter *ix_iterator(struct index *ix, const char *key)
 {
-	short i;
+	int i;
 	int cmpval = -1;
-	char *buf;
+	const char *buf;
 	blkaddr_t addr;
+	struct ix_iter *iter;
 
 	assert(ix != NULL);
 	assert(key != NULL);
 
-	buf = ix->ix_buf;
 	addr = ix->ix_root;
 
 next_level:
-	if (!ix_read(ix, addr, buf))
+	if ((buf = ix_node(ix, addr, ix->ix_buf)) == NULL)
 		return NULL;
-	for (i = 0; i < CNT(buf)
-			&& (cmpval = CMPF(ix, key, KEY(ix, buf, i))) > 0; i++)
-		;
 
-	if (i < CNT(buf) && TYPE(buf) == INNER) {
-		addr = PTR(ix, buf, i);
+	if (TYPE(buf) == INNER) {
+		i = search_node(ix, buf, key, &cmpval);
+		/* if i == CNT(buf), go on to most right leaf */
+		addr = PTR(ix, buf, (i < CNT(buf)) ? i : CNT(buf) - 1);
 		goto next_level;
-	} else if (i == CNT(buf)) {
-		struct ix_iter *iter;
-
-		/* go on to most right leaf */
-		while (TYPE(buf) == INNER) {
-			i = CNT(buf) - 1;
-			addr = PTR(ix, buf, i);
-			if (!ix_read(ix, addr, buf))
-				return NULL;
-		}
+	}
 
-		iter = xmalloc(sizeof(struct ix_iter));
-		iter->it_ix = ix;
-		iter->it_curindex = CNT(buf); /* set behind last element */
-		iter->it_curcmpval = cmpval; /* cmpval > 0 */
-		iter->it_origindex = CNT(buf);
-		iter->it_origcmpval = cmpval;
+	iter = it_new(ix, addr, buf);
+	i = (iter->it_ents != NULL)
+		? (int)en_search(ix, iter->it_ents, key, &cmpval)
+		: search_node(ix, buf, key, &cmpval);
 
-		iter->it_key = xmalloc(ix->ix_size);
-		memcpy(iter->it_key, key, ix->ix_size);
-
-		iter->it_buf = xmalloc(ix->ix_blksize);
-		memcpy(iter->it_buf, buf, ix->ix_blksize);
-		return iter;
-	} else { /* i < CNT(buf) && TYPE(buf) == LEAF && cmpval <= 0 */
-		struct ix_iter *iter;
-
-		iter = xmalloc(sizeof(struct ix_iter));
-		iter->it_ix = ix;
-		iter->it_curindex = i;
-		iter->it_curcmpval = cmpval;
-		iter->it_origaddr = addr;
-		iter->it_origindex = i;
-		iter->it_curcmpval = cmpval;
+	/* keys that cmpf regards as equal may begin in the right neighbor (see
+	 * ix_search()) */
+	if (i == it_cnt(iter) && RNBR(iter->it_buf) != INVALID_ADDR) {
+		addr = RNBR(iter->it_buf);
+		if (!it_read(iter, addr)) {
+			ix_iter_free(iter);
+			return NULL;
+		}
+		i = 0;
+		cmpval = CMPF(ix, key, it_key(iter, 0));
+	}
 
-		iter->it_key = xmalloc(ix->ix_size);
-		memcpy(iter->it_key, key, ix->ix_size);
+	/* if i == it_cnt(iter), the iterator is set behind the last element */
+	iter->it_curindex = i;
+	iter->it_curcmpval = cmpval;
+	iter->it_origaddr = addr;
+	iter->it_origindex = i;
+	iter->it_origcmpval = cmpval;
 
-		iter->it_buf = xmalloc(ix->ix_blksize);
-		memcpy(iter->it_buf, buf, ix->ix_blksize);
-		return iter;
-	}
+	iter->it_key = xmalloc(ix->ix_size);
+	memcpy(iter->it_key, key, ix->ix_size);
+	return iter;
 }
 
 struct ix_iter *ix_min(struct index *ix)
 {
-	char *buf;
+	const char *buf;
 	blkaddr_t addr;
 	struct ix_iter *iter;
 
 	assert(ix != NULL);
 
-	buf = ix->ix_buf;
 	addr = ix->ix_root;
 
 next_level:
-	if (!ix_read(ix, addr, buf))
+	if ((buf = ix_node(ix, addr, ix->ix_buf)) == NULL)
 		return NULL;
 
 	if (TYPE(buf) == INNER) {
@@ -493,37 +1852,29 @@ next_level:
 		goto next_level;
 	}
 
-	iter = xmalloc(sizeof(struct ix_iter));
-	iter->it_ix = ix;
-	iter->it_curindex = 0; /* set at the last element */
-	iter->it_curcmpval = 0;
-	iter->it_origindex = 0;
-	iter->it_origcmpval = 0;
+	iter = it_new(ix, addr, buf); /* set at the first element */
 
-	if (CNT(buf) > 0) {
+	/* with respect to the scenario of an empty tree (CNT(buf)=0), the key
+	 * remains NULL */
+	if (it_cnt(iter) > 0) {
 		iter->it_key = xmalloc(ix->ix_size);
-		memcpy(iter->it_key, KEY(ix, buf, 0), ix->ix_size);
-	} else /* with respect to the scenario of an empty tree (CNT(buf)=0) */
-		iter->it_key = NULL;
-
-	iter->it_buf = xmalloc(ix->ix_blksize);
-	memcpy(iter->it_buf, buf, ix->ix_blksize);
+		KEYCPY(ix, iter->it_key, it_key(iter, 0));
+	}
 	return iter;
 }
 
 struct ix_iter *ix_max(struct index *ix)
 {
-	char *buf;
+	const char *buf;
 	blkaddr_t addr;
 	struct ix_iter *iter;
 
 	assert(ix != NULL);
 
-	buf = ix->ix_buf;
 	addr = ix->ix_root;
 
 next_level:
-	if (!ix_read(ix, addr, buf))
+	if ((buf = ix_node(ix, addr, ix->ix_buf)) == NULL)
 		return NULL;
 
 	if (TYPE(buf) == INNER) {
@@ -531,22 +1882,16 @@ next_level:
 		goto next_level;
 	}
 
-	iter = xmalloc(sizeof(struct ix_iter));
-	iter->it_ix = ix;
-
-	iter->it_curindex = CNT(buf); /* set behind last element */
-	iter->it_curcmpval = 0;
-	iter->it_origindex = CNT(buf);
-	iter->it_origcmpval = 0;
+	iter = it_new(ix, addr, buf);
+	iter->it_curindex = it_cnt(iter); /* set behind last element */
+	iter->it_origindex = iter->it_curindex;
 
-	if (CNT(buf) > 0) {
+	/* for the scenario of an empty tree (CNT(buf)=0), the key remains
+	 * NULL */
+	if (it_cnt(iter) > 0) {
 		iter->it_key = xmalloc(ix->ix_size);
-		memcpy(iter->it_key, KEY(ix, buf, CNT(buf) - 1), ix->ix_size);
-	} else /* for the scenario of an empty tree (CNT(buf)=0) */
-		iter->it_key = NULL;
-
-	iter->it_buf = xmalloc(ix->ix_blksize);
-	memcpy(iter->it_buf, buf, ix->ix_blksize);
+		KEYCPY(ix, iter->it_key, it_key(iter, it_cnt(iter) - 1));
+	}
 	return iter;
 }
 
@@ -557,6 +1902,9 @@ void ix_iter_free(struct ix_iter *iter)
 			free(iter->it_buf);
 		if (iter->it_key)
 			free(iter->it_key);
+		if (iter->it_ents != NULL)
+			en_free(iter->it_ents);
+		free(iter->it_val);
 		free(iter);
 	}
 }
@@ -566,7 +1914,7 @@ void ix_reset(struct ix_iter *iter)
 	assert(iter != NULL);
 
 	if (iter->it_origaddr != INVALID_ADDR) {
-		ix_read(iter->it_ix, iter->it_origaddr, iter->it_buf);
+		it_read(iter, iter->it_origaddr);
 		iter->it_curindex = iter->it_origindex;
 		iter->it_curcmpval = iter->it_origcmpval;
 	}
@@ -598,19 +1946,19 @@ blkaddr_t ix_lnext(struct ix_iter *iter)
 
 	if (iter->it_curindex > 0) { /* left elem in block */
 		iter->it_curindex--;
-		ptr = PTR(iter->it_ix, iter->it_buf, iter->it_curindex);
-		key = KEY(iter->it_ix, iter->it_buf, iter->it_curindex);
+		ptr = it_ptr(iter, iter->it_curindex);
+		key = it_key(iter, iter->it_curindex);
 		iter->it_curcmpval = CMPF(iter->it_ix, iter->it_key, key);
 		return ptr;
 	} else if (LNBR(iter->it_buf) != INVALID_ADDR) { /* go to left block */
 		blkaddr_t addr;
 
 		addr = LNBR(iter->it_buf);
-		if (!ix_read(iter->it_ix, addr, iter->it_buf))
+		if (!it_read(iter, addr))
 			return INVALID_ADDR;
-		iter->it_curindex = CNT(iter->it_buf) - 1;
-		ptr = PTR(iter->it_ix, iter->it_buf, iter->it_curindex);
-		key = KEY(iter->it_ix, iter->it_buf, iter->it_curindex);
+		iter->it_curindex = it_cnt(iter) - 1;
+		ptr = it_ptr(iter, iter->it_curindex);
+		key = it_key(iter, iter->it_curindex);
 		iter->it_curcmpval = CMPF(iter->it_ix, iter->it_key, key);
 		return ptr;
 	} else /* left end of leaves reached */
@@ -622,8 +1970,8 @@ const void *ix_lval(const struct ix_iter *iter)
 	assert(iter != NULL);
 	assert(iter->it_curindex >= 0);
 
-	return iter->it_curindex < CNT(iter->it_buf)
-		? KEY(iter->it_ix, iter->it_buf, iter->it_curindex)
+	return iter->it_curindex < it_cnt(iter)
+		? it_key(iter, iter->it_curindex)
 		: NULL;
 }
 
@@ -635,9 +1983,9 @@ blkaddr_t ix_rnext(struct ix_iter *iter)
 	assert(iter != NULL);
 	assert(iter->it_curindex >= 0);
 
-	if (iter->it_curindex < CNT(iter->it_buf)) { /* right elem in block */
-		ptr = PTR(iter->it_ix, iter->it_buf, iter->it_curindex);
-		key = KEY(iter->it_ix, iter->it_buf, iter->it_curindex);
+	if (iter->it_curindex < it_cnt(iter)) { /* right elem in block */
+		ptr = it_ptr(iter, iter->it_curindex);
+		key = it_key(iter, iter->it_curindex);
 		iter->it_curcmpval = CMPF(iter->it_ix, iter->it_key, key);
 		iter->it_curindex++;
 		return ptr;
@@ -645,11 +1993,11 @@ blkaddr_t ix_rnext(struct ix_iter *iter)
 		blkaddr_t addr;
 
 		addr = RNBR(iter->it_buf);
-		if (!ix_read(iter->it_ix, addr, iter->it_buf))
+		if (!it_read(iter, addr))
 			return INVALID_ADDR;
 		iter->it_curindex = 0;
-		ptr = PTR(iter->it_ix, iter->it_buf, iter->it_curindex);
-		key = KEY(iter->it_ix, iter->it_buf, iter->it_curindex);
+		ptr = it_ptr(iter, iter->it_curindex);
+		key = it_key(iter, iter->it_curindex);
 		iter->it_curcmpval = CMPF(iter->it_ix, iter->it_key, key);
 		iter->it_curindex++;
 		return ptr;
@@ -662,67 +2010,17 @@ const void *ix_rval(const struct ix_iter *iter)
 	assert(iter != NULL);
 	assert(iter->it_curindex-1 >= 0);
 
-	return iter->it_curindex-1 < CNT(iter->it_buf)
-		? KEY(iter->it_ix, iter->it_buf, iter->it_curindex-1)
+	return iter->it_curindex-1 < it_cnt(iter)
+		? it_key(iter, iter->it_curindex-1)
 		: NULL;
 }
 
-static bool split_child(struct index *ix,
-		blkaddr_t paddr, char *pbuf,	/* the parent node */
-		short i,			/* the index of lbuf in pbuf */
-		blkaddr_t laddr, char *lbuf)	/* the full node */
-{
-	blkaddr_t raddr;
-	char rbuf[ix->ix_blksize];
-	short j, t;
-
-	t = ORDER(ix) / 2 + 1;
-
-	raddr = alloc_blk(ix);
-	TYPE(rbuf) = TYPE(lbuf);
-	CNT(rbuf) = t - 1;
-
-	LNBR(rbuf) = laddr;
-	RNBR(rbuf) = RNBR(lbuf);
-	RNBR(lbuf) = raddr;
-	if (!set_lnbr(ix, RNBR(rbuf), raddr))
-		return false;
-
-	/* initialize the rbuf with the upper half of entries of the old 
-	 * old node (which is stored in lbuf at) */
-	for (j = 0; j < CNT(rbuf); j++) {
-		PTR(ix, rbuf, j) = PTR(ix, lbuf, j+t);
-		KEYCPY(ix, KEY(ix, rbuf, j), KEY(ix, lbuf, j+t));
-	}
-	CNT(lbuf) = t;
-
-	/* update parent node: firstly shift the entries to obtain space for a
-	 * new one. then we have to interesting entries:
-	 * entry #i:   ptr = laddr, key = lkey
-	 * entry #i+1: ptr = laddr, key = lkey 
-	 * now we let entry #i+1 point to the right node (raddr) and change 
-	 * the key of the entry #i to the key where we split the old node */
-	CNT(pbuf)++;
-	for (j = CNT(pbuf)-2; j >= i; j--) {
-		PTR(ix, pbuf, j+1) = PTR(ix, pbuf, j);
-		KEYCPY(ix, KEY(ix, pbuf, j+1), KEY(ix, pbuf, j));
-	}
-	PTR(ix, pbuf, i+1) = raddr;
-	KEYCPY(ix, KEY(ix, pbuf, i), KEY(ix, lbuf, CNT(lbuf)-1));
-
-	if (!ix_write(ix, paddr, pbuf))
-		return false;
-	if (!ix_write(ix, laddr, lbuf))
-		return false;
-	if (!ix_write(ix, raddr, rbuf))
-		return false;
-	return true;
-}
-
 static bool insert(struct index *ix,
 		blkaddr_t addr, char *buf,		/* current node */
-		blkaddr_t tuple_addr, const char *key)	/* key/addr pair */
+		blkaddr_t tuple_addr, const char *key,	/* key/addr pair */
+		struct ix_entries *pc)			/* resulting nodes */
 {
+	struct ix_entries *e = ix->ix_ents;
 	short i;
 	int cmpval = -1;
 
@@ -730,166 +2028,415 @@ static bool insert(struct index *ix,
 	assert(addr != INVALID_ADDR);
 	assert(buf != NULL);
 
-	for (i = 0; i < CNT(buf)
-			&& (cmpval = CMPF(ix, key, KEY(ix, buf, i))) > 0; i++)
-		;
-
-	if (i < CNT(buf) && cmpval == 0) /* key exists already */
-		return true;
+	pc->en_cnt = 0;
+
+	if (POSTINGS(ix, TYPE(buf))) { /* LEAF: insert into posting list */
+		if (post_search(ix, buf, key, &cmpval).g < CNT(buf)
+				&& cmpval == 0) /* key exists already */
+			return true;
+		if ((i = post_put(ix, buf, tuple_addr, key)) >= 0)
+			return ix_write_from(ix, addr, buf, i);
+
+		/* the key does not fit or has not the leaf's prefix */
+		e->en_cnt = 0;
+		en_unpack(ix, e, buf);
+		en_insert(ix, e, en_search(ix, e, key, &cmpval), tuple_addr,
+				key);
+		return rebuild(ix, addr, buf, LEAF, e, pc);
+	}
 
+	i = search_node(ix, buf, key, &cmpval);
 	if (TYPE(buf) == LEAF) { /* LEAF: insert key/addr pair */
-		short j;
-
-		CNT(buf)++;
-		for (j = CNT(buf) - 2; j >= i; j--) {
-			KEYCPY(ix, KEY(ix, buf, j+1), KEY(ix, buf, j));
-			PTR(ix, buf, j+1) = PTR(ix, buf, j);
-		}
-
-		PTR(ix, buf, i) = tuple_addr;
-		KEYCPY(ix, KEY(ix, buf, i), key);
-		if (!ix_write(ix, addr, buf))
-			return false;
-		return true;
-	} else { /* INNER: search next; possibly update key and/or split */
+		if (i < CNT(buf) && cmpval == 0) /* key exists already */
+			return true;
+		if (put_entry(ix, buf, i, tuple_addr, key))
+			return ix_write_from(ix, addr, buf, i);
+
+		/* the key does not fit or has not the leaf's prefix */
+		e->en_cnt = 0;
+		en_unpack(ix, e, buf);
+		en_insert(ix, e, i, tuple_addr, key);
+	} else { /* INNER: insert in son; possibly update key and/or split */
 		blkaddr_t son_addr;
 		char son_buf[ix->ix_blksize];
+		bool update;
+		size_t j;
 
-		if (i == CNT(buf)) { /* update most right key and follow it */
+		update = (i == CNT(buf)); /* update most right key */
+		if (update)
 			i--;
-			KEYCPY(ix, KEY(ix, buf, i), key);
-			if (!ix_write(ix, addr, buf))
-				return false;
-		}
 
 		son_addr = PTR(ix, buf, i);
-		if (!ix_read(ix, son_addr, son_buf))
+		if (!ix_read(ix, son_addr, son_buf)
+				|| !insert(ix, son_addr, son_buf, tuple_addr,
+					key, pc))
 			return false;
 
-		if (CNT(son_buf) == ORDER(ix)) { /* split son */
-			if (!split_child(ix, addr, buf, i, son_addr, son_buf))
-				return false;
-			/* detect to which node we need to step down: 
-			 * left node is already read in son_buf, while we would
-			 * need to read right node from disk */
-			if (CMPF(ix, key, KEY(ix, buf, i)) > 0) {
-				i++;
-				son_addr = PTR(ix, buf, i);
-				if (!ix_read(ix, son_addr, son_buf))
-					return false;
-			}
+		if (pc->en_cnt <= 1) { /* son was not split */
+			if (!update)
+				return true;
+			if (set_key(ix, buf, i, key))
+				return ix_write_from(ix, addr, buf, i);
 		}
 
-		return insert(ix, son_addr, son_buf, tuple_addr, key);
+		e->en_cnt = 0;
+		en_unpack(ix, e, buf);
+		if (update)
+			en_set_key(ix, e, i, key);
+		if (pc->en_cnt > 1) {
+			/* the son's entry is replaced by the nodes it was split
+			 * into; the last one inherits its key */
+			for (j = 0; j + 1 < pc->en_cnt; j++)
+				en_insert(ix, e, i + j, pc->en_ptrs[j],
+						EN_KEY(ix, pc, j));
+			e->en_ptrs[i + j] = pc->en_ptrs[j];
+		}
 	}
+	return rebuild(ix, addr, buf, TYPE(buf), e, pc);
 }
 
 bool ix_insert(struct index *ix, blkaddr_t tuple_addr, const char *key)
 {
-	if (!ix_read(ix, ix->ix_root, ix->ix_buf))
+	struct ix_entries *pc = ix->ix_pieces;
+	blkaddr_t root_addr;
+	char root_buf[ix->ix_blksize];
+	size_t j;
+
+	assert(!ix->ix_postings || get_addr(ix, key) == (uint64_t)tuple_addr);
+
+	if (!ix_read(ix, ix->ix_root, ix->ix_buf)
+			|| !insert(ix, ix->ix_root, ix->ix_buf, tuple_addr, key,
+				pc))
 		return false;
 
-	if (CNT(ix->ix_buf) == ORDER(ix)) { /* root full => create a new */
-		blkaddr_t root_addr, old_root_addr;
-		char root_buf[ix->ix_blksize], *old_root_buf;
-		
-		old_root_addr = ix->ix_root;
-		old_root_buf = ix->ix_buf;
-		
-		ix->ix_root = alloc_blk(ix);
-		root_addr = ix->ix_root;
-		TYPE(root_buf) = INNER;
+	while (pc->en_cnt > 1) { /* root was split => create a new */
+		root_addr = alloc_blk(ix);
+		if (root_addr == INVALID_ADDR)
+			return false;
+		ix->ix_root = root_addr;
+
+		ix->ix_ents->en_cnt = 0;
+		for (j = 0; j < pc->en_cnt; j++)
+			en_insert(ix, ix->ix_ents, j, pc->en_ptrs[j],
+					EN_KEY(ix, pc, j));
 		LNBR(root_buf) = INVALID_ADDR;
 		RNBR(root_buf) = INVALID_ADDR;
-		CNT(root_buf) = 1;
-		PTR(ix, root_buf, 0) = old_root_addr;
-		KEYCPY(ix, KEY(ix, root_buf, 0),
-				KEY(ix, old_root_buf, CNT(old_root_buf) - 1));
-		split_child(ix, root_addr, root_buf, 0, old_root_addr,
-				old_root_buf);
-		return insert(ix, root_addr, root_buf, tuple_addr, key);
-	} else /* root is not full */
-		return insert(ix, ix->ix_root, ix->ix_buf, tuple_addr, key);
-}
-
-static void merge_neighbors(struct index *ix, 
-		char *pbuf,	/* parent node */
-		short i,	/* index of left son */
-		char *lbuf,	/* left son */
-		char *rbuf)	/* right son */
-{
-	short j, old_lbuf_cnt;
-
-	KEYCPY(ix, KEY(ix, pbuf, i), KEY(ix, pbuf, i+1));
-	for (j = i+1; j < CNT(pbuf)-1; j++) {
-		PTR(ix, pbuf, j) = PTR(ix, pbuf, j+1);
-		KEYCPY(ix, KEY(ix, pbuf, j), KEY(ix, pbuf, j+1));
-	}
-	CNT(pbuf)--;
-
-	old_lbuf_cnt = CNT(lbuf);
-	CNT(lbuf) += CNT(rbuf);
-	RNBR(lbuf) = RNBR(rbuf);
-	for (j = 0; j < CNT(rbuf); j++) {
-		PTR(ix, lbuf, old_lbuf_cnt + j) = PTR(ix, rbuf, j);
-		KEYCPY(ix, KEY(ix, lbuf, old_lbuf_cnt + j), KEY(ix, rbuf, j));
+		if (!rebuild(ix, root_addr, root_buf, INNER, ix->ix_ents, pc))
+			return false;
+	}
+	return true;
+}
+
+struct ix_load {
+	struct index	*ld_ix;		/* the index that is built */
+	size_t		ld_fill;	/* bytes per node */
+	char		ld_type;	/* type of the level's nodes */
+	struct ix_entries *ld_prev;	/* the full node left of ld_cur */
+	blkaddr_t	ld_prevaddr;	/* INVALID_ADDR if there is none */
+	blkaddr_t	ld_lnbr;	/* the left neighbor of ld_prev */
+	struct ix_entries *ld_cur;	/* the node that is filled */
+	blkaddr_t	ld_curaddr;	/* INVALID_ADDR if there is none */
+	struct ix_entries *ld_up;	/* address/key pairs of the next level */
+	char		*ld_buf;	/* the node that is written */
+};
+
+/* writes a node of the level that is built and adds the upper bound of its 
+ * keys and its address to the next level */
+static bool load_write(struct ix_load *ld, struct ix_entries *e,
+		blkaddr_t addr, blkaddr_t lnbr, blkaddr_t rnbr, const char *sep)
+{
+	struct index *ix = ld->ld_ix;
+	size_t plen;
+
+	range_size(ix, e, ld->ld_type, 0, e->en_cnt, &plen);
+	LNBR(ld->ld_buf) = lnbr;
+	RNBR(ld->ld_buf) = rnbr;
+	pack(ix, ld->ld_buf, ld->ld_type, e, 0, e->en_cnt, plen);
+	en_insert(ix, ld->ld_up, ld->ld_up->en_cnt, addr, sep);
+	return ix_write(ix, addr, ld->ld_buf);
+}
+
+/* appends a pair to the level that is built; a full node is written when the
+ * next one is started, so that ld_prev and ld_cur are the level's last ones */
+static bool load_entry(struct ix_load *ld, char type, blkaddr_t ptr,
+		const char *key)
+{
+	struct index *ix = ld->ld_ix;
+	struct ix_entries *cur = ld->ld_cur;
+	blkaddr_t addr;
+	size_t n;
+
+	if (ld->ld_curaddr != INVALID_ADDR) {
+		n = cur->en_cnt;
+		en_insert(ix, cur, n, ptr, key);
+		if (range_size(ix, cur, type, 0, n + 1, NULL) <= ld->ld_fill)
+			return true;
+		cur->en_cnt--;
+	}
+
+	/* the first leaf is the empty root of the new tree, the other nodes
+	 * follow in the file */
+	addr = (ld->ld_curaddr == INVALID_ADDR && type == LEAF)
+		? ix->ix_root : alloc_blk(ix);
+	if (addr == INVALID_ADDR)
+		return false;
+	if (ld->ld_prevaddr != INVALID_ADDR) {
+		char sep[ix->ix_size];
+
+		upper_bound(ix, type,
+				EN_KEY(ix, ld->ld_prev, ld->ld_prev->en_cnt - 1),
+				ld->ld_prev->en_lens[ld->ld_prev->en_cnt - 1],
+				EN_KEY(ix, cur, 0), cur->en_lens[0], sep);
+		if (!load_write(ld, ld->ld_prev, ld->ld_prevaddr, ld->ld_lnbr,
+					ld->ld_curaddr, sep))
+			return false;
+		ld->ld_lnbr = ld->ld_prevaddr;
 	}
+
+	ld->ld_cur = ld->ld_prev;
+	ld->ld_prev = cur;
+	ld->ld_prevaddr = ld->ld_curaddr;
+	ld->ld_curaddr = addr;
+	ld->ld_type = type;
+	ld->ld_cur->en_cnt = 0;
+	en_insert(ix, ld->ld_cur, 0, ptr, key);
+	return true;
 }
 
-static void move_left(struct index *ix,
-		char *pbuf,	/* parent node */
-		short i,	/* index of left son */
-		char *lbuf,	/* left son */
-		char *rbuf)	/* right son */
+/* writes the last nodes of the level that is built; if the last node is less
+ * than half full, it is filled up from its left neighbor or merged into it; 
+ * a level of one node is the root */
+static bool load_level_end(struct ix_load *ld)
 {
-	short j;
+	struct index *ix = ld->ld_ix;
+	struct ix_entries *l = ld->ld_prev, *r = ld->ld_cur;
+	blkaddr_t laddr = ld->ld_prevaddr, raddr = ld->ld_curaddr;
+	blkaddr_t lnbr = ld->ld_lnbr;
+	char sep[ix->ix_size];
+	size_t i, t;
+
+	ld->ld_prevaddr = INVALID_ADDR;
+	ld->ld_curaddr = INVALID_ADDR;
+	ld->ld_lnbr = INVALID_ADDR;
+
+	if (raddr == INVALID_ADDR)
+		return true;
+	if (laddr == INVALID_ADDR) {
+		ix->ix_root = raddr;
+		return load_write(ld, r, raddr, INVALID_ADDR, INVALID_ADDR,
+				EN_KEY(ix, r, r->en_cnt - 1));
+	}
 
-	CNT(lbuf)++;
-	PTR(ix, lbuf, CNT(lbuf)-1) = PTR(ix, rbuf, 0);
-	KEYCPY(ix, KEY(ix, lbuf, CNT(lbuf)-1), KEY(ix, rbuf, 0));
-	for (j = 0; j < CNT(rbuf)-1; j++) {
-		PTR(ix, rbuf, j) = PTR(ix, rbuf, j+1);
-		KEYCPY(ix, KEY(ix, rbuf, j), KEY(ix, rbuf, j+1));
+	if (range_size(ix, r, ld->ld_type, 0, r->en_cnt, NULL)
+			< ix->ix_blksize / 2) {
+		for (i = 0; i < r->en_cnt; i++)
+			en_insert(ix, l, l->en_cnt, r->en_ptrs[i],
+					EN_KEY(ix, r, i));
+		if (range_size(ix, l, ld->ld_type, 0, l->en_cnt, NULL)
+				<= ix->ix_blksize) {
+			/* both fit into the left node; the right one is the 
+			 * last allocated block */
+			assert(raddr == ix->ix_max);
+			ix->ix_max--;
+			return load_write(ld, l, laddr, lnbr, INVALID_ADDR,
+					EN_KEY(ix, l, l->en_cnt - 1));
+		}
+
+		/* the entries are distributed over both nodes */
+		t = split_point(ix, l, 0, l->en_cnt, ld->ld_type);
+		assert(t > 0);
+		r->en_cnt = 0;
+		for (i = t; i < l->en_cnt; i++)
+			en_insert(ix, r, r->en_cnt, l->en_ptrs[i],
+					EN_KEY(ix, l, i));
+		l->en_cnt = t;
 	}
-	CNT(rbuf)--;
-	KEYCPY(ix, KEY(ix, pbuf, i), KEY(ix, lbuf, CNT(lbuf)-1));
+
+	upper_bound(ix, ld->ld_type, EN_KEY(ix, l, l->en_cnt - 1),
+			l->en_lens[l->en_cnt - 1], EN_KEY(ix, r, 0),
+			r->en_lens[0], sep);
+	return load_write(ld, l, laddr, lnbr, raddr, sep)
+		&& load_write(ld, r, raddr, laddr, INVALID_ADDR,
+				EN_KEY(ix, r, r->en_cnt - 1));
 }
 
-static void move_right(struct index *ix,
-		char *pbuf,	/* parent node */
-		short i,	/* index of left son */
-		char *lbuf,	/* left son */
-		char *rbuf)	/* right son */
+struct ix_load *ix_load_begin(struct index *ix, double fill)
 {
-	short j;
+	struct ix_load *ld;
+
+	assert(ix != NULL);
+
+	if (ix->ix_root != 0 || ix->ix_max != 0
+			|| ix->ix_avail != INVALID_ADDR
+			|| !ix_read(ix, ix->ix_root, ix->ix_buf)
+			|| CNT(ix->ix_buf) != 0)
+		return NULL;
+
+	ld = xmalloc(sizeof(struct ix_load));
+	ld->ld_ix = ix;
+	ld->ld_fill = (size_t)(fill * ix->ix_blksize);
+	if (ld->ld_fill < ix->ix_blksize / 2)
+		ld->ld_fill = ix->ix_blksize / 2;
+	if (ld->ld_fill > ix->ix_blksize)
+		ld->ld_fill = ix->ix_blksize;
+	ld->ld_type = LEAF;
+	ld->ld_prev = en_init();
+	ld->ld_prevaddr = INVALID_ADDR;
+	ld->ld_lnbr = INVALID_ADDR;
+	ld->ld_cur = en_init();
+	ld->ld_curaddr = INVALID_ADDR;
+	ld->ld_up = en_init();
+	ld->ld_buf = xmalloc(ix->ix_blksize);
+	memset(ld->ld_buf, 0, ix->ix_blksize);
+	return ld;
+}
+
+bool ix_load(struct ix_load *ld, blkaddr_t tuple_addr, const char *key)
+{
+	struct index *ix;
+	int cmpval;
+
+	assert(ld != NULL);
+	assert(key != NULL);
+
+	ix = ld->ld_ix;
+	assert(!ix->ix_postings || get_addr(ix, key) == (uint64_t)tuple_addr);
+	if (ld->ld_curaddr != INVALID_ADDR) {
+		cmpval = CMPF(ix, key, EN_KEY(ix, ld->ld_cur,
+					ld->ld_cur->en_cnt - 1));
+		if (cmpval == 0) /* key exists already */
+			return true;
+		if (cmpval < 0)
+			return false;
+	}
+	return load_entry(ld, LEAF, tuple_addr, key);
+}
+
+bool ix_load_end(struct ix_load *ld)
+{
+	struct ix_entries *up;
+	size_t i;
+	bool retval;
+
+	assert(ld != NULL);
+
+	/* each level is built from the upper bounds of the level below */
+	retval = load_level_end(ld);
+	while (retval && ld->ld_up->en_cnt > 1) {
+		up = ld->ld_up;
+		ld->ld_up = en_init();
+		for (i = 0; retval && i < up->en_cnt; i++)
+			retval = load_entry(ld, INNER, up->en_ptrs[i],
+					EN_KEY(ld->ld_ix, up, i));
+		retval = retval && load_level_end(ld);
+		en_free(up);
+	}
+
+	en_free(ld->ld_up);
+	en_free(ld->ld_prev);
+	en_free(ld->ld_cur);
+	free(ld->ld_buf);
+	free(ld);
+	return retval;
+}
+
+/* merges the i-th and the (i+1)-th son of a node into the left one if their
+ * entries fit into it */
+static bool merge(struct index *ix,
+		blkaddr_t addr, char *buf,		/* parent node */
+		short i,				/* index of left son */
+		blkaddr_t laddr, char *lbuf,		/* left son */
+		blkaddr_t raddr, const char *rbuf)	/* right son */
+{
+	struct ix_entries *e = ix->ix_ents;
+	size_t plen;
+
+	/* the merged node is at least as large as both nodes without one 
+	 * header and the prefixes */
+	if (NODE_SIZE(ix, lbuf) + NODE_SIZE(ix, rbuf) > ix->ix_blksize
+			+ PREFIX_OFFSET(ix) + PLEN(ix, lbuf) + PLEN(ix, rbuf))
+		return true;
+
+	e->en_cnt = 0;
+	en_unpack(ix, e, lbuf);
+	en_unpack(ix, e, rbuf);
+	if (range_size(ix, e, TYPE(lbuf), 0, e->en_cnt, &plen)
+			> ix->ix_blksize)
+		return true;
+
+	RNBR(lbuf) = RNBR(rbuf);
+	pack(ix, lbuf, TYPE(lbuf), e, 0, e->en_cnt, plen);
+	if (!set_lnbr(ix, RNBR(lbuf), laddr))
+		return false;
+	free_blk(ix, raddr);
 
-	CNT(rbuf)++;
-	for (j = CNT(rbuf) - 1; j > 0; j--) {
-		PTR(ix, rbuf, j) = PTR(ix, rbuf, j-1);
-		KEYCPY(ix, KEY(ix, rbuf, j), KEY(ix, rbuf, j-1));
+	/* the left son takes the right son's entry, whose key is the upper 
+	 * bound of both */
+	PTR(ix, buf, i+1) = laddr;
+	del_entry(ix, buf, i);
+	return ix_write(ix, laddr, lbuf) && ix_write(ix, addr, buf);
+}
+
+/* removes the i-th son of a node if it has become empty, or merges it with a
+ * neighbor if it is less than half full */
+static bool rebalance(struct index *ix,
+		blkaddr_t addr, char *buf,		/* parent node */
+		short i,				/* index of son */
+		blkaddr_t son_addr, char *son_buf)	/* son */
+{
+	blkaddr_t nbr_addr;
+	char nbr_buf[ix->ix_blksize];
+
+	if (CNT(son_buf) == 0) {
+		if (!set_lnbr(ix, RNBR(son_buf), LNBR(son_buf))
+				|| !set_rnbr(ix, LNBR(son_buf), RNBR(son_buf)))
+			return false;
+		free_blk(ix, son_addr);
+		del_entry(ix, buf, i);
+		return ix_write(ix, addr, buf);
 	}
-	PTR(ix, rbuf, 0) = PTR(ix, lbuf, CNT(lbuf)-1);
-	KEYCPY(ix, KEY(ix, rbuf, 0), KEY(ix, lbuf, CNT(lbuf)-1));
-	CNT(lbuf)--;
-	KEYCPY(ix, KEY(ix, pbuf, i), KEY(ix, lbuf, CNT(lbuf)-1));
+
+	if (!UNDERFULL(ix, son_buf))
+		return true;
+
+	if (i + 1 < CNT(buf)) {
+		nbr_addr = PTR(ix, buf, i+1);
+		return ix_read(ix, nbr_addr, nbr_buf)
+			&& merge(ix, addr, buf, i, son_addr, son_buf,
+					nbr_addr, nbr_buf);
+	} else if (i > 0) {
+		nbr_addr = PTR(ix, buf, i-1);
+		return ix_read(ix, nbr_addr, nbr_buf)
+			&& merge(ix, addr, buf, i-1, nbr_addr, nbr_buf,
+					son_addr, son_buf);
+	} else
+		return true;
 }
 
 static blkaddr_t delete(struct index *ix,
 		blkaddr_t addr, char *buf,	/* current node */
 		const char *key)		/* searched key */
 {
-	short i, t;
+	short i;
 	int cmpval = 0;
 
 	assert(ix != NULL);
 	assert(addr != INVALID_ADDR);
 	assert(key != NULL);
 
-	t = ORDER(ix) / 2 + 1;
+	if (POSTINGS(ix, TYPE(buf))) { /* LEAF: delete from posting list */
+		struct post_pos pos;
+
+		pos = post_search(ix, buf, key, &cmpval);
+		if (pos.g == CNT(buf) || cmpval != 0)
+			return INVALID_ADDR;
+		post_del(ix, buf, pos.g, pos.addr);
+		if (!ix_write(ix, addr, buf))
+			return INVALID_ADDR;
+		return pos.addr;
+	}
 
-	for (i = 0; i < CNT(buf) 
-			&& (cmpval = CMPF(ix, key, KEY(ix, buf, i))) > 0; i++)
-		;
+	i = search_node(ix, buf, key, &cmpval);
 
 	if (i == CNT(buf)) /* key not found */
 		return INVALID_ADDR;
@@ -898,107 +2445,28 @@ static blkaddr_t delete(struct index *ix,
 		if (cmpval == 0) {
 			blkaddr_t tuple_addr;
 
+			/* the remaining keys keep the leaf's prefix */
 			tuple_addr = PTR(ix, buf, i);
-			for (; i < CNT(buf)-1; i++) {
-				PTR(ix, buf, i) = PTR(ix, buf, i+1);
-				KEYCPY(ix, KEY(ix, buf, i), KEY(ix, buf, i+1));
-			}
-			CNT(buf)--;
+			del_entry(ix, buf, i);
 			if (!ix_write(ix, addr, buf))
 				return INVALID_ADDR;
 			return tuple_addr;
 		} else
 			return INVALID_ADDR;
-	} else { /* INNER: search next; possibly update key and/or merge/move */
-		blkaddr_t son_addr;
+	} else { /* INNER: delete in son; possibly remove or merge it */
+		blkaddr_t son_addr, tuple_addr;
 		char son_buf[ix->ix_blksize];
 
+		/* the keys of inner nodes remain valid upper bounds */
 		son_addr = PTR(ix, buf, i);
-
 		if (!ix_read(ix, son_addr, son_buf))
 			return INVALID_ADDR;
-
-		if (CNT(son_buf) == t-1) { /* son would have too less sons */
-			blkaddr_t nbr_addr;
-			char nbr_buf[ix->ix_blksize];
-			bool nbr_is_left;
-
-			if (i >= 1) {
-				nbr_is_left = true;
-				nbr_addr = PTR(ix, buf, i-1);
-				if (!ix_read(ix, nbr_addr, nbr_buf))
-					return INVALID_ADDR;
-			} else {
-				nbr_is_left = false;
-				nbr_addr = PTR(ix, buf, i+1);
-				if (!ix_read(ix, nbr_addr, nbr_buf))
-					return INVALID_ADDR;
-			}
-	
-			if (CNT(nbr_buf) == t-1) { /* merge nodes */
-				if (nbr_is_left) {
-					/* decrement i, because the current
-					 * position shifts one left and this
-					 * position might be needed some lines
-					 * below again if cmp=0 */
-					--i;
-					merge_neighbors(ix, buf, i, nbr_buf,
-							son_buf);
-					free_blk(ix, son_addr);
-					son_addr = nbr_addr;
-					memcpy(son_buf, nbr_buf,
-							ix->ix_blksize);
-				} else {
-					merge_neighbors(ix, buf, i, son_buf, 
-							nbr_buf);
-					free_blk(ix, nbr_addr);
-				}
-				/* update LNBR pointer of right neighbor */
-				if (!set_lnbr(ix, RNBR(son_buf), son_addr))
-					return INVALID_ADDR;
-				assert(CNT(son_buf) > t-1);
-			} else if (CNT(nbr_buf) > t-1) { /* move one entry */
-				if (nbr_is_left) {
-					move_right(ix, buf, i-1, nbr_buf,
-							son_buf);
-					/* update nbr_buf */
-					if (!ix_write(ix, nbr_addr, nbr_buf))
-						return INVALID_ADDR;
-				} else {
-					move_left(ix, buf, i, son_buf,
-						nbr_buf);
-					/* update nbr_buf */
-					if (!ix_write(ix, nbr_addr, nbr_buf))
-						return INVALID_ADDR;
-				}
-				assert(CNT(son_buf) > t-1);
-				assert(CNT(nbr_buf) >= t-1);
-			}
-		}
-
-		if (cmpval == 0) { /* the to-be-deleted key is in parent node
-				    * and therefore must be replaced; but before
-				    * replacing delete() must step down to the
-				    * next level */
-			blkaddr_t tuple_addr;
-
-			tuple_addr = delete(ix, son_addr, son_buf, key);
-			if (tuple_addr == INVALID_ADDR)
-				return INVALID_ADDR;
-			KEYCPY(ix, KEY(ix, buf, i),
-					KEY(ix, son_buf, CNT(son_buf)-1));
-			if (!ix_write(ix, addr, buf))
-				return INVALID_ADDR;
-			return tuple_addr;
-		} else { /* because the to-be-deleted key is not in the parent
-			  * node, we don't need to update the parent after
-			  * delete()ing in the next level; thus we can achieve
-			  * end-recursion by firstly writing the parent and
-			  * delete()ing thereafter */
-			if (!ix_write(ix, addr, buf))
-				return INVALID_ADDR;
-			return delete(ix, son_addr, son_buf, key);
-		}
+		tuple_addr = delete(ix, son_addr, son_buf, key);
+		if (tuple_addr == INVALID_ADDR
+				|| !rebalance(ix, addr, buf, i, son_addr,
+					son_buf))
+			return INVALID_ADDR;
+		return tuple_addr;
 	}
 }
 
@@ -1014,8 +2482,10 @@ blkaddr_t ix_delete(struct index *ix, const char *key)
 	tuple_addr = delete(ix, ix->ix_root, ix->ix_buf, key);
 
 	if (TYPE(ix->ix_buf) == INNER && CNT(ix->ix_buf) == 1) { /* kick root */
-		free_blk(ix, ix->ix_root);
+		blkaddr_t old_root_addr = ix->ix_root;
+
 		ix->ix_root = PTR(ix, ix->ix_buf, 0);
+		free_blk(ix, old_root_addr);
 	}
 
 	return tuple_addr;
@@ -1034,22 +2504,38 @@ static void print_node(struct index *ix, blkaddr_t addr, FILE *fp)
 {
 	short i, j;
 	char buf[ix->ix_blksize]; /* need own buffer because of recursivity */
+	char key[ix->ix_size];
 
 	if (addr > ix->ix_max)
-		printf("addr out of range: %d\n", addr);
+		printf("addr out of range: %" PRId64 "\n", addr);
 	assert(addr != INVALID_ADDR);
 	assert(addr <= ix->ix_max);
 
 	assert(ix_read(ix, addr, buf));
 	indent();
-	fprintf(fp, "node %d (left: %d | right: %d) {\n", addr,
-			LNBR(buf), RNBR(buf));
+	fprintf(fp, "node %" PRId64 " (left: %" PRId64 " | right: %" PRId64
+			") {\n", addr, LNBR(buf), RNBR(buf));
 	indent_lvl += 4;
-	for (i = 0; i < CNT(buf); i++) {
+	if (POSTINGS(ix, TYPE(buf))) {
+		struct ix_entries *e = en_init();
+		size_t k;
+
+		en_unpack(ix, e, buf);
+		for (k = 0; k < e->en_cnt; k++) {
+			indent();
+			fprintf(fp, "ptr[%u]=%" PRId64 "\n", (unsigned int)k,
+					e->en_ptrs[k]);
+			indent();
+			fprintf(fp, "key[%u]=%d\n", (unsigned int)k,
+					*(int *)EN_KEY(ix, e, k));
+		}
+		en_free(e);
+	}
+	for (i = 0; i < CNT(buf) && !POSTINGS(ix, TYPE(buf)); i++) {
 		indent();
-		fprintf(fp, "ptr[%d]=%d\n", i, PTR(ix,buf,i));
+		fprintf(fp, "ptr[%d]=%" PRId64 "\n", i, PTR(ix,buf,i));
 		indent();
-		fprintf(fp, "key[%d]=%d\n", i, *(int *)KEY(ix,buf,i));
+		fprintf(fp, "key[%d]=%d\n", i, *(int *)get_key(ix,buf,i,key));
 		if (TYPE(buf) != LEAF)
 			print_node(ix, PTR(ix,buf,i), fp);
 	}
@@ -1069,10 +2555,9 @@ void ix_print(struct index *ix, const char *fn)
 
 	assert(fp != NULL);
 
-	fprintf(fp, "ix->ix_root = %d\n", ix->ix_root);
+	fprintf(fp, "ix->ix_root = %" PRId64 "\n", ix->ix_root);
 	fprintf(fp, "ix->ix_size = %u\n", (unsigned int)ix->ix_size);
 	fprintf(fp, "ix->ix_blksize = %u\n", (unsigned int)ix->ix_blksize);
-	fprintf(fp, "ix->ix_order = %d\n", ix->ix_order);
 
 	print_node(ix, ix->ix_root, fp);
 	fprintf(fp, "\n\n---------------------------\n\n");
@@ -1083,14 +2568,21 @@ void draw(struct index *ix, blkaddr_t addr, FILE *fp)
 	char str[4096];
 	char *ptr = str;
 	char buf[ix->ix_blksize];
+	char key[ix->ix_size];
 	short i;
 
 	if (!ix_read(ix, addr, buf))
 		return;
-	sprintf(str, "%d: ", addr);
+	sprintf(str, "%" PRId64 ": ", addr);
 	ptr += strlen(str);
 	for (i = 0; i < CNT(buf); i++) {
-		char *s = KEY(ix, buf, i);
+		char *s = key;
+
+		/* leaves with posting lists show the first key of each group */
+		if (POSTINGS(ix, TYPE(buf)))
+			post_first(ix, buf, i, key);
+		else
+			get_key(ix, buf, i, key);
 		strcpy(ptr, s);
 		ptr += strlen(s);
 		if (i+1 < CNT(buf)) {
@@ -1099,11 +2591,12 @@ void draw(struct index *ix, blkaddr_t addr, FILE *fp)
 		}
 	}
 
-	fprintf(fp, "%d[label=\"%s\"]\n", addr, str);
+	fprintf(fp, "%" PRId64 "[label=\"%s\"]\n", addr, str);
 	if (TYPE(buf) != LEAF) {
 		for (i = 0; i < CNT(buf); i++) {
 			draw(ix, PTR(ix, buf, i), fp);
-			fprintf(fp, "%d -> %d\n", addr, PTR(ix, buf, i));
+			fprintf(fp, "%" PRId64 " -> %" PRId64 "\n", addr,
+					PTR(ix, buf, i));
 		}
 	}
 }
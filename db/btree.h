@@ -18,34 +18,53 @@
  * Implementation of B+-Tree for indexing.
  *
  * Some words about the internal implementation: Each node is stored in a 
- * block of memory whose size is a multiple of BLK_SIZE.
+ * block of memory whose size is chosen when the index is created and stored
+ * in the index file's header.
  * A block in RAM is seen as a char pointer of exactly this size. The first 
  * bytes of this buffer are used for general information, i.e. the node's 
- * type (LEAF or INNER node) and the count of sons of the node, which is 
- * floor(ORDER/2) <= cnt <= ORDER. Note, by the way, that ORDER is always 
- * an odd number. The remaining bytes are mainly used for storing keys and
- * addresses, except some trailing bytes for the alignment. A node can save
- * up to ORDER pairs of keys and addresses, where addresses in INNER nodes
- * point to a node in the next level of the tree (blkaddr_t) and addresses
- * in LEAF nodes are a tuple address in the tuple file (blkaddr_t). 
- * In this B+-Tree's terminology, the addresses are called pointers 
- * and accessed with the PTR macro; keys are accessed with the KEY macro. 
- * Each node with count cnt sons, floor(ORDER/2) <= cnt <= ORDER, has cnt 
- * PTR/KEY pairs whose indexes are 0, ..., cnt-1. All entries in the subtree 
- * of the i-th entry are less or equal than the i-th key; and the subtree's 
- * node is the node at i-th pointer address, of course.
+ * type (LEAF or INNER node), the count of its entries, its neighbors on the
+ * same level, the end of its entries and the prefix that all its keys share.
+ * The entries follow the prefix; each is a pointer and the key's suffix,
+ * i.e. the key without the prefix and without trailing zeros, so that the 
+ * entries have variable length. The offsets of the entries are stored in
+ * slots at the end of the block, which grow towards the entries. Pointers in
+ * INNER nodes point to a node in the next level of the tree (blkaddr_t) and 
+ * pointers in LEAF nodes are a tuple address in the tuple file (blkaddr_t).
+ * Each node with cnt entries has cnt PTR/key pairs whose indexes are 0, ...,
+ * cnt-1. All entries in the subtree of the i-th entry are less or equal than
+ * the i-th key and greater than the (i-1)-th key; and the subtree's node is
+ * the node at i-th pointer address, of course. The keys of INNER nodes are
+ * only such upper bounds: a split leaf is separated by the shortest key that
+ * is not less than its greatest key and less than its right neighbor's least
+ * key. Because keys are compressed, the count of entries of a node is not 
+ * fixed: a node is split when an entry does not fit into it and merged with
+ * a neighbor when both fit into one node.
  * This only applies to nodes that are active (i.e. not deleted). Deleted
  * nodes store no information except a pointer to its predecessor in the list 
  * of deleted nodes which is accessed with PREV_DEL (stands for previously 
  * deleted). The address of the latest deleted node is stored in the index 
  * structure's ix_avail field, by default INVALID_ADDR.
  *
+ * Prefixes and separators are bytes of keys, so the keys must compare like
+ * their bytes with memcmp() (see normalize_val() in attr.h); cmpf may only
+ * regard more keys as equal.
+ *
  * Note that this B+-Tree does not allow inserting one key twice. Thus, 
  * each key is unique. This makes this B+-Tree useful for primary indexes.
  * To use it as secondary index, just store the tuple's address to which 
  * the key refers in the key itself, too. (Do not forget to tell your cmpf()
  * function to compare not just keys, but also the tuple addresses.) This is
  * ensures that each key is unique.
+ * Such an index is best created with posting lists: the last bytes of each
+ * key must then be the tuple address big-endian, and the leaves store each
+ * value, i.e. the rest of the key, once with the sorted list of its tuple 
+ * addresses, each as the difference to its predecessor in a variable-length
+ * integer. A value with many tuples thus needs one or two bytes per tuple. 
+ * The slots of such leaves point to these groups instead of single entries;
+ * cmpf may only regard keys with equal values as equal.
+ *
+ * Each written node is logged in the write-ahead log (see wal.h) before, so
+ * that it is redone after a crash.
  *
  * The B+-Tree algorithms are influenced by
  * Cormen et al.. Algorithmen - Eine Einfuehrung. Section 18: B-Baeume,
@@ -59,38 +78,62 @@
 #include "cache.h"
 #include "constants.h"
 
+struct ix_entries;
+
 struct index {
 	char		ix_name[PATH_MAX+1]; /* file name */
 	int		ix_fd;		/* file descriptor */
+	int		ix_logid;	/* file id in the log */
 	int		(*ix_cmpf)(const char *, const char *, size_t);
 	size_t		ix_size;	/* needed size for data */
 	size_t		ix_blksize;	/* real, aligned size (block size) */
-	short		ix_order;	/* the order of the B+-tree */
+	size_t		ix_hdsize;	/* size of the header block */
+	bool		ix_postings;	/* do leaves store posting lists? */
 	char		*ix_buf;	/* node buffer */
+	struct ix_entries *ix_ents;	/* entries of nodes that are rebuilt */
+	struct ix_entries *ix_pieces;	/* nodes into which a node is split */
 	blkaddr_t	ix_root;	/* address of root node */
 	blkaddr_t	ix_max;		/* maximum addressed block in file */
 	blkaddr_t	ix_avail;	/* last deleted node address */
 	struct cache	*ix_cache;	/* IO cache structure */
+	bool		ix_direct;	/* direct I/O? */
+	char		*ix_iobuf;	/* aligned node buffer for direct I/O */
+	char		*ix_map;	/* file mapping (USE_MMAP only) */
+	size_t		ix_mapsize;	/* size of the mapping */
+	off_t		ix_filesize;	/* size of the file */
 };
 
+/* the default fill factor of the nodes written by ix_load() */
+#define IX_LOAD_FILL		0.9
+
+struct ix_load;
+
 struct ix_iter {
 	struct index	*it_ix;		/* parent index structure */
-	short		it_curindex;	/* current index in node */
+	int		it_curindex;	/* current index in node */
 	int		it_curcmpval;	/* result of cmpf(key, KEY(curindex) */
 	char		*it_key;	/* searched key */
 	char		*it_buf;	/* current read node */
+	char		*it_val;	/* key returned by ix_lval(), ix_rval() */
+	struct ix_entries *it_ents;	/* it_buf's entries with posting lists */
 	blkaddr_t	it_origaddr;	/* needed for ix_iterator_reset() */
-	short		it_origindex;	/* needed for ix_iterator_reset() */
+	int		it_origindex;	/* needed for ix_iterator_reset() */
 	int		it_origcmpval;	/* needed for ix_iterator_reset() */
 };
 
 /* Creates a new B+-Tree index.
  * The ix_name argument must be the filename of the B+-Tree. The ix_size 
- * argument must be the size of a key in the B+-Tree. The cmpf argument
+ * argument must be the size of a key in the B+-Tree. The ix_blksize argument
+ * is the node size; if it is 0 or too small for a minimum count of entries of
+ * the largest keys, the smallest node size that fits them is used. If the
+ * ix_postings argument is true, the leaves store posting lists; the last 
+ * sizeof(blkaddr_t) bytes of each key must then be its tuple address 
+ * big-endian. The cmpf argument
  * must point to a function that  compares to keys and returns -1, 0, +1 if
  * the first is smaller, equal, greater than the second key. If cmpf is NULL,
  * memcmp is used as default.  */
 struct index *ix_create(const char *ix_name, size_t ix_size,
+		size_t ix_blksize, bool ix_postings,
 		int (*cmpf)(const char *, const char *, size_t));
 
 /* Opens an existing B+-Tree index.
@@ -101,6 +144,10 @@ struct index *ix_create(const char *ix_name, size_t ix_size,
 struct index *ix_open(const char *ix_name, 
 		int (*cmpf)(const char *, const char *, size_t));
 
+/* Determines whether an index file has an older format, which ix_open() does
+ * not open; such an index must be rebuilt. */
+bool ix_outdated(const char *ix_name);
+
 /* Closes a B+-Tree index and returns to indicate success. Invoking this 
  * function is imported as it saves the current root node address. */
 bool ix_close(struct index *ix);
@@ -167,6 +214,18 @@ const void *ix_rval(const struct ix_iter *iter);
  * probably an disk IO error. */
 bool ix_insert(struct index *ix, blkaddr_t tuple_addr, const char *key);
 
+/* Bulk loading builds an empty B+-tree bottom-up: ix_load_begin() returns 
+ * NULL if the tree is not empty. The entries must be passed to ix_load() in 
+ * ascending order of keys; like ix_insert(), it ignores a key that exists 
+ * already and returns false if the key is smaller than the previous one.
+ * The leaves are written from left to right and each is filled up to `fill'
+ * times the node size (at least the half, at most all); ix_load_end()
+ * builds the inner levels above them, frees `ld' and returns true to 
+ * indicate success. */
+struct ix_load *ix_load_begin(struct index *ix, double fill);
+bool ix_load(struct ix_load *ld, blkaddr_t tuple_addr, const char *key);
+bool ix_load_end(struct ix_load *ld);
+
 /* Deletes an entry that matches key in the B+Tree. The argument key must 
  * point to a memory block which has at least the size of the keys in the 
  * B+-Tree, because exactly this amount of bytes is copied as key into the 
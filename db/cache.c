@@ -14,12 +14,16 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _GNU_SOURCE		/* O_DIRECT */
+
 #include "cache.h"
 #include "mem.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #ifdef CACHE_STATS
@@ -27,44 +31,323 @@
 unsigned long cache_searches = 0;
 unsigned long cache_successful_searches = 0;
 unsigned long cache_pushes = 0;
-unsigned long cache_updates = 0;
+unsigned long cache_writes = 0;
+unsigned long cache_evictions = 0;
+unsigned long cache_flushes = 0;
 #endif
 
-struct cache *cache_init(size_t size, size_t maxcount)
+/* initial count of hash buckets (must be a power of two) */
+#define INIT_BUCKET_CNT		1024
+
+/* the hash bucket of the element (id, addr) */
+#define BUCKET(id, addr)	((((size_t)(id) * 2654435761U)\
+				^ ((size_t)(addr) * 40503U))\
+				& (pool.bucketcnt - 1))
+
+static struct { /* the buffer pool shared by all files */
+	bool initialized;		/* pool size read from environment? */
+	bool direct;			/* use direct I/O? */
+	size_t size;			/* max. size of cached data in bytes */
+	size_t used;			/* current size of cached data */
+	size_t count;			/* current count of elements */
+	size_t bucketcnt;		/* count of hash buckets */
+	struct cache_entry **buckets;	/* hash table of elements */
+	struct cache_entry *first;	/* most recently used element */
+	struct cache_entry *last;	/* least recently used element */
+	int next_id;			/* next unused file id */
+} pool;
+
+size_t parse_size(const char *s)
+{
+	char *end;
+	size_t size;
+
+	size = (size_t)strtoul(s, &end, 10);
+	switch (*end) {
+		case 'g': case 'G':
+			size *= 1024;
+			/* FALLTHROUGH */
+		case 'm': case 'M':
+			size *= 1024;
+			/* FALLTHROUGH */
+		case 'k': case 'K':
+			size *= 1024;
+	}
+	return size;
+}
+
+static void pool_init(void)
+{
+	const char *env;
+
+	if (pool.initialized)
+		return;
+
+	pool.initialized = true;
+	env = getenv(CACHE_POOL_SIZE_ENV);
+	pool.size = (env != NULL) ? parse_size(env) : CACHE_DEFAULT_POOL_SIZE;
+	env = getenv(CACHE_DIRECT_IO_ENV);
+	pool.direct = (env != NULL) && strtoul(env, NULL, 10) != 0;
+}
+
+static void free_entry(struct cache_entry *p)
+{
+	free(p->buf);
+	free(p);
+}
+
+static void rehash(size_t bucketcnt)
+{
+	struct cache_entry *p;
+	size_t i;
+
+	free(pool.buckets);
+	pool.bucketcnt = bucketcnt;
+	pool.buckets = xmalloc(bucketcnt * sizeof(struct cache_entry *));
+	for (i = 0; i < bucketcnt; i++)
+		pool.buckets[i] = NULL;
+	for (p = pool.first; p != NULL; p = p->next) {
+		i = BUCKET(p->cache->id, p->addr);
+		p->hnext = pool.buckets[i];
+		pool.buckets[i] = p;
+	}
+}
+
+static struct cache_entry *lookup(struct cache *cache, blkaddr_t addr)
+{
+	struct cache_entry *p;
+
+	if (pool.count == 0)
+		return NULL;
+
+	for (p = pool.buckets[BUCKET(cache->id, addr)]; p != NULL;
+			p = p->hnext)
+		if (p->addr == addr && p->cache == cache)
+			return p;
+	return NULL;
+}
+
+/* removes an element from the LRU list, its hash bucket and its file list */
+static void unlink_entry(struct cache_entry *p)
+{
+	struct cache_entry **pp;
+
+	if (p->prev != NULL)
+		p->prev->next = p->next;
+	else
+		pool.first = p->next;
+	if (p->next != NULL)
+		p->next->prev = p->prev;
+	else
+		pool.last = p->prev;
+
+	for (pp = &pool.buckets[BUCKET(p->cache->id, p->addr)]; *pp != p;
+			pp = &(*pp)->hnext)
+		assert(*pp != NULL);
+	*pp = p->hnext;
+
+	if (p->fprev != NULL)
+		p->fprev->fnext = p->fnext;
+	else
+		p->cache->entries = p->fnext;
+	if (p->fnext != NULL)
+		p->fnext->fprev = p->fprev;
+
+	pool.used -= p->cache->size;
+	pool.count--;
+	p->cache->count--;
+	if (p->dirty)
+		p->cache->dirtycnt--;
+}
+
+static int addrcmp(const void *p, const void *q)
+{
+	blkaddr_t a = (*(struct cache_entry **)p)->addr;
+	blkaddr_t b = (*(struct cache_entry **)q)->addr;
+
+	return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+/* evicts least recently used elements until `size' further bytes fit into
+ * the pool; returns an evicted element of exactly `size' bytes for reuse
+ * or NULL; stops early if a dirty element cannot be written, which then 
+ * stays in the pool */
+static struct cache_entry *evict(size_t size)
+{
+	struct cache_entry *p, *reusable = NULL;
+
+	while (pool.used + size > pool.size && pool.last != NULL) {
+		p = pool.last;
+		if (p->dirty) {
+			cache_flush(p->cache);
+			if (p->dirty) {
+				if (reusable != NULL)
+					free_entry(reusable);
+				return NULL;
+			}
+		}
+		unlink_entry(p);
+#ifdef CACHE_STATS
+		cache_evictions++;
+#endif
+		if (reusable == NULL && p->cache->size == size)
+			reusable = p;
+		else
+			free_entry(p);
+	}
+	return reusable;
+}
+
+void cache_set_pool_size(size_t size)
+{
+	struct cache_entry *p;
+
+	pool_init();
+	pool.size = size;
+	p = evict(0);
+	assert(p == NULL);
+}
+
+size_t cache_pool_size(void)
+{
+	pool_init();
+	return pool.size;
+}
+
+void cache_set_direct_io(bool direct)
+{
+	pool_init();
+	pool.direct = direct;
+}
+
+size_t cache_io_align(int fd)
+{
+	struct stat st;
+	size_t align = BLK_SIZE;
+
+	if (fstat(fd, &st) == 0)
+		while (align < (size_t)st.st_blksize && align < IO_ALIGN)
+			align *= 2;
+	return align;
+}
+
+bool cache_direct_io(int fd)
+{
+#ifdef O_DIRECT
+	int flags;
+
+	pool_init();
+	if (!pool.direct)
+		return false;
+	if ((flags = fcntl(fd, F_GETFL)) == -1)
+		return false;
+	return fcntl(fd, F_SETFL, flags | O_DIRECT) != -1;
+#else
+	return false;
+#endif
+}
+
+struct cache *cache_init(size_t size, void *ctx, flushf_t flushf)
 {
 	struct cache *cache;
-	unsigned short i;
 
 	assert(size > 0);
 
-	if (maxcount == 0)
-		return NULL;
+	pool_init();
 
 	cache = xmalloc(sizeof(struct cache));
+	cache->id = pool.next_id++;
 	cache->size = size;
-	cache->maxcount = maxcount;
 	cache->count = 0;
-	cache->first = NULL;
-	cache->last = NULL;
-	cache->table = xmalloc(maxcount * sizeof(struct cache_entry));
-	for (i = 0; i < maxcount; i++)
-		cache->table[i].buf = xmalloc(size);
+	cache->dirtycnt = 0;
+	cache->entries = NULL;
+	cache->ctx = ctx;
+	cache->flushf = flushf;
 	return cache;
 }
 
 void cache_free(struct cache *cache)
 {
-	size_t i;
+	struct cache_entry *p;
 
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->count; i++)
-		free(cache->table[i].buf);
-	free(cache->table);
+	while ((p = cache->entries) != NULL) {
+		unlink_entry(p);
+		free_entry(p);
+	}
+	assert(cache->count == 0);
 	free(cache);
 }
 
+bool cache_flush(struct cache *cache)
+{
+	struct cache_entry *p, **dirty;
+	size_t i, j, k, maxcnt, cnt = 0;
+	char *buf;
+	bool retval = true;
+
+	if (cache == NULL || cache->dirtycnt == 0)
+		return true;
+
+#ifdef CACHE_STATS
+	cache_flushes++;
+#endif
+
+	dirty = xmalloc(cache->dirtycnt * sizeof(struct cache_entry *));
+	for (p = cache->entries; p != NULL; p = p->fnext)
+		if (p->dirty)
+			dirty[cnt++] = p;
+	assert(cnt == cache->dirtycnt);
+	qsort(dirty, cnt, sizeof(struct cache_entry *), addrcmp);
+
+	maxcnt = CACHE_MAX_FLUSH_SIZE / cache->size;
+	if (maxcnt == 0)
+		maxcnt = 1;
+	buf = (maxcnt > 1) ? xmemalign(IO_ALIGN, maxcnt * cache->size) : NULL;
+
+	for (i = 0; i < cnt; i = j) {
+		for (j = i+1; j < cnt && j-i < maxcnt
+				&& dirty[j]->addr == dirty[j-1]->addr + 1; j++)
+			;
+		if (j-i == 1) {
+			if (!cache->flushf(cache->ctx, dirty[i]->addr,
+						dirty[i]->buf, 1)) {
+				retval = false;
+				continue;
+			}
+		} else {
+			for (k = i; k < j; k++)
+				memcpy(buf + (k-i) * cache->size, dirty[k]->buf,
+						cache->size);
+			if (!cache->flushf(cache->ctx, dirty[i]->addr, buf,
+						j-i)) {
+				retval = false;
+				continue;
+			}
+		}
+		for (k = i; k < j; k++)
+			dirty[k]->dirty = false;
+		cache->dirtycnt -= j-i;
+	}
+
+	free(buf);
+	free(dirty);
+	return retval;
+}
+
+bool cache_flush_all(void)
+{
+	struct cache_entry *p;
+	bool retval = true;
+
+	for (p = pool.first; p != NULL; p = p->next)
+		if (p->dirty && !cache_flush(p->cache))
+			retval = false;
+	return retval;
+}
+
 bool cache_search(struct cache *cache, blkaddr_t addr, char *buf)
 {
 	struct cache_entry *p;
@@ -79,28 +362,26 @@ bool cache_search(struct cache *cache, blkaddr_t addr, char *buf)
 	cache_searches++;
 #endif
 
-	for (p = cache->first; p != NULL; p = p->next)
-		if (addr == p->addr)
-			break;
+	p = lookup(cache, addr);
 	if (p == NULL)
 		return false;
 
-	if (p != cache->first) {
-		assert(cache->first != NULL);
-		assert(cache->last != NULL);
+	if (p != pool.first) {
+		assert(pool.first != NULL);
+		assert(pool.last != NULL);
 		assert(p->prev != NULL);
 
 		p->prev->next = p->next;
 		if (p->next != NULL)
 			p->next->prev = p->prev;
 	
-		if (p == cache->last)
-			cache->last = p->prev;
+		if (p == pool.last)
+			pool.last = p->prev;
 
 		p->prev = NULL;
-		p->next = cache->first;
-		cache->first->prev = p;
-		cache->first = p;
+		p->next = pool.first;
+		pool.first->prev = p;
+		pool.first = p;
 	}
 	memcpy(buf, p->buf, cache->size);
 #ifdef CACHE_STATS
@@ -109,9 +390,60 @@ bool cache_search(struct cache *cache, blkaddr_t addr, char *buf)
 	return true;
 }
 
+/* adds a new element to the cache, returns it or NULL if it does not fit */
+static struct cache_entry *push(struct cache *cache, blkaddr_t addr,
+		const char *buf)
+{
+	struct cache_entry *p;
+	size_t i;
+
+	if (cache->size > pool.size)
+		return NULL;
+
+	p = evict(cache->size);
+	if (p == NULL && pool.used + cache->size > pool.size)
+		return NULL; /* a dirty element could not be evicted */
+	if (p == NULL) {
+		p = xmalloc(sizeof(struct cache_entry));
+		p->buf = xmemalign(IO_ALIGN, cache->size);
+	}
+
+	if (pool.count >= pool.bucketcnt)
+		rehash(pool.bucketcnt > 0 ? 2 * pool.bucketcnt
+				: INIT_BUCKET_CNT);
+
+	p->cache = cache;
+	p->addr = addr;
+	p->dirty = false;
+	memcpy(p->buf, buf, cache->size);
+
+	p->prev = NULL;
+	p->next = pool.first;
+	if (pool.first != NULL)
+		pool.first->prev = p;
+	else
+		pool.last = p;
+	pool.first = p;
+
+	i = BUCKET(cache->id, addr);
+	p->hnext = pool.buckets[i];
+	pool.buckets[i] = p;
+
+	p->fprev = NULL;
+	p->fnext = cache->entries;
+	if (cache->entries != NULL)
+		cache->entries->fprev = p;
+	cache->entries = p;
+
+	pool.used += cache->size;
+	pool.count++;
+	cache->count++;
+	return p;
+}
+
 void cache_push(struct cache *cache, blkaddr_t addr, const char *buf)
 {
-	struct cache_entry *p = NULL;
+	struct cache_entry *p;
 
 	if (cache == NULL)
 		return;
@@ -123,63 +455,44 @@ void cache_push(struct cache *cache, blkaddr_t addr, const char *buf)
 	assert(addr != INVALID_ADDR);
 	assert(buf != NULL);
 
-	if (cache->count == 0) {
-		assert(cache->first == NULL);
-		assert(cache->last == NULL);
-		p = &cache->table[0];
-		p->prev = NULL;
-		p->next = NULL;
-		cache->first = p;
-		cache->last = p;
-		cache->count++;
-	} else if (cache->count < cache->maxcount) {
-		assert(cache->first != NULL);
-		assert(cache->last != NULL);
-		assert(cache->count == 1 || cache->first != cache->last);
-		p = &cache->table[cache->count];
-		p->prev = NULL;
-		p->next = cache->first;
-		cache->first->prev = p;
-		cache->first = p;
-		cache->count++;
-	} else if (cache->count == cache->maxcount) {
-		assert(cache->first != NULL);
-		assert(cache->last != NULL);
-		assert(cache->first != cache->last);
-		p = cache->last;
-		cache->last = cache->last->prev;
-		cache->last->next = NULL;
-		p->prev = NULL;
-		p->next = cache->first;
-		cache->first->prev = p;
-		cache->first = p;
+	p = lookup(cache, addr);
+	if (p != NULL) {
+		assert(!p->dirty);
+		memcpy(p->buf, buf, cache->size);
+		return;
 	}
-	p->addr = addr;
-	memcpy(p->buf, buf, cache->size);
+	push(cache, addr, buf);
 }
 
-bool cache_update(struct cache *cache, blkaddr_t addr, size_t offset,
+bool cache_write(struct cache *cache, blkaddr_t addr, size_t offset,
 		const char *buf, size_t len)
 {
-	size_t i;
+	struct cache_entry *p;
 
 	if (cache == NULL)
 		return false;
 
 #ifdef CACHE_STATS
-	cache_updates++;
+	cache_writes++;
 #endif
 
 	assert(addr != INVALID_ADDR);
 	assert(buf != NULL);
+	assert(offset + len <= cache->size);
 
-	for (i = 0; i < cache->count; i++) {
-		if (addr == cache->table[i].addr) {
-			memcpy(cache->table[i].buf + offset, buf, len);
-			return true;
-		}
+	p = lookup(cache, addr);
+	if (p != NULL)
+		memcpy(p->buf + offset, buf, len);
+	else if (offset == 0 && len == cache->size)
+		p = push(cache, addr, buf);
+	if (p == NULL)
+		return false;
+
+	if (!p->dirty) {
+		p->dirty = true;
+		cache->dirtycnt++;
 	}
-	return false;
+	return true;
 }
 
 #ifdef CACHE_STATS
@@ -190,7 +503,11 @@ void cache_print_stats(void)
 			cache_successful_searches,
 			(double)cache_successful_searches / cache_searches);
 	printf("Pushes: %lu\n", cache_pushes);
-	printf("Updates: %lu\n", cache_updates);
+	printf("Writes: %lu\n", cache_writes);
+	printf("Flushes: %lu\n", cache_flushes);
+	printf("Evictions: %lu\n", cache_evictions);
+	printf("Pool (used/size): %lu/%lu bytes\n",
+			(unsigned long)pool.used, (unsigned long)pool.size);
 }
 #endif
 
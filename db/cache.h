@@ -15,12 +15,25 @@
  */
 
 /*
- * Least Recently Used (LRU) cache. The implementation is `abstract' in a 
- * sense that it is used by both, io.c (relation tuple file) and btree.c 
- * (B+-Tree implementation) to cache read operations of blocks. Write operations
- * are not cached, i.e. there is no flush-mechanism to write the cache to disk.
- * Nevertheless, write operations must be synchronized with the cache so 
- * that the cached elements are kept up to date.
+ * Shared Least Recently Used (LRU) buffer pool. The implementation is 
+ * `abstract' in a sense that it is used by both, io.c (relation tuple file)
+ * and btree.c (B+-Tree implementation) to cache blocks. 
+ * All open files share one pool whose total size is limited by the pool size
+ * (see cache_set_pool_size()); hot files may thus use the memory that cold 
+ * files leave idle. Each file registers itself with cache_init() and gets a
+ * cache handle with a unique file id. Cached blocks are identified by their
+ * (file id, address) pair and looked up in a hash table.
+ * The cache is a write-back cache: cache_write() only modifies the cached 
+ * block and marks it dirty, so that subsequent writes to the same block are
+ * combined. Dirty blocks are written to disk by the file's flush function 
+ * when they are evicted, when the file is flushed with cache_flush() or when
+ * all files are flushed with cache_flush_all() (at checkpoints of the 
+ * write-ahead log, see wal.h). The flush functions force the log before.
+ * Flushing sorts the dirty blocks by address and writes consecutive blocks
+ * with one call of the flush function.
+ * The pool also determines the I/O mode of the files: with direct I/O, the
+ * files bypass the operating system's cache and the pool is the only cache.
+ * All cached blocks are aligned to IO_ALIGN for this purpose.
  */
 
 #ifndef __CACHE_H__
@@ -30,28 +43,92 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
-struct cache { /* cache structure */
+/* the name of the environment variable that specifies the pool size in bytes
+ * (suffixes K, M and G are allowed) */
+#define CACHE_POOL_SIZE_ENV	"DB_BUFFER_POOL_SIZE"
+
+/* the default size of the buffer pool */
+#define CACHE_DEFAULT_POOL_SIZE	(1024 * 1024 * 16)
+
+/* the name of the environment variable that enables direct I/O (if set to
+ * a non-zero number) */
+#define CACHE_DIRECT_IO_ENV	"DB_DIRECT_IO"
+
+/* the maximum size of data that is written with one call of a flush 
+ * function */
+#define CACHE_MAX_FLUSH_SIZE	(1024 * 256)
+
+/* Writes `cnt' consecutive blocks starting with block `addr' from `buf' to
+ * the file; `ctx' is the pointer given to cache_init(). Returns true to
+ * indicate success. */
+typedef bool (*flushf_t)(void *ctx, blkaddr_t addr, const char *buf,
+		size_t cnt);
+
+struct cache { /* handle of one file in the buffer pool */
+	int id;				/* unique file id */
 	size_t size;			/* size of a cached element */
-	unsigned short maxcount;	/* max. count of elements in cache */
-	unsigned short count;		/* current count of elements in cache */
-	struct cache_entry *table;	/* table of cached elements */
-	struct cache_entry *first;	/* first element in list */
-	struct cache_entry *last;	/* last element in list */
+	size_t count;			/* current count of elements of file */
+	size_t dirtycnt;		/* current count of dirty elements */
+	struct cache_entry *entries;	/* list of the file's elements */
+	void *ctx;			/* context for flushf */
+	flushf_t flushf;		/* writes blocks to the file */
 };
 
-struct cache_entry { /* element in cache table */
+struct cache_entry { /* element in buffer pool */
+	struct cache *cache;		/* file handle of cached element */
 	blkaddr_t addr;			/* address in file of cached element */
+	bool dirty;			/* modified since last flush? */
 	char *buf;			/* data of cached element */
-	struct cache_entry *prev;	/* previous list element or NULL */
-	struct cache_entry *next;	/* next list element or NULL */
+	struct cache_entry *prev;	/* previous LRU list element or NULL */
+	struct cache_entry *next;	/* next LRU list element or NULL */
+	struct cache_entry *hnext;	/* next element in hash bucket or NULL */
+	struct cache_entry *fprev;	/* previous element of file or NULL */
+	struct cache_entry *fnext;	/* next element of file or NULL */
 };
 
-/* Initializes a cache for `count' elements of `size' bytes. */
-struct cache *cache_init(size_t size, size_t count);
+/* Parses a size in bytes; the suffixes K, M and G are allowed. */
+size_t parse_size(const char *s);
+
+/* Sets the maximum size of the buffer pool in bytes. If the pool currently 
+ * uses more memory, the least recently used elements are evicted; dirty 
+ * elements that cannot be written stay in the pool. A size of zero disables
+ * caching. */
+void cache_set_pool_size(size_t size);
+
+/* Returns the maximum size of the buffer pool in bytes. */
+size_t cache_pool_size(void);
 
-/* Frees the memory used by the cache. */
+/* Chooses between direct I/O and buffered I/O for files opened afterwards.
+ * The default is taken from the environment variable DB_DIRECT_IO. */
+void cache_set_direct_io(bool direct);
+
+/* Returns the alignment of the file's blocks needed for direct I/O, i.e. 
+ * the file system's block size, at least BLK_SIZE and at most IO_ALIGN. */
+size_t cache_io_align(int fd);
+
+/* Switches the file to direct I/O if direct I/O is chosen. The caller must 
+ * ensure that all following reads and writes use buffers, positions and 
+ * sizes aligned to cache_io_align(). Returns true if the file uses direct 
+ * I/O now and false if it still uses buffered I/O. */
+bool cache_direct_io(int fd);
+
+/* Registers a file whose elements have `size' bytes at the buffer pool. 
+ * The function `flushf' is used to write dirty elements to the file and is 
+ * invoked with `ctx' as first argument. */
+struct cache *cache_init(size_t size, void *ctx, flushf_t flushf);
+
+/* Evicts all elements of the file from the pool and frees the handle. Dirty
+ * elements are discarded, i.e. call cache_flush() before. */
 void cache_free(struct cache *cache);
 
+/* Writes all dirty elements of the file to disk. Returns true to indicate 
+ * success. */
+bool cache_flush(struct cache *cache);
+
+/* Writes all dirty elements of all files to disk. Returns true to indicate
+ * success. */
+bool cache_flush_all(void);
+
 /* Checks whether `addr' is in the cache; in this case it copies the data into
  * buf and returns true; otherwise returns false. */
 bool cache_search(struct cache *cache, blkaddr_t addr, char *buf);
@@ -59,9 +136,12 @@ bool cache_search(struct cache *cache, blkaddr_t addr, char *buf);
 /* Adds a new element to the cache. */
 void cache_push(struct cache *cache, blkaddr_t addr, const char *buf);
 
-/* Checks whether `addr' is in the cache; in this case it updates the data 
- * at offset `offset' with the data in `buf' with the length `len'. */
-bool cache_update(struct cache *cache, blkaddr_t addr, size_t offset,
+/* Writes `len' bytes of `buf' at offset `offset' of the element `addr' into
+ * the cache and marks the element dirty. If `addr' is not in the cache, it is
+ * added if the complete element is written (i.e. `offset' is 0 and `len' is
+ * the element size). Returns false if the data was not written into the 
+ * cache; in this case the caller must write it to the file itself. */
+bool cache_write(struct cache *cache, blkaddr_t addr, size_t offset,
 		const char *buf, size_t len);
 
 #ifdef CACHE_STATS
@@ -80,21 +80,15 @@ enum operator {
 #include <limits.h>
 #include <sys/stat.h>
 
-#if defined(O_NOATIME) && defined(O_DIRECT)
-	#define OPEN_RD_FLAGS	(O_RDWR | O_DIRECT | O_NOATIME)
-#elif !defined(O_NOATIME) && defined(O_DIRECT)
-	#define OPEN_RD_FLAGS	(O_RDWR | O_DIRECT)
-#elif defined(O_NOATIME) && !defined(O_DIRECT)
+/* files are opened for buffered I/O; direct I/O is enabled after opening 
+ * (see cache_direct_io()) */
+#if defined(O_NOATIME)
 	#define OPEN_RD_FLAGS	(O_RDWR | O_NOATIME)
 #else 
 	#define OPEN_RD_FLAGS	(O_RDWR)
 #endif
 
-#if defined(O_NOATIME) && defined(O_DIRECT)
-	#define OPEN_RW_FLAGS	(O_RDWR | O_DIRECT | O_NOATIME)
-#elif !defined(O_NOATIME) && defined(O_DIRECT)
-	#define OPEN_RW_FLAGS	(O_RDWR | O_DIRECT)
-#elif defined(O_NOATIME) && !defined(O_DIRECT)
+#if defined(O_NOATIME)
 	#define OPEN_RW_FLAGS	(O_RDWR | O_NOATIME)
 #else 
 	#define OPEN_RW_FLAGS	(O_RDWR)
@@ -109,6 +103,9 @@ enum operator {
 
 #define FILE_MODE		(S_IRUSR | S_IWUSR)
 
+#define MAP_EXTENT_SIZE		(1024 * 1024 * 16)	/* min. growth of file 
+							 * mappings (USE_MMAP) */
+
 #ifndef PATH_MAX
 #define PATH_MAX	4096
 #endif
@@ -127,6 +124,9 @@ enum operator {
 #define SP_BASEDIR	DB_BASEDIR
 #define SP_SUFFIX	".sp"
 
+#define WAL_BASEDIR	DB_BASEDIR
+#define WAL_FILENAME	"db.wal"
+
 
 /* I have no clue why, but cygwin library does not define them */
 #ifdef _WIN32
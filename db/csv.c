@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2006, 2007 Christoph Schwering <schwering@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "csv.h"
+#include "constants.h"
+#include "io.h"
+#include "str.h"
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the minimum size of the field buffer; it holds any number */
+#define FIELD_MIN	64
+
+/* reads a field of at most size-1 characters into buf and sets *endp to the
+ * character that terminated it (a comma, a line break or EOF); longer fields
+ * are cut; returns false if a quote is not closed */
+static bool read_field(FILE *fp, char *buf, size_t size, size_t *lenp,
+		int *endp)
+{
+	size_t len;
+	bool quoted;
+	int c;
+
+	len = 0;
+	quoted = false;
+	c = getc(fp);
+	if (c == '"') {
+		quoted = true;
+		c = getc(fp);
+	}
+	for (;; c = getc(fp)) {
+		if (quoted) {
+			if (c == EOF)
+				return false;
+			if (c == '"' && (c = getc(fp)) != '"') {
+				/* the closing quote; c is the next character */
+				quoted = false;
+				ungetc(c, fp);
+				continue;
+			}
+		} else if (c == ',' || c == '\n' || c == EOF)
+			break;
+		else if (c == '\r')
+			continue;
+		if (len + 1 < size)
+			buf[len++] = (char)c;
+	}
+	buf[len] = '\0';
+	*lenp = len;
+	*endp = c;
+	return true;
+}
+
+/* converts a field into the value of `attr' in `tuple' */
+static bool set_field(char *tuple, const struct sattr *attr, const char *buf,
+		size_t len)
+{
+	char *dest, *end;
+	long l;
+	unsigned long ul;
+	db_int_t vint;
+	db_uint_t vuint;
+	db_float_t vfloat;
+	db_double_t vdouble;
+
+	dest = tuple + attr->at_offset;
+	errno = 0;
+	end = NULL;
+	switch (attr->at_domain) {
+		case INT:
+			l = strtol(buf, &end, 10);
+			if (l < INT_MIN || l > INT_MAX)
+				return false;
+			vint = (db_int_t)l;
+			memcpy(dest, &vint, sizeof(db_int_t));
+			break;
+		case UINT:
+			ul = strtoul(buf, &end, 10);
+			if (ul > UINT_MAX)
+				return false;
+			vuint = (db_uint_t)ul;
+			memcpy(dest, &vuint, sizeof(db_uint_t));
+			break;
+		case LONG:
+			l = strtol(buf, &end, 10);
+			memcpy(dest, &l, sizeof(db_long_t));
+			break;
+		case ULONG:
+			ul = strtoul(buf, &end, 10);
+			memcpy(dest, &ul, sizeof(db_ulong_t));
+			break;
+		case FLOAT:
+			vfloat = strtof(buf, &end);
+			memcpy(dest, &vfloat, sizeof(db_float_t));
+			break;
+		case DOUBLE:
+			vdouble = strtod(buf, &end);
+			memcpy(dest, &vdouble, sizeof(db_double_t));
+			break;
+		case STRING:
+			strntermcpy(dest, buf, attr->at_size);
+			return true;
+		case BYTES:
+			if (len > attr->at_size)
+				len = attr->at_size;
+			memcpy(dest, buf, len);
+			memset(dest + len, 0, attr->at_size - len);
+			return true;
+		default:
+			assert(false);
+			return false;
+	}
+
+	/* a number must be the complete field */
+	if (end == buf || errno != 0)
+		return false;
+	while (isspace((unsigned char)*end))
+		end++;
+	return *end == '\0';
+}
+
+enum csv_result csv_read_tuple(FILE *fp, const struct srel *rl, char *tuple)
+{
+	size_t size, len;
+	int i, c, end;
+
+	assert(fp != NULL);
+	assert(rl != NULL);
+	assert(tuple != NULL);
+
+	while ((c = getc(fp)) == '\n' || c == '\r')
+		;
+	if (c == EOF)
+		return CSV_EOF;
+	ungetc(c, fp);
+
+	size = FIELD_MIN;
+	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
+		if (rl->rl_header.hd_attrs[i].at_size + 1 > size)
+			size = rl->rl_header.hd_attrs[i].at_size + 1;
+
+	{
+		char buf[size];
+
+		for (i = 0; i < rl->rl_header.hd_atcnt; i++) {
+			if (!read_field(fp, buf, size, &len, &end)
+					|| !set_field(tuple,
+						&rl->rl_header.hd_attrs[i],
+						buf, len)
+					|| (i+1 < rl->rl_header.hd_atcnt)
+						!= (end == ','))
+				return CSV_INVALID;
+		}
+	}
+	return CSV_TUPLE;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2006, 2007 Christoph Schwering <schwering@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Reading of tuples from files with comma-separated values (CSV), which is 
+ * used by the COPY statement (see dml_copy()).
+ * Each line of such a file is a tuple whose fields are the values of the 
+ * relation's attributes in the order of the attributes and are separated by
+ * commas. A field may be enclosed in double quotes; then it may contain 
+ * commas, line breaks and double quotes, which are written twice. Empty lines
+ * and carriage returns are ignored.
+ * Numbers are written like in C. STRING and BYTES fields are copied as they
+ * are; fields longer than the attribute are cut like the values of INSERT.
+ */
+
+#ifndef __CSV_H__
+#define __CSV_H__
+
+#include "io.h"
+#include <stdio.h>
+
+enum csv_result {
+	CSV_TUPLE,	/* a tuple was read */
+	CSV_EOF,	/* end of file */
+	CSV_INVALID	/* the line is no valid tuple of the relation */
+};
+
+/* Reads the next line of `fp' into `tuple', which must have room for 
+ * RL_TPDATA_SIZE() bytes. */
+enum csv_result csv_read_tuple(FILE *fp, const struct srel *rl, char *tuple);
+
+#endif
+
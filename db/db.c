@@ -1,13 +1,18 @@
 #include "db.h"
+#include "attr.h"
 #include "block.h"
+#include "cache.h"
 #include "constants.h"
 #include "ddl.h"
 #include "dml.h"
+#include "err.h"
 #include "mem.h"
 #include "parser.h"
 #include "printer.h"
 #include "rlalg.h"
 #include "rlmngt.h"
+#include "str.h"
+#include "wal.h"
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -35,6 +40,8 @@
 #define RL(i)		((struct xrel *)(i).rl)
 /* returns the xrel_iter structure of a DB_ITERATOR */
 #define ITER(i)		((struct xrel_iter *)(i).iter)
+/* returns the xrel_batch structure of a DB_ITERATOR */
+#define BATCH(i)	((struct xrel_batch *)(i).batch)
 
 /* from parser.y */
 extern struct stmt_result *dql_parse(const char *stmt);
@@ -430,6 +437,7 @@ DB_ITERATOR db_iterator(DB_RESULT result)
 		iter.result.ptr = NULL;
 		iter.rl = NULL;
 		iter.iter = NULL;
+		iter.batch = NULL;
 		iter.val_buf =  NULL;
 		return iter;
 	}
@@ -438,6 +446,9 @@ DB_ITERATOR db_iterator(DB_RESULT result)
 	rl = R(result)->val.rl;
 	iter.rl = rl;
 	iter.iter = rl->rl_iterator(rl);
+	iter.batch = xmalloc(sizeof(struct xrel_batch));
+	BATCH(iter)->bt_selcnt = 0;
+	BATCH(iter)->bt_pos = 0;
 	iter.val_buf = xmalloc(sizeof(struct db_val) * rl->rl_atcnt);
 	return iter;
 }
@@ -446,12 +457,21 @@ void db_free_iterator(DB_ITERATOR iter)
 {
 	if (iter.val_buf != NULL) 
 		free(iter.val_buf);
+	if (iter.batch != NULL)
+		free(iter.batch);
 	xrel_iter_free(ITER(iter));
 }
 
 const char *db_next_buf(DB_ITERATOR iter)
 {
-	return ITER(iter)->it_next(ITER(iter));
+	struct xrel_batch *batch;
+
+	/* the tuples are read in batches and handed out one by one */
+	batch = BATCH(iter);
+	if (batch->bt_pos == batch->bt_selcnt
+			&& xrel_next_batch(ITER(iter), batch) == 0)
+		return NULL;
+	return batch->bt_tuples[batch->bt_sel[batch->bt_pos++]];
 }
 
 struct db_val *db_next(DB_ITERATOR iter)
@@ -663,9 +683,161 @@ int db_iterate(DB_RESULT result, void *ctx,
 		return -1;
 }
 
+/* stores a value in its attribute of a tuple; returns false if the domains 
+ * differ */
+static bool set_value(char *tuple, const struct sattr *attr,
+		const struct db_val *val)
+{
+	char *dest;
+
+	dest = tuple + attr->at_offset;
+	switch (attr->at_domain) {
+		case STRING:
+			if (val->domain != DB_STRING)
+				return false;
+			strntermcpy(dest, val->val.pstring, attr->at_size);
+			return true;
+		case BYTES:
+			if (val->domain != DB_BYTES)
+				return false;
+			memcpy(dest, val->val.pbytes, attr->at_size);
+			return true;
+		case INT:
+			if (val->domain != DB_INT)
+				return false;
+			memcpy(dest, &val->val.vint, sizeof(db_int_t));
+			return true;
+		case UINT:
+			if (val->domain != DB_UINT)
+				return false;
+			memcpy(dest, &val->val.vuint, sizeof(db_uint_t));
+			return true;
+		case LONG:
+			if (val->domain != DB_LONG)
+				return false;
+			memcpy(dest, &val->val.vlong, sizeof(db_long_t));
+			return true;
+		case ULONG:
+			if (val->domain != DB_ULONG)
+				return false;
+			memcpy(dest, &val->val.vulong, sizeof(db_ulong_t));
+			return true;
+		case FLOAT:
+			if (val->domain != DB_FLOAT)
+				return false;
+			memcpy(dest, &val->val.vfloat, sizeof(db_float_t));
+			return true;
+		case DOUBLE:
+			if (val->domain != DB_DOUBLE)
+				return false;
+			memcpy(dest, &val->val.vdouble, sizeof(db_double_t));
+			return true;
+		default:
+			assert(false);
+			return false;
+	}
+}
+
+unsigned long db_bulk_insert(const char *table, unsigned short cnt,
+		const struct db_val *vals, unsigned long rowcnt)
+{
+	struct srel *rl;
+	struct sattr *attrs[ATTR_MAX];
+	struct deferred_ixs *dx;
+	char *tuples;
+	unsigned long i, j, n, max, inserted;
+	size_t kept;
+	int k, l;
+
+	if ((rl = open_relation(table)) == NULL) {
+		ERR(E_OPEN_RELATION_FAILED);
+		return 0;
+	}
+
+	/* the values of each tuple name all attributes once */
+	if (cnt != rl->rl_header.hd_atcnt) {
+		ERR(E_ATTRIBUTE_NOT_INITIALIZED);
+		return 0;
+	}
+	for (k = 0; k < cnt; k++) {
+		attrs[k] = (vals[k].name != NULL)
+			? sattr_by_srl_and_attr_name(rl, (char *)vals[k].name)
+			: NULL;
+		if (attrs[k] == NULL) {
+			ERR(E_ATTRIBUTE_NOT_FOUND);
+			return 0;
+		}
+		for (l = 0; l < k; l++) {
+			if (attrs[l] == attrs[k]) {
+				ERR(E_ATTRIBUTE_NOT_INITIALIZED);
+				return 0;
+			}
+		}
+	}
+
+	max = BULK_BATCH_SIZE / RL_TPDATA_SIZE(rl);
+	if (max == 0)
+		max = 1;
+	if (max > rowcnt)
+		max = rowcnt;
+
+	/* more than one batch is a bulk insertion, i.e. the indexes are 
+	 * brought up to date at its end */
+	dx = NULL;
+	if (rowcnt > max && (dx = bulk_insert_begin(rl)) == NULL)
+		return 0;
+
+	tuples = xmalloc(max * RL_TPDATA_SIZE(rl));
+	inserted = 0;
+	for (i = 0; i < rowcnt; i += n) {
+		n = (rowcnt - i < max) ? rowcnt - i : max;
+		for (j = 0; j < n; j++) {
+			for (k = 0; k < cnt; k++) {
+				if (!set_value(tuples + j * RL_TPDATA_SIZE(rl),
+							attrs[k],
+							&vals[(i+j) * cnt + k])) {
+					ERR(E_DIFFERENT_TYPES);
+					goto end;
+				}
+			}
+		}
+		if (!bulk_insert_into_relation(rl, dx, tuples, n))
+			break;
+		/* the batch is applied even if its commit fails */
+		inserted += n;
+		if (!wal_commit())
+			break;
+	}
+end:
+	free(tuples);
+	if (dx != NULL) {
+		/* a duplicate primary key cuts off the batches from there */
+		bulk_insert_end(rl, dx, &kept);
+		wal_commit();
+		inserted = kept;
+	}
+	return inserted;
+}
+
+void db_set_buffer_pool_size(size_t size)
+{
+	cache_set_pool_size(size);
+}
+
+void db_set_direct_io(bool direct)
+{
+	cache_set_direct_io(direct);
+}
+
+void db_set_group_commit(unsigned int cnt)
+{
+	wal_set_group_commit(cnt);
+}
+
 void db_cleanup(void)
 {
 	dql_cleanup();
 	close_relations();
+	wal_close();
 }
 
@@ -57,6 +57,7 @@ typedef struct {
 	DB_RESULT result;
 	void *rl;			/* struct xrel */
 	void *iter;			/* struct xrel_iter */
+	void *batch;			/* struct xrel_batch */
 	struct db_val *val_buf;
 } DB_ITERATOR;
 
@@ -216,6 +217,45 @@ int db_iterate(DB_RESULT result, void *ctx,
 		void (*func)(void *ctx, unsigned short cnt,
 			const struct db_val *vals));
 
+/* Inserts `rowcnt' tuples into a table at once, like the COPY statement: the
+ * tuples are appended in large batches and the table's indexes are updated 
+ * once at the end. `vals' holds `cnt' values per tuple, first those of the
+ * first tuple, then those of the second and so on. The values of a tuple 
+ * must specify all attributes of the table by their `name'; the attributes 
+ * must be in the same order in each tuple. The `domain' of a value must be 
+ * the attribute's domain, `relation' and `size' are ignored.
+ * Each batch is committed on its own, i.e. the batches before an error stay 
+ * inserted. Returns the count of inserted tuples, which is less than 
+ * `rowcnt' if an error occured; the batch that failed is not inserted then, 
+ * unless only its commit failed: such a batch is counted, because it is 
+ * applied, but a crash may lose it. A tuple with the primary key of a tuple 
+ * of an earlier batch is found at the end; its batch and the following ones
+ * are deleted again. */
+unsigned long db_bulk_insert(const char *table, unsigned short cnt,
+		const struct db_val *vals, unsigned long rowcnt);
+
+/* Sets the size in bytes of the buffer pool that caches the blocks of all
+ * relation and index files. The default size is taken from the environment 
+ * variable DB_BUFFER_POOL_SIZE (e.g. `256M'), or 16 MB if it is not set.
+ * A size of zero disables the cache. */
+void db_set_buffer_pool_size(size_t size);
+
+/* Chooses direct I/O (true) or buffered I/O (false) for relation and index 
+ * files opened afterwards. With direct I/O, the files bypass the operating 
+ * system's cache and only the buffer pool caches their blocks. The default
+ * is taken from the environment variable DB_DIRECT_IO (e.g. `1'), or 
+ * buffered I/O if it is not set. Files whose layout is not aligned to the 
+ * file system's block size always use buffered I/O. */
+void db_set_direct_io(bool direct);
+
+/* Sets the count of modifying statements after which the write-ahead log is
+ * synced to disk (group commit). A crash of the system may lose the
+ * statements since the last sync, but never leaves the files inconsistent.
+ * The default is taken from the environment variable DB_GROUP_COMMIT (e.g.
+ * `1'), or 16 if it is not set. A count of 0 or 1 syncs the log after each
+ * statement. */
+void db_set_group_commit(unsigned int cnt);
+
 /* Closes all opened relations and frees all allocated memory.
  * Do not invoke this function as long as any result of a db_*() function is in
  * use.
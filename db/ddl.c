@@ -15,6 +15,7 @@
  */
 
 #include "ddl.h"
+#include "block.h"
 #include "constants.h"
 #include "err.h"
 #include "fgnkey.h"
@@ -52,6 +53,8 @@ bool ddl_exec(struct ddl_stmt *stmt)
 			return ddl_create_index(stmt->ptr.crt_ix);
 		case DROP_INDEX:
 			return ddl_drop_index(stmt->ptr.drp_ix);
+		case VACUUM_TABLE:
+			return ddl_vacuum_table(stmt->ptr.vac_tbl);
 		default:
 			return false;
 	}
@@ -71,6 +74,11 @@ bool ddl_create_table(struct crt_tbl *crt_tbl)
 	assert(crt_tbl->cnt <= ATTR_MAX);
 	assert(crt_tbl->attr_dcls != NULL);
 
+	if (crt_tbl->pgsize != 0 && !PG_SIZE_VALID(crt_tbl->pgsize)) {
+		ERR(E_INVALID_PAGE_SIZE);
+		return false;
+	}
+
 	for (i = 0, atsize_sum = 0; i < crt_tbl->cnt; i++) {
 		struct attr_dcl *dcl;
 
@@ -84,7 +92,8 @@ bool ddl_create_table(struct crt_tbl *crt_tbl)
 		atsize_sum += sattrs[i].at_size;
 	}
 
-	rl = create_relation(crt_tbl->tbl_name, sattrs, crt_tbl->cnt);
+	rl = create_relation(crt_tbl->tbl_name, sattrs, crt_tbl->cnt,
+			crt_tbl->pgsize);
 
 	if (rl == NULL)
 		return false;
@@ -146,40 +155,65 @@ bool ddl_drop_view(struct drp_view *drp_view)
 		return true;
 }
 
+/* looks up the `cnt' attributes named `names' of `rl' */
+static bool sattrs_by_names(struct srel *rl, char **names, int cnt,
+		struct sattr *attrs[])
+{
+	int i, j;
+
+	for (i = 0; i < cnt; i++) {
+		attrs[i] = NULL;
+		for (j = 0; j < rl->rl_header.hd_atcnt; j++)
+			if (!strcmp(rl->rl_header.hd_attrs[j].at_name,
+						names[i]))
+				attrs[i] = &rl->rl_header.hd_attrs[j];
+		if (attrs[i] == NULL)
+			return false;
+	}
+	return true;
+}
+
 bool ddl_create_index(struct crt_ix *crt_ix)
 {
 	struct srel *rl;
-	struct sattr *sattr;
-	int i;
+	struct sattr *sattrs[IX_ATTR_MAX];
 
 	assert(crt_ix != NULL);
 	assert(crt_ix->tbl_name != NULL);
-	assert(crt_ix->attr_name != NULL);
+	assert(crt_ix->attr_names != NULL);
+	assert(crt_ix->cnt > 0 && crt_ix->cnt <= IX_ATTR_MAX);
+
+	if (crt_ix->pgsize != 0 && !PG_SIZE_VALID(crt_ix->pgsize)) {
+		ERR(E_INVALID_PAGE_SIZE);
+		return false;
+	}
 
 	rl = open_relation(crt_ix->tbl_name);
 	if (rl == NULL)
 		return false;
 
-	sattr = NULL;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
-		if (!strcmp(rl->rl_header.hd_attrs[i].at_name,
-					crt_ix->attr_name))
-			sattr = &rl->rl_header.hd_attrs[i];
-	if (sattr == NULL)
+	if (!sattrs_by_names(rl, crt_ix->attr_names, crt_ix->cnt, sattrs))
 		return false;
 
-	return create_index(rl, sattr, SECONDARY) != NULL;
+	if (crt_ix->cnt == 1)
+		return create_index(rl, sattrs[0], SECONDARY, crt_ix->pgsize)
+			!= NULL;
+	else
+		return create_composite_index(rl, sattrs, crt_ix->cnt,
+				crt_ix->pgsize) != NULL;
 }
 
 bool ddl_drop_index(struct drp_ix *drp_ix)
 {
 	struct srel *rl;
-	struct sattr *sattr;
-	int i;
+	struct sattr *sattrs[IX_ATTR_MAX];
+	struct sindex *six;
+	bool retval;
 
 	assert(drp_ix != NULL);
 	assert(drp_ix->tbl_name != NULL);
-	assert(drp_ix->attr_name != NULL);
+	assert(drp_ix->attr_names != NULL);
+	assert(drp_ix->cnt > 0 && drp_ix->cnt <= IX_ATTR_MAX);
 
 	rl = open_relation(drp_ix->tbl_name);
 	if (rl == NULL) {
@@ -187,20 +221,28 @@ bool ddl_drop_index(struct drp_ix *drp_ix)
 		return false;
 	}
 
-	sattr = NULL;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
-		if (!strcmp(rl->rl_header.hd_attrs[i].at_name,
-					drp_ix->attr_name))
-			sattr = &rl->rl_header.hd_attrs[i];
-	if (sattr == NULL) {
+	if (!sattrs_by_names(rl, drp_ix->attr_names, drp_ix->cnt, sattrs)) {
 		ERR(E_ATTRIBUTE_NOT_FOUND);
 		return false;
 	}
 
-	if (!drop_index(rl, sattr)) {
+	if (drp_ix->cnt == 1)
+		retval = drop_index(rl, sattrs[0]);
+	else if ((six = composite_index(rl, sattrs, drp_ix->cnt)) != NULL)
+		retval = drop_composite_index(rl, six);
+	else
+		retval = false;
+	if (!retval) {
 		ERR(E_UNLINK_INDEX_FAILED);
 		return false;
 	} else
 		return true;
 }
 
+bool ddl_vacuum_table(struct vac_tbl *vac_tbl)
+{
+	assert(vac_tbl != NULL);
+	assert(vac_tbl->tbl_name != NULL);
+
+	return vacuum_relation(vac_tbl->tbl_name, vac_tbl->attr_name);
+}
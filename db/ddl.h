@@ -51,7 +51,8 @@ enum ddl_type {
 	CREATE_VIEW,
 	DROP_VIEW,
 	CREATE_INDEX,
-	DROP_INDEX
+	DROP_INDEX,
+	VACUUM_TABLE
 };
 
 struct ddl_stmt {
@@ -63,6 +64,7 @@ struct ddl_stmt {
 		struct drp_view *drp_view;
 		struct crt_ix *crt_ix;
 		struct drp_ix *drp_ix;
+		struct vac_tbl *vac_tbl;
 	} ptr;
 };
 
@@ -83,6 +85,7 @@ struct crt_tbl {
 	char *tbl_name;
 	struct attr_dcl **attr_dcls;
 	int cnt;
+	size_t pgsize; /* 0 means default */
 };
 
 struct drp_tbl {
@@ -100,12 +103,20 @@ struct drp_view {
 
 struct crt_ix {
 	char *tbl_name;
-	char *attr_name;
+	char **attr_names; /* more than one for a composite index */
+	int cnt;
+	size_t pgsize; /* 0 means default */
 };
 
 struct drp_ix {
 	char *tbl_name;
-	char *attr_name;
+	char **attr_names;
+	int cnt;
+};
+
+struct vac_tbl {
+	char *tbl_name;
+	char *attr_name; /* NULL means no clustering */
 };
 
 bool ddl_exec(struct ddl_stmt *stmt);
@@ -115,6 +126,7 @@ bool ddl_create_view(struct crt_view *crt_view);
 bool ddl_drop_view(struct drp_view *drp_view);
 bool ddl_create_index(struct crt_ix *crt_ix);
 bool ddl_drop_index(struct drp_ix *drp_ix);
+bool ddl_vacuum_table(struct vac_tbl *vac_tbl);
 
 void ddl_stmt_free(struct ddl_stmt *ptr);
 void crt_tbl_free(struct crt_tbl *ptr);
@@ -123,6 +135,7 @@ void crt_view_free(struct crt_view *ptr);
 void drp_view_free(struct drp_view *ptr);
 void crt_ix_free(struct crt_ix *ptr);
 void drp_ix_free(struct drp_ix *ptr);
+void vac_tbl_free(struct vac_tbl *ptr);
 
 #endif
 
@@ -18,6 +18,7 @@
 #include "block.h"
 #include "attr.h"
 #include "constants.h"
+#include "csv.h"
 #include "db.h"
 #include "err.h"
 #include "expr.h"
@@ -29,6 +30,7 @@
 #include "sp.h"
 #include "verif.h"
 #include "view.h"
+#include "wal.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -173,6 +175,19 @@ static struct xattr **attrs_to_xattrs(struct attr **attrs, int cnt,
 	return xattrs;
 }
 
+/* Joins by index nested loops or full scan unless a hash join or a merge 
+ * join is better. */
+static struct xrel *best_join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **xexprs, int cnt)
+{
+	if (hash_join_suitable(r, s, xexprs, cnt))
+		return hash_join_init(r, s, xexprs, cnt);
+	else if (merge_join_suitable(r, s, xexprs, cnt))
+		return merge_join_init(r, s, xexprs, cnt);
+	else
+		return join_init(r, s, xexprs, cnt);
+}
+
 struct xrel *dml_query(struct dml_query *query)
 {
 	assert(query != NULL);
@@ -258,6 +273,8 @@ bool dml_modi(struct dml_modi *modi, tpcnt_t *cnt_ptr)
 			return dml_delete(modi->ptr.deletion, cnt_ptr);
 		case UPDATE:
 			return dml_update(modi->ptr.update, cnt_ptr);
+		case COPY:
+			return dml_copy(modi->ptr.copy, cnt_ptr);
 		default:
 			return false;
 	}
@@ -421,7 +438,7 @@ struct xrel *dml_join(struct join *join)
 			for (cnt = 0; dnf[i][cnt] != NULL; cnt++)
 				;
 			xexprs = exprs_to_xexprs(dnf[i], cnt, rls[0], rls[1]);
-			join_rl = join_init(rls[0], rls[1], xexprs, cnt);
+			join_rl = best_join_init(rls[0], rls[1], xexprs, cnt);
 			if (result == NULL)
 				result = join_rl;
 			else
@@ -479,7 +496,7 @@ struct xrel *dml_join(struct join *join)
 			}
 		}
 
-		result = join_init(rls[0], rls[1], xexprs, cnt);
+		result = best_join_init(rls[0], rls[1], xexprs, cnt);
 
 		for (j = 0; j < cnt; j++)
 			free(xexprs[j]);
@@ -542,7 +559,7 @@ bool dml_insert(struct insertion *insertion)
 	}
 
 	if (rl != NULL) {
-		char tuple[rl->rl_header.hd_tpsize];
+		char tuple[RL_TPDATA_SIZE(rl)];
 		int i;
 
 		assert(insertion->atcnt <= rl->rl_header.hd_atcnt);
@@ -581,6 +598,79 @@ bool dml_insert(struct insertion *insertion)
 		return false;
 }
 
+bool dml_copy(struct copy *copy, tpcnt_t *cnt_ptr)
+{
+	struct srel *rl;
+	struct deferred_ixs *dx;
+	FILE *fp;
+	char *tuples;
+	size_t cnt, max, inserted;
+	enum csv_result r;
+	bool retval;
+
+	assert(copy != NULL);
+
+	if (cnt_ptr != NULL)
+		*cnt_ptr = 0;
+
+	if ((rl = open_relation(copy->tbl_name)) == NULL) {
+		ERR(E_OPEN_RELATION_FAILED);
+		return false;
+	}
+
+	if ((fp = fopen(copy->filename, "r")) == NULL) {
+		ERR(E_OPEN_FAILED);
+		return false;
+	}
+
+	max = BULK_BATCH_SIZE / RL_TPDATA_SIZE(rl);
+	if (max == 0)
+		max = 1;
+	tuples = xmalloc(max * RL_TPDATA_SIZE(rl));
+	dx = NULL;
+	cnt = 0;
+	inserted = 0;
+	retval = true;
+	do {
+		r = csv_read_tuple(fp, rl, tuples + cnt * RL_TPDATA_SIZE(rl));
+		if (r == CSV_TUPLE)
+			cnt++;
+		if (cnt == max && dx == NULL) {
+			/* a file of more than one batch is a bulk insertion,
+			 * i.e. the indexes are brought up to date at its end */
+			dx = bulk_insert_begin(rl);
+			retval = (dx != NULL);
+		}
+		if (retval && (cnt == max || (r != CSV_TUPLE && cnt > 0))) {
+			/* a batch is committed like a statement, which keeps
+			 * the write-ahead log small */
+			retval = bulk_insert_into_relation(rl, dx, tuples, cnt);
+			if (retval)
+				inserted += cnt;
+			retval = retval && wal_commit();
+			cnt = 0;
+		}
+	} while (retval && r == CSV_TUPLE);
+	free(tuples);
+	fclose(fp);
+
+	if (dx != NULL) {
+		/* a duplicate primary key cuts off the batches from there */
+		retval = bulk_insert_end(rl, dx, &inserted) && retval;
+	}
+	if (cnt_ptr != NULL)
+		*cnt_ptr = (tpcnt_t)inserted;
+
+	if (retval && r == CSV_INVALID) {
+		ERR(E_INVALID_CSV);
+		return false;
+	} else if (!retval) {
+		ERR(E_TUPLE_INSERT_FAILED);
+		return false;
+	}
+	return true;
+}
+
 static bool delete_helper(struct srel *rl, struct expr **conj, tpcnt_t *tpcnt)
 {
 	struct index *ix;
@@ -791,8 +881,8 @@ update_next:
 		assert(iter != NULL);
 		nextf = index_iterator_nextf(conj[0]->op);
 		while ((addr = nextf(iter)) != INVALID_ADDR) {
-			char new_tuple[rl->rl_header.hd_tpsize];
-			char old_tuple[rl->rl_header.hd_tpsize];
+			char new_tuple[RL_TPDATA_SIZE(rl)];
+			char old_tuple[RL_TPDATA_SIZE(rl)];
 			const char *tmp_tuple;
 			int i;
 
@@ -806,8 +896,8 @@ update_next:
 			if (!expr_check(tmp_tuple, conj, conj_cnt))
 				continue;
 
-			memcpy(old_tuple, tmp_tuple, rl->rl_header.hd_tpsize);
-			memcpy(new_tuple, tmp_tuple, rl->rl_header.hd_tpsize);
+			memcpy(old_tuple, tmp_tuple, RL_TPDATA_SIZE(rl));
+			memcpy(new_tuple, tmp_tuple, RL_TPDATA_SIZE(rl));
 			for (i = 0; i < cnt; i++)
 				set_sattr_val(new_tuple, sattrs[i], values[i]);
 
@@ -831,7 +921,7 @@ update_next:
 	} else {
 		struct srel_iter *iter;
 		const char *old_tuple;
-		char new_tuple[rl->rl_header.hd_tpsize];
+		char new_tuple[RL_TPDATA_SIZE(rl)];
 		blkaddr_t addr;
 		int i;
 
@@ -841,7 +931,7 @@ update_next:
 			if (!expr_check(old_tuple, conj, conj_cnt))
 				continue;
 
-			memcpy(new_tuple, old_tuple, rl->rl_header.hd_tpsize);
+			memcpy(new_tuple, old_tuple, RL_TPDATA_SIZE(rl));
 
 			for (i = 0; i < cnt; i++)
 				set_sattr_val(new_tuple, sattrs[i], values[i]);
@@ -138,12 +138,14 @@ struct dml_modi {
 	enum modi_type {
 		INSERTION,
 		DELETION,
-		UPDATE
+		UPDATE,
+		COPY
 	} type;
 	union {
 		struct insertion *insertion;
 		struct deletion *deletion;
 		struct update *update;
+		struct copy *copy;
 	} ptr;
 };
 
@@ -168,6 +170,11 @@ struct update {
 	struct expr *expr_tree;
 };
 
+struct copy {
+	char *tbl_name;
+	char *filename;		/* CSV file (see csv.h) */
+};
+
 /* The query family of DML commands consists of selection, projection,
  * union and join commands. */
 struct xrel *dml_query(struct dml_query *query);
@@ -181,7 +188,7 @@ struct xrel *dml_sort(struct sort *sort);
 bool dml_sp(struct dml_sp *sp, struct value *result);
 
 /* The modi family of DML (modification) commands consists of insertion,
- * update and deletion. The `cnt_ptr' pointer can point to an tpcnt_t in which
+ * update, deletion and copy. The `cnt_ptr' pointer can point to an tpcnt_t in which
  * the count of affected tuples is stored. The pointer can be NULL. If
  * the `modi' is a insertion in dml_modi() and the insertion is successful,
  * `cnt_ptr' is set to 1. */
@@ -190,5 +197,15 @@ bool dml_insert(struct insertion *insertion);
 bool dml_delete(struct deletion *deletion, tpcnt_t *cnt_ptr);
 bool dml_update(struct update *update, tpcnt_t *cnt_ptr);
 
+/* Inserts the tuples of a CSV file in batches of BULK_BATCH_SIZE bytes; each
+ * batch is committed like a statement. A file of more than one batch is a 
+ * bulk insertion (see bulk_insert_begin()), i.e. the indexes are updated at 
+ * the end. The copy is not atomic: an invalid line ends it after the lines 
+ * before it are inserted, and a batch that cannot be inserted ends it after
+ * the batches before; these stay committed although false is returned. 
+ * `cnt_ptr' tells the count of inserted tuples, including a batch that is
+ * applied but whose commit failed. */
+bool dml_copy(struct copy *copy, tpcnt_t *cnt_ptr);
+
 #endif
 
@@ -72,6 +72,12 @@ enum {
 	E_COULD_NOT_CREATE_VIEW,
 	E_COULD_NOT_DROP_VIEW,
 	E_IO_ERROR,
+	E_INVALID_PAGE_SIZE,
+	E_UNKNOWN_FORMAT,
+	E_CONVERSION_FAILED,
+	E_LOG_FAILED,
+	E_VACUUM_FAILED,
+	E_INVALID_CSV,
 
 	E_SEMANTIC_ERROR,
 
@@ -15,6 +15,7 @@
  */
 
 #include "fgnkey.h"
+#include "attr.h"
 #include "btree.h"
 #include "io.h"
 #include "ixmngt.h"
@@ -66,7 +67,7 @@ bool create_foreign_key(struct srel *fgn_rl, struct sattr *fgn_attr,
 	}
 	assert(fgn_attr_index != -1);
 
-	if ((ref_ix = create_index(ref_rl, ref_attr, SECONDARY)) == NULL)
+	if ((ref_ix = create_index(ref_rl, ref_attr, SECONDARY, 0)) == NULL)
 		return false;
 
 	/* update fgn_rl's references */
@@ -152,13 +153,24 @@ bool remove_references_to(struct srel *ref_rl)
 	return true;
 }
 
+/* searches a value of `attr' in its primary index `ix' */
+static blkaddr_t search_val(struct index *ix, struct sattr *attr,
+		const char *val)
+{
+	char key[attr->at_size];
+
+	assert(ix->ix_size == attr->at_size);
+
+	normalize_val(attr, key, val);
+	return ix_search(ix, key);
+}
+
 bool foreign_key_conflict(struct srel *ref_rl, const char *tuple)
 {
 	struct sref *ref;
 	struct srel *fgn_rl;
 	struct sattr *fgn_attr, *ref_attr;
 	struct index *fgn_ix;
-	const char *key;
 	blkaddr_t addr;
 	int i;
 
@@ -171,7 +183,6 @@ bool foreign_key_conflict(struct srel *ref_rl, const char *tuple)
 		ref = &ref_rl->rl_header.hd_fkeys[i];
 
 		ref_attr = &ref_rl->rl_header.hd_attrs[ref->rf_thisattr];
-		key = tuple + ref_attr->at_offset;
 
 		fgn_rl = open_relation(ref->rf_refrl);
 		fgn_attr = &fgn_rl->rl_header.hd_attrs[ref->rf_refattr];
@@ -179,7 +190,8 @@ bool foreign_key_conflict(struct srel *ref_rl, const char *tuple)
 
 		fgn_ix = open_index(fgn_rl, fgn_attr);
 		assert(fgn_ix != NULL);
-		addr = ix_search(fgn_ix, key);
+		addr = search_val(fgn_ix, fgn_attr,
+				tuple + ref_attr->at_offset);
 		if (addr == INVALID_ADDR)
 			return true;
 	}
@@ -193,8 +205,8 @@ static bool updrefs(struct srel *ref_rl, struct sattr *ref_attr,
 	struct index *ref_ix;
 	char old_key[size+sizeof(blkaddr_t)], new_key[size+sizeof(blkaddr_t)];
 	const char *old_tuple;
-	char new_tuple[ref_rl->rl_header.hd_tpsize];
-	blkaddr_t addr, invalid_addr;
+	char new_tuple[RL_TPDATA_SIZE(ref_rl)];
+	blkaddr_t addr;
 	bool retval;
 
 	assert(ref_rl != NULL);
@@ -206,15 +218,14 @@ static bool updrefs(struct srel *ref_rl, struct sattr *ref_attr,
 	ref_ix = open_index(ref_rl, ref_attr);
 	assert(ref_ix != NULL);
 
-	invalid_addr = INVALID_ADDR;
-	memcpy(old_key, old_val, size);
-	memcpy(old_key + size, &invalid_addr, sizeof(blkaddr_t));
-	memcpy(new_key, new_val, size);
+	normalize_val(ref_attr, old_key, old_val);
+	normalize_addr(ref_attr, old_key, INVALID_ADDR);
+	normalize_val(ref_attr, new_key, new_val);
 
 	retval = true;
 	while ((addr = ix_search(ref_ix, old_key)) != INVALID_ADDR) {
 		old_tuple = rl_get(ref_rl, addr);
-		memcpy(new_tuple, old_tuple, ref_rl->rl_header.hd_tpsize);
+		memcpy(new_tuple, old_tuple, RL_TPDATA_SIZE(ref_rl));
 		memcpy(new_tuple + ref_attr->at_offset, new_val, size);
 		retval &= update_relation(ref_rl, addr, old_tuple, new_tuple,
 				tpcnt);
@@ -268,7 +279,7 @@ static bool delrefs(struct srel *ref_rl, struct sattr *ref_attr,
 {
 	struct index *ref_ix;
 	char key[size + sizeof(blkaddr_t)];
-	blkaddr_t addr, invalid_addr;
+	blkaddr_t addr;
 	const char *tuple;
 	bool retval;
 
@@ -280,9 +291,8 @@ static bool delrefs(struct srel *ref_rl, struct sattr *ref_attr,
 	ref_ix = open_index(ref_rl, ref_attr);
 	assert(ref_ix != NULL);
 
-	invalid_addr = INVALID_ADDR;
-	memcpy(key, val, size);
-	memcpy(key + size, &invalid_addr, sizeof(blkaddr_t));
+	normalize_val(ref_attr, key, val);
+	normalize_addr(ref_attr, key, INVALID_ADDR);
 
 	retval = true;
 	while ((addr = ix_search(ref_ix, key)) != INVALID_ADDR) {
@@ -14,194 +14,698 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _XOPEN_SOURCE 500	/* ftruncate(), pread(), pwrite() */
+
 #include "io.h"
 #include "block.h"
 #include "cache.h"
 #include "constants.h"
 #include "err.h"
 #include "mem.h"
+#include "wal.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#ifdef USE_MMAP
+#include <sys/mman.h>
+#endif
 
-/* the maximum size of the database cache */
-#define TOTAL_CACHE_SIZE	(1024 * 10)
+#ifdef USE_MMAP
+/* pages are accessed in the file mapping instead of the buffer pool */
+#ifndef NO_CACHE
+#define NO_CACHE
+#endif
+#endif
 
-/* converts a block address (blkaddr_t) to a file position (off_t) */
-#define ADDR_TO_POS(rl, addr)	(((off_t)addr) * (rl)->rl_header.hd_tpasize\
-				+ (rl)->rl_header.hd_asize)
+/* the header's counters are logged and thus remain valid after a crash, 
+ * unless the mapped pages are written before the log (see wal.h) */
+#ifdef USE_MMAP
+#define HD_LOGGED		false
+#else
+#define HD_LOGGED		true
+#endif
 
-/* moves the file cursor to the address (blkaddr_t) */
-#define GOTO_ADDR(rl, addr)	lseek(rl->rl_fd, ADDR_TO_POS(rl,addr), SEEK_SET)
+/* converts a page address (blkaddr_t) to a file position (off_t) */
+#define PG_TO_POS(rl, pg)	((off_t)(pg) * (off_t)(rl)->rl_header.hd_pgsize\
+				+ (rl)->rl_header.hd_asize)
 
-/* calculates the size of a 'size'-bytes large tuple aligned to BLK_SIZE */
-#define CALC_ASIZE(size)	((size) + ((- (size)) % BLK_SIZE))
+/* the page of a tuple address and the tuple's slot in this page */
+#define PAGE_OF(rl, addr)	((addr) / (blkaddr_t)(rl)->rl_header.hd_tppp)
+#define SLOT_OF(rl, addr)	((addr) % (blkaddr_t)(rl)->rl_header.hd_tppp)
 
-/* moves the file cursor cnt bytes forward from the current position */
-#define SKIP_BYTES(rl, cnt)	lseek(rl->rl_fd, cnt, SEEK_CUR)
+/* calculates the size of a 'size'-bytes large block aligned to 'align' */
+#define ALIGN_SIZE(size, align)	((size) + ((- (size)) % (align)))
 
 /* fills a buffer from a given offset to another given position with zeros */
 #define FILL_BUF(buf, from, to)	memset(buf+from, 0, (to)-(from))
 
-/* tuple types: TP_AVAIL is a free space, TP_OCCUP marks an active tuple */
+/* tuple types: TP_AVAIL is a free space, TP_OCCUP marks an active tuple, 
+ * TP_UNUSED is a slot behind the last tuple in the last page */
 #define TP_AVAIL		((tpstatus_t)0)
 #define TP_OCCUP		(((tpstatus_t)1))
+#define TP_UNUSED		(((tpstatus_t)2))
 
-#define TP_PREV_OFFSET		sizeof(tpstatus_t)
-#define TP_NEXT_OFFSET		(TP_PREV_OFFSET + sizeof(blkaddr_t))
-#define TP_DATA_OFFSET		(TP_NEXT_OFFSET + sizeof(blkaddr_t))
+#define TP_DATA_OFFSET		sizeof(tpstatus_t)
 
 /* the tuple's status: either TP_AVAIL or TP_OCCUP */
 #define TP_STATUS(tp)		(*((tpstatus_t *)((char *)(tp))))
 
-/* the tuple's following neighbor's address */
-#define TP_NEXT_ADDR(tp)	(*((blkaddr_t *)((char *)(tp)+TP_NEXT_OFFSET)))
-
-/* the tuple's preceeding neighbor's address */
-#define TP_PREV_ADDR(tp)	(*((blkaddr_t *)((char *)(tp)+TP_PREV_OFFSET)))
-
 /* the tuple's data itself */
 #define TP_DATA(tp)		((char *)(tp)+TP_DATA_OFFSET)
 
-/* reads a given amount of bytes from a file into a pointer */
-#define READ(fd, ptr, size)	(read((fd),(ptr),(size)) == (ssize_t)(size))
+/* the size of a tuple's data area in a page */
+#define TP_DATA_SIZE(rl)	((rl)->rl_header.hd_tpsize - TP_DATA_OFFSET)
+
+/* the size of the page header */
+#define PG_HDR_SIZE		sizeof(tpcnt_t)
+
+/* the count of active tuples in a page */
+#define PG_CNT(pg)		(*((tpcnt_t *)(pg)))
 
-/* writes a given amount of bytes from a pointer to a file */
-#define WRITE(fd, ptr, size)	(write((fd),(ptr),(size)) == (ssize_t)(size))
+/* the offset of a slot's directory entry in a page; the directory entry
+ * consists of the status, i.e. the TP_STATUS macro can be applied to it */
+#define PG_SLOT_OFFSET(rl, slot) (PG_HDR_SIZE + (slot) * TP_DATA_OFFSET)
 
+/* the offset of a slot's data in a page */
+#define PG_DATA_OFFSET(rl, slot) (PG_SLOT_OFFSET((rl),\
+				(rl)->rl_header.hd_tppp)\
+				+ (slot) * TP_DATA_SIZE(rl))
+
+/* reads a given amount of bytes from a file position into a pointer */
+#define PREAD(fd, ptr, size, pos) (pread((fd),(ptr),(size),(pos))\
+				== (ssize_t)(size))
+
+/* writes a given amount of bytes from a pointer to a file position */
+#define PWRITE(fd, ptr, size, pos) (pwrite((fd),(ptr),(size),(pos))\
+				== (ssize_t)(size))
+
+/* the count of tuple addresses covered by a page of the free-space map */
+#define FSM_BITS(rl)		((blkaddr_t)(rl)->rl_header.hd_pgsize * 8)
+
+/* the map page of a tuple address and the address' bit in this page */
+#define FSM_PAGE_OF(rl, addr)	((addr) / FSM_BITS(rl))
+#define FSM_BIT_OF(rl, addr)	((addr) % FSM_BITS(rl))
+
+/* converts a map page address (blkaddr_t) to a file position (off_t) */
+#define FSM_TO_POS(rl, pg)	((off_t)(pg) * (off_t)(rl)->rl_header.hd_pgsize)
+
+/* the header's counters hd_tpcnt, hd_tpfree and hd_tpmax, which are logged 
+ * together */
+#define HD_CNT_OFFSET		offsetof(struct srel_hdr, hd_tpcnt)
+#define HD_CNT_SIZE		(offsetof(struct srel_hdr, hd_tpmax)\
+				+ sizeof(blkaddr_t) - HD_CNT_OFFSET)
 
 typedef char tpstatus_t; /* a tuple's status (either TP_AVAIL or TP_OCCUP) */
 
-static inline bool tp_read(struct srel *rl, blkaddr_t addr, char *buf)
+#ifdef USE_MMAP
+/* maps the file such that at least `size' bytes are mapped; the mapping grows
+ * by at least MAP_EXTENT_SIZE bytes to keep remapping rare */
+static bool map_file(struct srel *rl, off_t size)
+{
+	size_t mapsize;
+	char *map;
+
+	mapsize = (size_t)size + rl->rl_mapsize + MAP_EXTENT_SIZE;
+	map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+			rl->rl_fd, 0);
+	if (map == MAP_FAILED)
+		return false;
+	if (rl->rl_map != NULL)
+		munmap(rl->rl_map, rl->rl_mapsize);
+	rl->rl_map = map;
+	rl->rl_mapsize = mapsize;
+	return true;
+}
+
+/* enlarges the file to `size' bytes and remaps it if necessary */
+static bool map_extend(struct srel *rl, off_t size)
+{
+	if (size <= rl->rl_filesize)
+		return true;
+	if ((size_t)size > rl->rl_mapsize && !map_file(rl, size))
+		return false;
+	if (ftruncate(rl->rl_fd, size) != 0)
+		return false;
+	rl->rl_filesize = size;
+	return true;
+}
+
+/* returns a pointer to the page in the mapping or NULL if it is not in the 
+ * file */
+static inline char *pg_map(struct srel *rl, blkaddr_t pg)
+{
+	if (PG_TO_POS(rl, pg + 1) > rl->rl_filesize)
+		return NULL;
+	return rl->rl_map + PG_TO_POS(rl, pg);
+}
+#endif
+
+/* initializes the file mapping (if any) */
+static bool map_init(struct srel *rl)
 {
+	struct stat st;
+
+	rl->rl_map = NULL;
+	rl->rl_mapsize = 0;
+	rl->rl_filesize = (fstat(rl->rl_fd, &st) == 0) ? st.st_size : 0;
+#ifdef USE_MMAP
+	return map_file(rl, rl->rl_filesize);
+#else
+	return true;
+#endif
+}
+
+static inline bool pg_read(struct srel *rl, blkaddr_t pg, char *buf)
+{
+#ifdef USE_MMAP
+	const char *page;
+
+	if ((page = pg_map(rl, pg)) == NULL)
+		return false;
+	memcpy(buf, page, rl->rl_header.hd_pgsize);
+	return true;
+#else
 	bool retval;
 
 #ifndef NO_CACHE
-	if (cache_search(rl->rl_cache, addr, buf))
+	if (cache_search(rl->rl_cache, pg, buf))
 		return true;
 #endif
 
-	GOTO_ADDR(rl, addr);
-	retval = READ(rl->rl_fd, buf, rl->rl_header.hd_tpasize);
+	retval = PREAD(rl->rl_fd, buf, rl->rl_header.hd_pgsize,
+			PG_TO_POS(rl, pg));
 #ifndef NO_CACHE
 	if (retval)
-		cache_push(rl->rl_cache, addr, buf);
+		cache_push(rl->rl_cache, pg, buf);
 #endif
 	return retval;
+#endif
 }
 
-static inline bool tp_write(struct srel *rl, blkaddr_t addr, const char *buf)
+/* initializes an empty page whose slots are all unused */
+static void pg_init(struct srel *rl, char *buf)
 {
-	bool retval;
+	unsigned short slot;
+	char *tp;
+
+	FILL_BUF(buf, 0, rl->rl_header.hd_pgsize);
+	for (slot = 0; slot < rl->rl_header.hd_tppp; slot++) {
+		tp = buf + PG_SLOT_OFFSET(rl, slot);
+		TP_STATUS(tp) = TP_UNUSED;
+	}
+}
 
-	GOTO_ADDR(rl, addr);
-	retval = WRITE(rl->rl_fd, buf, rl->rl_header.hd_tpasize);
+/* loads a page into rl_pgbuf; pages behind the last page are initialized */
+static bool pg_load(struct srel *rl, blkaddr_t pg)
+{
+	if (rl->rl_pgaddr == pg)
+		return true;
+
+	if (rl->rl_header.hd_tpmax == INVALID_ADDR
+			|| pg > PAGE_OF(rl, rl->rl_header.hd_tpmax))
+		pg_init(rl, rl->rl_pgbuf);
+	else if (!pg_read(rl, pg, rl->rl_pgbuf)) {
+		rl->rl_pgaddr = INVALID_ADDR;
+		return false;
+	}
+	rl->rl_pgaddr = pg;
+	return true;
+}
+
+/* writes `len' bytes of `buf' at the offset `offset' of the page; the change
+ * must have been logged */
+static inline bool pg_store(struct srel *rl, blkaddr_t pg, size_t offset,
+		const char *buf, size_t len)
+{
+	rl->rl_modcnt++;
+	if (rl->rl_direct && len != rl->rl_header.hd_pgsize
+			&& !pg_load(rl, pg))
+		return false;
+	if (rl->rl_pgaddr == pg && rl->rl_pgbuf + offset != buf)
+		memcpy(rl->rl_pgbuf + offset, buf, len);
+
+#ifdef USE_MMAP
+	if (!map_extend(rl, PG_TO_POS(rl, pg + 1)))
+		return false;
+	memcpy(rl->rl_map + PG_TO_POS(rl, pg) + offset, buf, len);
+	return true;
+#else
 #ifndef NO_CACHE
-	if (retval)
-		cache_update(rl->rl_cache, addr, 0, buf,
-				rl->rl_header.hd_tpasize);
+	if (cache_write(rl->rl_cache, pg, offset, buf, len))
+		return true;
 #endif
-	return retval;
+
+	if (rl->rl_direct && len != rl->rl_header.hd_pgsize) {
+		/* direct I/O writes complete pages only */
+		buf = rl->rl_pgbuf;
+		offset = 0;
+		len = rl->rl_header.hd_pgsize;
+	}
+	return wal_force()
+		&& PWRITE(rl->rl_fd, buf, len, PG_TO_POS(rl, pg) + offset);
+#endif
+}
+
+/* logs `len' bytes of rl_pgbuf at the offset `offset' of the page */
+static inline bool pg_log(struct srel *rl, blkaddr_t pg, size_t offset,
+		size_t len)
+{
+	return wal_write(rl->rl_logid, PG_TO_POS(rl, pg) + offset,
+			rl->rl_pgbuf + offset, len, len);
+}
+
+static inline bool pg_write(struct srel *rl, blkaddr_t pg, size_t offset,
+		const char *buf, size_t len)
+{
+	return wal_write(rl->rl_logid, PG_TO_POS(rl, pg) + offset, buf, len,
+			len) && pg_store(rl, pg, offset, buf, len);
+}
+
+/* logs the header's counters */
+static inline bool hd_log(struct srel *rl)
+{
+	return wal_write(rl->rl_logid, HD_CNT_OFFSET,
+			(const char *)&rl->rl_header + HD_CNT_OFFSET,
+			HD_CNT_SIZE, HD_CNT_SIZE);
+}
+
+/* reads the tuple (i.e. its directory entry and data) at `addr' into buf */
+static inline bool tp_read(struct srel *rl, blkaddr_t addr, char *buf)
+{
+	blkaddr_t slot = SLOT_OF(rl, addr);
+
+	if (!pg_load(rl, PAGE_OF(rl, addr)))
+		return false;
+
+	memcpy(buf, rl->rl_pgbuf + PG_SLOT_OFFSET(rl, slot), TP_DATA_OFFSET);
+	memcpy(TP_DATA(buf), rl->rl_pgbuf + PG_DATA_OFFSET(rl, slot),
+			TP_DATA_SIZE(rl));
+	return true;
+}
+
+/* reads the directory entry of the tuple at `addr' into buf and returns a 
+ * pointer to the tuple's data; with USE_MMAP, this is a pointer into the 
+ * mapping, otherwise the data is read into buf, too */
+static inline const char *tp_get(struct srel *rl, blkaddr_t addr, char *buf)
+{
+#ifdef USE_MMAP
+	blkaddr_t slot = SLOT_OF(rl, addr);
+	const char *page;
+
+	if ((page = pg_map(rl, PAGE_OF(rl, addr))) == NULL)
+		return NULL;
+	memcpy(buf, page + PG_SLOT_OFFSET(rl, slot), TP_DATA_OFFSET);
+	return page + PG_DATA_OFFSET(rl, slot);
+#else
+	return tp_read(rl, addr, buf) ? TP_DATA(buf) : NULL;
+#endif
+}
+
+/* writes the tuple and logs it in one group with the header; the group also
+ * includes the `linked' records that the caller logs right afterwards */
+static inline bool tp_write(struct srel *rl, blkaddr_t addr, const char *buf,
+		unsigned int linked)
+{
+	blkaddr_t pg = PAGE_OF(rl, addr), slot = SLOT_OF(rl, addr);
+	bool newpg;
+	char *tp;
+
+	newpg = rl->rl_header.hd_tpmax == INVALID_ADDR
+		|| pg > PAGE_OF(rl, rl->rl_header.hd_tpmax);
+	if (!pg_load(rl, pg))
+		return false;
+
+	/* the counters follow the tuple's status */
+	tp = rl->rl_pgbuf + PG_SLOT_OFFSET(rl, slot);
+	if (TP_STATUS(tp) == TP_OCCUP) {
+		PG_CNT(rl->rl_pgbuf)--;
+		rl->rl_header.hd_tpcnt--;
+	} else if (TP_STATUS(tp) == TP_AVAIL)
+		rl->rl_header.hd_tpfree--;
+	if (TP_STATUS(buf) == TP_OCCUP) {
+		PG_CNT(rl->rl_pgbuf)++;
+		rl->rl_header.hd_tpcnt++;
+	} else if (TP_STATUS(buf) == TP_AVAIL)
+		rl->rl_header.hd_tpfree++;
+	if (rl->rl_header.hd_tpmax == INVALID_ADDR
+			|| addr > rl->rl_header.hd_tpmax)
+		rl->rl_header.hd_tpmax = addr;
+	memcpy(tp, buf, TP_DATA_OFFSET);
+	memcpy(rl->rl_pgbuf + PG_DATA_OFFSET(rl, slot), TP_DATA(buf),
+			TP_DATA_SIZE(rl));
+
+	/* a new page is logged completely, otherwise the tuple count, the 
+	 * directory entry and the data suffice; the counters are linked with
+	 * the page */
+	wal_link((newpg ? 1 : 3) + linked);
+	if (newpg) {
+		if (!pg_log(rl, pg, 0, rl->rl_header.hd_pgsize))
+			return false;
+	} else if (!pg_log(rl, pg, 0, PG_HDR_SIZE)
+			|| !pg_log(rl, pg, PG_SLOT_OFFSET(rl, slot),
+				TP_DATA_OFFSET)
+			|| !pg_log(rl, pg, PG_DATA_OFFSET(rl, slot),
+				TP_DATA_SIZE(rl)))
+		return false;
+	return hd_log(rl)
+		&& pg_store(rl, pg, 0, rl->rl_pgbuf, rl->rl_header.hd_pgsize);
 }
 
+/* writes the bytes from `from' to `to' of `buf' at the offset `offset' of 
+ * the tuple; the range must not exceed the directory entry or the data */
 static inline bool tp_write_range(struct srel *rl, blkaddr_t addr,
 		size_t offset, const char *buf, size_t from, size_t to)
 {
-	bool retval;
+	blkaddr_t slot = SLOT_OF(rl, addr);
+	size_t pos;
+
+	if (offset < TP_DATA_OFFSET) {
+		assert(offset + (to-from) <= TP_DATA_OFFSET);
+		pos = PG_SLOT_OFFSET(rl, slot) + offset;
+	} else
+		pos = PG_DATA_OFFSET(rl, slot) + offset - TP_DATA_OFFSET;
+	return pg_write(rl, PAGE_OF(rl, addr), pos, buf+from, to-from);
+}
 
-	GOTO_ADDR(rl, addr);
-	SKIP_BYTES(rl, offset);
-	retval = WRITE(rl->rl_fd, buf+from, to-from);
 #ifndef NO_CACHE
-	if (retval)
-		cache_update(rl->rl_cache, addr, offset, buf+from, to-from);
+static bool tp_flush(void *ctx, blkaddr_t addr, const char *buf, size_t cnt)
+{
+	struct srel *rl = ctx;
+
+	if (!wal_force() || !PWRITE(rl->rl_fd, buf,
+				cnt * rl->rl_header.hd_pgsize,
+				PG_TO_POS(rl, addr))) {
+		ERR(E_WRITE_FAILED);
+		return false;
+	}
+	return true;
+}
+#endif
+
+#ifndef NO_CACHE
+static bool fsm_flush(void *ctx, blkaddr_t addr, const char *buf, size_t cnt)
+{
+	struct srel *rl = ctx;
+
+	if (!wal_force() || !PWRITE(rl->rl_fsmfd, buf,
+				cnt * rl->rl_header.hd_pgsize,
+				FSM_TO_POS(rl, addr))) {
+		ERR(E_WRITE_FAILED);
+		return false;
+	}
+	return true;
+}
+#endif
+
+/* loads a page of the free-space map into rl_fsmbuf; the map is shorter 
+ * than the relation if the last pages have no free bits */
+static bool fsm_load(struct srel *rl, blkaddr_t pg)
+{
+	ssize_t n;
+
+	if (rl->rl_fsmpg == pg)
+		return true;
+
+#ifndef NO_CACHE
+	if (cache_search(rl->rl_fsmcache, pg, rl->rl_fsmbuf)) {
+		rl->rl_fsmpg = pg;
+		return true;
+	}
+#endif
+
+	n = pread(rl->rl_fsmfd, rl->rl_fsmbuf, rl->rl_header.hd_pgsize,
+			FSM_TO_POS(rl, pg));
+	if (n == -1) {
+		rl->rl_fsmpg = INVALID_ADDR;
+		return false;
+	}
+	FILL_BUF(rl->rl_fsmbuf, (size_t)n, rl->rl_header.hd_pgsize);
+#ifndef NO_CACHE
+	cache_push(rl->rl_fsmcache, pg, rl->rl_fsmbuf);
+#endif
+	rl->rl_fsmpg = pg;
+	return true;
+}
+
+/* sets (free) or clears the bit of a tuple address in the free-space map */
+static bool fsm_mark(struct srel *rl, blkaddr_t addr, bool free)
+{
+	blkaddr_t pg = FSM_PAGE_OF(rl, addr), bit = FSM_BIT_OF(rl, addr);
+	char *byte;
+
+	if (!fsm_load(rl, pg))
+		return false;
+
+	byte = rl->rl_fsmbuf + bit / 8;
+	if (free) {
+		*byte |= (char)(1 << (bit % 8));
+		if (pg < rl->rl_fsmhint)
+			rl->rl_fsmhint = pg;
+	} else
+		*byte &= (char)~(1 << (bit % 8));
+
+	if (!wal_write(rl->rl_fsmlogid, FSM_TO_POS(rl, pg) + bit / 8, byte,
+				1, 1))
+		return false;
+#ifndef NO_CACHE
+	if (cache_write(rl->rl_fsmcache, pg, bit / 8, byte, 1))
+		return true;
+#endif
+	return wal_force()
+		&& PWRITE(rl->rl_fsmfd, byte, 1, FSM_TO_POS(rl, pg) + bit / 8);
+}
+
+/* returns the lowest free tuple address or INVALID_ADDR if there is none; 
+ * the map pages before rl_fsmhint have no free bits */
+static blkaddr_t fsm_find(struct srel *rl)
+{
+	const uint64_t *words;
+	blkaddr_t pg, addr;
+	size_t i, j;
+
+	if (rl->rl_header.hd_tpfree == 0)
+		return INVALID_ADDR;
+
+	for (pg = rl->rl_fsmhint; pg <= FSM_PAGE_OF(rl, rl->rl_header.hd_tpmax);
+			pg++) {
+		if (!fsm_load(rl, pg))
+			return INVALID_ADDR;
+		words = (const uint64_t *)rl->rl_fsmbuf;
+		for (i = 0; i < rl->rl_header.hd_pgsize / sizeof(uint64_t); i++) {
+			if (words[i] == 0)
+				continue;
+			for (j = i * sizeof(uint64_t) * 8; ; j++) {
+				if (rl->rl_fsmbuf[j / 8] & (1 << (j % 8)))
+					break;
+			}
+			rl->rl_fsmhint = pg;
+			addr = pg * FSM_BITS(rl) + (blkaddr_t)j;
+			return (addr <= rl->rl_header.hd_tpmax) ? addr
+				: INVALID_ADDR;
+		}
+	}
+	rl->rl_fsmhint = pg;
+	return INVALID_ADDR;
+}
+
+/* opens the free-space map file of a relation and initializes its buffers */
+static bool fsm_init(struct srel *rl, int flags)
+{
+	char filename[PATH_MAX+1];
+
+	if (strlen(rl->rl_name) + strlen(RL_FSM_SUFFIX) > PATH_MAX)
+		return false;
+	strcpy(filename, rl->rl_name);
+	strcat(filename, RL_FSM_SUFFIX);
+	rl->rl_fsmfd = open(filename, flags, FILE_MODE);
+	if (rl->rl_fsmfd == -1)
+		return false;
+	if ((rl->rl_fsmlogid = wal_register(filename, rl->rl_fsmfd, NULL,
+					NULL)) == -1) {
+		close(rl->rl_fsmfd);
+		return false;
+	}
+
+	rl->rl_fsmbuf = xmemalign(IO_ALIGN, rl->rl_header.hd_pgsize);
+	rl->rl_fsmpg = INVALID_ADDR;
+	rl->rl_fsmhint = 0;
+#ifndef NO_CACHE
+	rl->rl_fsmcache = cache_init(rl->rl_header.hd_pgsize, rl, fsm_flush);
+#endif
+	return true;
+}
+
+static void fsm_free(struct srel *rl)
+{
+	wal_unregister(rl->rl_fsmlogid);
+	close(rl->rl_fsmfd);
+	rl->rl_fsmfd = -1;
+#ifndef NO_CACHE
+	cache_free(rl->rl_fsmcache);
+#endif
+	free(rl->rl_fsmbuf);
+}
+
+bool rl_flush(struct srel *rl)
+{
+	assert(rl != NULL);
+
+#ifndef NO_CACHE
+	return cache_flush(rl->rl_cache) && cache_flush(rl->rl_fsmcache);
+#else
+	return true;
 #endif
-	return retval;
 }
 
 bool rl_write_header(struct srel *rl)
 {
-	char buf[rl->rl_header.hd_asize];
+	char *buf;
+	bool retval;
 
 	assert(rl != NULL);
 
+	buf = xmemalign(IO_ALIGN, rl->rl_header.hd_asize);
 	memcpy(buf, &(rl->rl_header), sizeof(struct srel_hdr));
 	FILL_BUF(buf, sizeof(struct srel_hdr), rl->rl_header.hd_asize);
-	lseek(rl->rl_fd, 0, SEEK_SET);
-	return WRITE(rl->rl_fd, buf, rl->rl_header.hd_asize);
+	retval = wal_force()
+		&& PWRITE(rl->rl_fd, buf, rl->rl_header.hd_asize, 0);
+	free(buf);
+	return retval;
+}
+
+static bool checkpoint(void *ctx)
+{
+	return rl_write_header(ctx);
 }
 
+/* recomputes the header's counters and the free-space map from the pages */
 static void rebuild_header(struct srel *rl)
 {
-	blkaddr_t addr;
+	blkaddr_t pg, addr;
+	unsigned short slot;
+	tpcnt_t cnt;
+	char *tp;
 
 	assert(rl != NULL);
 
 	rl->rl_header.hd_tpcnt = 0;
+	rl->rl_header.hd_tpfree = 0;
 	rl->rl_header.hd_tpmax = INVALID_ADDR;
-	rl->rl_header.hd_tpavail = INVALID_ADDR;
-	rl->rl_header.hd_tplatest = INVALID_ADDR;
-
-	for (addr = 0; tp_read(rl, addr, rl->rl_tpbuf); addr++) {
-		if (TP_STATUS(rl->rl_tpbuf) == TP_OCCUP)
-			rl->rl_header.hd_tpcnt++;
-		if (TP_STATUS(rl->rl_tpbuf) == TP_AVAIL
-				&& TP_NEXT_ADDR(rl->rl_tpbuf) == INVALID_ADDR)
-			rl->rl_header.hd_tpavail = addr;
-		if (TP_STATUS(rl->rl_tpbuf) == TP_OCCUP
-				&& TP_NEXT_ADDR(rl->rl_tpbuf) == INVALID_ADDR)
-			rl->rl_header.hd_tplatest = addr;
+	if (ftruncate(rl->rl_fsmfd, 0) != 0)
+		ERR(E_WRITE_FAILED);
+	rl->rl_fsmpg = INVALID_ADDR;
+	rl->rl_fsmhint = 0;
+
+	rl->rl_pgaddr = INVALID_ADDR;
+	for (pg = 0; pg_read(rl, pg, rl->rl_pgbuf); pg++) {
+		rl->rl_pgaddr = pg;
+		cnt = 0;
+		for (slot = 0; slot < rl->rl_header.hd_tppp; slot++) {
+			addr = pg * rl->rl_header.hd_tppp + slot;
+			tp = rl->rl_pgbuf + PG_SLOT_OFFSET(rl, slot);
+			if (TP_STATUS(tp) == TP_UNUSED)
+				continue;
+			rl->rl_header.hd_tpmax = addr;
+			if (TP_STATUS(tp) == TP_OCCUP)
+				cnt++;
+			else if (fsm_mark(rl, addr, true))
+				rl->rl_header.hd_tpfree++;
+		}
+		rl->rl_header.hd_tpcnt += cnt;
+		if (PG_CNT(rl->rl_pgbuf) != cnt)
+			pg_write(rl, pg, 0, (const char *)&cnt,
+					sizeof(tpcnt_t));
 	}
-
-	rl->rl_header.hd_tpmax = addr - 1;
+	rl->rl_pgaddr = INVALID_ADDR;
 }
 
 static bool read_header(struct srel *rl) 
 {
 	assert(rl != NULL);
 
-	return READ(rl->rl_fd, &(rl->rl_header), sizeof(struct srel_hdr));
+	return PREAD(rl->rl_fd, &(rl->rl_header), sizeof(struct srel_hdr), 0);
+}
+
+/* switches the relation to direct I/O if it is chosen and the header and 
+ * the pages are aligned to the file system's block size */
+static void init_direct_io(struct srel *rl)
+{
+#ifdef USE_MMAP
+	rl->rl_direct = false;
+#else
+	size_t align = cache_io_align(rl->rl_fd);
+
+	rl->rl_direct = rl->rl_header.hd_asize % align == 0
+		&& rl->rl_header.hd_pgsize % align == 0
+		&& cache_direct_io(rl->rl_fd);
+#endif
 }
 
 struct srel *rl_create(struct srel *rl)
 {
 	unsigned short i;
-	size_t atsize_sum;
+	size_t atsize_sum, align;
 
 	assert(rl != NULL);
 
+	if (!wal_open()) {
+		ERR(E_LOG_FAILED);
+		return NULL;
+	}
+
 	rl->rl_fd = open(rl->rl_name, CREATE_FLAGS, FILE_MODE);
 	if (rl->rl_fd == -1)
 		return NULL;
 
-	/* align header to a multiple BLK_SIZE byte */
-	rl->rl_header.hd_asize = CALC_ASIZE(sizeof(struct srel_hdr));
+	/* align header and pages to the file system's block size */
+	align = cache_io_align(rl->rl_fd);
+	rl->rl_header.hd_asize = ALIGN_SIZE(sizeof(struct srel_hdr), align);
 
-	/* align tuple size to a multiple of BLK_SIZE byte */
+	/* pack as many tuples as possible into a page */
 	atsize_sum = 0;
 	for (i = 0; i < rl->rl_header.hd_atcnt; i++) {
 		rl->rl_header.hd_attrs[i].at_offset = atsize_sum;
 		atsize_sum += rl->rl_header.hd_attrs[i].at_size;
 	}
+	memcpy(rl->rl_header.hd_magic, RL_MAGIC, RL_MAGIC_SIZE);
+	rl->rl_header.hd_format = RL_FORMAT;
 	rl->rl_header.hd_tpsize = TP_DATA_OFFSET + atsize_sum;
-	rl->rl_header.hd_tpasize = CALC_ASIZE(rl->rl_header.hd_tpsize);
+	if (rl->rl_header.hd_pgsize == 0)
+		rl->rl_header.hd_pgsize = RL_PAGE_SIZE;
+	rl->rl_header.hd_pgsize = ALIGN_SIZE(rl->rl_header.hd_pgsize, align);
+	rl->rl_header.hd_tppp = (rl->rl_header.hd_pgsize - PG_HDR_SIZE)
+		/ rl->rl_header.hd_tpsize;
+	if (rl->rl_header.hd_tppp == 0) {
+		rl->rl_header.hd_pgsize = ALIGN_SIZE(PG_HDR_SIZE
+				+ rl->rl_header.hd_tpsize, align);
+		rl->rl_header.hd_tppp = 1;
+	}
 
 	rl->rl_header.hd_tpcnt = 0;
+	rl->rl_header.hd_tpfree = 0;
 	rl->rl_header.hd_tpmax = INVALID_ADDR;
-	rl->rl_header.hd_tpavail = INVALID_ADDR;
-	rl->rl_header.hd_tplatest = INVALID_ADDR;
 	rl->rl_header.hd_refcnt = 0;
 	rl->rl_header.hd_fkeycnt = 0;
-	rl->rl_header.hd_rlclosed = false;
-
-	if (rl_write_header(rl)) {
-		rl->rl_tpbuf = xmalloc(rl->rl_header.hd_tpasize);
+	rl->rl_header.hd_rlclosed = HD_LOGGED;
+	rl->rl_converted = false;
+
+	init_direct_io(rl);
+	if (rl_write_header(rl) && map_init(rl)
+			&& (rl->rl_logid = wal_register(rl->rl_name,
+					rl->rl_fd, checkpoint, rl)) != -1
+			&& fsm_init(rl, OPEN_RW_FLAGS | O_CREAT | O_TRUNC)) {
+		rl->rl_tpbuf = xmalloc(rl->rl_header.hd_tpsize);
+		rl->rl_pgbuf = xmemalign(IO_ALIGN, rl->rl_header.hd_pgsize);
+		rl->rl_pgaddr = INVALID_ADDR;
+		rl->rl_modcnt = 0;
 #ifndef NO_CACHE
-		rl->rl_cache = cache_init(rl->rl_header.hd_tpasize,
-				TOTAL_CACHE_SIZE / rl->rl_header.hd_tpasize);
+		rl->rl_cache = cache_init(rl->rl_header.hd_pgsize, rl,
+				tp_flush);
 #endif
 		return rl;
 	} else {
@@ -210,33 +714,349 @@ struct srel *rl_create(struct srel *rl)
 	}
 }
 
+/* the header of RL_FORMAT_BLOCK and RL_FORMAT_SLOTTED files; the last three
+ * fields are zero in RL_FORMAT_BLOCK files */
+struct srel_hdr32 {
+	char		hd_name[RL_NAME_MAX+1];
+	unsigned short	hd_atcnt;
+	struct sattr	hd_attrs[ATTR_MAX];
+	off_t		hd_asize;
+	size_t		hd_tpsize;
+	size_t		hd_tpasize;
+	uint32_t	hd_tpcnt;
+	int32_t		hd_tpmax;
+	int32_t		hd_tplatest;
+	int32_t		hd_tpavail;
+	struct sref	hd_fkeys[FKEY_MAX];
+	unsigned short	hd_fkeycnt;
+	struct sref	hd_refs[REF_MAX];
+	unsigned short	hd_refcnt;
+	bool		hd_rlclosed;
+	size_t		hd_pgsize;
+	unsigned short	hd_format;
+	unsigned short	hd_tppp;
+};
+
+/* the header of RL_FORMAT_SLOTTED64 files */
+struct srel_hdr64 {
+	char		hd_magic[RL_MAGIC_SIZE];
+	unsigned short	hd_format;
+	char		hd_name[RL_NAME_MAX+1];
+	unsigned short	hd_atcnt;
+	struct sattr	hd_attrs[ATTR_MAX];
+	off_t		hd_asize;
+	size_t		hd_tpsize;
+	tpcnt_t		hd_tpcnt;
+	blkaddr_t	hd_tpmax;
+	blkaddr_t	hd_tplatest;
+	blkaddr_t	hd_tpavail;
+	struct sref	hd_fkeys[FKEY_MAX];
+	unsigned short	hd_fkeycnt;
+	struct sref	hd_refs[REF_MAX];
+	unsigned short	hd_refcnt;
+	bool		hd_rlclosed;
+	size_t		hd_pgsize;
+	unsigned short	hd_tppp;
+};
+
+/* the header of RL_FORMAT_FSM files */
+struct srel_hdr_fsm {
+	char		hd_magic[RL_MAGIC_SIZE];
+	unsigned short	hd_format;
+	char		hd_name[RL_NAME_MAX+1];
+	unsigned short	hd_atcnt;
+	struct sattr	hd_attrs[ATTR_MAX];
+	off_t		hd_asize;
+	size_t		hd_tpsize;
+	tpcnt_t		hd_tpcnt;
+	tpcnt_t		hd_tpfree;
+	blkaddr_t	hd_tpmax;
+	struct sref	hd_fkeys[FKEY_MAX];
+	unsigned short	hd_fkeycnt;
+	struct sref	hd_refs[REF_MAX];
+	unsigned short	hd_refcnt;
+	bool		hd_rlclosed;
+	size_t		hd_pgsize;
+	unsigned short	hd_tppp;
+};
+
+/* the layout of an old relation file */
+struct layout {
+	off_t		asize;		/* size of the header */
+	size_t		pgsize;		/* size of a page */
+	size_t		pghdsize;	/* size of the page header */
+	size_t		tppp;		/* count of tuples per page */
+	size_t		entsize;	/* size of a slot directory entry */
+	size_t		datasize;	/* size of a tuple's data */
+};
+
+/* suffix of the file into which an old relation file is converted or a
+ * relation is compacted */
+#define NEW_SUFFIX		".new"
+
+/* reads the header of an old relation file into the header of the new 
+ * relation and determines the old file's layout */
+static bool convert_header(struct srel *rl, struct srel *nrl,
+		struct layout *lo)
+{
+	char magic[RL_MAGIC_SIZE];
+	struct srel_hdr32 hd32;
+	struct srel_hdr64 hd64;
+	struct srel_hdr_fsm hdf;
+
+	/* no old format has composite indexes or node sizes */
+	nrl->rl_header.hd_ixcnt = 0;
+	memset(nrl->rl_header.hd_ixpgsizes, 0,
+			sizeof(nrl->rl_header.hd_ixpgsizes));
+	nrl->rl_header.hd_ixdeferred = false;
+
+	if (!PREAD(rl->rl_fd, magic, RL_MAGIC_SIZE, 0))
+		return false;
+	if (memcmp(magic, RL_MAGIC, RL_MAGIC_SIZE) == 0) {
+		if (!PREAD(rl->rl_fd, &hdf, sizeof(struct srel_hdr_fsm), 0))
+			return false;
+		if (hdf.hd_format == RL_FORMAT_FSM) {
+			/* only the header grew */
+			lo->asize = hdf.hd_asize;
+			lo->pgsize = hdf.hd_pgsize;
+			lo->pghdsize = sizeof(tpcnt_t);
+			lo->tppp = hdf.hd_tppp;
+			lo->entsize = sizeof(tpstatus_t);
+			lo->datasize = hdf.hd_tpsize - lo->entsize;
+			memcpy(nrl->rl_header.hd_name, hdf.hd_name,
+					RL_NAME_MAX+1);
+			nrl->rl_header.hd_atcnt = hdf.hd_atcnt;
+			memcpy(nrl->rl_header.hd_attrs, hdf.hd_attrs,
+					sizeof(hdf.hd_attrs));
+			memcpy(nrl->rl_header.hd_fkeys, hdf.hd_fkeys,
+					sizeof(hdf.hd_fkeys));
+			nrl->rl_header.hd_fkeycnt = hdf.hd_fkeycnt;
+			memcpy(nrl->rl_header.hd_refs, hdf.hd_refs,
+					sizeof(hdf.hd_refs));
+			nrl->rl_header.hd_refcnt = hdf.hd_refcnt;
+			nrl->rl_header.hd_pgsize = hdf.hd_pgsize;
+			return true;
+		}
+		if (!PREAD(rl->rl_fd, &hd64, sizeof(struct srel_hdr64), 0)
+				|| hd64.hd_format != RL_FORMAT_SLOTTED64)
+			return false;
+		/* slot directory entries have 64-bit list pointers */
+		lo->asize = hd64.hd_asize;
+		lo->pgsize = hd64.hd_pgsize;
+		lo->pghdsize = sizeof(tpcnt_t);
+		lo->tppp = hd64.hd_tppp;
+		lo->entsize = sizeof(tpstatus_t) + 2 * sizeof(blkaddr_t);
+		lo->datasize = hd64.hd_tpsize - lo->entsize;
+		memcpy(nrl->rl_header.hd_name, hd64.hd_name, RL_NAME_MAX+1);
+		nrl->rl_header.hd_atcnt = hd64.hd_atcnt;
+		memcpy(nrl->rl_header.hd_attrs, hd64.hd_attrs,
+				sizeof(hd64.hd_attrs));
+		memcpy(nrl->rl_header.hd_fkeys, hd64.hd_fkeys,
+				sizeof(hd64.hd_fkeys));
+		nrl->rl_header.hd_fkeycnt = hd64.hd_fkeycnt;
+		memcpy(nrl->rl_header.hd_refs, hd64.hd_refs,
+				sizeof(hd64.hd_refs));
+		nrl->rl_header.hd_refcnt = hd64.hd_refcnt;
+		nrl->rl_header.hd_pgsize = hd64.hd_pgsize;
+		return true;
+	}
+
+	if (!PREAD(rl->rl_fd, &hd32, sizeof(struct srel_hdr32), 0))
+		return false;
+	if (hd32.hd_format == RL_FORMAT_BLOCK) {
+		/* each block is a page with exactly one tuple */
+		lo->pgsize = hd32.hd_tpasize;
+		lo->pghdsize = 0;
+		lo->tppp = 1;
+		nrl->rl_header.hd_pgsize = 0;
+	} else if (hd32.hd_format == RL_FORMAT_SLOTTED) {
+		lo->pgsize = hd32.hd_pgsize;
+		lo->pghdsize = sizeof(uint32_t);
+		lo->tppp = hd32.hd_tppp;
+		nrl->rl_header.hd_pgsize = hd32.hd_pgsize;
+	} else
+		return false;
+	/* slot directory entries have 32-bit list pointers */
+	lo->asize = hd32.hd_asize;
+	lo->entsize = sizeof(tpstatus_t) + 2 * sizeof(int32_t);
+	lo->datasize = hd32.hd_tpsize - lo->entsize;
+	memcpy(nrl->rl_header.hd_name, hd32.hd_name, RL_NAME_MAX+1);
+	nrl->rl_header.hd_atcnt = hd32.hd_atcnt;
+	memcpy(nrl->rl_header.hd_attrs, hd32.hd_attrs, sizeof(hd32.hd_attrs));
+	memcpy(nrl->rl_header.hd_fkeys, hd32.hd_fkeys, sizeof(hd32.hd_fkeys));
+	nrl->rl_header.hd_fkeycnt = hd32.hd_fkeycnt;
+	memcpy(nrl->rl_header.hd_refs, hd32.hd_refs, sizeof(hd32.hd_refs));
+	nrl->rl_header.hd_refcnt = hd32.hd_refcnt;
+	return true;
+}
+
+/* copies the tuples of an old relation file to a new relation file with the
+ * same tuple addresses, which then replaces the old file; the header and the
+ * free-space map are rebuilt from the tuples */
+static bool convert(struct srel *rl)
+{
+	char filename[PATH_MAX+1], fsmname[PATH_MAX+1], newfsmname[PATH_MAX+1];
+	struct layout lo;
+	struct srel *nrl;
+	size_t chunkmax, cnt, i;
+	unsigned short fkeycnt, refcnt;
+	char *chunk, *page, *tp;
+	blkaddr_t pg, addr;
+	ssize_t n;
+	bool retval;
+
+	if (strlen(rl->rl_name) + strlen(NEW_SUFFIX)
+			+ strlen(RL_FSM_SUFFIX) > PATH_MAX)
+		return false;
+	strcpy(filename, rl->rl_name);
+	strcat(filename, NEW_SUFFIX);
+
+	nrl = xmalloc(sizeof(struct srel));
+	strcpy(nrl->rl_name, filename);
+	nrl->rl_ixtable = NULL;
+	if (!convert_header(rl, nrl, &lo) || lo.pgsize == 0 || lo.tppp == 0) {
+		ERR(E_UNKNOWN_FORMAT);
+		free(nrl);
+		return false;
+	}
+	fkeycnt = nrl->rl_header.hd_fkeycnt; /* reset by rl_create() */
+	refcnt = nrl->rl_header.hd_refcnt;
+	rl_unlink(filename); /* left by an interrupted conversion */
+	if (!rl_create(nrl)) {
+		free(nrl);
+		return false;
+	}
+	nrl->rl_header.hd_fkeycnt = fkeycnt;
+	nrl->rl_header.hd_refcnt = refcnt;
+
+	chunkmax = RL_SCAN_CHUNK_SIZE / lo.pgsize;
+	if (chunkmax == 0)
+		chunkmax = 1;
+	chunk = xmalloc(chunkmax * lo.pgsize);
+	retval = true;
+	for (pg = 0; retval; pg += cnt) {
+		n = pread(rl->rl_fd, chunk, chunkmax * lo.pgsize,
+				lo.asize + (off_t)pg * (off_t)lo.pgsize);
+		if (n == -1)
+			retval = false;
+		if (n <= 0 || (cnt = n / lo.pgsize) == 0)
+			break;
+		for (i = 0; i < cnt * lo.tppp && retval; i++) {
+			page = chunk + (i / lo.tppp) * lo.pgsize;
+			tp = page + lo.pghdsize + (i % lo.tppp) * lo.entsize;
+			if (TP_STATUS(tp) == TP_UNUSED)
+				continue;
+
+			addr = pg * (blkaddr_t)lo.tppp + (blkaddr_t)i;
+			TP_STATUS(nrl->rl_tpbuf) = TP_STATUS(tp);
+			memcpy(TP_DATA(nrl->rl_tpbuf), page + lo.pghdsize
+					+ lo.tppp * lo.entsize
+					+ (i % lo.tppp) * lo.datasize,
+					lo.datasize);
+			retval = tp_write(nrl, addr, nrl->rl_tpbuf, 0)
+				&& (TP_STATUS(tp) == TP_OCCUP
+				|| fsm_mark(nrl, addr, true));
+		}
+	}
+	free(chunk);
+
+	retval = rl_close(nrl) && retval;
+	strcpy(fsmname, rl->rl_name);
+	strcat(fsmname, RL_FSM_SUFFIX);
+	strcpy(newfsmname, filename);
+	strcat(newfsmname, RL_FSM_SUFFIX);
+	if (retval && wal_rename(newfsmname, fsmname)
+			&& wal_rename(filename, rl->rl_name)) {
+		close(rl->rl_fd);
+		rl->rl_fd = open(rl->rl_name, OPEN_RW_FLAGS, FILE_MODE);
+		return rl->rl_fd != -1;
+	}
+	rl_unlink(filename);
+	return false;
+}
+
 struct srel *rl_open(struct srel *rl)
 {
+	char magic[RL_MAGIC_SIZE];
+	unsigned short format;
+	bool rebuild;
+
 	assert(rl != NULL);
 
+	/* the log is redone before the file is read */
+	if (!wal_open()) {
+		ERR(E_LOG_FAILED);
+		return NULL;
+	}
+
 	rl->rl_fd = open(rl->rl_name, OPEN_RW_FLAGS, FILE_MODE);
 	if (rl->rl_fd == -1) {
 		ERR(E_OPEN_FAILED);
 		return  NULL;
 	}
 
-	if (read_header(rl)) {
-		rl->rl_tpbuf = xmalloc(rl->rl_header.hd_tpasize);
-		if (rl->rl_header.hd_rlclosed) {
-			rl->rl_header.hd_rlclosed = false;
-			if (!rl_write_header(rl)) {
-				ERR(E_WRITE_FAILED);
-				free(rl->rl_tpbuf);
-				return NULL;
-			}
-		} else {
-			rl->rl_header.hd_rlclosed = false;
-			rebuild_header(rl);
+	/* files of old formats have no magic number or an older format 
+	 * version and are converted */
+	rl->rl_converted = false;
+	if (PREAD(rl->rl_fd, magic, RL_MAGIC_SIZE, 0)
+			&& (memcmp(magic, RL_MAGIC, RL_MAGIC_SIZE) != 0
+			|| (PREAD(rl->rl_fd, &format, sizeof(format),
+				offsetof(struct srel_hdr, hd_format))
+			&& format < RL_FORMAT))) {
+		if (!convert(rl)) {
+			ERR(E_CONVERSION_FAILED);
+			close(rl->rl_fd);
+			return NULL;
 		}
+		rl->rl_converted = true;
+	}
+
+	if (!read_header(rl) || rl->rl_header.hd_format != RL_FORMAT) {
+		ERR(E_UNKNOWN_FORMAT);
+		close(rl->rl_fd);
+		return NULL;
+	}
+	rl->rl_logid = wal_register(rl->rl_name, rl->rl_fd, checkpoint, rl);
+
+	/* a missing free-space map is rebuilt */
+	rebuild = !fsm_init(rl, OPEN_RW_FLAGS);
+	if (rebuild && !fsm_init(rl, OPEN_RW_FLAGS | O_CREAT | O_TRUNC)) {
+		ERR(E_OPEN_FAILED);
+		wal_unregister(rl->rl_logid);
+		close(rl->rl_fd);
+		return NULL;
+	}
+
+	if (map_init(rl)) {
+		init_direct_io(rl);
+		rl->rl_tpbuf = xmalloc(rl->rl_header.hd_tpsize);
+		rl->rl_pgbuf = xmemalign(IO_ALIGN, rl->rl_header.hd_pgsize);
+		rl->rl_pgaddr = INVALID_ADDR;
+		rl->rl_modcnt = 0;
 #ifndef NO_CACHE
-		rl->rl_cache = cache_init(rl->rl_header.hd_tpasize,
-				TOTAL_CACHE_SIZE / rl->rl_header.hd_tpasize);
+		rl->rl_cache = cache_init(rl->rl_header.hd_pgsize, rl,
+				tp_flush);
 #endif
+		/* the counters are only rebuilt if the relation was not 
+		 * closed properly and they were not logged */
+		rebuild = rebuild || !rl->rl_header.hd_rlclosed;
+		if (rebuild)
+			rebuild_header(rl);
+		rl->rl_header.hd_rlclosed = HD_LOGGED;
+		if ((rebuild || !HD_LOGGED) && !rl_write_header(rl)) {
+			ERR(E_WRITE_FAILED);
+#ifdef USE_MMAP
+			munmap(rl->rl_map, rl->rl_mapsize);
+#endif
+#ifndef NO_CACHE
+			cache_free(rl->rl_cache);
+#endif
+			fsm_free(rl);
+			wal_unregister(rl->rl_logid);
+			free(rl->rl_pgbuf);
+			free(rl->rl_tpbuf);
+			return NULL;
+		}
 		return rl;
 	} else 
 		return NULL;
@@ -248,47 +1068,127 @@ bool rl_close(struct srel *rl)
 
 	assert(rl != NULL);
 
-	rl->rl_header.hd_rlclosed = true;
-	if (!(retval = rl_write_header(rl)))
+	retval = rl_flush(rl);
+	rl->rl_header.hd_rlclosed = retval;
+	if (!rl_write_header(rl)) {
 		ERR(E_WRITE_FAILED);
+		retval = false;
+	}
 
+#ifdef USE_MMAP
+	munmap(rl->rl_map, rl->rl_mapsize);
+#endif
+	wal_unregister(rl->rl_logid);
 	close(rl->rl_fd);
 	rl->rl_fd = -1;
 #ifndef NO_CACHE
 	cache_free(rl->rl_cache);
 #endif
+	fsm_free(rl);
+	free(rl->rl_pgbuf);
 	free(rl->rl_tpbuf);
 	rl->rl_tpbuf = NULL;
 	free(rl);
 	return retval;
 }
 
-static bool update_prev_addr(struct srel *rl, blkaddr_t addr,
-		blkaddr_t prev_addr)
+bool rl_unlink(const char *rl_name)
 {
-	assert(rl != NULL);
+	char filename[PATH_MAX+1];
 
-	if (addr == INVALID_ADDR)
-		return true;
-	return tp_write_range(rl, addr, TP_PREV_OFFSET,
-			(const char *)&prev_addr, 0, sizeof(blkaddr_t));
+	assert(rl_name != NULL);
+
+	if (strlen(rl_name) + strlen(RL_FSM_SUFFIX) > PATH_MAX)
+		return false;
+	strcpy(filename, rl_name);
+	strcat(filename, RL_FSM_SUFFIX);
+	wal_unlink(filename);
+	return wal_unlink(rl_name);
 }
 
-static bool update_next_addr(struct srel *rl, blkaddr_t addr,
-		blkaddr_t next_addr)
+bool rl_compact(struct srel *rl, blkaddr_t (*nextf)(void *ctx), void *ctx)
 {
+	char filename[PATH_MAX+1];
+	struct srel *nrl;
+	struct srel_iter *iter = NULL;
+	const char *tuple;
+	blkaddr_t addr;
+	bool retval;
+
 	assert(rl != NULL);
 
-	if (addr == INVALID_ADDR)
-		return true;
-	return tp_write_range(rl, addr, TP_NEXT_OFFSET,
-			(const char *)&next_addr, 0, sizeof(blkaddr_t));
+	if (strlen(rl->rl_name) + strlen(NEW_SUFFIX) + strlen(RL_FSM_SUFFIX)
+			> PATH_MAX)
+		return false;
+	strcpy(filename, rl->rl_name);
+	strcat(filename, NEW_SUFFIX);
+
+	nrl = xmalloc(sizeof(struct srel));
+	strcpy(nrl->rl_name, filename);
+	nrl->rl_header = rl->rl_header;
+	nrl->rl_ixtable = NULL;
+	rl_unlink(filename); /* left by an interrupted compaction */
+	if (!rl_create(nrl)) {
+		free(nrl);
+		return false;
+	}
+	nrl->rl_header.hd_fkeycnt = rl->rl_header.hd_fkeycnt;
+	nrl->rl_header.hd_refcnt = rl->rl_header.hd_refcnt;
+
+	/* the new file's map is empty, i.e. the tuples are appended */
+	retval = true;
+	if (nextf == NULL)
+		iter = rl_physical_iterator(rl);
+	while (retval) {
+		if (nextf == NULL) {
+			if ((tuple = rl_next(iter)) == NULL)
+				break;
+		} else if ((addr = nextf(ctx)) != INVALID_ADDR) {
+			if ((tuple = rl_get(rl, addr)) == NULL)
+				retval = false;
+		} else
+			break;
+		retval = retval && rl_insert(nrl, tuple) != INVALID_ADDR;
+	}
+	if (iter != NULL)
+		srel_iter_free(iter);
+
+	/* an incomplete order must not lose tuples */
+	retval = retval && nrl->rl_header.hd_tpcnt == rl->rl_header.hd_tpcnt;
+	retval = rl_close(nrl) && retval;
+	if (!retval)
+		rl_unlink(filename);
+	return retval;
 }
 
-bool rl_delete(struct srel *rl, blkaddr_t addr)
+bool rl_replace(const char *rl_name)
 {
-	blkaddr_t prev_addr, next_addr;
+	char fsmname[PATH_MAX+1], filename[PATH_MAX+1];
+	char newfsmname[PATH_MAX+1];
+
+	assert(rl_name != NULL);
+
+	if (strlen(rl_name) + strlen(NEW_SUFFIX) + strlen(RL_FSM_SUFFIX)
+			> PATH_MAX)
+		return false;
+	strcpy(fsmname, rl_name);
+	strcat(fsmname, RL_FSM_SUFFIX);
+	strcpy(filename, rl_name);
+	strcat(filename, NEW_SUFFIX);
+	strcpy(newfsmname, filename);
+	strcat(newfsmname, RL_FSM_SUFFIX);
+
+	/* the old map is removed first and the new one moved last, because
+	 * rl_open() rebuilds a missing map, but not a map of the other file */
+	if (access(filename, F_OK) != 0)
+		return false;
+	wal_unlink(fsmname);
+	return wal_rename(filename, rl_name)
+		&& wal_rename(newfsmname, fsmname);
+}
 
+bool rl_delete(struct srel *rl, blkaddr_t addr)
+{
 	assert(rl != NULL);
 
 	if (addr > rl->rl_header.hd_tpmax) {
@@ -301,41 +1201,22 @@ bool rl_delete(struct srel *rl, blkaddr_t addr)
 		ERR(E_READ_FAILED);
 		return false;
 	}
-	if (TP_STATUS(rl->rl_tpbuf) == TP_AVAIL)
+	if (TP_STATUS(rl->rl_tpbuf) != TP_OCCUP)
 		return true;
-	prev_addr = TP_PREV_ADDR(rl->rl_tpbuf);
-	next_addr = TP_NEXT_ADDR(rl->rl_tpbuf);
 
 	/* mark tuple as deleted */
 	TP_STATUS(rl->rl_tpbuf) = TP_AVAIL;
-	TP_NEXT_ADDR(rl->rl_tpbuf) = INVALID_ADDR;
-	TP_PREV_ADDR(rl->rl_tpbuf) = rl->rl_header.hd_tpavail;
-	FILL_BUF(rl->rl_tpbuf, TP_DATA_OFFSET, rl->rl_header.hd_tpasize);
-
-	/* override tuple in file */
-	if (tp_write(rl, addr, rl->rl_tpbuf)) {
-		/* update linked list of deleted tuples */
-		if (!update_next_addr(rl, rl->rl_header.hd_tpavail, addr)) {
-			ERR(E_UPDATE_NEXT_ADDR_FAILED);
-			return false;
-		}
-		rl->rl_header.hd_tpavail = addr;
-
-		/* update linked list of active tuples */
-		if (!update_next_addr(rl, prev_addr, next_addr)) {
-			ERR(E_UPDATE_NEXT_ADDR_FAILED);
-			return false;
-		}
-		if (!update_prev_addr(rl, next_addr, prev_addr)) {
-			ERR(E_UPDATE_PREV_ADDR_FAILED);
-			return false;
-		}
-
-		if (addr == rl->rl_header.hd_tplatest)
-			rl->rl_header.hd_tplatest = prev_addr;
-		rl->rl_header.hd_tpcnt--;
+	FILL_BUF(rl->rl_tpbuf, TP_DATA_OFFSET, rl->rl_header.hd_tpsize);
+
+	/* override tuple in file and mark it free in the free-space map; both
+	 * are one group, otherwise a crash between them would leak the slot.
+	 * The map's page is loaded first, so that fsm_mark() cannot fail 
+	 * before it logs the bit. */
+	if (fsm_load(rl, FSM_PAGE_OF(rl, addr))
+			&& tp_write(rl, addr, rl->rl_tpbuf, 1)
+			&& fsm_mark(rl, addr, true))
 		return true;
-	} else {
+	else {
 		ERR(E_WRITE_FAILED);
 		return false;
 	}
@@ -355,12 +1236,10 @@ bool rl_update(struct srel *rl, blkaddr_t addr, const char *data)
 	/* prepare buffer with updated data only */
 	memcpy(TP_DATA(rl->rl_tpbuf), data,
 			rl->rl_header.hd_tpsize - TP_DATA_OFFSET);
-	FILL_BUF(rl->rl_tpbuf, rl->rl_header.hd_tpsize,
-			rl->rl_header.hd_tpasize);
 
 	/* write the updated data to file */
 	if (tp_write_range(rl, addr, TP_DATA_OFFSET, TP_DATA(rl->rl_tpbuf), 0,
-				rl->rl_header.hd_tpasize - TP_DATA_OFFSET))
+				rl->rl_header.hd_tpsize - TP_DATA_OFFSET))
 		return true;
 	else {
 		ERR(E_ADDR_OUT_OF_RANGE);
@@ -370,18 +1249,16 @@ bool rl_update(struct srel *rl, blkaddr_t addr, const char *data)
 
 blkaddr_t rl_insert(struct srel *rl, const char *tp_data)
 {
-	blkaddr_t addr, prev_addr, next_addr;
+	blkaddr_t addr;
 
 	assert(rl != NULL);
 	assert(tp_data != NULL);
 
-	/* determine tuple address: replace an available tuple (and update 
-	 * the list of deleted tuples) or append it */
-	addr = rl->rl_header.hd_tpavail;
+	/* determine tuple address: replace an available tuple or append it */
+	addr = fsm_find(rl);
 	if (addr == INVALID_ADDR)
 		addr = rl->rl_header.hd_tpmax + 1;
-
-	if (addr <= rl->rl_header.hd_tpmax) {
+	else {
 		if (!tp_read(rl, addr, rl->rl_tpbuf)) {
 			ERR(E_READ_FAILED);
 			return INVALID_ADDR;
@@ -390,51 +1267,121 @@ blkaddr_t rl_insert(struct srel *rl, const char *tp_data)
 			ERR(E_TUPLE_ACTIVE);
 			return INVALID_ADDR;
 		}
-		prev_addr = TP_PREV_ADDR(rl->rl_tpbuf);
-		next_addr = TP_NEXT_ADDR(rl->rl_tpbuf);
-	} else {
-		prev_addr = INVALID_ADDR;
-		next_addr = INVALID_ADDR;
-	}
 
+		/* the bit is cleared before the tuple is written, such that
+		 * a crash never leaves it set for an occupied tuple */
+		if (!fsm_mark(rl, addr, false)) {
+			ERR(E_WRITE_FAILED);
+			return INVALID_ADDR;
+		}
+	}
 
 	/* initialize tuple buffer */
 	TP_STATUS(rl->rl_tpbuf) = TP_OCCUP;
-	TP_PREV_ADDR(rl->rl_tpbuf) = rl->rl_header.hd_tplatest;
-	TP_NEXT_ADDR(rl->rl_tpbuf) = INVALID_ADDR;
 	memcpy(TP_DATA(rl->rl_tpbuf), tp_data,
 			rl->rl_header.hd_tpsize - TP_DATA_OFFSET);
-	FILL_BUF(rl->rl_tpbuf, rl->rl_header.hd_tpsize,
-			rl->rl_header.hd_tpasize);
 
 	/* write tuple to file */
-	if (tp_write(rl, addr, rl->rl_tpbuf)) {
-		/* update linked list of active tuples */
-		if (!update_next_addr(rl, rl->rl_header.hd_tplatest, addr)) {
-			ERR(E_UPDATE_NEXT_ADDR_FAILED);
-			return INVALID_ADDR;
-		}
-		rl->rl_header.hd_tplatest = addr;
+	if (!tp_write(rl, addr, rl->rl_tpbuf, 0)) {
+		ERR(E_WRITE_FAILED);
+		return INVALID_ADDR;
+	}
+	return addr;
+}
+
+/* writes `cnt' complete new pages from `buf' behind the last page with one 
+ * write; the pages must have been logged */
+static bool pg_append(struct srel *rl, blkaddr_t pg, const char *buf,
+		size_t cnt)
+{
+	const size_t pgsize = rl->rl_header.hd_pgsize;
+
+	/* rl_pgbuf and the cache only hold pages up to the last page */
+	if (rl->rl_pgaddr != INVALID_ADDR && rl->rl_pgaddr >= pg)
+		rl->rl_pgaddr = INVALID_ADDR;
+#ifdef USE_MMAP
+	for (; cnt > 0; cnt--, pg++, buf += pgsize)
+		if (!pg_store(rl, pg, 0, buf, pgsize))
+			return false;
+	return true;
+#else
+	rl->rl_modcnt++;
+	return wal_force() && PWRITE(rl->rl_fd, buf, cnt * pgsize,
+			PG_TO_POS(rl, pg));
+#endif
+}
+
+blkaddr_t rl_append(struct srel *rl, const char *tp_data, size_t cnt)
+{
+	const size_t pgsize = rl->rl_header.hd_pgsize;
+	blkaddr_t first, pg;
+	size_t i, slot, chunkmax, chunkcnt;
+	char *chunk, *page;
+	bool retval;
+
+	assert(rl != NULL);
+	assert(tp_data != NULL || cnt == 0);
+
+	first = rl->rl_header.hd_tpmax + 1;
 
-		/* update linked list of deleted tuples */
-		if (!update_next_addr(rl, prev_addr, next_addr)) {
-			ERR(E_UPDATE_NEXT_ADDR_FAILED);
+	/* the last page is filled up tuple by tuple */
+	for (i = 0; i < cnt && SLOT_OF(rl, first + i) != 0; i++) {
+		TP_STATUS(rl->rl_tpbuf) = TP_OCCUP;
+		memcpy(TP_DATA(rl->rl_tpbuf), tp_data + i * TP_DATA_SIZE(rl),
+				TP_DATA_SIZE(rl));
+		if (!tp_write(rl, first + i, rl->rl_tpbuf, 0)) {
+			ERR(E_WRITE_FAILED);
 			return INVALID_ADDR;
 		}
-		rl->rl_header.hd_tpavail = prev_addr;
+	}
 
-		if (addr > rl->rl_header.hd_tpmax)
-			rl->rl_header.hd_tpmax = addr;
-		rl->rl_header.hd_tpcnt++;
-		return addr;
-	} else {
+	/* the new pages are built in a chunk, each page is logged once with 
+	 * the counters and the chunk is written at once */
+	chunkmax = RL_SCAN_CHUNK_SIZE / pgsize;
+	if (chunkmax == 0)
+		chunkmax = 1;
+	if (chunkmax > (cnt - i) / rl->rl_header.hd_tppp + 1)
+		chunkmax = (cnt - i) / rl->rl_header.hd_tppp + 1;
+	chunk = xmemalign(IO_ALIGN, chunkmax * pgsize);
+	retval = true;
+	while (retval && i < cnt) {
+		pg = PAGE_OF(rl, first + i);
+		for (chunkcnt = 0; chunkcnt < chunkmax && i < cnt; chunkcnt++) {
+			page = chunk + chunkcnt * pgsize;
+			pg_init(rl, page);
+			for (slot = 0; slot < rl->rl_header.hd_tppp && i < cnt;
+					slot++, i++) {
+				TP_STATUS(page + PG_SLOT_OFFSET(rl, slot))
+					= TP_OCCUP;
+				memcpy(page + PG_DATA_OFFSET(rl, slot),
+						tp_data + i * TP_DATA_SIZE(rl),
+						TP_DATA_SIZE(rl));
+			}
+			PG_CNT(page) = (tpcnt_t)slot;
+			rl->rl_header.hd_tpcnt += (tpcnt_t)slot;
+			rl->rl_header.hd_tpmax = first + i - 1;
+			wal_link(1);
+			if (!wal_write(rl->rl_logid, PG_TO_POS(rl, pg + chunkcnt),
+						page, pgsize, pgsize)
+					|| !hd_log(rl)) {
+				retval = false;
+				break;
+			}
+		}
+		retval = retval && pg_append(rl, pg, chunk, chunkcnt);
+	}
+	free(chunk);
+	if (!retval) {
 		ERR(E_WRITE_FAILED);
 		return INVALID_ADDR;
 	}
+	return first;
 }
 
 const char *rl_get(struct srel *rl, blkaddr_t addr)
 {
+	const char *data;
+
 	assert(rl != NULL);
 
 	if (addr > rl->rl_header.hd_tpmax) {
@@ -443,10 +1390,10 @@ const char *rl_get(struct srel *rl, blkaddr_t addr)
 	}
 
 	/* load tuple into buffer */
-	if (tp_read(rl, addr, rl->rl_tpbuf)) {
+	if ((data = tp_get(rl, addr, rl->rl_tpbuf)) != NULL) {
 		tpstatus_t status = TP_STATUS(rl->rl_tpbuf);
 		if (status == TP_OCCUP)
-			return rl->rl_tpbuf + TP_DATA_OFFSET;
+			return data;
 		else {
 			ERR(E_TUPLE_DELETED);
 			return NULL;
@@ -466,13 +1413,31 @@ struct srel_iter *rl_iterator(struct srel *rl)
 	iter = xmalloc(sizeof(struct srel_iter));
 	iter->it_rl = rl;
 	iter->it_curaddr = INVALID_ADDR;
+	iter->it_physical = false;
+	iter->it_chunk = NULL;
+	iter->it_chunkcnt = 0;
+	iter->it_tpbuf = xmalloc(rl->rl_header.hd_tpsize);
+	return iter;
+}
 
-	/* buffer is empty except the TP_PREV_ADDR field which points to 
-	 * the youngest tuple */
-	iter->it_tpbuf = xmalloc(rl->rl_header.hd_tpasize);
-	FILL_BUF(iter->it_tpbuf, 0, rl->rl_header.hd_tpasize);
-	TP_PREV_ADDR(iter->it_tpbuf) = rl->rl_header.hd_tplatest;
+struct srel_iter *rl_physical_iterator(struct srel *rl)
+{
+	struct srel_iter *iter;
 
+	assert(rl != NULL);
+
+	iter = xmalloc(sizeof(struct srel_iter));
+	iter->it_rl = rl;
+	iter->it_curaddr = INVALID_ADDR;
+	iter->it_tpbuf = NULL;
+	iter->it_physical = true;
+	iter->it_chunk = NULL;
+	iter->it_chunkmax = RL_SCAN_CHUNK_SIZE / rl->rl_header.hd_pgsize;
+	if (iter->it_chunkmax == 0)
+		iter->it_chunkmax = 1;
+	iter->it_chunkcnt = 0;
+	iter->it_chunkpg = INVALID_ADDR;
+	iter->it_chunkmod = 0;
 	return iter;
 }
 
@@ -481,6 +1446,8 @@ void srel_iter_free(struct srel_iter *iter)
 	if (iter != NULL) {
 		if (iter->it_tpbuf != NULL)
 			free(iter->it_tpbuf);
+		if (iter->it_chunk != NULL)
+			free(iter->it_chunk);
 		free(iter);
 	}
 }
@@ -490,15 +1457,127 @@ void rl_iterator_reset(struct srel_iter *iter)
 	assert(iter != NULL);
 
 	iter->it_curaddr = INVALID_ADDR;
+}
+
+#ifndef USE_MMAP
+/* reads as many pages as possible starting with page `pg' into the chunk; 
+ * the cached pages may be newer than the file, so they are copied over the
+ * pages read from the file instead of flushing them */
+static bool read_chunk(struct srel_iter *iter, blkaddr_t pg)
+{
+	struct srel *rl = iter->it_rl;
+	size_t cnt, filecnt, i;
+	ssize_t n;
+
+	cnt = PAGE_OF(rl, rl->rl_header.hd_tpmax) - pg + 1;
+	if (iter->it_chunk == NULL) {
+		/* small relations don't need a chunk of maximum size */
+		if (iter->it_chunkmax > cnt)
+			iter->it_chunkmax = cnt;
+		iter->it_chunk = xmemalign(IO_ALIGN, iter->it_chunkmax
+				* rl->rl_header.hd_pgsize);
+	}
+	if (cnt > iter->it_chunkmax)
+		cnt = iter->it_chunkmax;
+
+	iter->it_chunkcnt = 0;
+	n = pread(rl->rl_fd, iter->it_chunk, cnt * rl->rl_header.hd_pgsize,
+			PG_TO_POS(rl, pg));
+	if (n < 0)
+		return false;
+	filecnt = (size_t)n / rl->rl_header.hd_pgsize;
 
-	/* buffer is empty except the TP_PREV_ADDR field which points to 
-	 * the youngest tuple */
-	FILL_BUF(iter->it_tpbuf, 0, iter->it_rl->rl_header.hd_tpasize);
-	TP_PREV_ADDR(iter->it_tpbuf) = iter->it_rl->rl_header.hd_tplatest;
+	/* the pages behind the end of the file are in the cache, if they were
+	 * written at all */
+	for (i = 0; i < cnt; i++) {
+#ifndef NO_CACHE
+		if (cache_search(rl->rl_cache, pg + (blkaddr_t)i,
+					iter->it_chunk
+					+ i * rl->rl_header.hd_pgsize))
+			continue;
+#endif
+		if (i >= filecnt)
+			break;
+	}
+	if (i == 0)
+		return false;
+	iter->it_chunkcnt = i;
+	iter->it_chunkpg = pg;
+	iter->it_chunkmod = rl->rl_modcnt;
+	return true;
+}
+#endif
+
+/* returns the next tuple; if `inchunk' is set, NULL is also returned where
+ * the next chunk had to be read, which would overwrite the current one */
+static const char *physical_next(struct srel_iter *iter, bool inchunk)
+{
+	struct srel *rl = iter->it_rl;
+	blkaddr_t addr, pg, slot;
+	char *page;
+
+	for (addr = iter->it_curaddr + 1; addr <= rl->rl_header.hd_tpmax;
+			addr++) {
+		pg = PAGE_OF(rl, addr);
+		slot = SLOT_OF(rl, addr);
+#ifdef USE_MMAP
+		/* the mapping is the chunk */
+		if ((page = pg_map(rl, pg)) == NULL) {
+			ERR(E_READ_FAILED);
+			return NULL;
+		}
+#else
+		if (pg < iter->it_chunkpg
+				|| pg >= iter->it_chunkpg
+				+ (blkaddr_t)iter->it_chunkcnt
+				|| iter->it_chunkmod != rl->rl_modcnt) {
+			if (inchunk) {
+				iter->it_curaddr = addr - 1;
+				return NULL;
+			}
+			if (!read_chunk(iter, pg)) {
+				ERR(E_READ_FAILED);
+				return NULL;
+			}
+		}
+		page = iter->it_chunk
+			+ (pg - iter->it_chunkpg) * rl->rl_header.hd_pgsize;
+#endif
+
+		/* skip empty pages */
+		if (slot == 0 && PG_CNT(page) == 0) {
+			addr += rl->rl_header.hd_tppp - 1;
+			continue;
+		}
+
+		if (TP_STATUS(page + PG_SLOT_OFFSET(rl, slot)) == TP_OCCUP) {
+			iter->it_curaddr = addr;
+			return page + PG_DATA_OFFSET(rl, slot);
+		}
+	}
+	iter->it_curaddr = rl->rl_header.hd_tpmax;
+	return NULL;
+}
+
+size_t rl_next_batch(struct srel_iter *iter, const char **tuples, size_t max)
+{
+	size_t n;
+
+	assert(iter != NULL);
+	assert(iter->it_physical);
+	assert(tuples != NULL);
+
+	/* the batch ends where the next chunk would be read */
+	for (n = 0; n < max; n++)
+		if ((tuples[n] = physical_next(iter, n > 0)) == NULL)
+			break;
+	return n;
 }
 
 const char *rl_next(struct srel_iter *iter)
 {
+	const char *data;
+
 	assert(iter != NULL);
 
 	if (iter == NULL) {
@@ -506,21 +1585,19 @@ const char *rl_next(struct srel_iter *iter)
 		return NULL;
 	}
 
-	/* determine address of tuple */
-	iter->it_curaddr = TP_PREV_ADDR(iter->it_tpbuf);
-	if (iter->it_curaddr == INVALID_ADDR)
-		return NULL;
+	if (iter->it_physical)
+		return physical_next(iter, false);
 
-	/* load tuple into buffer */
-	if (!tp_read(iter->it_rl, iter->it_curaddr, iter->it_tpbuf)) {
-		ERR(E_READ_FAILED);
-		return NULL;
-	}
-	if (TP_STATUS(iter->it_tpbuf) == TP_OCCUP)
-		return TP_DATA(iter->it_tpbuf);
-	else {
-		ERR(E_TUPLE_DELETED);
-		return NULL;
+	/* load the next active tuple into the buffer */
+	while (iter->it_curaddr < iter->it_rl->rl_header.hd_tpmax) {
+		iter->it_curaddr++;
+		data = tp_get(iter->it_rl, iter->it_curaddr, iter->it_tpbuf);
+		if (data == NULL) {
+			ERR(E_READ_FAILED);
+			return NULL;
+		}
+		if (TP_STATUS(iter->it_tpbuf) == TP_OCCUP)
+			return data;
 	}
+	return NULL;
 }
-
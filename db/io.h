@@ -16,26 +16,45 @@
 
 /*
  * Input/output core utilities for the relation file.
- * All tuples of a relation (= table) have a fixed size which is a multiple 
- * of BLK_SIZE. Tuples are stored in a single file, a so-called relation data 
- * file.
- * Each tuple has a status byte (which marks it either as deleted or active), 
- * a pointer to the next tuple and a pointer to the previous tuple. 
- * This makes a set of tuples form a double linked list. In fact, all 
- * active tuples form a double linked list and all deleted tuples form another 
- * double linked list.
- * Pointers to tuples are their addresses or indexes in the file. The first 
- * index is 0, which is the address of the first tuple, which is positioned 
- * directly after the relation data file header. The equivalent of NULL 
- * pointers in the context of tuple addresses is INVALID_ADDR = -1.
+ * All tuples of a relation (= table) have a fixed size. Tuples are stored in 
+ * a single file, a so-called relation data file, which consists of pages.
+ * A page starts with a small header (the count of active
+ * tuples in the page), followed by a slot directory and the tuples' data. 
+ * Each slot directory entry is a status byte which marks the tuple either 
+ * as deleted or active or the slot as unused.
+ * Deleted tuples are recorded in the free-space map, a bitmap with one bit 
+ * per tuple address which is stored in pages of its own in a second file 
+ * (the relation data file's name plus RL_FSM_SUFFIX). Inserting and deleting
+ * a tuple thus touches the tuple's page and one page of the map.
+ * Pointers to tuples are their addresses in the file. The address of the 
+ * tuple in slot s of page p is p * hd_tppp + s, where hd_tppp is the count of
+ * tuples per page. The first address is 0, which is the address of the first 
+ * tuple in the first page, which is positioned directly after the relation
+ * data file header. The equivalent of NULL pointers in the context of tuple
+ * addresses is INVALID_ADDR = -1.
  * The mentioned relation data file header is a struct header, aligned to a 
- * multiple of BLK_SIZE. This header contains important information like the 
- * tuple size and the first nodes of the double linked lists of active 
- * respectively deleted tuples.
- * When a relation is closed explicitly, this header is written to the relation 
- * file and thus kept up to date. While this makes sense, omitting it does 
- * not destroy the relation, because the database rebuilds those header 
- * information that got out of sync with the database.
+ * multiple of the file system's block size (at least BLK_SIZE), just like 
+ * the pages of new relations; this allows direct I/O. This header contains 
+ * important information like the tuple size and the count of active 
+ * respectively deleted tuples. It starts with RL_MAGIC and the format 
+ * version.
+ * Relation files of older formats are converted to the current format by
+ * rl_open(): RL_FORMAT_BLOCK (each tuple in a block of a multiple of 
+ * BLK_SIZE bytes) and RL_FORMAT_SLOTTED have 32-bit addresses and no magic 
+ * number, RL_FORMAT_SLOTTED64 links the tuples in lists instead of the 
+ * free-space map and the header of RL_FORMAT_FSM has no composite indexes.
+ * The node sizes of the indexes and the mark of a bulk insertion were 
+ * appended to the header of RL_FORMAT_IXS later; they lie in the zero-filled
+ * rest of the aligned header of older files of this format, i.e. their 
+ * indexes are rebuilt with the default size.
+ * When a relation is closed explicitly and at checkpoints of the log, this 
+ * header is written to the relation file and thus kept up to date. 
+ * The changes of the pages, the map and the header's counters are logged in 
+ * the write-ahead log (see wal.h) before they are written, so that they are 
+ * redone after a crash; opening a relation thus does not scan it. Only if 
+ * the counters could not be logged (with USE_MMAP) or the free-space map is
+ * missing, the database rebuilds those header information and the map from
+ * the pages.
  */
 
 #ifndef __IO_H__
@@ -52,11 +71,39 @@
 #define AT_NAME_MAX	31	/* attribute name size */
 #define REF_MAX		3	/* max. count of references to a relation */
 #define FKEY_MAX	3	/* max. count of foreign keys of a relation */
+#define IX_MAX		8	/* max. count of composite indexes */
+#define IX_ATTR_MAX	4	/* max. attribute count of a composite index */
+
+/* the id of the index of a single attribute is the attribute's number, 
+ * composite indexes have the ids ATTR_MAX, ..., IX_ID_MAX-1 */
+#define IX_ID_MAX	(ATTR_MAX + IX_MAX)
 
 #define NOT_INDEXED	0	/* attribute not indexed */
 #define PRIMARY		1	/* primary index (no double values allowed) */
 #define SECONDARY	2	/* secondary index (double values allowed) */
 
+#define RL_FORMAT_BLOCK		0	/* one tuple per block, 32-bit
+					 * addresses (old format) */
+#define RL_FORMAT_SLOTTED	1	/* many tuples per page, 32-bit
+					 * addresses (old format) */
+#define RL_FORMAT_SLOTTED64	2	/* many tuples per page, 64-bit
+					 * addresses (old format) */
+#define RL_FORMAT_FSM		3	/* many tuples per page, 64-bit
+					 * addresses, free-space map (old
+					 * format) */
+#define RL_FORMAT_IXS		4	/* like RL_FORMAT_FSM, composite
+					 * indexes in the header */
+#define RL_FORMAT		RL_FORMAT_IXS	/* current format */
+
+#define RL_FSM_SUFFIX	".fsm"	/* suffix of the free-space map file */
+
+/* starts the header of RL_FORMAT_SLOTTED64 and newer files; the header of 
+ * older files starts with the relation name which is never empty */
+#define RL_MAGIC	"\0DBSREL"
+#define RL_MAGIC_SIZE	8
+
+#define RL_PAGE_SIZE	(8 * BLK_SIZE)	/* min. page size of new relations */
+
 struct sattr { /* a stored relation attribute */
 	enum domain	at_domain;		/* content type */
 	char		at_name[AT_NAME_MAX+1];	/* name */
@@ -72,45 +119,99 @@ struct sref {
 	unsigned short	rf_thisattr;		/* index of owning attr */
 };
 
+struct sindex { /* a stored composite index */
+	unsigned short	sx_id;			/* index id */
+	unsigned short	sx_atcnt;		/* count of attributes */
+	unsigned short	sx_attrs[IX_ATTR_MAX];	/* numbers of the attributes
+						 * in the order of the key */
+};
+
 struct srel_hdr { /* information container for a relation */
+	char		hd_magic[RL_MAGIC_SIZE];/* RL_MAGIC */
+	unsigned short	hd_format;		/* RL_FORMAT */
 	char		hd_name[RL_NAME_MAX+1];	/* relation name */
 	unsigned short	hd_atcnt;		/* count of attributes */
 	struct sattr	hd_attrs[ATTR_MAX];	/* attributes */
 	off_t		hd_asize;		/* aligned size of header */
-	size_t		hd_tpsize;		/* status+addr+tuple size */
-	size_t		hd_tpasize;		/* tpsize aligned to BLK_SIZE */
+	size_t		hd_tpsize;		/* status+tuple size */
 	tpcnt_t		hd_tpcnt;		/* count of tuples in table */
+	tpcnt_t		hd_tpfree;		/* count of deleted tuples */
 	blkaddr_t	hd_tpmax;		/* maximum address in table */
-	blkaddr_t	hd_tplatest;		/* latest inserted tuple */
-	blkaddr_t	hd_tpavail;		/* latest deleted tuple */
 	struct sref	hd_fkeys[FKEY_MAX];	/* true if rl has fgn key */
 	unsigned short	hd_fkeycnt;		/* count of foreign keys */
 	struct sref	hd_refs[REF_MAX];	/* references to this rl */
 	unsigned short	hd_refcnt;		/* count of references */
-	bool		hd_rlclosed;		/* relation closed properly? */
+	bool		hd_rlclosed;		/* counters valid, i.e.
+						 * closed properly or
+						 * logged? */
+	size_t		hd_pgsize;		/* size of a page */
+	unsigned short	hd_tppp;		/* count of tuples per page */
+	struct sindex	hd_ixs[IX_MAX];		/* composite indexes */
+	unsigned short	hd_ixcnt;		/* count of composite indexes */
+	size_t		hd_ixpgsizes[IX_ID_MAX];/* node sizes of the indexes
+						 * by id, 0 for the default */
+	bool		hd_ixdeferred;		/* indexes lack the tuples of
+						 * a bulk insertion? */
 };
 
 struct srel { /* a stored relation */
 	char			rl_name[PATH_MAX+1];	/* path to data file */
 	int			rl_fd;			/* file descriptor */
+	int			rl_logid;		/* file id in the log */
 	struct srel_hdr		rl_header;		/* table header */
 	char			*rl_tpbuf;		/* aligned tuple buf */
-	struct cache		*rl_cache;		/* tuple LRU cache */
+	char			*rl_pgbuf;		/* page buffer */
+	blkaddr_t		rl_pgaddr;		/* page in rl_pgbuf */
+	unsigned long		rl_modcnt;		/* count of page writes */
+	struct cache		*rl_cache;		/* page LRU cache */
+	int			rl_fsmfd;		/* free-space map file
+							 * descriptor */
+	int			rl_fsmlogid;		/* map's file id in the
+							 * log */
+	char			*rl_fsmbuf;		/* map page buffer */
+	blkaddr_t		rl_fsmpg;		/* map page in
+							 * rl_fsmbuf */
+	blkaddr_t		rl_fsmhint;		/* first map page that
+							 * may have free bits */
+	struct cache		*rl_fsmcache;		/* map page LRU cache */
+	bool			rl_direct;		/* direct I/O? */
+	char			*rl_map;		/* file mapping
+							 * (USE_MMAP only) */
+	size_t			rl_mapsize;		/* size of mapping */
+	off_t			rl_filesize;		/* size of file */
 	struct hashtable	*rl_ixtable;		/* index table */
+	bool			rl_converted;		/* converted from an
+							 * old format by
+							 * rl_open()? */
 };
 
 struct srel_iter { /* sequential database iterator */
 	struct srel	*it_rl;			/* owning relation */
 	blkaddr_t	it_curaddr;		/* current tuple address */
-	char		*it_tpbuf;		/* aligned tuple buffer */
+	char		*it_tpbuf;		/* tuple buffer */
+	bool		it_physical;		/* iterate in physical order? */
+	char		*it_chunk;		/* pages read at once */
+	size_t		it_chunkmax;		/* max. count of pages in chunk */
+	size_t		it_chunkcnt;		/* count of pages in chunk */
+	blkaddr_t	it_chunkpg;		/* first page in chunk */
+	unsigned long	it_chunkmod;		/* rl_modcnt when chunk read */
 };
 
+/* the size of a tuple's data, i.e. of the tuple without its status byte */
+#define RL_TPDATA_SIZE(rl)	((rl)->rl_header.hd_tpsize - sizeof(char))
+
+/* the maximum size of data read at once by physical order iterators and 
+ * written at once by rl_append() */
+#define RL_SCAN_CHUNK_SIZE	(1024 * 1024 * 4)
+
 /* Create a new stored relation. Returns a pointer to the relation on success, 
- * NULL otherwise. */
+ * NULL otherwise. If the header's hd_pgsize is not 0, it is taken as page 
+ * size, otherwise RL_PAGE_SIZE; a page holds at least one tuple anyway. */
 struct srel *rl_create(struct srel *rl);
 
 /* Open an existing relation. Returns a pointer to the relation on success, 
- * NULL otherwise. */
+ * NULL otherwise. Files of an old format are converted to the current format
+ * first and rl_converted is set; their indexes must be rebuilt then. */
 struct srel *rl_open(struct srel *rl);
 
 /* Updates the header of a stored relation. For example, this function must 
@@ -118,24 +219,60 @@ struct srel *rl_open(struct srel *rl);
  * field has changed. */
 bool rl_write_header(struct srel *rl);
 
+/* Writes the relation's dirty cached tuples to disk. Returns true to indicate
+ * success. */
+bool rl_flush(struct srel *rl);
+
 /* Close a relation. Very important to keep the header up to date. */
 bool rl_close(struct srel *rl);
 
+/* Removes the files of a closed relation. */
+bool rl_unlink(const char *rl_name);
+
+/* Writes the active tuples of a relation densely into a new relation file, 
+ * whose name is the relation file's name plus a suffix. The tuples are 
+ * written in the order of the addresses returned by nextf(ctx) until it 
+ * returns INVALID_ADDR or, if nextf is NULL, in the order of their addresses.
+ * All active tuples must be written. Returns true to indicate success. */
+bool rl_compact(struct srel *rl, blkaddr_t (*nextf)(void *ctx), void *ctx);
+
+/* Replaces the files of a closed relation with the files written by 
+ * rl_compact(). A crash leaves either the old or the new relation file. The 
+ * tuple addresses change, i.e. the relation's indexes must be rebuilt. 
+ * Returns true to indicate success. */
+bool rl_replace(const char *rl_name);
+
 /* Delete a tuple at a given address. */
 bool rl_delete(struct srel *rl, blkaddr_t addr);
 
 /* Update the data at a given tuple address. */
 bool rl_update(struct srel *rl, blkaddr_t addr, const char *tp_data);
 
-/* Insert a new tuple at the next available address and returns this address. */
+/* Insert a new tuple at the lowest free address and returns this address. */
 blkaddr_t rl_insert(struct srel *rl, const char *tp_data);
 
-/* Returns the tuple data at a given tuple address. */
+/* Appends `cnt' tuples, whose data are stored one after another in tp_data, 
+ * behind the last tuple, i.e. free addresses are not reused. The pages are 
+ * logged and written completely, many of them at once. Returns the address 
+ * of the first tuple; the others follow it. */
+blkaddr_t rl_append(struct srel *rl, const char *tp_data, size_t cnt);
+
+/* Returns the tuple data at a given tuple address. If compiled with USE_MMAP,
+ * rl_get() and rl_next() return pointers into the mapped file which remain 
+ * valid until the next tuple is inserted. */
 const char *rl_get(struct srel *rl, blkaddr_t addr);
 
-/* Creates a relation itator. */
+/* Creates a relation itator. The tuples are iterated in the order of their
+ * addresses and read through the page cache, which suits scans that modify 
+ * the relation. */
 struct srel_iter *rl_iterator(struct srel *rl);
 
+/* Creates a relation iterator that iterates over the tuples in the order in 
+ * which they are stored in the file. The iterator reads up to 
+ * RL_SCAN_CHUNK_SIZE bytes at once and is therefore much faster than 
+ * rl_iterator() for full scans that do not modify the relation. */
+struct srel_iter *rl_physical_iterator(struct srel *rl);
+
 /* Frees an iterator structure and its buffer. */
 void srel_iter_free(struct srel_iter *iter);
 
@@ -145,5 +282,11 @@ void rl_iterator_reset(struct srel_iter *iter);
 /* Iterate over the relation tuples. */
 const char *rl_next(struct srel_iter *it);
 
+/* Like rl_next(), but stores pointers to up to `max' tuples in `tuples' and
+ * returns their count, which is 0 only at the end. The tuples are not copied
+ * and remain valid until the next call; hence the batch ends where the
+ * iterator reads the next chunk. Only for physical order iterators. */
+size_t rl_next_batch(struct srel_iter *it, const char **tuples, size_t max);
+
 #endif
 
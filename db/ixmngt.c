@@ -24,40 +24,161 @@
 #include "mem.h"
 #include "parser.h"
 #include "rlmngt.h"
+#include "sort.h"
 #include "str.h"
+#include "wal.h"
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 
-static int hashf(const struct sattr *attr)
+/* the keys of the ixtables, i.e. the ids of the indexes (see io.h) */
+static int ix_ids[IX_ID_MAX];
+
+static int hashf(const int *id)
 {
-	assert(attr != NULL);
-	assert(attr->at_name != NULL);
+	assert(id != NULL);
 
-	return strhash(attr->at_name);
+	return *id;
 }
 
-static bool attrequals(const struct sattr *a1, const struct sattr *a2)
+static bool idequals(const int *id1, const int *id2)
 {
-	assert(a1 != NULL);
-	assert(a2 != NULL);
+	assert(id1 != NULL);
+	assert(id2 != NULL);
 
-	return a1 == a2;
+	return *id1 == *id2;
 }
 
 void init_ixtable(struct srel *rl)
 {
+	int i;
+
 	assert(rl != NULL);
 
 	if (rl->rl_ixtable == NULL) {
+		for (i = 0; i < IX_ID_MAX; i++)
+			ix_ids[i] = i;
 		rl->rl_ixtable = table_init(3, (int (*)(void *))hashf,
-				(bool (*)(void *, void *))attrequals);
+				(bool (*)(void *, void *))idequals);
 		assert(rl->rl_ixtable != NULL);
 	}
 }
 
-static void ix_mkfn(char *filename, const struct srel *rl,
+/* the id of the index of `attr' */
+static inline int attr_id(const struct srel *rl, const struct sattr *attr)
+{
+	assert(attr >= rl->rl_header.hd_attrs
+			&& attr < rl->rl_header.hd_attrs + ATTR_MAX);
+
+	return (int)(attr - rl->rl_header.hd_attrs);
+}
+
+/* the composite index `id' of `rl' or NULL */
+static struct sindex *sindex_by_id(struct srel *rl, int id)
+{
+	int i;
+
+	for (i = 0; i < rl->rl_header.hd_ixcnt; i++)
+		if (rl->rl_header.hd_ixs[i].sx_id == id)
+			return &rl->rl_header.hd_ixs[i];
+	return NULL;
+}
+
+/* NOT_INDEXED if there is no index `id' in `rl', otherwise PRIMARY or 
+ * SECONDARY; composite indexes are secondary ones */
+static int ix_type(struct srel *rl, int id)
+{
+	assert(id >= 0 && id < IX_ID_MAX);
+
+	if (id < ATTR_MAX)
+		return id < rl->rl_header.hd_atcnt
+			? rl->rl_header.hd_attrs[id].at_indexed : NOT_INDEXED;
+	else
+		return sindex_by_id(rl, id) != NULL ? SECONDARY : NOT_INDEXED;
+}
+
+/* writes the attributes of the index `id' in the order of its keys to 
+ * `attrs' and returns their count */
+static int ix_attrs(struct srel *rl, int id, struct sattr *attrs[])
+{
+	struct sindex *six;
+	int i;
+
+	if (id < ATTR_MAX) {
+		attrs[0] = &rl->rl_header.hd_attrs[id];
+		return 1;
+	}
+
+	six = sindex_by_id(rl, id);
+	assert(six != NULL);
+	for (i = 0; i < six->sx_atcnt; i++)
+		attrs[i] = &rl->rl_header.hd_attrs[six->sx_attrs[i]];
+	return six->sx_atcnt;
+}
+
+/* writes the ids of all indexes of `rl' to `ids' and returns their count */
+static int all_ix_ids(struct srel *rl, int ids[])
+{
+	int i, cnt;
+
+	cnt = 0;
+	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
+		if (rl->rl_header.hd_attrs[i].at_indexed != NOT_INDEXED)
+			ids[cnt++] = i;
+	for (i = 0; i < rl->rl_header.hd_ixcnt; i++)
+		ids[cnt++] = rl->rl_header.hd_ixs[i].sx_id;
+	return cnt;
+}
+
+/* the size of the keys of the index `id' of the type `type' */
+static size_t ix_key_size(struct srel *rl, int id, int type)
+{
+	struct sattr *attrs[IX_ATTR_MAX];
+	size_t size;
+	int i, cnt;
+
+	cnt = ix_attrs(rl, id, attrs);
+	size = 0;
+	for (i = 0; i < cnt; i++)
+		size += attrs[i]->at_size;
+	if (type != PRIMARY)
+		size += sizeof(blkaddr_t);
+	return size;
+}
+
+/* determines whether one of the attributes flagged in `attrs' is an 
+ * attribute of the index `id'; NULL flags all attributes */
+static bool ix_affected(struct srel *rl, int id, bool attrs[])
+{
+	struct sattr *ixattrs[IX_ATTR_MAX];
+	int i, cnt;
+
+	if (attrs == NULL)
+		return true;
+
+	cnt = ix_attrs(rl, id, ixattrs);
+	for (i = 0; i < cnt; i++)
+		if (attrs[attr_id(rl, ixattrs[i])])
+			return true;
+	return false;
+}
+
+/* the index files are named by the relation and the index id */
+static void ix_mkfn(char *filename, const struct srel *rl, int id)
+{
+	assert(filename != NULL);
+	assert(rl != NULL);
+	assert(id >= 0 && id < IX_ID_MAX);
+	assert(strlen(IX_BASEDIR) + strlen(rl->rl_header.hd_name)
+			+ strlen(IX_DELIM) + 2 + strlen(IX_SUFFIX) <= PATH_MAX);
+
+	sprintf(filename, "%s%s%s%d%s", IX_BASEDIR, rl->rl_header.hd_name,
+			IX_DELIM, id, IX_SUFFIX);
+}
+
+/* the name of the index file of `attr' before indexes had ids */
+static void ix_mkfn_attr(char *filename, const struct srel *rl,
 		const struct sattr *attr)
 {
 	int len;
@@ -80,137 +201,355 @@ static void ix_mkfn(char *filename, const struct srel *rl,
 	strcpy(filename+len, IX_SUFFIX);
 }
 
-struct index *create_index(struct srel *rl, struct sattr *attr, int type)
+/* the size of an entry, i.e. of a key and an address; it is aligned such 
+ * that the keys can be compared in place */
+#define ENTRY_SIZE(ix)	(((ix)->ix_size + 2 * sizeof(blkaddr_t) - 1)\
+			/ sizeof(blkaddr_t) * sizeof(blkaddr_t))
+
+static bool remove_index(struct srel *rl, int id);
+
+/* compares the keys of two entries of the index `ctx' */
+static int entrycmp(const void *p, const void *q, void *ctx)
+{
+	struct index *ix = ctx;
+
+	return ix->ix_cmpf(p, q, ix->ix_size);
+}
+
+/* writes the key of the values `vals' of the `cnt' attributes `attrs' of the
+ * index `ix' to `key', i.e. the concatenated normalized values (see 
+ * normalize_val()); keys of secondary indexes contain the tuple address */
+static void make_key(char *key, struct sattr *attrs[], int cnt,
+		struct index *ix, const char *vals[], blkaddr_t addr)
+{
+	size_t off;
+	int i;
+
+	assert(cnt > 0);
+
+	off = 0;
+	for (i = 0; i < cnt; i++) {
+		normalize_val(attrs[i], key + off, vals[i]);
+		off += attrs[i]->at_size;
+	}
+	if (ix->ix_size > off)
+		normalize_addr(attrs[cnt-1], key + off - attrs[cnt-1]->at_size,
+				addr);
+}
+
+/* searches a value of `attr' in its index `ix' */
+static blkaddr_t search_key(struct index *ix, struct sattr *attr,
+		const char *val)
+{
+	char key[ix->ix_size];
+
+	make_key(key, &attr, 1, ix, &val, INVALID_ADDR);
+	return ix_search(ix, key);
+}
+
+/* writes the key of the tuple at `addr' in the index `ix' with the id `id' 
+ * to `key' */
+static void tuple_key(char *key, struct srel *rl, int id, struct index *ix,
+		const char *tuple, blkaddr_t addr)
+{
+	struct sattr *attrs[IX_ATTR_MAX];
+	const char *vals[IX_ATTR_MAX];
+	int i, cnt;
+
+	cnt = ix_attrs(rl, id, attrs);
+	for (i = 0; i < cnt; i++)
+		vals[i] = tuple + attrs[i]->at_offset;
+	make_key(key, attrs, cnt, ix, vals, addr);
+}
+
+/* writes the entry of the tuple at `addr' in the index `ix' with the id 
+ * `id'; the key is followed by the address (see ENTRY_SIZE()) */
+static void make_entry(char *entry, struct srel *rl, int id,
+		struct index *ix, const char *tuple, blkaddr_t addr)
+{
+	tuple_key(entry, rl, id, ix, tuple, addr);
+	memcpy(entry + ix->ix_size, &addr, sizeof(blkaddr_t));
+}
+
+/* fills the new index `ix' with the id `id' bottom-up with the sorted 
+ * entries of the tuples of `rl' whose addresses are less than `cut' (all if
+ * it is INVALID_ADDR) */
+static bool build_index(struct srel *rl, int id, struct index *ix,
+		blkaddr_t cut)
+{
+	struct srel_iter *iter;
+	struct xsort *xs;
+	struct ix_load *ld;
+	const char *tuple, *entry;
+	char buf[ENTRY_SIZE(ix)];
+	blkaddr_t addr;
+	bool retval;
+
+	xs = xsort_init(ENTRY_SIZE(ix), entrycmp, ix);
+	iter = rl_physical_iterator(rl);
+	assert(iter != NULL);
+	retval = true;
+	while (retval && (tuple = rl_next(iter)) != NULL) {
+		if (cut != INVALID_ADDR && iter->it_curaddr >= cut)
+			continue;
+		make_entry(buf, rl, id, ix, tuple, iter->it_curaddr);
+		retval = xsort_put(xs, buf);
+	}
+	srel_iter_free(iter);
+
+	retval = retval && xsort_finish(xs);
+	ld = retval ? ix_load_begin(ix, IX_LOAD_FILL) : NULL;
+	retval = (ld != NULL);
+	while (retval && (entry = xsort_get(xs)) != NULL) {
+		memcpy(&addr, entry + ix->ix_size, sizeof(blkaddr_t));
+		retval = ix_load(ld, addr, entry);
+	}
+	if (ld != NULL)
+		retval = ix_load_end(ld) && retval;
+	xsort_free(xs);
+	return retval;
+}
+
+/* creates, registers and builds the index `id' of the type `type' from the
+ * tuples before `cut' (see build_index()) and keeps its node size for 
+ * rebuilds (see open_ix()); the caller records the index in the relation's 
+ * header and writes it */
+static struct index *new_index(struct srel *rl, int id, int type,
+		size_t pgsize, blkaddr_t cut)
 {
 	char ix_name[PATH_MAX+1];
-	size_t ix_size;
-	cmpf_t cmpf;
 	struct index *ix;
-	char at_indexed_old;
+
+	assert(type == PRIMARY || type == SECONDARY);
+
+	ix_mkfn(ix_name, rl, id);
+
+	/* the tuples of a value of a secondary index are a posting list */
+	ix = ix_create(ix_name, ix_key_size(rl, id, type), pgsize,
+			type == SECONDARY, ixcmpf_by_type(type));
+	if (ix == NULL)
+		return NULL;
+
+	table_insert(rl->rl_ixtable, &ix_ids[id], ix);
+	if (!build_index(rl, id, ix, cut)) {
+		remove_index(rl, id);
+		return NULL;
+	}
+	rl->rl_header.hd_ixpgsizes[id] = pgsize;
+	return ix;
+}
+
+struct index *create_index(struct srel *rl, struct sattr *attr, int type,
+		size_t pgsize)
+{
+	struct index *ix;
+	bool b;
 
 	assert(rl != NULL);
 	assert(attr != NULL);
 	assert(type == PRIMARY || type == SECONDARY);
 
-	ix_mkfn(ix_name, rl, attr);
-	ix_size = attr->at_size;
-	if (type == SECONDARY)
-		ix_size += sizeof(blkaddr_t);
-
-	/* the next four lines: first, we set at_indexed to the future value,
-	 * so that ixcmpf_by_sattr() returns the right comparison function; 
-	 * aftercalling ixcmpf_by_sattr() we reset it to the old value again,
-	 * because in case of failure the attribute should not be marked as
-	 * indexed!
-	 * marking the attribute as indexed and updating the relation's header
-	 * is done later (only in case of success, of course) */
-	at_indexed_old = attr->at_indexed;
-	attr->at_indexed = type;
-	cmpf = ixcmpf_by_sattr(attr);
-	attr->at_indexed = at_indexed_old;
-
-	ix = ix_create(ix_name, ix_size, cmpf);
+	/* the attribute is marked as indexed only in case of success */
+	ix = new_index(rl, attr_id(rl, attr), type, pgsize, INVALID_ADDR);
 	if (ix != NULL) {
-		struct srel_iter *iter;
-		blkaddr_t addr;
-		const char *tuple;
-		char data[ix_size];
-		bool b;
-
-		table_insert(rl->rl_ixtable, attr, ix);
-
-		iter = rl_iterator(rl);
-		assert(iter != NULL);
-		while ((tuple = rl_next(iter))) {
-			addr = iter->it_curaddr;
-			memcpy(data, tuple + attr->at_offset, attr->at_size);
-			memcpy(data + attr->at_size, &addr, sizeof(blkaddr_t));
-			b = ix_insert(ix, addr, data);
-			assert(b == true);
-		}
-		srel_iter_free(iter);
-
 		attr->at_indexed = type;
 		b = rl_write_header(rl);
 		assert(b == true);
+	}
+	return ix;
+}
 
-		return ix;
-	} else
+struct index *create_composite_index(struct srel *rl, struct sattr *attrs[],
+		int cnt, size_t pgsize)
+{
+	struct sindex *six;
+	struct index *ix;
+	int id, i;
+	bool b;
+
+	assert(rl != NULL);
+	assert(attrs != NULL);
+	assert(cnt > 0 && cnt <= IX_ATTR_MAX);
+
+	if (rl->rl_header.hd_ixcnt == IX_MAX)
 		return NULL;
+
+	/* the descriptor must exist while the index is built; it is removed
+	 * again in case of failure */
+	for (id = ATTR_MAX; sindex_by_id(rl, id) != NULL; id++)
+		;
+	six = &rl->rl_header.hd_ixs[rl->rl_header.hd_ixcnt++];
+	six->sx_id = id;
+	six->sx_atcnt = cnt;
+	for (i = 0; i < cnt; i++)
+		six->sx_attrs[i] = attr_id(rl, attrs[i]);
+
+	ix = new_index(rl, id, SECONDARY, pgsize, INVALID_ADDR);
+	if (ix != NULL) {
+		b = rl_write_header(rl);
+		assert(b == true);
+	} else
+		rl->rl_header.hd_ixcnt--;
+	return ix;
 }
 
-struct index *open_index(struct srel *rl, struct sattr *attr)
+struct sindex *composite_index(struct srel *rl, struct sattr *attrs[],
+		int cnt)
+{
+	struct sindex *six;
+	int i, j;
+
+	assert(rl != NULL);
+	assert(attrs != NULL);
+
+	for (i = 0; i < rl->rl_header.hd_ixcnt; i++) {
+		six = &rl->rl_header.hd_ixs[i];
+		if (six->sx_atcnt != cnt)
+			continue;
+		for (j = 0; j < cnt; j++)
+			if (six->sx_attrs[j] != attr_id(rl, attrs[j]))
+				break;
+		if (j == cnt)
+			return six;
+	}
+	return NULL;
+}
+
+/* opens the index `id'; a missing or outdated index is rebuilt */
+static struct index *open_ix(struct srel *rl, int id)
 {
 	char ix_name[PATH_MAX+1];
 	struct index *ix;
+	int type;
 
 	assert(rl != NULL);
-	assert(attr != NULL);
 
-	if (attr->at_indexed != PRIMARY && attr->at_indexed != SECONDARY)
+	type = ix_type(rl, id);
+	if (type != PRIMARY && type != SECONDARY)
 		return NULL;
 
-	ix_mkfn(ix_name, rl, attr);
+	ix_mkfn(ix_name, rl, id);
 
-	if ((ix = table_search(rl->rl_ixtable, attr)) != NULL)
+	if ((ix = table_search(rl->rl_ixtable, &ix_ids[id])) != NULL)
 		return ix;
-	else if ((ix = ix_open(ix_name, ixcmpf_by_sattr(attr))) != NULL) {
-		table_insert(rl->rl_ixtable, attr, ix);
+	else if ((ix = ix_open(ix_name, ixcmpf_by_type(type))) != NULL) {
+		table_insert(rl->rl_ixtable, &ix_ids[id], ix);
 		return ix;
+	} else if (access(ix_name, F_OK) != 0) {
+		/* a missing index (see remove_indexes()) is rebuilt with
+		 * the node size it was created with */
+		return new_index(rl, id, type,
+				rl->rl_header.hd_ixpgsizes[id], INVALID_ADDR);
+	} else if (ix_outdated(ix_name)) {
+		/* so is an index whose keys are not normalized */
+		return remove_index(rl, id)
+			? new_index(rl, id, type,
+					rl->rl_header.hd_ixpgsizes[id],
+					INVALID_ADDR)
+			: NULL;
 	} else
 		return NULL;
 }
 
+struct index *open_index(struct srel *rl, struct sattr *attr)
+{
+	assert(rl != NULL);
+	assert(attr != NULL);
+
+	return open_ix(rl, attr_id(rl, attr));
+}
+
+struct index *open_composite_index(struct srel *rl, struct sindex *six)
+{
+	assert(rl != NULL);
+	assert(six != NULL);
+
+	return open_ix(rl, six->sx_id);
+}
+
 void open_indexes(struct srel *rl)
 {
-	int i;
+	int ids[IX_ID_MAX];
+	int i, cnt;
 
 	assert(rl != NULL);
 
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
-		open_index(rl, &rl->rl_header.hd_attrs[i]);
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++)
+		open_ix(rl, ids[i]);
 }
 
-void close_index(struct srel *rl, struct sattr *attr)
+/* closes the index `id' if it is open */
+static void close_ix(struct srel *rl, int id)
 {
 	struct index *ix;
 
 	assert(rl != NULL);
-	assert(attr != NULL);
 
-	if ((ix = table_search(rl->rl_ixtable, attr)) != NULL) {
-		table_delete(rl->rl_ixtable, attr);
+	if ((ix = table_search(rl->rl_ixtable, &ix_ids[id])) != NULL) {
+		table_delete(rl->rl_ixtable, &ix_ids[id]);
 		ix_close(ix);
 	}
 }
 
+void close_index(struct srel *rl, struct sattr *attr)
+{
+	assert(rl != NULL);
+	assert(attr != NULL);
+
+	close_ix(rl, attr_id(rl, attr));
+}
+
 void close_indexes(struct srel *rl)
 {
-	int i;
+	int ids[IX_ID_MAX];
+	int i, cnt;
 
 	assert(rl != NULL);
 
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
-		if (rl->rl_header.hd_attrs[i].at_indexed != NOT_INDEXED)
-			close_index(rl, &rl->rl_header.hd_attrs[i]);
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++)
+		close_ix(rl, ids[i]);
+}
+
+/* closes an index and removes its file */
+static bool remove_index(struct srel *rl, int id)
+{
+	char ix_name[PATH_MAX+1];
+
+	assert(rl != NULL);
+
+	close_ix(rl, id);
+	ix_mkfn(ix_name, rl, id);
+	return access(ix_name, F_OK) != 0 || wal_unlink(ix_name);
 }
 
 bool drop_index(struct srel *rl, struct sattr *attr)
 {
-	char buf[PATH_MAX+1];
-	struct index *ix;
 	bool retval;
 
 	assert(rl != NULL);
 	assert(attr != NULL);
 
-	retval = true;
-	if ((ix = open_index(rl, attr)) != NULL) {
-		strntermcpy(buf, ix->ix_name, PATH_MAX+1);
-		close_index(rl, attr);
-		retval &= unlink(buf) == 0;
-	}
-	return retval;
+	retval = remove_index(rl, attr_id(rl, attr));
+	attr->at_indexed = NOT_INDEXED;
+	rl->rl_header.hd_ixpgsizes[attr_id(rl, attr)] = 0;
+	return rl_write_header(rl) && retval;
+}
+
+bool drop_composite_index(struct srel *rl, struct sindex *six)
+{
+	bool retval;
+
+	assert(rl != NULL);
+	assert(six != NULL);
+	assert(rl->rl_header.hd_ixcnt > 0);
+
+	/* the last descriptor takes the place of the dropped one */
+	retval = remove_index(rl, six->sx_id);
+	rl->rl_header.hd_ixpgsizes[six->sx_id] = 0;
+	*six = rl->rl_header.hd_ixs[--rl->rl_header.hd_ixcnt];
+	return rl_write_header(rl) && retval;
 }
 
 bool drop_indexes(struct srel *rl)
@@ -224,6 +563,55 @@ bool drop_indexes(struct srel *rl)
 	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
 		if (rl->rl_header.hd_attrs[i].at_indexed != NOT_INDEXED)
 			retval &= drop_index(rl, &rl->rl_header.hd_attrs[i]);
+	while (rl->rl_header.hd_ixcnt > 0)
+		retval &= drop_composite_index(rl, &rl->rl_header.hd_ixs[0]);
+	return retval;
+}
+
+bool remove_indexes(struct srel *rl)
+{
+	int ids[IX_ID_MAX];
+	int i, cnt;
+	bool retval;
+
+	assert(rl != NULL);
+
+	retval = true;
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++)
+		retval &= remove_index(rl, ids[i]);
+	return retval;
+}
+
+bool rebuild_indexes(struct srel *rl)
+{
+	char ix_name[PATH_MAX+1];
+	int ids[IX_ID_MAX];
+	int i, cnt;
+	bool retval;
+
+	assert(rl != NULL);
+
+	retval = true;
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++) {
+		close_ix(rl, ids[i]);
+		ix_mkfn(ix_name, rl, ids[i]);
+		wal_unlink(ix_name);
+		if (ids[i] < ATTR_MAX) {
+			/* the file of an old index is named by its attribute */
+			ix_mkfn_attr(ix_name, rl,
+					&rl->rl_header.hd_attrs[ids[i]]);
+			if (access(ix_name, F_OK) == 0)
+				wal_unlink(ix_name);
+		}
+		if (new_index(rl, ids[i], ix_type(rl, ids[i]),
+					rl->rl_header.hd_ixpgsizes[ids[i]],
+					INVALID_ADDR) == NULL) {
+			ERR(E_CREATE_INDEX_FAILED);
+			retval = false;
+		}
+	}
 	return retval;
 }
 
@@ -232,7 +620,6 @@ bool primary_key_conflict(struct srel *rl, const char *new_tuple,
 {
 	struct sattr *attr;
 	struct index *ix;
-	const char *key;
 	int i;
 
 	assert(rl != NULL);
@@ -252,30 +639,95 @@ bool primary_key_conflict(struct srel *rl, const char *new_tuple,
 					attr->at_size))
 			continue;
 
-		key = new_tuple + attr->at_offset;
-		if (ix_search(ix, key) != INVALID_ADDR)
+		if (search_key(ix, attr, new_tuple + attr->at_offset)
+				!= INVALID_ADDR)
 			return true;
 	}
 	return false;
 }
 
-static size_t calc_max_key_size(struct srel *rl, bool *attrs)
+/* the index whose keys are compared by sort_entrycmp() */
+static struct index *sort_ix = NULL;
+
+static int sort_entrycmp(const void *p, const void *q)
 {
-	size_t size, max;
-	int i;
+	return entrycmp(p, q, sort_ix);
+}
+
+/* returns the entries of `cnt' tuples with the addresses addr, addr+1, ... 
+ * in the index `ix' with the id `id' sorted by their keys; an entry is the 
+ * key followed by the address (see ENTRY_SIZE()) */
+static char *sort_entries(struct srel *rl, int id, struct index *ix,
+		const char *tuples, size_t cnt, blkaddr_t addr)
+{
+	char *entries;
+	blkaddr_t a;
+	size_t i;
+
+	entries = xmalloc(cnt * ENTRY_SIZE(ix));
+	for (i = 0; i < cnt; i++) {
+		a = (addr != INVALID_ADDR) ? addr + (blkaddr_t)i : INVALID_ADDR;
+		make_entry(entries + i * ENTRY_SIZE(ix), rl, id, ix,
+				tuples + i * RL_TPDATA_SIZE(rl), a);
+	}
+	sort_ix = ix;
+	qsort(entries, cnt, ENTRY_SIZE(ix), sort_entrycmp);
+	sort_ix = NULL;
+	return entries;
+}
+
+bool batch_primary_key_conflict(struct srel *rl, const char *tuples,
+		size_t cnt)
+{
+	struct sattr *attr;
+	struct index *ix;
+	char *entries, *entry;
+	size_t i;
+	bool conflict;
+	int j;
 
 	assert(rl != NULL);
+	assert(tuples != NULL || cnt == 0);
 
-	max = 0;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++) {
-		if (rl->rl_header.hd_attrs[i].at_indexed == NOT_INDEXED)
+	for (j = 0; j < rl->rl_header.hd_atcnt; j++) {
+		attr = &rl->rl_header.hd_attrs[j];
+		if (attr->at_indexed != PRIMARY)
+			continue;
+
+		ix = open_index(rl, attr);
+		if (ix == NULL)
 			continue;
 
-		size = rl->rl_header.hd_attrs[i].at_size;
-		if (rl->rl_header.hd_attrs[i].at_indexed != PRIMARY)
-			size += sizeof(blkaddr_t);
+		/* equal keys of the batch are neighbors; the index is searched
+		 * in the order of the keys */
+		entries = sort_entries(rl, j, ix, tuples, cnt, INVALID_ADDR);
+		conflict = false;
+		for (i = 0; i < cnt && !conflict; i++) {
+			entry = entries + i * ENTRY_SIZE(ix);
+			conflict = (i > 0 && ix->ix_cmpf(entry - ENTRY_SIZE(ix),
+						entry, ix->ix_size) == 0)
+				|| ix_search(ix, entry) != INVALID_ADDR;
+		}
+		free(entries);
+		if (conflict)
+			return true;
+	}
+	return false;
+}
+
+static size_t calc_max_key_size(struct srel *rl, bool *attrs)
+{
+	int ids[IX_ID_MAX];
+	size_t size, max;
+	int i, cnt;
 
-		if ((attrs == NULL || attrs[i] == true) && max < size)
+	assert(rl != NULL);
+
+	max = 0;
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++) {
+		size = ix_key_size(rl, ids[i], ix_type(rl, ids[i]));
+		if (ix_affected(rl, ids[i], attrs) && max < size)
 			max = size;
 	}
 	return max;
@@ -284,10 +736,10 @@ static size_t calc_max_key_size(struct srel *rl, bool *attrs)
 bool insert_into_indexes(struct srel *rl, bool attrs[],
 		blkaddr_t addr, const char *tuple)
 {
-	int i;
+	int ids[IX_ID_MAX];
+	int i, cnt;
 	struct index *ix;
 	char data[calc_max_key_size(rl, attrs)];
-	struct sattr *attr;
 	bool retval;
 
 	assert(rl != NULL);
@@ -295,70 +747,361 @@ bool insert_into_indexes(struct srel *rl, bool attrs[],
 	assert(tuple != NULL);
 
 	retval = true;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++) {
-		if (attrs != NULL && !attrs[i])
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++) {
+		if (!ix_affected(rl, ids[i], attrs))
 			continue;
 
-		attr = &rl->rl_header.hd_attrs[i];
-		if (attr->at_indexed == NOT_INDEXED)
+		ix = open_ix(rl, ids[i]);
+		if (ix == NULL)
 			continue;
 
-		ix = open_index(rl, attr);
+		assert(ix->ix_size == ix_key_size(rl, ids[i],
+					ix_type(rl, ids[i])));
+
+		tuple_key(data, rl, ids[i], ix, tuple, addr);
+		retval &= ix_insert(ix, addr, data);
+	}
+	return retval;
+}
+
+bool insert_batch_into_indexes(struct srel *rl, blkaddr_t addr,
+		const char *tuples, size_t cnt)
+{
+	int ids[IX_ID_MAX];
+	struct index *ix;
+	struct ix_load *ld;
+	char *entries, *entry;
+	blkaddr_t a;
+	size_t i;
+	bool retval;
+	int j, ixcnt;
+
+	assert(rl != NULL);
+	assert(addr != INVALID_ADDR);
+	assert(tuples != NULL || cnt == 0);
+
+	retval = true;
+	ixcnt = all_ix_ids(rl, ids);
+	for (j = 0; j < ixcnt; j++) {
+		ix = open_ix(rl, ids[j]);
 		if (ix == NULL)
 			continue;
 
-#ifndef NDEBUG
-		if (attr->at_indexed == PRIMARY)
-			assert(ix->ix_size == attr->at_size);
-		else if (attr->at_indexed == SECONDARY)
-			assert(ix->ix_size == attr->at_size+sizeof(blkaddr_t));
-#endif
+		/* an empty index is built bottom-up; otherwise, inserting in
+		 * the order of the keys touches each node of the tree's right
+		 * part once instead of once per key */
+		entries = sort_entries(rl, ids[j], ix, tuples, cnt, addr);
+		ld = ix_load_begin(ix, IX_LOAD_FILL);
+		for (i = 0; i < cnt && retval; i++) {
+			entry = entries + i * ENTRY_SIZE(ix);
+			memcpy(&a, entry + ix->ix_size, sizeof(blkaddr_t));
+			retval = (ld != NULL) ? ix_load(ld, a, entry)
+				: ix_insert(ix, a, entry);
+		}
+		if (ld != NULL)
+			retval = ix_load_end(ld) && retval;
+		free(entries);
+	}
+	return retval;
+}
 
-		memcpy(data, tuple + attr->at_offset, attr->at_size);
-		if (attr->at_indexed == SECONDARY)
-			memcpy(data + attr->at_size, &addr, sizeof(blkaddr_t));
+struct deferred_ix { /* the collected entries of an index */
+	int		dx_id;		/* index id */
+	struct index	*dx_ix;		/* the index */
+	struct xsort	*dx_xs;		/* entries by keys and addresses */
+	bool		dx_rebuild;	/* rebuilt instead of inserting the
+					 * entries? */
+};
+
+struct deferred_batch { /* a batch whose entries were collected */
+	blkaddr_t	db_addr;	/* address of the first tuple */
+	size_t		db_cnt;		/* count of tuples */
+};
+
+struct deferred_ixs {
+	struct srel		*dx_rl;			/* the relation */
+	tpcnt_t			dx_tpcnt;		/* its former count of
+							 * tuples */
+	struct deferred_ix	dx_ixs[IX_ID_MAX];	/* its indexes */
+	int			dx_cnt;			/* count of indexes */
+	struct deferred_batch	*dx_batches;		/* collected batches */
+	size_t			dx_batchcnt;		/* count of batches */
+	size_t			dx_tpcnt_new;		/* count of collected
+							 * tuples */
+	bool			dx_ok;			/* all entries were
+							 * collected? */
+};
+
+/* compares two entries of the index `ctx' by their keys and then by their 
+ * addresses; equal keys of a primary index thus are in insertion order */
+static int entryaddrcmp(const void *p, const void *q, void *ctx)
+{
+	struct index *ix = ctx;
+	blkaddr_t a, b;
+	int cmp;
+
+	if ((cmp = entrycmp(p, q, ctx)) != 0)
+		return cmp;
+	memcpy(&a, (const char *)p + ix->ix_size, sizeof(blkaddr_t));
+	memcpy(&b, (const char *)q + ix->ix_size, sizeof(blkaddr_t));
+	return (a > b) - (a < b);
+}
 
-		retval &= ix_insert(ix, addr, data);
+struct deferred_ixs *defer_indexes(struct srel *rl)
+{
+	struct deferred_ixs *dx;
+	struct deferred_ix *d;
+	struct index *ix;
+	int ids[IX_ID_MAX];
+	int i, cnt;
+
+	assert(rl != NULL);
+
+	dx = xmalloc(sizeof(struct deferred_ixs));
+	dx->dx_rl = rl;
+	dx->dx_tpcnt = rl->rl_header.hd_tpcnt;
+	dx->dx_cnt = 0;
+	dx->dx_batches = NULL;
+	dx->dx_batchcnt = 0;
+	dx->dx_tpcnt_new = 0;
+	dx->dx_ok = true;
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++) {
+		if ((ix = open_ix(rl, ids[i])) == NULL)
+			continue;
+		d = &dx->dx_ixs[dx->dx_cnt++];
+		d->dx_id = ids[i];
+		d->dx_ix = ix;
+		d->dx_xs = xsort_init(ENTRY_SIZE(ix), entryaddrcmp, ix);
+		d->dx_rebuild = false;
 	}
+	return dx;
+}
+
+/* adds the entries of `cnt' tuples with the addresses addr, addr+1, ... to
+ * the collected entries of `d' */
+static bool defer_entries(struct srel *rl, struct deferred_ix *d,
+		blkaddr_t addr, const char *tuples, size_t cnt)
+{
+	char entry[ENTRY_SIZE(d->dx_ix)];
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		make_entry(entry, rl, d->dx_id, d->dx_ix,
+				tuples + i * RL_TPDATA_SIZE(rl),
+				addr + (blkaddr_t)i);
+		if (!xsort_put(d->dx_xs, entry))
+			return false;
+	}
+	return true;
+}
+
+bool defer_batch(struct deferred_ixs *dx, blkaddr_t addr,
+		const char *tuples, size_t cnt)
+{
+	struct deferred_batch *batch;
+	int j;
+
+	assert(dx != NULL);
+	assert(addr != INVALID_ADDR);
+	assert(tuples != NULL || cnt == 0);
+
+	dx->dx_batches = xrealloc(dx->dx_batches,
+			(dx->dx_batchcnt + 1) * sizeof(struct deferred_batch));
+	batch = &dx->dx_batches[dx->dx_batchcnt++];
+	batch->db_addr = addr;
+	batch->db_cnt = cnt;
+	dx->dx_tpcnt_new += cnt;
+	for (j = 0; j < dx->dx_cnt && dx->dx_ok; j++)
+		dx->dx_ok = defer_entries(dx->dx_rl, &dx->dx_ixs[j], addr,
+				tuples, cnt);
+	return dx->dx_ok;
+}
+
+/* reads the collected entries of `d' in the order of their keys and inserts
+ * those whose addresses are less than `cut' (all if it is INVALID_ADDR) into
+ * the index unless it is rebuilt; an empty index is built bottom-up. If 
+ * `dup' is not NULL, an entry whose key equals the one before is not 
+ * inserted, but the least address of such entries is kept in `dup' */
+static bool insert_deferred(struct deferred_ix *d, blkaddr_t cut,
+		blkaddr_t *dup)
+{
+	struct index *ix = d->dx_ix;
+	struct ix_load *ld;
+	const char *entry;
+	char prev[ix->ix_size];
+	blkaddr_t addr;
+	bool retval, first;
+
+	if (!xsort_finish(d->dx_xs))
+		return false;
+
+	ld = !d->dx_rebuild ? ix_load_begin(ix, IX_LOAD_FILL) : NULL;
+	retval = true;
+	first = true;
+	while (retval && (entry = xsort_get(d->dx_xs)) != NULL) {
+		memcpy(&addr, entry + ix->ix_size, sizeof(blkaddr_t));
+		if (cut != INVALID_ADDR && addr >= cut)
+			continue;
+		if (dup != NULL && !first
+				&& ix->ix_cmpf(prev, entry, ix->ix_size) == 0) {
+			if (*dup == INVALID_ADDR || addr < *dup)
+				*dup = addr;
+			continue;
+		}
+		if (ld != NULL)
+			retval = ix_load(ld, addr, entry);
+		else if (!d->dx_rebuild)
+			retval = ix_insert(ix, addr, entry);
+		memcpy(prev, entry, ix->ix_size);
+		first = false;
+	}
+	if (ld != NULL)
+		retval = ix_load_end(ld) && retval;
+	return retval;
+}
+
+/* removes the entry of the tuple at `addr' from the primary index of `d' 
+ * unless the key belongs to another tuple, i.e. an earlier one with an equal
+ * key was kept (see insert_deferred()) */
+static bool remove_deferred(struct srel *rl, struct deferred_ix *d,
+		const char *tuple, blkaddr_t addr)
+{
+	char key[d->dx_ix->ix_size];
+
+	tuple_key(key, rl, d->dx_id, d->dx_ix, tuple, addr);
+	if (ix_search(d->dx_ix, key) != addr)
+		return true;
+	return ix_delete(d->dx_ix, key) != INVALID_ADDR;
+}
+
+/* removes the entries of the collected tuples from `cut' on from the 
+ * primary indexes the entries were inserted into */
+static bool remove_deferred_batches(struct deferred_ixs *dx, blkaddr_t cut)
+{
+	struct srel *rl = dx->dx_rl;
+	struct deferred_batch *batch;
+	struct deferred_ix *d;
+	const char *tuple;
+	blkaddr_t addr;
+	size_t i, k;
+	bool retval;
+	int j;
+
+	retval = true;
+	for (k = 0; k < dx->dx_batchcnt; k++) {
+		batch = &dx->dx_batches[k];
+		for (i = 0; i < batch->db_cnt; i++) {
+			addr = batch->db_addr + (blkaddr_t)i;
+			if (addr < cut)
+				continue;
+			if ((tuple = rl_get(rl, addr)) == NULL) {
+				retval = false;
+				continue;
+			}
+			for (j = 0; j < dx->dx_cnt; j++) {
+				d = &dx->dx_ixs[j];
+				if (ix_type(rl, d->dx_id) == PRIMARY
+						&& !d->dx_rebuild)
+					retval &= remove_deferred(rl, d, tuple,
+							addr);
+			}
+		}
+	}
+	return retval;
+}
+
+bool insert_deferred_into_indexes(struct deferred_ixs *dx, blkaddr_t *cut,
+		size_t *cnt_ptr)
+{
+	struct srel *rl;
+	struct deferred_ix *d;
+	blkaddr_t dup;
+	size_t k;
+	bool retval;
+	int j;
+
+	assert(dx != NULL);
+	assert(cut != NULL);
+
+	/* an index is rebuilt if at least as many tuples were added as there
+	 * were before; an empty index is built bottom-up anyway */
+	rl = dx->dx_rl;
+	for (j = 0; j < dx->dx_cnt; j++)
+		dx->dx_ixs[j].dx_rebuild = dx->dx_tpcnt > 0
+			&& dx->dx_tpcnt_new >= (size_t)dx->dx_tpcnt;
+
+	/* the primary indexes come first: a key of a tuple of an earlier 
+	 * batch cuts the insertion at the batch of the duplicate */
+	retval = dx->dx_ok;
+	dup = INVALID_ADDR;
+	for (j = 0; j < dx->dx_cnt && retval; j++) {
+		d = &dx->dx_ixs[j];
+		if (ix_type(rl, d->dx_id) == PRIMARY)
+			retval = insert_deferred(d, INVALID_ADDR, &dup);
+	}
+	*cut = INVALID_ADDR;
+	for (k = 0; dup != INVALID_ADDR && k < dx->dx_batchcnt
+			&& dx->dx_batches[k].db_addr <= dup; k++)
+		*cut = dx->dx_batches[k].db_addr;
+	if (*cut != INVALID_ADDR && retval)
+		retval = remove_deferred_batches(dx, *cut);
+
+	for (j = 0; j < dx->dx_cnt && retval; j++) {
+		d = &dx->dx_ixs[j];
+		if (ix_type(rl, d->dx_id) != PRIMARY && !d->dx_rebuild)
+			retval = insert_deferred(d, *cut, NULL);
+		else if (d->dx_rebuild)
+			retval = remove_index(rl, d->dx_id)
+				&& new_index(rl, d->dx_id,
+						ix_type(rl, d->dx_id),
+						rl->rl_header.hd_ixpgsizes[
+							d->dx_id],
+						*cut) != NULL;
+	}
+
+	if (cnt_ptr != NULL) {
+		*cnt_ptr = 0;
+		for (k = 0; k < dx->dx_batchcnt; k++)
+			if (*cut == INVALID_ADDR
+					|| dx->dx_batches[k].db_addr < *cut)
+				*cnt_ptr += dx->dx_batches[k].db_cnt;
+	}
+
+	for (j = 0; j < dx->dx_cnt; j++)
+		xsort_free(dx->dx_ixs[j].dx_xs);
+	free(dx->dx_batches);
+	free(dx);
 	return retval;
 }
 
 bool delete_from_indexes(struct srel *rl, bool attrs[],
 		blkaddr_t addr, const char *tuple)
 {
-	int i;
+	int ids[IX_ID_MAX];
+	int i, cnt;
 	struct index *ix;
 	char data[calc_max_key_size(rl, attrs)];
-	struct sattr *attr;
 	bool retval;
 
 	assert(rl != NULL);
 	assert(tuple != NULL);
 
 	retval = true;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++) {
-		if (attrs != NULL && !attrs[i])
+	cnt = all_ix_ids(rl, ids);
+	for (i = 0; i < cnt; i++) {
+		if (!ix_affected(rl, ids[i], attrs))
 			continue;
 
-		attr = &rl->rl_header.hd_attrs[i];
-		if (attr->at_indexed == NOT_INDEXED)
-			continue;
-
-		ix = open_index(rl, attr);
+		ix = open_ix(rl, ids[i]);
 		if (ix == NULL)
 			continue;
 
-#ifndef NDEBUG
-		if (attr->at_indexed == PRIMARY)
-			assert(ix->ix_size == attr->at_size);
-		else if (attr->at_indexed == SECONDARY)
-			assert(ix->ix_size == attr->at_size+sizeof(blkaddr_t));
-#endif
-
-		memcpy(data, tuple + attr->at_offset, attr->at_size);
-		if (attr->at_indexed == SECONDARY)
-			memcpy(data + attr->at_size, &addr, sizeof(blkaddr_t));
+		assert(ix->ix_size == ix_key_size(rl, ids[i],
+					ix_type(rl, ids[i])));
 
+		tuple_key(data, rl, ids[i], ix, tuple, addr);
 		retval &= (ix_delete(ix, data) != INVALID_ADDR);
 	}
 	return retval;
@@ -368,7 +1111,7 @@ struct ix_iter *search_in_index(struct srel *rl, struct sattr *attr,
 		int compar, const char *key)
 {
 	struct index *ix;
-	struct ix_iter *iter;
+	char buf[attr->at_size + sizeof(blkaddr_t)];
 
 	assert(attr != NULL);
 	assert(key != NULL);
@@ -376,24 +1119,102 @@ struct ix_iter *search_in_index(struct srel *rl, struct sattr *attr,
 
 	ix = open_index(rl, attr);
 	assert(ix != NULL);
+	assert(ix->ix_size == attr->at_size
+			+ (attr->at_indexed == PRIMARY ? 0 : sizeof(blkaddr_t)));
+
+	/* INVALID_ADDR matches the addresses of all tuples of a secondary 
+	 * index */
+	make_key(buf, &attr, 1, ix, &key, INVALID_ADDR);
+	return ix_iterator(ix, buf);
+}
+
+/* writes the normalized values `vals' of `attrs' to `key'; the values of the
+ * attributes without value (NULL) are `fill' bytes */
+static void bound_key(char *key, struct sattr *attrs[], int cnt,
+		const char *vals[], int fill)
+{
+	size_t off;
+	int i;
+
+	off = 0;
+	for (i = 0; i < cnt; i++) {
+		if (vals[i] != NULL)
+			normalize_val(attrs[i], key + off, vals[i]);
+		else
+			memset(key + off, fill, attrs[i]->at_size);
+		off += attrs[i]->at_size;
+	}
+}
+
+struct cix_iter *search_in_composite_index(struct srel *rl,
+		struct sindex *six, const char *lo[], const char *hi[])
+{
+	struct sattr *attrs[IX_ATTR_MAX];
+	struct cix_iter *iter;
+	struct index *ix;
+	int cnt;
+
+	assert(rl != NULL);
+	assert(six != NULL);
+	assert(lo != NULL);
+	assert(hi != NULL);
+
+	ix = open_composite_index(rl, six);
+	assert(ix != NULL);
 
-	if (attr->at_indexed == PRIMARY) {
-		assert(ix->ix_size == attr->at_size);
+	cnt = ix_attrs(rl, six->sx_id, attrs);
+	assert(ix->ix_size == ix_key_size(rl, six->sx_id, SECONDARY));
 
-		iter = ix_iterator(ix, key);
-		return iter;
-	} else {
-		char buf[attr->at_size + sizeof(blkaddr_t)];
-		blkaddr_t invalid_addr;
+	iter = xmalloc(sizeof(struct cix_iter));
+	iter->ci_size = ix->ix_size - sizeof(blkaddr_t);
+	iter->ci_hi = xmalloc(ix->ix_size);
+	bound_key(iter->ci_hi, attrs, cnt, hi, 0xff);
 
-		assert(ix->ix_size == attr->at_size + sizeof(blkaddr_t));
+	{
+		char key[ix->ix_size];
 
-		invalid_addr = INVALID_ADDR;
-		memcpy(buf, key, attr->at_size);
-		memcpy(buf + attr->at_size, &invalid_addr, sizeof(blkaddr_t));
-		iter = ix_iterator(ix, buf);
-		return iter;
+		/* INVALID_ADDR matches the addresses of all tuples */
+		bound_key(key, attrs, cnt, lo, 0x00);
+		normalize_addr(attrs[cnt-1], key + iter->ci_size
+				- attrs[cnt-1]->at_size, INVALID_ADDR);
+		iter->ci_iter = ix_iterator(ix, key);
+	}
+	if (iter->ci_iter == NULL) {
+		free(iter->ci_hi);
+		free(iter);
+		return NULL;
 	}
+	return iter;
+}
+
+blkaddr_t cix_next(struct cix_iter *iter)
+{
+	blkaddr_t addr;
+
+	assert(iter != NULL);
+
+	/* the entries behind the upper bound are greater, too */
+	if ((addr = ix_rnext(iter->ci_iter)) == INVALID_ADDR
+			|| memcmp(ix_rval(iter->ci_iter), iter->ci_hi,
+				iter->ci_size) > 0)
+		return INVALID_ADDR;
+	return addr;
+}
+
+void cix_reset(struct cix_iter *iter)
+{
+	assert(iter != NULL);
+
+	ix_reset(iter->ci_iter);
+}
+
+void cix_iter_free(struct cix_iter *iter)
+{
+	assert(iter != NULL);
+
+	ix_iter_free(iter->ci_iter);
+	free(iter->ci_hi);
+	free(iter);
 }
 
 static blkaddr_t next_leq(struct ix_iter *iter)
@@ -21,6 +21,13 @@
  * management functions open_index(), create_index(), close_index()
  * remember indexes that are already open. This caching mechanism avoids 
  * opening a indexes twice at once.
+ * Each index has an id (see io.h): the index of a single attribute has the
+ * attribute's number, a composite index the id of its struct sindex in the
+ * relation's header. The relation's ixtable maps the ids to the open indexes
+ * and the index files are named by the relation and the id. The keys of a
+ * composite index are the concatenated normalized values of its attributes
+ * (see normalize_val()) followed by the tuple address; composite indexes are
+ * secondary indexes.
  */
 
 #ifndef __IXMNGT_H__
@@ -34,13 +41,31 @@ void init_ixtable(struct srel *rl);
 
 /* Creates a new index of a given relation and an attribute. The index is 
  * registered in the relation's ixtable. The type must be either 
- * PRIMARY or SECONDARY as they're defined in io.h. */
-struct index *create_index(struct srel *rl, struct sattr *attr, int type);
+ * PRIMARY or SECONDARY as they're defined in io.h. The node size is pgsize
+ * or the default if pgsize is 0. */
+struct index *create_index(struct srel *rl, struct sattr *attr, int type,
+		size_t pgsize);
+
+/* Creates a new composite index of the `cnt' attributes `attrs' of a 
+ * relation and records it in the relation's header. The keys are ordered by
+ * the first attribute, then by the second one and so on. Returns NULL if 
+ * the relation has IX_MAX composite indexes already. */
+struct index *create_composite_index(struct srel *rl, struct sattr *attrs[],
+		int cnt, size_t pgsize);
+
+/* Returns the composite index of exactly the attributes `attrs' in this order
+ * or NULL. */
+struct sindex *composite_index(struct srel *rl, struct sattr *attrs[],
+		int cnt);
 
 /* Opens a specified index of a relation. The index is registered in the 
- * relation's ixtable. */
+ * relation's ixtable. If the index file is missing or has an older format, 
+ * the index is rebuilt. */
 struct index *open_index(struct srel *rl, struct sattr *attr);
 
+/* Like open_index() for a composite index. */
+struct index *open_composite_index(struct srel *rl, struct sindex *six);
+
 /* Opens all existing indexes of a relation. The index is registered in the
  * relation's ixtable. */
 void open_indexes(struct srel *rl);
@@ -51,12 +76,27 @@ void close_index(struct srel *rl, struct sattr *attr);
 /* Closes all indexes of a relation. */
 void close_indexes(struct srel *rl);
 
-/* Removes the index file belonging to the index of `attr' of `rl'. */
+/* Removes the index file belonging to the index of `attr' of `rl'; the 
+ * attribute is not indexed anymore. */
 bool drop_index(struct srel *rl, struct sattr *attr);
 
+/* Removes the file of a composite index and its descriptor `six' from the
+ * relation's header. */
+bool drop_composite_index(struct srel *rl, struct sindex *six);
+
 /* Removes all files belonging to any indexes of a given relation. */
 bool drop_indexes(struct srel *rl);
 
+/* Removes the files of all indexes of a relation, but the attributes remain
+ * indexed, i.e. the indexes are rebuilt when they are opened next. */
+bool remove_indexes(struct srel *rl);
+
+/* Replaces the files of all indexes of a relation with new indexes that are
+ * built from the relation's tuples. This is necessary after rl_open() 
+ * converted the relation from an old format or after a crash interrupted a
+ * bulk insertion. */
+bool rebuild_indexes(struct srel *rl);
+
 /* Determines whether there is a primary index conflict, i.e. that there 
  * already is a tuple whose value in an primary indexed attribute is the same
  * as in `new_tuple'. This check is only performed if `new_tuple' and 
@@ -65,10 +105,46 @@ bool drop_indexes(struct srel *rl);
 bool primary_key_conflict(struct srel *rl, const char *new_tuple,
 		const char *old_tuple);
 
+/* Like primary_key_conflict() for the insertion of a batch of `cnt' tuples of
+ * RL_TPDATA_SIZE() bytes each; two tuples of the batch conflict, too. */
+bool batch_primary_key_conflict(struct srel *rl, const char *tuples,
+		size_t cnt);
+
 /* Synchronisation a INSERT operation on all indexes of a relation. */
 bool insert_into_indexes(struct srel *rl, bool sattrs[],
 		blkaddr_t addr, const char *tuple);
 
+/* Synchronisation of the insertion of a batch of `cnt' tuples with the 
+ * addresses addr, addr+1, ... on all indexes of a relation. The keys are 
+ * sorted and inserted in their order, once per index. */
+bool insert_batch_into_indexes(struct srel *rl, blkaddr_t addr,
+		const char *tuples, size_t cnt);
+
+/* The entries of bulk insertions that are collected and inserted into the 
+ * indexes at once (see bulk_insert_begin()). */
+struct deferred_ixs;
+
+/* Begins to collect the entries of the indexes of `rl' instead of inserting 
+ * them. The indexes must not change until insert_deferred_into_indexes(). */
+struct deferred_ixs *defer_indexes(struct srel *rl);
+
+/* Collects the entries of a batch of `cnt' tuples with the addresses addr, 
+ * addr+1, ...; the batches must be appended in the order of their addresses.
+ * Returns true to indicate success. */
+bool defer_batch(struct deferred_ixs *dx, blkaddr_t addr,
+		const char *tuples, size_t cnt);
+
+/* Inserts the collected entries into the indexes, once per index in the 
+ * order of the keys; an empty index is built bottom-up and so is an index 
+ * rebuilt if the relation had at most as many tuples before. If a tuple has the 
+ * primary key of a tuple of an earlier batch, its batch and the later ones 
+ * are cut off: `cut' is the address of the first tuple of this batch and the
+ * entries of the tuples from there on are not inserted; otherwise `cut' is 
+ * INVALID_ADDR. `cnt_ptr' tells the count of tuples before the cut. Frees 
+ * `dx' and returns true to indicate success. */
+bool insert_deferred_into_indexes(struct deferred_ixs *dx, blkaddr_t *cut,
+		size_t *cnt_ptr);
+
 /* Synchronisation a DELETE operation on all indexes of a relation. */
 bool delete_from_indexes(struct srel *rl, bool attrs[],
 		blkaddr_t addr, const char *tuple);
@@ -78,6 +154,33 @@ bool delete_from_indexes(struct srel *rl, bool attrs[],
 struct ix_iter *search_in_index(struct srel *rl, struct sattr *attr,
 		int compar, const char *key);
 
+/* An iterator over the entries of a composite index between two bounds. */
+struct cix_iter {
+	struct ix_iter	*ci_iter;	/* iterator from the lower bound */
+	char		*ci_hi;		/* upper bound, normalized values */
+	size_t		ci_size;	/* size of the values in a key */
+};
+
+/* Returns an iterator over the tuple addresses of the composite index `six'
+ * whose values lie between `lo' and `hi', each an array of one value per 
+ * attribute of the index (in the order of the index); NULL means no bound. 
+ * The bounds are inclusive and compared as the concatenated values, i.e. 
+ * only a prefix of attributes with equal lower and upper bounds and at most
+ * one further bounded attribute restricts the range exactly, the other 
+ * values must be checked by the caller. */
+struct cix_iter *search_in_composite_index(struct srel *rl,
+		struct sindex *six, const char *lo[], const char *hi[]);
+
+/* Returns the next tuple address of the composite index iterator in the 
+ * order of the index or INVALID_ADDR behind the upper bound. */
+blkaddr_t cix_next(struct cix_iter *iter);
+
+/* Resets a composite index iterator to its lower bound. */
+void cix_reset(struct cix_iter *iter);
+
+/* Frees a composite index iterator. */
+void cix_iter_free(struct cix_iter *iter);
+
 /* Returns the index iterator "next one, please" function that belongs to 
  * compar. This is either ix_next_left (LEQ, LT), ix_next_right (GEQ, GT)
  * or ix_next (EQ). (Moving the iterator to the right position is done in 
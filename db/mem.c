@@ -14,6 +14,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _XOPEN_SOURCE 600	/* posix_memalign() */
+
 #include "mem.h"
 #include "hashset.h"
 #include "str.h"
@@ -425,6 +427,46 @@ void *xrealloc(void *ptr, size_t size)
 }
 #endif
 
+#ifdef MEMDEBUG
+void *wxmemalign(size_t align, size_t size, const char *file,
+		const char *function, int line)
+{
+	void *ptr;
+	struct memrec *rec;
+
+	if (table == NULL)
+		init_table();
+
+	if (posix_memalign(&ptr, align, size) != 0)
+		ptr = NULL;
+	malloc_calls++;
+	mem_cur += size;
+	mem_total += size;
+	if (mem_cur > mem_peak) {
+		mem_peak = mem_cur;
+		peak_file = file;
+		peak_line = line;
+		peak_function = function;
+	}
+
+	rec = init_rec(ptr, size, file, function, line);
+	table_insert(table, ptr, rec);
+	return ptr;
+}
+#else
+void *xmemalign(size_t align, size_t size)
+{
+	void *val;
+
+	if (posix_memalign(&val, align, size) != 0) {
+		fprintf(stderr, "%s(): Virtual memory exhausted.\n",
+				__FUNCTION__);
+		exit(1);
+	}
+	return val;
+}
+#endif
+
 #ifdef MEMDEBUG
 void wfree(void *ptr, const char *file, const char *function, int line)
 {
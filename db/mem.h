@@ -17,6 +17,8 @@
 /*
  * Wrappers for malloc(), calloc(), realloc(), free() functions.
  * These functions are very useful to search memory leaks.
+ * xmemalign() allocates memory aligned to a power of two (as needed for 
+ * direct I/O), which is released with free(), too.
  */
 
 #ifndef __MEM_H__
@@ -31,6 +33,7 @@
 void *xmalloc(size_t size);
 void *xcalloc(size_t nmemb, size_t size);
 void *xrealloc(void *ptr, size_t size);
+void *xmemalign(size_t align, size_t size);
 
 typedef int mid_t;
 mid_t gnew(void);
@@ -53,6 +56,8 @@ mid_t gnew(void);
 				__LINE__)
 #define xrealloc(ptr,size)	wxrealloc(ptr, size, __FILE__, __FUNCTION__,\
 				__LINE__)
+#define xmemalign(align,size)	wxmemalign(align, size, __FILE__, __FUNCTION__,\
+				__LINE__)
 #define free(ptr)		wfree(ptr, __FILE__, __FUNCTION__, __LINE__)
 
 mid_t wgnew(const char *file, const char *function, int line);
@@ -71,6 +76,8 @@ void *wxcalloc(size_t nmemb, size_t size, const char *file,
 		const char *function, int line);
 void *wxrealloc(void *ptr, size_t size, const char *file,
 		const char *function, int line);
+void *wxmemalign(size_t align, size_t size, const char *file,
+		const char *function, int line);
 void wfree(void *ptr, const char *file, const char *function, int line);
 void memprint(void);
 
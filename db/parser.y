@@ -28,6 +28,7 @@
 #include "expr.h"
 #include "mem.h"
 #include "sort.h"
+#include "wal.h"
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -88,6 +89,7 @@ extern void dql_scanner_cleanup(void);
 	struct drp_view		*drp_view;
 	struct crt_ix		*crt_ix;
 	struct drp_ix		*drp_ix;
+	struct vac_tbl		*vac_tbl;
 
 	struct dml_query	*dml_query;
 	struct srcrl		*srcrl;
@@ -103,6 +105,7 @@ extern void dql_scanner_cleanup(void);
 	struct insertion	*insertion;
 	struct deletion		*deletion;
 	struct update		*update;
+	struct copy		*copy;
 
 	struct stmt_result	*stmt_result;
 }
@@ -125,7 +128,10 @@ extern void dql_scanner_cleanup(void);
 %token TOK_WILDCARD TOK_FROM TOK_WHERE TOK_AS TOK_ON TOK_OVER TOK_BY TOK_ASC
 %token TOK_DESC TOK_SET
 %token TOK_VALUES TOK_INTO
+%token TOK_COPY
 %token TOK_PRIMARY_KEY TOK_FOREIGN_KEY
+%token TOK_PAGE_SIZE
+%token TOK_VACUUM TOK_ORDER_BY
 %token TOK_AND TOK_OR
 %token TOK_EQ TOK_LEQ TOK_GEQ TOK_LT TOK_GT TOK_NEQ
 %token TOK_EOQ
@@ -137,7 +143,7 @@ extern void dql_scanner_cleanup(void);
 %left TOK_AND
 
 %type <string_ptr> tbl_name view_name ix_name attr_name
-%type <int_val> field_size
+%type <int_val> field_size page_size
 %type <type> type
 %type <expr> expr
 %type <int_val> comp
@@ -147,12 +153,14 @@ extern void dql_scanner_cleanup(void);
 %type <ddl_stmt> ddl_stmt
 %type <attr_dcl> attr_dcl
 %type <list> attr_dcllist
+%type <list> attr_namelist
 %type <crt_tbl> crt_tbl
 %type <drp_tbl> drp_tbl
 %type <crt_view> crt_view
 %type <drp_view> drp_view
 %type <crt_ix> crt_ix
 %type <drp_ix> drp_ix
+%type <vac_tbl> vac_tbl
 
 %type <dml_query> dml_query
 %type <srcrl> srcrl
@@ -178,6 +186,7 @@ extern void dql_scanner_cleanup(void);
 %type <list> attrvaluelist
 %type <expr> update_where
 %type <update> update
+%type <copy> copy
 
 %type <stmt_result> stmt
 %start stmt
@@ -265,6 +274,13 @@ ddl_stmt : crt_tbl
 		ddl_stmt->ptr.drp_ix = $1;
 		$$ = ddl_stmt;
 	}
+	| vac_tbl
+	{
+		NEW(ddl_stmt);
+		ddl_stmt->type = VACUUM_TABLE;
+		ddl_stmt->ptr.vac_tbl = $1;
+		$$ = ddl_stmt;
+	}
 	;
 
 field_size : TOK_INT
@@ -273,6 +289,16 @@ field_size : TOK_INT
 	}
 	;
 
+page_size : /* empty */
+	{
+		$$ = 0;
+	}
+	| TOK_PAGE_SIZE TOK_INT
+	{
+		$$ = $2;
+	}
+	;
+
 type : TOK_TYPE_BYTES '(' field_size ')'
 	{
 		NEW(type);
@@ -478,12 +504,13 @@ attr_dcllist : attr_dcllist ',' attr_dcl
 	}
 	;
 
-crt_tbl : TOK_CREATE TOK_TABLE tbl_name '(' attr_dcllist ')'
+crt_tbl : TOK_CREATE TOK_TABLE tbl_name '(' attr_dcllist ')' page_size
 	{
 		NEW(crt_tbl);
 		crt_tbl->tbl_name = $3;
 		crt_tbl->attr_dcls = (struct attr_dcl **)$5->table;
 		crt_tbl->cnt = $5->used;
+		crt_tbl->pgsize = (size_t)$7;
 		gfree($5, id);
 		$$ = crt_tbl;
 	}
@@ -514,24 +541,58 @@ drp_view : TOK_DROP TOK_VIEW view_name
 	}
 	;
 
-crt_ix : TOK_CREATE TOK_INDEX TOK_ON tbl_name '(' attr_name ')'
+attr_namelist : attr_namelist ',' attr_name
+	{
+		al_append($1, $3);
+		$$ = $1;
+	}
+	| attr_name
+	{
+		struct alist *list = al_init_gc(10, id);
+		al_append(list, $1);
+		$$ = list;
+	}
+	;
+
+crt_ix : TOK_CREATE TOK_INDEX TOK_ON tbl_name '(' attr_namelist ')' page_size
 	{
 		NEW(crt_ix);
 		crt_ix->tbl_name = $4;
-		crt_ix->attr_name = $6;
+		crt_ix->attr_names = (char **)$6->table;
+		crt_ix->cnt = $6->used;
+		crt_ix->pgsize = (size_t)$8;
+		gfree($6, id);
 		$$ = crt_ix;
 	}
 	;
 
-drp_ix : TOK_DROP TOK_INDEX ix_name '(' attr_name ')'
+drp_ix : TOK_DROP TOK_INDEX ix_name '(' attr_namelist ')'
 	{
 		NEW(drp_ix);
 		drp_ix->tbl_name = $3;
-		drp_ix->attr_name = $5;
+		drp_ix->attr_names = (char **)$5->table;
+		drp_ix->cnt = $5->used;
+		gfree($5, id);
 		$$ = drp_ix;
 	}
 	;
 
+vac_tbl : TOK_VACUUM tbl_name
+	{
+		NEW(vac_tbl);
+		vac_tbl->tbl_name = $2;
+		vac_tbl->attr_name = NULL;
+		$$ = vac_tbl;
+	}
+	| TOK_VACUUM tbl_name TOK_ORDER_BY attr_name
+	{
+		NEW(vac_tbl);
+		vac_tbl->tbl_name = $2;
+		vac_tbl->attr_name = $4;
+		$$ = vac_tbl;
+	}
+	;
+
 dml_query : selection
 	{
 		NEW(dml_query);
@@ -834,6 +895,13 @@ dml_modi : insertion
 		dml_modi->ptr.update = $1;
 		$$ = dml_modi;
 	}
+	| copy
+	{
+		NEW(dml_modi);
+		dml_modi->type = COPY;
+		dml_modi->ptr.copy = $1;
+		$$ = dml_modi;
+	}
 	;
 
 valuelist : valuelist ',' value
@@ -923,6 +991,15 @@ update : TOK_UPDATE tbl_name TOK_SET attrvaluelist update_where
 	}
 	;
 
+copy : TOK_COPY tbl_name TOK_FROM TOK_STRING
+	{
+		NEW(copy);
+		copy->tbl_name = $2;
+		copy->filename = $4;
+		$$ = copy;
+	}
+	;
+
 expr	: '(' expr ')'
 	{
 		$$ = $2;
@@ -1034,6 +1111,8 @@ struct stmt_result *dql_parse(const char *stmt)
 	qlparse();
 	r = statement_result;
 	current--;
+	if (current == -1 && !wal_commit() && r != NULL)
+		r->success = false;
 	return r;
 }
 
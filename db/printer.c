@@ -213,8 +213,10 @@ static void print_attrval(FILE *out, struct xattr *attr, const char *tuple)
 tpcnt_t xrel_fprint(FILE *out, struct xrel *rl)
 {
 	struct xrel_iter *iter;
+	struct xrel_batch batch;
 	const char *tuple;
 	tpcnt_t i;
+	unsigned short k;
 	int j;
 
 	assert(rl != NULL);
@@ -240,15 +242,18 @@ tpcnt_t xrel_fprint(FILE *out, struct xrel *rl)
 
 	print_line(out, rl);
 
-	for (i = 0; (tuple = iter->it_next(iter)) != NULL; i++) {
-		fprintf(out, "|");
-		for (j = 0; j < rl->rl_atcnt; j++) {
-			print_attrval(out, rl->rl_attrs[j], tuple);
+	for (i = 0; xrel_next_batch(iter, &batch) > 0; ) {
+		for (k = 0; k < batch.bt_selcnt; k++, i++) {
+			tuple = batch.bt_tuples[batch.bt_sel[k]];
 			fprintf(out, "|");
+			for (j = 0; j < rl->rl_atcnt; j++) {
+				print_attrval(out, rl->rl_attrs[j], tuple);
+				fprintf(out, "|");
+			}
+			fprintf(out, "\n");
 		}
-		fprintf(out, "\n");
 	}
-	assert(iter->it_next(iter) == NULL);
+	assert(xrel_next_batch(iter, &batch) == 0);
 	xrel_iter_free(iter);
 	print_line(out, rl);
 	return i;
@@ -20,7 +20,9 @@
 #include "mem.h"
 #include "constants.h" /* INT, .., EQ, GEQ, ... */
 #include "sort.h"
+#include "cache.h" /* parse_size() */
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +32,8 @@ enum {
 	UNION,
 	PROJECTION,
 	JOIN,
+	HASH_JOIN,
+	MERGE_JOIN,
 	SELECTION,
 	SORT
 };
@@ -183,6 +187,90 @@ static bool best_av_xexpr(struct xrel *rl, struct xattr **ix_attr,
 		return false;
 }
 
+/* finds the composite index of the stored relation below the selection `rl'
+ * whose leading attributes are compared with EQ, followed by at most one 
+ * attribute with a range, such that the most attributes are restricted;
+ * their bounds are written to `lo' and `hi' (see search_in_composite_index())
+ * and their count to `cnt' */
+static struct sindex *best_composite_index(struct xrel *rl, const char *lo[],
+		const char *hi[], int *cnt)
+{
+	struct xrel *prl;
+	struct srel *srl;
+	struct sindex *six, *best_six;
+	struct sattr *attr;
+	struct xexpr *e;
+	const char *l[IX_ATTR_MAX], *h[IX_ATTR_MAX], *eq;
+	int i, j, k, n;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == SELECTION);
+
+	*cnt = 0;
+	prl = (struct xrel *)rl->rl_rls[0];
+	if (prl->rl_type != SREL_WRAPPER)
+		return NULL;
+
+	srl = (struct srel *)prl->rl_rls[0];
+	best_six = NULL;
+	for (i = 0; i < srl->rl_header.hd_ixcnt; i++) {
+		six = &srl->rl_header.hd_ixs[i];
+		n = 0;
+		for (j = 0; j < six->sx_atcnt; j++)
+			l[j] = h[j] = NULL;
+		for (j = 0; j < six->sx_atcnt; j++) {
+			attr = &srl->rl_header.hd_attrs[six->sx_attrs[j]];
+			eq = NULL;
+			for (k = 0; k < rl->rl_excnt; k++) {
+				e = rl->rl_exprs[k];
+				assert(e->ex_type == ATTR_TO_VAL);
+				if (e->ex_left_attr->at_sattr != attr)
+					continue;
+				switch (e->ex_compar) {
+					case EQ:  eq = e->ex_right_val; break;
+					case GEQ:
+					case GT:  l[j] = e->ex_right_val; break;
+					case LEQ:
+					case LT:  h[j] = e->ex_right_val; break;
+				}
+			}
+			if (eq != NULL) {
+				l[j] = h[j] = eq;
+				n = j + 1;
+				continue;
+			}
+			if (l[j] != NULL || h[j] != NULL)
+				n = j + 1;
+			break;
+		}
+		if (n > *cnt && open_composite_index(srl, six) != NULL) {
+			best_six = six;
+			*cnt = n;
+			memcpy(lo, l, six->sx_atcnt * sizeof(const char *));
+			memcpy(hi, h, six->sx_atcnt * sizeof(const char *));
+		}
+	}
+	return best_six;
+}
+
+/* returns the composite index (see best_composite_index()) if it restricts
+ * more attributes than the best index of a single attribute, unless that is
+ * a primary key compared with EQ, or if no single attribute index applies */
+static struct sindex *selection_composite_index(struct xrel *rl,
+		const char *lo[], const char *hi[])
+{
+	struct xattr *ix_attr;
+	struct sindex *six;
+	int compar, cnt;
+
+	if (!best_av_xexpr(rl, &ix_attr, &compar, NULL))
+		return best_composite_index(rl, lo, hi, &cnt);
+	if (compar == EQ && ix_attr->at_sattr->at_indexed == PRIMARY)
+		return NULL;
+	six = best_composite_index(rl, lo, hi, &cnt);
+	return cnt > 1 ? six : NULL;
+}
+
 static bool xrel_has_xattr(struct xrel *rl, struct xattr *attr)
 {
 	unsigned short i, j;
@@ -239,6 +327,50 @@ static void tpcpy(char *dest, struct xrel *destrl, const char *src,
 	memcpy(dest + offset, src, srcrl->rl_size);
 }
 
+/* copies the part of the tuple `src' of destrl that stems from srcrl into 
+ * the tuple `dest' of destrl */
+static void tpcpy_part(char *dest, struct xrel *destrl, const char *src,
+		struct xrel *srcrl)
+{
+	size_t offset;
+
+	assert(destrl->rl_rls[0] == srcrl || destrl->rl_rls[1] == srcrl);
+
+	if (destrl->rl_rls[0] == srcrl)
+		offset = 0;
+	else
+		offset = ((struct xrel *)destrl->rl_rls[0])->rl_size;
+
+	memcpy(dest + offset, src + offset, srcrl->rl_size);
+}
+
+/* Fills a batch with the tuples that `fill' writes into the iterator's batch
+ * buffer one after another, for joins whose it_next() builds its tuple in 
+ * it_tpbuf: so the joined tuples need not be copied. `fill' returns false at
+ * the end; it is not invoked again then. */
+static inline unsigned short fill_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch,
+		bool (*fill)(struct xrel_iter *, char *))
+{
+	size_t size;
+	unsigned short n;
+
+	size = iter->it_rl->rl_size;
+	if (iter->it_batchbuf == NULL)
+		iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * size);
+	for (n = 0; n < XREL_BATCH_MAX; n++) {
+		if (!fill(iter, iter->it_batchbuf + n * size)) {
+			iter->it_eof = true;
+			break;
+		}
+		batch->bt_tuples[n] = iter->it_batchbuf + n * size;
+		batch->bt_sel[n] = n;
+	}
+	batch->bt_cnt = n;
+	batch->bt_selcnt = n;
+	return n;
+}
+
 static bool xattr_check(const char *tuple, struct xattr *attr, int oper,
 		const void *val)
 {
@@ -438,6 +570,8 @@ void xrel_free(struct xrel *rl)
 				xrel_free(rl->rl_rls[0]);
 				break;
 			case JOIN:
+			case HASH_JOIN:
+			case MERGE_JOIN:
 				xrel_free(rl->rl_rls[0]);
 				xrel_free(rl->rl_rls[1]);
 				break;
@@ -466,10 +600,63 @@ void xrel_iter_free(struct xrel_iter *iter)
 			free(iter->it_tpbuf);
 		if (iter->it_fp != NULL)
 			fclose(iter->it_fp);
+		if (iter->it_batchbuf != NULL)
+			free(iter->it_batchbuf);
 		free(iter);
 	}
 }
 
+/* Fills a batch by it_next() for iterators that have no it_next_batch().
+ * The tuples are copied because it_next() overwrites its buffer. Once 
+ * it_next() returned NULL, it is not invoked again: some iterators, e.g. 
+ * those of indexes, start over then. */
+static unsigned short legacy_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	const char *tuple;
+	size_t size;
+	unsigned short n;
+
+	size = iter->it_rl->rl_size;
+	for (n = 0; n < XREL_BATCH_MAX; n++) {
+		if ((tuple = iter->it_next(iter)) == NULL) {
+			iter->it_eof = true;
+			break;
+		}
+		if (iter->it_batchbuf == NULL)
+			iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * size);
+		memcpy(iter->it_batchbuf + n * size, tuple, size);
+		batch->bt_tuples[n] = iter->it_batchbuf + n * size;
+		batch->bt_sel[n] = n;
+	}
+	batch->bt_cnt = n;
+	batch->bt_selcnt = n;
+	return n;
+}
+
+unsigned short xrel_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	unsigned short n;
+
+	assert(iter != NULL);
+	assert(batch != NULL);
+
+	if (iter->it_eof) {
+		n = 0;
+		batch->bt_cnt = 0;
+		batch->bt_selcnt = 0;
+	} else if (iter->it_next_batch != NULL)
+		n = iter->it_next_batch(iter, batch);
+	else
+		n = legacy_next_batch(iter, batch);
+	assert(n == batch->bt_selcnt);
+	if (n == 0)
+		iter->it_eof = true;
+	batch->bt_pos = 0;
+	return n;
+}
+
 static const char *wrapper_next(struct xrel_iter *iter)
 {
 	struct srel_iter *srel_iter;
@@ -483,6 +670,27 @@ static const char *wrapper_next(struct xrel_iter *iter)
 	return rl_next(srel_iter);
 }
 
+/* hands out the pointers of rl_next_batch(), i.e. the tuples are not 
+ * copied */
+static unsigned short wrapper_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	unsigned short i, n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SREL_WRAPPER);
+	assert(iter->it_iter[0] != NULL);
+
+	n = (unsigned short)rl_next_batch(iter->it_iter[0], batch->bt_tuples,
+			XREL_BATCH_MAX);
+	for (i = 0; i < n; i++)
+		batch->bt_sel[i] = i;
+	batch->bt_cnt = n;
+	batch->bt_selcnt = n;
+	return n;
+}
+
 static void wrapper_reset(struct xrel_iter *iter)
 {
 	struct srel_iter *srel_iter;
@@ -492,6 +700,7 @@ static void wrapper_reset(struct xrel_iter *iter)
 	assert(iter->it_rl->rl_type == SREL_WRAPPER);
 	assert(iter->it_iter[0] != NULL);
 
+	iter->it_eof = false;
 	srel_iter = iter->it_iter[0];
 	rl_iterator_reset(srel_iter);
 }
@@ -509,8 +718,10 @@ static struct xrel_iter *wrapper_iterator(struct xrel *rl)
 	iter->it_state = 0;
 	iter->it_tpbuf = NULL;
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
-	srel_iter = rl_iterator(rl->rl_rls[0]);
+	srel_iter = rl_physical_iterator(rl->rl_rls[0]);
 	assert(srel_iter != NULL);
 
 	iter->it_iter[0] = srel_iter;
@@ -521,6 +732,7 @@ static struct xrel_iter *wrapper_iterator(struct xrel *rl)
 
 	iter->it_next = wrapper_next;
 	iter->it_reset = wrapper_reset;
+	iter->it_next_batch = wrapper_next_batch;
 	return iter;
 }
 
@@ -550,6 +762,60 @@ static const char *wrapper_ix_next(struct xrel_iter *iter)
 	return iter->it_tpbuf;
 }
 
+/* reads the tuples at the `cnt' addresses into the batch; rl_get() reads
+ * each tuple into the same buffer, so it is copied once */
+static unsigned short wrapper_get_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch, const blkaddr_t *addrs,
+		unsigned short cnt)
+{
+	struct srel *srl;
+	const char *tuple;
+	size_t size;
+	unsigned short n;
+
+	srl = (struct srel *)iter->it_rl->rl_rls[0];
+	size = iter->it_rl->rl_size;
+	if (iter->it_batchbuf == NULL)
+		iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * size);
+	for (n = 0; n < cnt; n++) {
+		if ((tuple = rl_get(srl, addrs[n])) == NULL) {
+			iter->it_eof = true;
+			break;
+		}
+		memcpy(iter->it_batchbuf + n * size, tuple, size);
+		batch->bt_tuples[n] = iter->it_batchbuf + n * size;
+		batch->bt_sel[n] = n;
+	}
+	batch->bt_cnt = n;
+	batch->bt_selcnt = n;
+	return n;
+}
+
+/* like wrapper_ix_next(), but fills a batch; once the index iterator is 
+ * exhausted, it is not polled again (see legacy_next_batch()) */
+static unsigned short wrapper_ix_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	blkaddr_t addrs[XREL_BATCH_MAX];
+	blkaddr_t (*nextf)(struct ix_iter *);
+	unsigned short n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SREL_WRAPPER);
+	assert(iter->it_iter[0] != NULL);
+
+	nextf = index_iterator_nextf(iter->it_compar);
+	assert(nextf != NULL);
+	for (n = 0; n < XREL_BATCH_MAX; n++) {
+		if ((addrs[n] = nextf(iter->it_iter[0])) == INVALID_ADDR) {
+			iter->it_eof = true;
+			break;
+		}
+	}
+	return wrapper_get_batch(iter, batch, addrs, n);
+}
+
 static void wrapper_ix_reset(struct xrel_iter *iter)
 {
 	assert(iter != NULL);
@@ -558,6 +824,7 @@ static void wrapper_ix_reset(struct xrel_iter *iter)
 	assert(iter->it_iter[0] != NULL);
 
 	iter->it_state = 0;
+	iter->it_eof = false;
 	ix_reset(iter->it_iter[0]);
 }
 
@@ -579,6 +846,8 @@ static struct xrel_iter *wrapper_ix_iterator(struct xrel *rl,
 	iter->it_compar = compar;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	ix_iter = search_in_index(attr->at_srl, attr->at_sattr, compar, val);
 	assert(ix_iter != NULL);
@@ -591,6 +860,134 @@ static struct xrel_iter *wrapper_ix_iterator(struct xrel *rl,
 
 	iter->it_next = wrapper_ix_next;
 	iter->it_reset = wrapper_ix_reset;
+	iter->it_next_batch = wrapper_ix_next_batch;
+	return iter;
+}
+
+static const char *wrapper_cix_next(struct xrel_iter *iter)
+{
+	struct srel *srl;
+	blkaddr_t addr;
+	const char *tuple;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SREL_WRAPPER);
+	assert(iter->it_iter[0] != NULL);
+
+	if ((addr = cix_next(iter->it_iter[0])) == INVALID_ADDR)
+		return NULL;
+
+	srl = (struct srel *)iter->it_rl->rl_rls[0];
+	if ((tuple = rl_get(srl, addr)) == NULL)
+		return NULL;
+	memcpy(iter->it_tpbuf, tuple, iter->it_rl->rl_size);
+	return iter->it_tpbuf;
+}
+
+/* like wrapper_cix_next(), but fills a batch */
+static unsigned short wrapper_cix_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	blkaddr_t addrs[XREL_BATCH_MAX];
+	unsigned short n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SREL_WRAPPER);
+	assert(iter->it_iter[0] != NULL);
+
+	for (n = 0; n < XREL_BATCH_MAX; n++) {
+		if ((addrs[n] = cix_next(iter->it_iter[0])) == INVALID_ADDR) {
+			iter->it_eof = true;
+			break;
+		}
+	}
+	return wrapper_get_batch(iter, batch, addrs, n);
+}
+
+static void wrapper_cix_reset(struct xrel_iter *iter)
+{
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SREL_WRAPPER);
+	assert(iter->it_iter[0] != NULL);
+
+	iter->it_state = 0;
+	iter->it_eof = false;
+	cix_reset(iter->it_iter[0]);
+}
+
+/* an iterator over the tuples whose values lie between `lo' and `hi' in the 
+ * composite index `six' (see search_in_composite_index()) */
+static struct xrel_iter *wrapper_cix_iterator(struct xrel *rl,
+		struct sindex *six, const char *lo[], const char *hi[])
+{
+	struct xrel_iter *iter;
+	struct cix_iter *cix_iter;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == SREL_WRAPPER);
+	assert(six != NULL);
+
+	iter = xmalloc(sizeof(struct xrel_iter));
+	iter->it_rl = rl;
+	iter->it_state = 0;
+	iter->it_compar = EQ;
+	iter->it_tpbuf = xmalloc(rl->rl_size);
+	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	cix_iter = search_in_composite_index(rl->rl_rls[0], six, lo, hi);
+	assert(cix_iter != NULL);
+
+	iter->it_iter[0] = cix_iter;
+	iter->it_free_iter[0] = (void (*)(void *))cix_iter_free;
+
+	iter->it_iter[1] = NULL;
+	iter->it_free_iter[1] = NULL;
+
+	iter->it_next = wrapper_cix_next;
+	iter->it_reset = wrapper_cix_reset;
+	iter->it_next_batch = wrapper_cix_next_batch;
+	return iter;
+}
+
+/* an iterator over all tuples in the order of the index of attr */
+static struct xrel_iter *wrapper_ordered_iterator(struct xrel *rl,
+		struct xattr *attr)
+{
+	struct xrel_iter *iter;
+	struct ix_iter *ix_iter;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == SREL_WRAPPER);
+	assert(attr != NULL);
+	assert(attr->at_srl == rl->rl_rls[0]);
+	assert(attr->at_ix != NULL);
+
+	if ((ix_iter = ix_min(attr->at_ix)) == NULL)
+		return NULL;
+
+	iter = xmalloc(sizeof(struct xrel_iter));
+	iter->it_rl = rl;
+	iter->it_state = 0;
+	iter->it_compar = GEQ;
+	iter->it_tpbuf = xmalloc(rl->rl_size);
+	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	iter->it_iter[0] = ix_iter;
+	iter->it_free_iter[0] = (void (*)(void *))ix_iter_free;
+
+	iter->it_iter[1] = NULL;
+	iter->it_free_iter[1] = NULL;
+
+	iter->it_next = wrapper_ix_next;
+	iter->it_reset = wrapper_ix_reset;
+	iter->it_next_batch = wrapper_ix_next_batch;
 	return iter;
 }
 
@@ -635,7 +1032,46 @@ struct xrel *wrapper_init(struct srel *srl)
 	return rl;
 }
 
-static const char *join_next_indexed(struct xrel_iter *iter)
+/* Estimated count of tuples of an expressible relation; selections are
+ * assumed to select everything. */
+static double xrel_card(struct xrel *rl)
+{
+	assert(rl != NULL);
+
+	switch (rl->rl_type) {
+		case SREL_WRAPPER:
+			return ((struct srel *)rl->rl_rls[0])
+				->rl_header.hd_tpcnt;
+		case SELECTION:
+		case PROJECTION:
+		case SORT:
+			return xrel_card(rl->rl_rls[0]);
+		case UNION:
+			return xrel_card(rl->rl_rls[0])
+				+ xrel_card(rl->rl_rls[1]);
+		case JOIN:
+		case HASH_JOIN:
+		case MERGE_JOIN:
+			return xrel_card(rl->rl_rls[0])
+				* xrel_card(rl->rl_rls[1]);
+		default:
+			assert(false);
+			return 0;
+	}
+}
+
+/* the memory budget of a hash join or block nested-loop join */
+static size_t join_memory(void)
+{
+	const char *env;
+
+	env = getenv(JOIN_MEMORY_ENV);
+	return (env != NULL) ? parse_size(env) : JOIN_DEFAULT_MEMORY;
+}
+
+/* writes the next joined tuple into buf; the tuple of the scanned relation 
+ * is kept in it_tpbuf */
+static bool join_fill_indexed(struct xrel_iter *iter, char *buf)
 {
 	struct xrel_iter *iter0, *iter1;
 	const char *tuple0, *tuple1;
@@ -660,7 +1096,7 @@ next_tuple:
 		int compar;
 
 		if ((tuple1 = iter1->it_next(iter1)) == NULL)
-			return NULL;
+			return false;
 		tpcpy(iter->it_tpbuf, iter->it_rl, tuple1, iter1->it_rl);
 
 		prl = iter->it_ixattr->at_pxrl;
@@ -685,254 +1121,1511 @@ next_tuple:
 		iter->it_state = 0;
 		goto next_tuple;
 	} else {
-		tpcpy(iter->it_tpbuf, iter->it_rl, tuple0, iter0->it_rl);
-		if (!xexpr_check(iter->it_tpbuf,
-					iter->it_rl->rl_exprs,
+		if (buf != iter->it_tpbuf)
+			tpcpy_part(buf, iter->it_rl, iter->it_tpbuf,
+					iter1->it_rl);
+		tpcpy(buf, iter->it_rl, tuple0, iter0->it_rl);
+		if (!xexpr_check(buf, iter->it_rl->rl_exprs,
 					iter->it_rl->rl_excnt)) {
 			goto next_tuple;
 		} else
-			return iter->it_tpbuf;
+			return true;
 	}
 }
 
-static const char *join_next_fullscan(struct xrel_iter *iter)
+static const char *join_next_indexed(struct xrel_iter *iter)
 {
-	const char *tuple0, *tuple1;
-	struct xrel_iter *iter0, *iter1;
+	return join_fill_indexed(iter, iter->it_tpbuf) ? iter->it_tpbuf : NULL;
+}
+
+static unsigned short join_next_indexed_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	return fill_batch(iter, batch, join_fill_indexed);
+}
+
+static void join_reset_indexed(struct xrel_iter *iter)
+{
+	struct xrel_iter *xrel_iter;
 
-next_tuple:
 	assert(iter != NULL);
 	assert(iter->it_rl != NULL);
 	assert(iter->it_rl->rl_type == JOIN);
 
-	iter0 = iter->it_iter[0];
-	iter1 = iter->it_iter[1];
+	iter->it_state = 0;
+	iter->it_eof = false;
+	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
+	if (xrel_iter != NULL) {
+		xrel_iter->it_free_iter[0](xrel_iter);
+		iter->it_iter[0] = NULL;
+	}
+	xrel_iter = (struct xrel_iter *)iter->it_iter[1];
+	xrel_iter->it_reset(xrel_iter);
+}
 
-	assert(iter0 != NULL);
-	assert(iter0->it_rl != NULL);
-	assert(iter1 != NULL);
-	assert(iter1->it_rl != NULL);
+/* The state of a block nested-loop join: as many outer tuples as fit into
+ * the memory budget are buffered and joined with each inner tuple, so the
+ * inner relation is read once per block instead of once per outer tuple. */
+struct bnl {
+	struct xrel_iter *bl_oiter;	/* iterator of outer relation */
+	struct xrel_iter *bl_iiter;	/* iterator of inner relation */
+	char		*bl_block;	/* buffered outer tuples */
+	size_t		bl_max;		/* capacity of bl_block in tuples */
+	size_t		bl_cnt;		/* count of tuples in bl_block */
+	size_t		bl_index;	/* next tuple of bl_block to join */
+	bool		bl_inner;	/* is there a current inner tuple? */
+	struct xrel_batch *bl_ibatch;	/* inner tuples (batches only); its
+					 * bt_pos is the current one */
+};
+
+static struct bnl *bnl_init(struct xrel_iter *oiter, struct xrel_iter *iiter)
+{
+	struct bnl *bl;
+	size_t size;
+
+	size = oiter->it_rl->rl_size;
+	bl = xmalloc(sizeof(struct bnl));
+	bl->bl_oiter = oiter;
+	bl->bl_iiter = iiter;
+	bl->bl_max = join_memory() / size;
+	if (bl->bl_max == 0)
+		bl->bl_max = 1;
+	bl->bl_block = NULL;
+	bl->bl_cnt = 0;
+	bl->bl_index = 0;
+	bl->bl_inner = false;
+	bl->bl_ibatch = NULL;
+	return bl;
+}
+
+static void bnl_free(struct bnl *bl)
+{
+	if (bl != NULL) {
+		xrel_iter_free(bl->bl_oiter);
+		xrel_iter_free(bl->bl_iiter);
+		if (bl->bl_block != NULL)
+			free(bl->bl_block);
+		if (bl->bl_ibatch != NULL)
+			free(bl->bl_ibatch);
+		free(bl);
+	}
+}
+
+/* Reads the next block of outer tuples; false if there are none. */
+static bool bnl_load(struct bnl *bl)
+{
+	const char *tuple;
+	size_t size;
+
+	size = bl->bl_oiter->it_rl->rl_size;
+	bl->bl_cnt = 0;
+	while (bl->bl_cnt < bl->bl_max
+			&& (tuple = bl->bl_oiter->it_next(bl->bl_oiter))
+			!= NULL) {
+		if (bl->bl_block == NULL)
+			bl->bl_block = xmalloc(bl->bl_max * size);
+		memcpy(bl->bl_block + bl->bl_cnt * size, tuple, size);
+		bl->bl_cnt++;
+	}
+	return bl->bl_cnt > 0;
+}
+
+static const char *join_next_block(struct xrel_iter *iter)
+{
+	struct bnl *bl;
+	struct xrel *orl;
+	const char *tuple;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == JOIN);
+
+	bl = iter->it_iter[0];
+	assert(bl != NULL);
+	orl = bl->bl_oiter->it_rl;
 
 	if (iter->it_state == 0) {
-		if ((tuple0 = iter0->it_next(iter0)) == NULL)
+		if (!bnl_load(bl))
 			return NULL;
-		tpcpy(iter->it_tpbuf, iter->it_rl, tuple0, iter0->it_rl);
 		iter->it_state = 1;
 	}
 
-	if ((tuple1 = iter1->it_next(iter1)) == NULL) {
-		if ((tuple0 = iter0->it_next(iter0)) == NULL)
-			return NULL;
-		tpcpy(iter->it_tpbuf, iter->it_rl, tuple0, iter0->it_rl);
-		iter1->it_reset(iter1);
-		if ((tuple1 = iter1->it_next(iter1)) == NULL)
+	for (;;) {
+		while (bl->bl_inner && bl->bl_index < bl->bl_cnt) {
+			tuple = bl->bl_block + bl->bl_index * orl->rl_size;
+			bl->bl_index++;
+			tpcpy(iter->it_tpbuf, iter->it_rl, tuple, orl);
+			if (xexpr_check(iter->it_tpbuf, iter->it_rl->rl_exprs,
+						iter->it_rl->rl_excnt))
+				return iter->it_tpbuf;
+		}
+
+		if ((tuple = bl->bl_iiter->it_next(bl->bl_iiter)) != NULL) {
+			tpcpy(iter->it_tpbuf, iter->it_rl, tuple,
+					bl->bl_iiter->it_rl);
+			bl->bl_inner = true;
+			bl->bl_index = 0;
+			continue;
+		}
+
+		bl->bl_inner = false;
+		if (!bnl_load(bl))
 			return NULL;
+		bl->bl_iiter->it_reset(bl->bl_iiter);
+	}
+}
+
+/* Like join_next_block(), but fills a batch. The inner relation is read in
+ * batches, too. */
+static unsigned short join_next_block_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	struct bnl *bl;
+	struct xrel *rl, *orl;
+	struct xrel_batch *ib;
+	const char *tuple;
+	unsigned short n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == JOIN);
+
+	bl = iter->it_iter[0];
+	assert(bl != NULL);
+	rl = iter->it_rl;
+	orl = bl->bl_oiter->it_rl;
+
+	n = 0;
+	if (iter->it_state == 0) {
+		if (!bnl_load(bl))
+			goto out;
+		iter->it_state = 1;
+	}
+	if (iter->it_batchbuf == NULL)
+		iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * rl->rl_size);
+	if (bl->bl_ibatch == NULL) {
+		bl->bl_ibatch = xmalloc(sizeof(struct xrel_batch));
+		bl->bl_ibatch->bt_selcnt = 0;
+		bl->bl_ibatch->bt_pos = 0;
+	}
+	ib = bl->bl_ibatch;
+
+	while (n < XREL_BATCH_MAX) {
+		if (bl->bl_inner && bl->bl_index < bl->bl_cnt) {
+			tuple = bl->bl_block + bl->bl_index * orl->rl_size;
+			bl->bl_index++;
+			tpcpy(iter->it_tpbuf, rl, tuple, orl);
+			if (xexpr_check(iter->it_tpbuf, rl->rl_exprs,
+						rl->rl_excnt)) {
+				char *buf;
+
+				buf = iter->it_batchbuf + n * rl->rl_size;
+				memcpy(buf, iter->it_tpbuf, rl->rl_size);
+				batch->bt_tuples[n] = buf;
+				batch->bt_sel[n] = n;
+				n++;
+			}
+			continue;
+		}
+
+		if (bl->bl_inner)
+			ib->bt_pos++;
+		if (ib->bt_pos < ib->bt_selcnt
+				|| xrel_next_batch(bl->bl_iiter, ib) > 0) {
+			tuple = ib->bt_tuples[ib->bt_sel[ib->bt_pos]];
+			tpcpy(iter->it_tpbuf, rl, tuple, bl->bl_iiter->it_rl);
+			bl->bl_inner = true;
+			bl->bl_index = 0;
+			continue;
+		}
+
+		bl->bl_inner = false;
+		if (!bnl_load(bl)) {
+			iter->it_eof = true;
+			break;
+		}
+		bl->bl_iiter->it_reset(bl->bl_iiter);
+	}
+out:
+	batch->bt_cnt = n;
+	batch->bt_selcnt = n;
+	return n;
+}
+
+static void join_reset_block(struct xrel_iter *iter)
+{
+	struct bnl *bl;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == JOIN);
+
+	iter->it_state = 0;
+	iter->it_eof = false;
+	bl = iter->it_iter[0];
+	bl->bl_inner = false;
+	if (bl->bl_ibatch != NULL) {
+		bl->bl_ibatch->bt_selcnt = 0;
+		bl->bl_ibatch->bt_pos = 0;
+	}
+	bl->bl_oiter->it_reset(bl->bl_oiter);
+	bl->bl_iiter->it_reset(bl->bl_iiter);
+}
+
+static struct xrel_iter *join_iterator(struct xrel *rl)
+{
+	struct xrel_iter *iter;
+	struct xattr *ix_attr, *other_attr;
+	int compar;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == JOIN);
+
+	iter = xmalloc(sizeof(struct xrel_iter));
+	iter->it_rl = rl;
+	iter->it_state = 0;
+	iter->it_tpbuf = xmalloc(rl->rl_size);
+	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	if (best_aa_xexpr(rl, NULL, &ix_attr, &compar, &other_attr)) {
+		struct xrel *prl;
+
+		assert(ix_attr->at_ix != NULL);
+
+		iter->it_compar = compar;
+		iter->it_scanattr = other_attr;
+		iter->it_ixattr = ix_attr;
+
+		iter->it_iter[0] = NULL; /* later from rl_ix_iterator() */
+		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
+
+		prl = other_attr->at_pxrl;
+		iter->it_iter[1] = prl->rl_iterator(prl);
+		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
+
+		iter->it_next = join_next_indexed;
+		iter->it_reset = join_reset_indexed;
+		iter->it_next_batch = join_next_indexed_batch;
+	} else {
+		struct xrel *orl, *irl;
+
+		/* the smaller relation is the outer one, which is buffered */
+		orl = rl->rl_rls[0];
+		irl = rl->rl_rls[1];
+		if (xrel_card(orl) * orl->rl_size
+				> xrel_card(irl) * irl->rl_size) {
+			orl = rl->rl_rls[1];
+			irl = rl->rl_rls[0];
+		}
+		iter->it_iter[0] = bnl_init(orl->rl_iterator(orl),
+				irl->rl_iterator(irl));
+		iter->it_free_iter[0] = (void (*)(void *))bnl_free;
+
+		iter->it_iter[1] = NULL;
+		iter->it_free_iter[1] = NULL;
+
+		iter->it_next = join_next_block;
+		iter->it_reset = join_reset_block;
+		iter->it_next_batch = join_next_block_batch;
+	}
+	return iter;
+}
+
+static struct xrel_iter *join_ix_iterator(struct xrel *rl,
+		struct xattr *attr, int compar, const char *val)
+{
+	struct xrel_iter *iter;
+	struct xrel *prl, *other_prl;
+	struct xattr *pattr, *ix_attr, *scan_attr;
+	int joincompar;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == JOIN);
+	assert(attr != NULL);
+	assert(attr->at_pxrl == rl->rl_rls[0]
+			|| attr->at_pxrl == rl->rl_rls[1]);
+	assert(attr->at_ix != NULL);
+
+	iter = xmalloc(sizeof(struct xrel_iter));
+	iter->it_rl = rl;
+	iter->it_state = 0;
+	iter->it_tpbuf = xmalloc(rl->rl_size);
+	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	prl = attr->at_pxrl;
+	other_prl = other_xrel(rl, prl);
+	pattr = attr->at_pxattr;
+	if (best_aa_xexpr(rl, other_prl, &ix_attr, &joincompar, &scan_attr)) {
+		assert(attr->at_pxrl == scan_attr->at_pxrl);
+
+		iter->it_compar = joincompar;
+		iter->it_scanattr = scan_attr;
+		iter->it_ixattr = ix_attr;
+
+		iter->it_iter[0] = NULL; /* later from rl_ix_iterator() */
+		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
+
+		iter->it_iter[1] = prl->rl_ix_iterator(prl, pattr, compar, val);
+		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
+
+		iter->it_next = join_next_indexed;
+		iter->it_reset = join_reset_indexed;
+		iter->it_next_batch = join_next_indexed_batch;
+	} else {
+		/* the tuples selected by the index are buffered */
+		iter->it_iter[0] = bnl_init(
+				prl->rl_ix_iterator(prl, pattr, compar, val),
+				other_prl->rl_iterator(other_prl));
+		iter->it_free_iter[0] = (void (*)(void *))bnl_free;
+
+		iter->it_iter[1] = NULL;
+		iter->it_free_iter[1] = NULL;
+
+		iter->it_next = join_next_block;
+		iter->it_reset = join_reset_block;
+		iter->it_next_batch = join_next_block_batch;
+	}
+	return iter;
+}
+
+struct xrel *join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt)
+{
+	struct xrel *rl;
+	unsigned short i;
+	size_t offset;
+
+	assert(r != NULL);
+	assert(s != NULL);
+	assert(r != s);
+	assert(excnt == 0 || exprs != NULL);
+
+	rl = xmalloc(sizeof(struct xrel));
+	rl->rl_type = JOIN;
+	rl->rl_rls[0] = r;
+	rl->rl_rls[1] = s;
+	rl->rl_size = r->rl_size + s->rl_size;
+
+	rl->rl_excnt = excnt;
+	rl->rl_exprs = (rl->rl_excnt > 0)
+		? xmalloc(rl->rl_excnt * sizeof(struct xexpr *))
+		: NULL;
+	for (i = 0; i < rl->rl_excnt; i++) {
+		rl->rl_exprs[i] = xmalloc(sizeof(struct xexpr));
+		memcpy(rl->rl_exprs[i], exprs[i], sizeof(struct xexpr));
+		assert(rl->rl_exprs[i]->ex_type == ATTR_TO_ATTR);
+	}
+
+	rl->rl_atcnt = r->rl_atcnt + s->rl_atcnt;
+	rl->rl_attrs = xmalloc(rl->rl_atcnt * sizeof(struct xattr *));
+	for (i = 0, offset = 0; i < rl->rl_atcnt; i++) {
+		struct xattr *attr;
+		unsigned short j;
+
+		rl->rl_attrs[i] = xmalloc(sizeof(struct xattr));
+		if (i < r->rl_atcnt)
+			attr = r->rl_attrs[i];
+		else
+			attr = s->rl_attrs[i - r->rl_atcnt];
+		memcpy(rl->rl_attrs[i], attr, sizeof(struct xattr));
+		rl->rl_attrs[i]->at_pxrl = (i < r->rl_atcnt) ? r : s;
+		rl->rl_attrs[i]->at_pxattr = attr;
+		rl->rl_attrs[i]->at_offset = offset;
+		offset += attr->at_sattr->at_size;
+
+		for (j = 0; j < excnt; j++) {
+			struct xexpr *expr;
+
+			expr = rl->rl_exprs[j];
+			if (expr->ex_left_attr == attr)
+				expr->ex_left_attr = rl->rl_attrs[i];
+			if (expr->ex_right_attr == attr)
+				expr->ex_right_attr = rl->rl_attrs[i];
+		}
+	}
+
+	rl->rl_srtcnt = 0;
+	rl->rl_srtattrs = NULL;
+	rl->rl_srtorders = NULL;
+
+	rl->rl_iterator = join_iterator;
+	rl->rl_ix_iterator = join_ix_iterator;
+	return rl;
+}
+
+#define HJ_BUCKETS	64	/* initial count of hash table buckets */
+#define HJ_PART_BITS	4	/* hash bits that select a partition */
+#define HJ_PARTS	(1 << HJ_PART_BITS) /* count of partitions */
+#define HJ_LEVELS	4	/* how often partitions are repartitioned */
+
+/* The partition of a hash value at a level of repartitioning; the bits are
+ * taken from the top so that the buckets (low bits) remain well-used. */
+#define HJ_PART(hash, level)	((int)(((hash) >> (32 - HJ_PART_BITS \
+					* ((level)+1))) & (HJ_PARTS - 1)))
+
+struct hjentry { /* tuple of the build relation of a HASH_JOIN */
+	struct hjentry	*he_next;	/* next entry in bucket */
+	uint32_t	he_hash;	/* hash value of the key */
+	char		he_data[];	/* key followed by tuple */
+};
+
+struct hjtask { /* partitions of build and probe relation to be joined */
+	FILE		*tk_build;	/* build tuples; NULL at level 0 */
+	FILE		*tk_probe;	/* probe tuples; NULL at level 0 */
+	int		tk_level;	/* count of partitionings */
+};
+
+/* The state of a HASH_JOIN iterator. The build relation is loaded into a
+ * hash table. When the table exceeds the memory budget, its biggest
+ * partition is written into a temporary file, as are all following build
+ * tuples of this partition and the probe tuples of this partition later
+ * (hybrid hash join). Each pair of such files is joined afterwards in the
+ * same way, but partitioned by other bits of the hash value. At the last
+ * level, the build partition is loaded in pieces that fit into memory and
+ * the probe partition is read once for each. */
+struct hjoin {
+	struct xrel	*hj_rl;		/* the HASH_JOIN relation */
+	struct xrel	*hj_brl;	/* build relation */
+	struct xrel	*hj_prl;	/* probe relation */
+	struct xrel_iter *hj_biter;	/* iterator of build relation */
+	struct xrel_iter *hj_piter;	/* iterator of probe relation */
+	char		*hj_tpbuf;	/* tuple buffer of the HASH_JOIN iter */
+	unsigned short	hj_atcnt;	/* count of key attributes */
+	struct xattr	**hj_battrs;	/* key attributes of build relation */
+	struct xattr	**hj_pattrs;	/* key attributes of probe relation */
+	size_t		hj_keysize;	/* size of a key */
+	size_t		hj_esize;	/* size of an entry */
+	size_t		hj_budget;	/* memory budget in bytes */
+	size_t		hj_mem;		/* memory used by the hash table */
+	size_t		hj_pmem[HJ_PARTS]; /* memory used by partitions */
+	unsigned long	hj_cnt;		/* count of entries */
+	unsigned long	hj_bcnt;	/* count of buckets (power of 2) */
+	struct hjentry	**hj_buckets;	/* the buckets */
+	FILE		*hj_bparts[HJ_PARTS]; /* spilled build partitions */
+	FILE		*hj_pparts[HJ_PARTS]; /* spilled probe partitions */
+	bool		hj_spilled;	/* was anything spilled? */
+	struct hjtask	hj_task;	/* the current task */
+	bool		hj_more;	/* build partition not loaded fully? */
+	bool		hj_done;	/* no more tuples? */
+	struct hjtask	*hj_tasks;	/* stack of pending tasks */
+	size_t		hj_taskcnt;	/* count of pending tasks */
+	char		*hj_bbuf;	/* build tuple read from file */
+	char		*hj_pbuf;	/* probe tuple read from file */
+	struct hjentry	*hj_cur;	/* next candidate for probe tuple */
+	uint32_t	hj_hash;	/* hash value of probe tuple's key */
+	char		*hj_key;	/* key of probe tuple */
+};
+
+/* Writes the values of attrs in tuple to key such that values that are EQ
+ * have equal bytes and returns the key's (FNV-1a) hash value. */
+static uint32_t hj_key(char *key, size_t keysize, const char *tuple,
+		struct xattr **attrs, unsigned short atcnt)
+{
+	uint32_t hash;
+	unsigned short i;
+	size_t j;
+	char *k;
+
+	for (i = 0, k = key; i < atcnt; i++) {
+		struct sattr *a;
+		const char *v;
+
+		a = attrs[i]->at_sattr;
+		v = tuple + attrs[i]->at_offset;
+		if (a->at_domain == STRING) {
+			strncpy(k, v, a->at_size);
+		} else if (a->at_domain == FLOAT) {
+			db_float_t f;
+
+			memcpy(&f, v, sizeof(f));
+			if (f == 0)
+				f = 0; /* -0 equals 0 */
+			memcpy(k, &f, sizeof(f));
+		} else if (a->at_domain == DOUBLE) {
+			db_double_t d;
+
+			memcpy(&d, v, sizeof(d));
+			if (d == 0)
+				d = 0; /* -0 equals 0 */
+			memcpy(k, &d, sizeof(d));
+		} else
+			memcpy(k, v, a->at_size);
+		k += a->at_size;
+	}
+	hash = 2166136261U;
+	for (j = 0; j < keysize; j++) {
+		hash ^= (unsigned char)key[j];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void hj_set_buckets(struct hjoin *hj, unsigned long bcnt)
+{
+	struct hjentry **buckets;
+	unsigned long i;
+
+	buckets = xmalloc(bcnt * sizeof(struct hjentry *));
+	for (i = 0; i < bcnt; i++)
+		buckets[i] = NULL;
+	if (hj->hj_buckets != NULL) {
+		for (i = 0; i < hj->hj_bcnt; i++) {
+			struct hjentry *e, *next;
+
+			for (e = hj->hj_buckets[i]; e != NULL; e = next) {
+				next = e->he_next;
+				e->he_next = buckets[e->he_hash & (bcnt - 1)];
+				buckets[e->he_hash & (bcnt - 1)] = e;
+			}
+		}
+		free(hj->hj_buckets);
+		hj->hj_mem -= hj->hj_bcnt * sizeof(struct hjentry *);
+	}
+	hj->hj_buckets = buckets;
+	hj->hj_bcnt = bcnt;
+	hj->hj_mem += bcnt * sizeof(struct hjentry *);
+}
+
+/* Removes all entries from the hash table. */
+static void hj_clear(struct hjoin *hj)
+{
+	unsigned long i;
+
+	if (hj->hj_buckets != NULL) {
+		for (i = 0; i < hj->hj_bcnt; i++) {
+			struct hjentry *e, *next;
+
+			for (e = hj->hj_buckets[i]; e != NULL; e = next) {
+				next = e->he_next;
+				free(e);
+			}
+		}
+		free(hj->hj_buckets);
+		hj->hj_buckets = NULL;
+	}
+	hj->hj_cnt = 0;
+	hj->hj_mem = 0;
+	for (i = 0; i < HJ_PARTS; i++)
+		hj->hj_pmem[i] = 0;
+	hj->hj_cur = NULL;
+	hj_set_buckets(hj, HJ_BUCKETS);
+}
+
+/* Closes the spilled partitions and pending tasks. */
+static void hj_close_files(struct hjoin *hj)
+{
+	size_t i;
+
+	for (i = 0; i < HJ_PARTS; i++) {
+		if (hj->hj_bparts[i] != NULL)
+			fclose(hj->hj_bparts[i]);
+		if (hj->hj_pparts[i] != NULL)
+			fclose(hj->hj_pparts[i]);
+		hj->hj_bparts[i] = NULL;
+		hj->hj_pparts[i] = NULL;
+	}
+	for (i = 0; i < hj->hj_taskcnt; i++) {
+		fclose(hj->hj_tasks[i].tk_build);
+		fclose(hj->hj_tasks[i].tk_probe);
+	}
+	hj->hj_taskcnt = 0;
+	if (hj->hj_task.tk_build != NULL)
+		fclose(hj->hj_task.tk_build);
+	if (hj->hj_task.tk_probe != NULL)
+		fclose(hj->hj_task.tk_probe);
+	hj->hj_task.tk_build = NULL;
+	hj->hj_task.tk_probe = NULL;
+	hj->hj_task.tk_level = 0;
+}
+
+/* Writes the in-memory entries of partition part into a temporary file. If
+ * no temporary file can be created, the partition simply stays in memory. */
+static bool hj_spill(struct hjoin *hj, int part)
+{
+	unsigned long i;
+
+	assert(hj->hj_bparts[part] == NULL);
+
+	if ((hj->hj_bparts[part] = tmpfile()) == NULL
+			|| (hj->hj_pparts[part] = tmpfile()) == NULL) {
+		if (hj->hj_bparts[part] != NULL)
+			fclose(hj->hj_bparts[part]);
+		hj->hj_bparts[part] = NULL;
+		hj->hj_budget = (size_t)-1;
+		return true;
+	}
+	hj->hj_spilled = true;
+
+	for (i = 0; i < hj->hj_bcnt; i++) {
+		struct hjentry **ep, *e;
+
+		ep = &hj->hj_buckets[i];
+		while ((e = *ep) != NULL) {
+			if (HJ_PART(e->he_hash, hj->hj_task.tk_level) != part) {
+				ep = &e->he_next;
+				continue;
+			}
+			if (!TMP_WRITE(hj->hj_bparts[part],
+						e->he_data + hj->hj_keysize,
+						hj->hj_brl->rl_size)) {
+				ERR(E_WRITE_FAILED);
+				return false;
+			}
+			*ep = e->he_next;
+			free(e);
+			hj->hj_cnt--;
+			hj->hj_mem -= hj->hj_esize;
+		}
+	}
+	hj->hj_pmem[part] = 0;
+	return true;
+}
+
+static const char *hj_build_next(struct hjoin *hj)
+{
+	FILE *fp;
+
+	if ((fp = hj->hj_task.tk_build) == NULL)
+		return hj->hj_biter->it_next(hj->hj_biter);
+	else if (TMP_READ(fp, hj->hj_bbuf, hj->hj_brl->rl_size))
+		return hj->hj_bbuf;
+	else
+		return NULL;
+}
+
+static const char *hj_probe_next(struct hjoin *hj)
+{
+	FILE *fp;
+
+	if ((fp = hj->hj_task.tk_probe) == NULL)
+		return hj->hj_piter->it_next(hj->hj_piter);
+	else if (TMP_READ(fp, hj->hj_pbuf, hj->hj_prl->rl_size))
+		return hj->hj_pbuf;
+	else
+		return NULL;
+}
+
+/* Loads the build tuples of the current task into the hash table (or as
+ * many as fit into memory at the last level). */
+static bool hj_load(struct hjoin *hj)
+{
+	const char *tuple;
+	int level;
+
+	level = hj->hj_task.tk_level;
+	hj->hj_more = false;
+	while ((tuple = hj_build_next(hj)) != NULL) {
+		struct hjentry *e;
+		uint32_t hash;
+		int part;
+
+		tpcpy(hj->hj_tpbuf, hj->hj_rl, tuple, hj->hj_brl);
+		e = xmalloc(hj->hj_esize);
+		hash = hj_key(e->he_data, hj->hj_keysize, hj->hj_tpbuf,
+				hj->hj_battrs, hj->hj_atcnt);
+		part = (level < HJ_LEVELS) ? HJ_PART(hash, level) : 0;
+		if (hj->hj_bparts[part] != NULL) {
+			free(e);
+			if (!TMP_WRITE(hj->hj_bparts[part], tuple,
+						hj->hj_brl->rl_size)) {
+				ERR(E_WRITE_FAILED);
+				return false;
+			}
+			continue;
+		}
+
+		e->he_hash = hash;
+		memcpy(e->he_data + hj->hj_keysize, tuple,
+				hj->hj_brl->rl_size);
+		e->he_next = hj->hj_buckets[hash & (hj->hj_bcnt - 1)];
+		hj->hj_buckets[hash & (hj->hj_bcnt - 1)] = e;
+		hj->hj_cnt++;
+		hj->hj_mem += hj->hj_esize;
+		hj->hj_pmem[part] += hj->hj_esize;
+		if (hj->hj_cnt > hj->hj_bcnt)
+			hj_set_buckets(hj, 2 * hj->hj_bcnt);
+
+		if (hj->hj_mem <= hj->hj_budget)
+			continue;
+		if (level < HJ_LEVELS) {
+			while (hj->hj_mem > hj->hj_budget) {
+				int i, max;
+
+				for (i = 0, max = -1; i < HJ_PARTS; i++)
+					if (hj->hj_pmem[i] > 0 && (max == -1
+						|| hj->hj_pmem[i]
+						> hj->hj_pmem[max]))
+						max = i;
+				if (max == -1)
+					break;
+				if (!hj_spill(hj, max))
+					return false;
+			}
+		} else {
+			hj->hj_more = true;
+			break;
+		}
+	}
+	return true;
+}
+
+/* Starts the join of all tuples of the build and probe relation. */
+static bool hj_start(struct hjoin *hj)
+{
+	hj_close_files(hj);
+	hj->hj_budget = join_memory();
+	hj->hj_spilled = false;
+	hj_clear(hj);
+	return hj_load(hj);
+}
+
+/* Switches to the next piece of the build partition or to the next task
+ * when all probe tuples of the current task are processed. Returns false
+ * if there is nothing left to join. */
+static bool hj_next_pass(struct hjoin *hj)
+{
+	struct hjtask *task;
+	int i;
+
+	task = &hj->hj_task;
+	if (hj->hj_more) {
+		hj_clear(hj);
+		rewind(task->tk_probe);
+		return hj_load(hj);
+	}
+
+	for (i = 0; i < HJ_PARTS; i++) {
+		FILE *bfp, *pfp;
+
+		bfp = hj->hj_bparts[i];
+		pfp = hj->hj_pparts[i];
+		if (bfp == NULL)
+			continue;
+		hj->hj_bparts[i] = NULL;
+		hj->hj_pparts[i] = NULL;
+		if (ftell(bfp) == 0 || ftell(pfp) == 0) {
+			fclose(bfp);
+			fclose(pfp);
+			continue;
+		}
+		hj->hj_tasks = xrealloc(hj->hj_tasks,
+				(hj->hj_taskcnt + 1) * sizeof(struct hjtask));
+		rewind(bfp);
+		rewind(pfp);
+		hj->hj_tasks[hj->hj_taskcnt].tk_build = bfp;
+		hj->hj_tasks[hj->hj_taskcnt].tk_probe = pfp;
+		hj->hj_tasks[hj->hj_taskcnt].tk_level = task->tk_level + 1;
+		hj->hj_taskcnt++;
+	}
+
+	if (task->tk_build != NULL)
+		fclose(task->tk_build);
+	if (task->tk_probe != NULL)
+		fclose(task->tk_probe);
+	task->tk_build = NULL;
+	task->tk_probe = NULL;
+
+	if (hj->hj_taskcnt == 0)
+		return false;
+	*task = hj->hj_tasks[--hj->hj_taskcnt];
+	hj_clear(hj);
+	return hj_load(hj);
+}
+
+static void hj_free(struct hjoin *hj)
+{
+	if (hj != NULL) {
+		hj_close_files(hj);
+		hj_clear(hj);
+		free(hj->hj_buckets);
+		xrel_iter_free(hj->hj_biter);
+		xrel_iter_free(hj->hj_piter);
+		free(hj->hj_battrs);
+		free(hj->hj_pattrs);
+		if (hj->hj_tasks != NULL)
+			free(hj->hj_tasks);
+		free(hj->hj_bbuf);
+		free(hj->hj_pbuf);
+		free(hj->hj_key);
+		free(hj);
+	}
+}
+
+static struct hjoin *hj_init(struct xrel *rl, struct xrel_iter *biter,
+		struct xrel_iter *piter, char *tpbuf)
+{
+	struct hjoin *hj;
+	unsigned short i;
+
+	hj = xmalloc(sizeof(struct hjoin));
+	hj->hj_rl = rl;
+	hj->hj_brl = biter->it_rl;
+	hj->hj_prl = piter->it_rl;
+	hj->hj_biter = biter;
+	hj->hj_piter = piter;
+	hj->hj_tpbuf = tpbuf;
+
+	/* the keys consist of the attributes of the EQ expressions */
+	hj->hj_atcnt = 0;
+	hj->hj_battrs = xmalloc(rl->rl_excnt * sizeof(struct xattr *));
+	hj->hj_pattrs = xmalloc(rl->rl_excnt * sizeof(struct xattr *));
+	hj->hj_keysize = 0;
+	for (i = 0; i < rl->rl_excnt; i++) {
+		struct xexpr *e;
+
+		e = rl->rl_exprs[i];
+		if (e->ex_compar != EQ)
+			continue;
+		if (e->ex_left_attr->at_pxrl == hj->hj_brl) {
+			hj->hj_battrs[hj->hj_atcnt] = e->ex_left_attr;
+			hj->hj_pattrs[hj->hj_atcnt] = e->ex_right_attr;
+		} else {
+			hj->hj_battrs[hj->hj_atcnt] = e->ex_right_attr;
+			hj->hj_pattrs[hj->hj_atcnt] = e->ex_left_attr;
+		}
+		assert(hj->hj_battrs[hj->hj_atcnt]->at_pxrl == hj->hj_brl);
+		assert(hj->hj_pattrs[hj->hj_atcnt]->at_pxrl == hj->hj_prl);
+		hj->hj_keysize += e->ex_left_attr->at_sattr->at_size;
+		hj->hj_atcnt++;
+	}
+	assert(hj->hj_atcnt > 0);
+	hj->hj_esize = sizeof(struct hjentry) + hj->hj_keysize
+		+ hj->hj_brl->rl_size;
+
+	hj->hj_budget = 0;
+	hj->hj_mem = 0;
+	hj->hj_cnt = 0;
+	hj->hj_bcnt = 0;
+	hj->hj_buckets = NULL;
+	for (i = 0; i < HJ_PARTS; i++) {
+		hj->hj_pmem[i] = 0;
+		hj->hj_bparts[i] = NULL;
+		hj->hj_pparts[i] = NULL;
+	}
+	hj->hj_spilled = false;
+	hj->hj_task.tk_build = NULL;
+	hj->hj_task.tk_probe = NULL;
+	hj->hj_task.tk_level = 0;
+	hj->hj_more = false;
+	hj->hj_done = false;
+	hj->hj_tasks = NULL;
+	hj->hj_taskcnt = 0;
+	hj->hj_bbuf = xmalloc(hj->hj_brl->rl_size);
+	hj->hj_pbuf = xmalloc(hj->hj_prl->rl_size);
+	hj->hj_cur = NULL;
+	hj->hj_hash = 0;
+	hj->hj_key = xmalloc(hj->hj_keysize);
+	return hj;
+}
+
+/* writes the next joined tuple into buf; the probe tuple is kept in 
+ * it_tpbuf */
+static bool hash_join_fill(struct xrel_iter *iter, char *buf)
+{
+	struct hjoin *hj;
+	const char *tuple;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == HASH_JOIN);
+
+	hj = iter->it_iter[0];
+	assert(hj != NULL);
+
+	if (hj->hj_done)
+		return false;
+
+	for (;;) {
+		int level;
+
+		while (hj->hj_cur != NULL) {
+			struct hjentry *e;
+
+			e = hj->hj_cur;
+			hj->hj_cur = e->he_next;
+			if (e->he_hash != hj->hj_hash
+					|| memcmp(e->he_data, hj->hj_key,
+						hj->hj_keysize) != 0)
+				continue;
+			if (buf != iter->it_tpbuf)
+				tpcpy_part(buf, iter->it_rl, iter->it_tpbuf,
+						hj->hj_prl);
+			tpcpy(buf, iter->it_rl, e->he_data + hj->hj_keysize,
+					hj->hj_brl);
+			if (xexpr_check(buf, iter->it_rl->rl_exprs,
+						iter->it_rl->rl_excnt))
+				return true;
+		}
+
+		if ((tuple = hj_probe_next(hj)) == NULL) {
+			if (!hj_next_pass(hj)) {
+				hj->hj_done = true;
+				return false;
+			}
+			continue;
+		}
+		tpcpy(iter->it_tpbuf, iter->it_rl, tuple, hj->hj_prl);
+		hj->hj_hash = hj_key(hj->hj_key, hj->hj_keysize,
+				iter->it_tpbuf, hj->hj_pattrs, hj->hj_atcnt);
+		level = hj->hj_task.tk_level;
+		if (level < HJ_LEVELS) {
+			FILE *fp;
+
+			fp = hj->hj_pparts[HJ_PART(hj->hj_hash, level)];
+			if (fp != NULL) {
+				if (!TMP_WRITE(fp, tuple, hj->hj_prl->rl_size)) {
+					ERR(E_WRITE_FAILED);
+					hj->hj_done = true;
+					return false;
+				}
+				continue;
+			}
+		}
+		hj->hj_cur = hj->hj_buckets[hj->hj_hash & (hj->hj_bcnt - 1)];
+	}
+}
+
+static const char *hash_join_next(struct xrel_iter *iter)
+{
+	return hash_join_fill(iter, iter->it_tpbuf) ? iter->it_tpbuf : NULL;
+}
+
+static unsigned short hash_join_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	return fill_batch(iter, batch, hash_join_fill);
+}
+
+static void hash_join_reset(struct xrel_iter *iter)
+{
+	struct hjoin *hj;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == HASH_JOIN);
+
+	iter->it_eof = false;
+	hj = iter->it_iter[0];
+	if (!hj->hj_spilled && !hj->hj_done) {
+		/* the hash table holds the whole build relation */
+		hj->hj_cur = NULL;
+		hj->hj_piter->it_reset(hj->hj_piter);
+	} else {
+		hj->hj_biter->it_reset(hj->hj_biter);
+		hj->hj_piter->it_reset(hj->hj_piter);
+		hj->hj_done = !hj_start(hj);
+	}
+}
+
+/* Returns an iterator that joins the tuples of biter, which are loaded into
+ * the hash table, with those of piter. */
+static struct xrel_iter *hash_join_probe(struct xrel *rl,
+		struct xrel_iter *biter, struct xrel_iter *piter)
+{
+	struct xrel_iter *iter;
+	struct hjoin *hj;
+
+	iter = xmalloc(sizeof(struct xrel_iter));
+	iter->it_rl = rl;
+	iter->it_state = 0;
+	iter->it_tpbuf = xmalloc(rl->rl_size);
+	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	hj = hj_init(rl, biter, piter, iter->it_tpbuf);
+	hj->hj_done = !hj_start(hj);
+	iter->it_iter[0] = hj;
+	iter->it_free_iter[0] = (void (*)(void *))hj_free;
+
+	iter->it_iter[1] = NULL;
+	iter->it_free_iter[1] = NULL;
+
+	iter->it_next = hash_join_next;
+	iter->it_reset = hash_join_reset;
+	iter->it_next_batch = hash_join_next_batch;
+	return iter;
+}
+
+static struct xrel_iter *hash_join_iterator(struct xrel *rl)
+{
+	struct xrel *brl, *prl;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == HASH_JOIN);
+
+	/* the hash table is built on the smaller relation */
+	brl = rl->rl_rls[0];
+	prl = rl->rl_rls[1];
+	if (xrel_card(brl) * brl->rl_size > xrel_card(prl) * prl->rl_size) {
+		brl = rl->rl_rls[1];
+		prl = rl->rl_rls[0];
+	}
+	return hash_join_probe(rl, brl->rl_iterator(brl),
+			prl->rl_iterator(prl));
+}
+
+static struct xrel_iter *hash_join_ix_iterator(struct xrel *rl,
+		struct xattr *attr, int compar, const char *val)
+{
+	struct xrel *brl, *prl;
+
+	assert(rl != NULL);
+	assert(rl->rl_type == HASH_JOIN);
+	assert(attr != NULL);
+	assert(attr->at_pxrl == rl->rl_rls[0]
+			|| attr->at_pxrl == rl->rl_rls[1]);
+	assert(attr->at_ix != NULL);
+
+	/* the hash table is built on the tuples selected by the index */
+	brl = attr->at_pxrl;
+	prl = other_xrel(rl, brl);
+	return hash_join_probe(rl,
+			brl->rl_ix_iterator(brl, attr->at_pxattr, compar, val),
+			prl->rl_iterator(prl));
+}
+
+bool hash_join_suitable(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt)
+{
+	unsigned short i;
+	bool eq;
+
+	assert(r != NULL);
+	assert(s != NULL);
+	assert(excnt == 0 || exprs != NULL);
+
+	eq = false;
+	for (i = 0; i < excnt; i++) {
+		struct xexpr *e;
+
+		e = exprs[i];
+		assert(e->ex_type == ATTR_TO_ATTR);
+		if (e->ex_compar != EQ)
+			continue;
+		if (e->ex_left_attr->at_ix != NULL
+				|| e->ex_right_attr->at_ix != NULL)
+			return false;
+		eq = true;
+	}
+	return eq;
+}
+
+struct xrel *hash_join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt)
+{
+	struct xrel *rl;
+
+	rl = join_init(r, s, exprs, excnt);
+	rl->rl_type = HASH_JOIN;
+	rl->rl_iterator = hash_join_iterator;
+	rl->rl_ix_iterator = hash_join_ix_iterator;
+	return rl;
+}
+
+/* The state of a MERGE_JOIN iterator. Both relations are written into
+ * temporary files sorted by the attributes of the merge expression (see
+ * xrel_sort_by_key()). For each outer tuple, the inner tuples that fulfill
+ * the expression form a contiguous range of the inner file; this range is
+ * bounded by the first inner tuple that is >= and the first one that is >
+ * the outer tuple, and these two move forward only. */
+struct mjoin {
+	struct xrel	*mj_orl;	/* outer relation */
+	struct xrel	*mj_irl;	/* inner relation */
+	FILE		*mj_ofp;	/* sorted outer records */
+	FILE		*mj_ifp;	/* sorted inner records */
+	size_t		mj_keysize;	/* size of the key preceding a tuple */
+	size_t		mj_osize;	/* size of an outer record */
+	size_t		mj_isize;	/* size of an inner record */
+	int		mj_compar;	/* outer key `mj_compar' inner key */
+	long		mj_icnt;	/* count of inner records */
+	long		mj_ipos;	/* position of mj_ifp in records */
+	long		mj_ge;		/* first inner record >= outer key */
+	long		mj_gt;		/* first inner record > outer key */
+	char		*mj_gekey;	/* key of inner record mj_ge */
+	char		*mj_gtkey;	/* key of inner record mj_gt */
+	long		mj_pos;		/* next inner record to join */
+	long		mj_end;		/* end of inner records to join */
+	char		*mj_orec;	/* current outer record */
+	char		*mj_irec;	/* current inner record */
+};
+
+/* the comparator c' such that a c b holds iff b c' a holds */
+static inline int mirrored_compar(int compar)
+{
+	switch (compar) {
+		case LT:	return GT;
+		case LEQ:	return GEQ;
+		case GT:	return LT;
+		case GEQ:	return LEQ;
+		default:	return compar;
+	}
+}
+
+/* Is the parent relation of attr ordered by attr's index? */
+static inline bool index_ordered(struct xattr *attr)
+{
+	return attr->at_pxrl->rl_type == SREL_WRAPPER && attr->at_ix != NULL;
+}
+
+/* Chooses the expression by which a MERGE_JOIN merges: EQ expressions are
+ * preferred, then those whose attributes are index-ordered. */
+static struct xexpr *merge_xexpr(struct xrel *rl)
+{
+	struct xexpr *best_e;
+	int best_score;
+	unsigned short i;
+
+	best_e = NULL;
+	best_score = -1;
+	for (i = 0; i < rl->rl_excnt; i++) {
+		struct xexpr *e;
+		int score;
+
+		e = rl->rl_exprs[i];
+		assert(e->ex_type == ATTR_TO_ATTR);
+		if (e->ex_compar == NEQ)
+			continue;
+		score = ((e->ex_compar == EQ) ? 4 : 0)
+			+ (index_ordered(e->ex_left_attr) ? 1 : 0)
+			+ (index_ordered(e->ex_right_attr) ? 1 : 0);
+		if (score > best_score) {
+			best_e = e;
+			best_score = score;
+		}
+	}
+	return best_e;
+}
+
+/* Reads the first `size' bytes of the pos-th inner record. */
+static bool mj_read(struct mjoin *mj, long pos, char *buf, size_t size)
+{
+	if (mj->mj_ipos != pos
+			&& fseek(mj->mj_ifp, pos * (long)mj->mj_isize, SEEK_SET))
+		return false;
+	if (!TMP_READ(mj->mj_ifp, buf, size)) {
+		mj->mj_ipos = -1;
+		return false;
+	}
+	mj->mj_ipos = (size == mj->mj_isize) ? pos + 1 : -1;
+	return true;
+}
+
+static void mj_rewind(struct mjoin *mj)
+{
+	rewind(mj->mj_ofp);
+	mj->mj_ipos = -1;
+	mj->mj_ge = 0;
+	mj->mj_gt = 0;
+	if (mj->mj_icnt > 0 && !mj_read(mj, 0, mj->mj_gekey, mj->mj_keysize))
+		mj->mj_icnt = 0;
+	if (mj->mj_icnt > 0)
+		memcpy(mj->mj_gtkey, mj->mj_gekey, mj->mj_keysize);
+	mj->mj_pos = 0;
+	mj->mj_end = 0;
+}
+
+/* Moves mj_ge and mj_gt behind the inner records less than and less than or
+ * equal to the current outer record. */
+static void mj_advance(struct mjoin *mj)
+{
+	const char *key;
+	size_t size;
+
+	key = mj->mj_orec;
+	size = mj->mj_keysize;
+	while (mj->mj_ge < mj->mj_icnt && memcmp(mj->mj_gekey, key, size) < 0)
+		if (++mj->mj_ge < mj->mj_icnt
+				&& !mj_read(mj, mj->mj_ge, mj->mj_gekey, size))
+			mj->mj_icnt = mj->mj_ge;
+	if (mj->mj_gt < mj->mj_ge) {
+		mj->mj_gt = mj->mj_ge;
+		memcpy(mj->mj_gtkey, mj->mj_gekey, size);
+	}
+	while (mj->mj_gt < mj->mj_icnt && memcmp(mj->mj_gtkey, key, size) <= 0)
+		if (++mj->mj_gt < mj->mj_icnt
+				&& !mj_read(mj, mj->mj_gt, mj->mj_gtkey, size))
+			mj->mj_icnt = mj->mj_gt;
+}
+
+static void mj_free(struct mjoin *mj)
+{
+	if (mj != NULL) {
+		if (mj->mj_ofp != NULL)
+			fclose(mj->mj_ofp);
+		if (mj->mj_ifp != NULL)
+			fclose(mj->mj_ifp);
+		free(mj->mj_gekey);
+		free(mj->mj_gtkey);
+		free(mj->mj_orec);
+		free(mj->mj_irec);
+		free(mj);
 	}
-	tpcpy(iter->it_tpbuf, iter->it_rl, tuple1, iter1->it_rl);
-	if (!xexpr_check(iter->it_tpbuf, iter->it_rl->rl_exprs,
-				iter->it_rl->rl_excnt))
-		goto next_tuple;
-	else
-		return iter->it_tpbuf;
 }
 
-static void join_reset_indexed(struct xrel_iter *iter)
+/* writes the next joined tuple into buf; the outer tuple is kept in 
+ * it_tpbuf */
+static bool merge_join_fill(struct xrel_iter *iter, char *buf)
 {
-	struct xrel_iter *xrel_iter;
+	struct mjoin *mj;
 
 	assert(iter != NULL);
 	assert(iter->it_rl != NULL);
-	assert(iter->it_rl->rl_type == JOIN);
+	assert(iter->it_rl->rl_type == MERGE_JOIN);
 
-	iter->it_state = 0;
-	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
-	if (xrel_iter != NULL) {
-		xrel_iter->it_free_iter[0](xrel_iter);
-		iter->it_iter[0] = NULL;
+	mj = iter->it_iter[0];
+	assert(mj != NULL);
+
+	if (mj->mj_ofp == NULL || mj->mj_ifp == NULL)
+		return false;
+
+	for (;;) {
+		while (mj->mj_pos < mj->mj_end) {
+			if (!mj_read(mj, mj->mj_pos, mj->mj_irec,
+						mj->mj_isize))
+				return false;
+			mj->mj_pos++;
+			if (buf != iter->it_tpbuf)
+				tpcpy_part(buf, iter->it_rl, iter->it_tpbuf,
+						mj->mj_orl);
+			tpcpy(buf, iter->it_rl, mj->mj_irec + mj->mj_keysize,
+					mj->mj_irl);
+			if (xexpr_check(buf, iter->it_rl->rl_exprs,
+						iter->it_rl->rl_excnt))
+				return true;
+		}
+
+		if (!TMP_READ(mj->mj_ofp, mj->mj_orec, mj->mj_osize))
+			return false;
+		tpcpy(iter->it_tpbuf, iter->it_rl,
+				mj->mj_orec + mj->mj_keysize, mj->mj_orl);
+		mj_advance(mj);
+		switch (mj->mj_compar) {
+			case EQ:
+				mj->mj_pos = mj->mj_ge;
+				mj->mj_end = mj->mj_gt;
+				break;
+			case LT:
+				mj->mj_pos = mj->mj_gt;
+				mj->mj_end = mj->mj_icnt;
+				break;
+			case LEQ:
+				mj->mj_pos = mj->mj_ge;
+				mj->mj_end = mj->mj_icnt;
+				break;
+			case GT:
+				mj->mj_pos = 0;
+				mj->mj_end = mj->mj_ge;
+				break;
+			case GEQ:
+				mj->mj_pos = 0;
+				mj->mj_end = mj->mj_gt;
+				break;
+			default:
+				assert(false);
+		}
 	}
-	xrel_iter = (struct xrel_iter *)iter->it_iter[1];
-	xrel_iter->it_reset(xrel_iter);
 }
 
-static void join_reset_fullscan(struct xrel_iter *iter)
+static const char *merge_join_next(struct xrel_iter *iter)
 {
-	struct xrel_iter *xrel_iter;
+	return merge_join_fill(iter, iter->it_tpbuf) ? iter->it_tpbuf : NULL;
+}
+
+static unsigned short merge_join_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	return fill_batch(iter, batch, merge_join_fill);
+}
+
+static void merge_join_reset(struct xrel_iter *iter)
+{
+	struct mjoin *mj;
 
 	assert(iter != NULL);
 	assert(iter->it_rl != NULL);
-	assert(iter->it_rl->rl_type == JOIN);
+	assert(iter->it_rl->rl_type == MERGE_JOIN);
 
-	iter->it_state = 0;
-	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
-	xrel_iter->it_reset(xrel_iter);
-	xrel_iter = (struct xrel_iter *)iter->it_iter[1];
-	xrel_iter->it_reset(xrel_iter);
+	iter->it_eof = false;
+	mj = iter->it_iter[0];
+	if (mj->mj_ofp != NULL && mj->mj_ifp != NULL)
+		mj_rewind(mj);
 }
 
-static struct xrel_iter *join_iterator(struct xrel *rl)
+/* Returns an iterator that merges the tuples of iter0 and iter1 (of the first
+ * and second parent relation); they are ordered by the merge expression if
+ * ordered0 and ordered1, respectively, and freed afterwards. */
+static struct xrel_iter *merge_join_merge(struct xrel *rl,
+		struct xrel_iter *iter0, bool ordered0,
+		struct xrel_iter *iter1, bool ordered1)
 {
 	struct xrel_iter *iter;
-	struct xattr *ix_attr, *other_attr;
-	int compar;
+	struct mjoin *mj;
+	struct xexpr *e;
+	struct xattr *oattr, *iattr;
 
-	assert(rl != NULL);
-	assert(rl->rl_type == JOIN);
+	e = merge_xexpr(rl);
+	assert(e != NULL);
+	if (e->ex_left_attr->at_pxrl == rl->rl_rls[0]) {
+		oattr = e->ex_left_attr;
+		iattr = e->ex_right_attr;
+	} else {
+		oattr = e->ex_right_attr;
+		iattr = e->ex_left_attr;
+	}
+	assert(oattr->at_pxrl == rl->rl_rls[0]);
+	assert(iattr->at_pxrl == rl->rl_rls[1]);
+
+	mj = xmalloc(sizeof(struct mjoin));
+	mj->mj_orl = rl->rl_rls[0];
+	mj->mj_irl = rl->rl_rls[1];
+	mj->mj_ofp = xrel_sort_by_key(mj->mj_orl, iter0, oattr->at_pxattr,
+			ordered0);
+	mj->mj_ifp = xrel_sort_by_key(mj->mj_irl, iter1, iattr->at_pxattr,
+			ordered1);
+	xrel_iter_free(iter0);
+	xrel_iter_free(iter1);
+	mj->mj_keysize = oattr->at_sattr->at_size;
+	mj->mj_osize = mj->mj_keysize + mj->mj_orl->rl_size;
+	mj->mj_isize = mj->mj_keysize + mj->mj_irl->rl_size;
+	mj->mj_compar = (e->ex_left_attr == oattr) ? e->ex_compar
+		: mirrored_compar(e->ex_compar);
+	mj->mj_gekey = xmalloc(mj->mj_keysize);
+	mj->mj_gtkey = xmalloc(mj->mj_keysize);
+	mj->mj_orec = xmalloc(mj->mj_osize);
+	mj->mj_irec = xmalloc(mj->mj_isize);
+	if (mj->mj_ofp != NULL && mj->mj_ifp != NULL) {
+		fseek(mj->mj_ifp, 0, SEEK_END);
+		mj->mj_icnt = ftell(mj->mj_ifp) / (long)mj->mj_isize;
+		mj_rewind(mj);
+	} else
+		ERR(E_IO_ERROR);
 
 	iter = xmalloc(sizeof(struct xrel_iter));
 	iter->it_rl = rl;
 	iter->it_state = 0;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
-	if (best_aa_xexpr(rl, NULL, &ix_attr, &compar, &other_attr)) {
-		struct xrel *prl;
-
-		assert(ix_attr->at_ix != NULL);
+	iter->it_iter[0] = mj;
+	iter->it_free_iter[0] = (void (*)(void *))mj_free;
 
-		iter->it_compar = compar;
-		iter->it_scanattr = other_attr;
-		iter->it_ixattr = ix_attr;
+	iter->it_iter[1] = NULL;
+	iter->it_free_iter[1] = NULL;
 
-		iter->it_iter[0] = NULL; /* later from rl_ix_iterator() */
-		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
+	iter->it_next = merge_join_next;
+	iter->it_reset = merge_join_reset;
+	iter->it_next_batch = merge_join_next_batch;
+	return iter;
+}
 
-		prl = other_attr->at_pxrl;
-		iter->it_iter[1] = prl->rl_iterator(prl);
-		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
+/* an iterator over prl ordered by pattr's index if possible */
+static struct xrel_iter *merge_input(struct xrel *prl, struct xattr *pattr,
+		bool *ordered)
+{
+	struct xrel_iter *iter;
 
-		iter->it_next = join_next_indexed;
-		iter->it_reset = join_reset_indexed;
-	} else {
-		struct xrel *prl;
+	*ordered = false;
+	if (prl->rl_type == SREL_WRAPPER && pattr->at_ix != NULL
+			&& (iter = wrapper_ordered_iterator(prl, pattr))
+			!= NULL) {
+		*ordered = true;
+		return iter;
+	}
+	return prl->rl_iterator(prl);
+}
 
-		prl = (struct xrel *)rl->rl_rls[0];
-		iter->it_iter[0] = prl->rl_iterator(prl);
-		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
+static struct xrel_iter *merge_join_iterator(struct xrel *rl)
+{
+	struct xrel_iter *iter0, *iter1;
+	struct xexpr *e;
+	struct xattr *attr0, *attr1;
+	bool ordered0, ordered1;
 
-		prl = (struct xrel *)rl->rl_rls[1];
-		iter->it_iter[1] = prl->rl_iterator(prl);
-		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
+	assert(rl != NULL);
+	assert(rl->rl_type == MERGE_JOIN);
 
-		iter->it_next = join_next_fullscan;
-		iter->it_reset = join_reset_fullscan;
+	e = merge_xexpr(rl);
+	assert(e != NULL);
+	attr0 = e->ex_left_attr;
+	attr1 = e->ex_right_attr;
+	if (attr0->at_pxrl != rl->rl_rls[0]) {
+		attr0 = e->ex_right_attr;
+		attr1 = e->ex_left_attr;
 	}
-	return iter;
+	iter0 = merge_input(attr0->at_pxrl, attr0->at_pxattr, &ordered0);
+	iter1 = merge_input(attr1->at_pxrl, attr1->at_pxattr, &ordered1);
+	return merge_join_merge(rl, iter0, ordered0, iter1, ordered1);
 }
 
-static struct xrel_iter *join_ix_iterator(struct xrel *rl,
+static struct xrel_iter *merge_join_ix_iterator(struct xrel *rl,
 		struct xattr *attr, int compar, const char *val)
 {
-	struct xrel_iter *iter;
 	struct xrel *prl, *other_prl;
-	struct xattr *pattr, *ix_attr, *scan_attr;
-	int joincompar;
+	struct xrel_iter *iter, *other_iter;
+	struct xexpr *e;
+	struct xattr *other_attr;
+	bool ordered;
 
 	assert(rl != NULL);
-	assert(rl->rl_type == JOIN);
+	assert(rl->rl_type == MERGE_JOIN);
 	assert(attr != NULL);
 	assert(attr->at_pxrl == rl->rl_rls[0]
 			|| attr->at_pxrl == rl->rl_rls[1]);
 	assert(attr->at_ix != NULL);
 
-	iter = xmalloc(sizeof(struct xrel_iter));
-	iter->it_rl = rl;
-	iter->it_state = 0;
-	iter->it_tpbuf = xmalloc(rl->rl_size);
-	iter->it_fp = NULL;
-
 	prl = attr->at_pxrl;
 	other_prl = other_xrel(rl, prl);
-	pattr = attr->at_pxattr;
-	if (best_aa_xexpr(rl, other_prl, &ix_attr, &joincompar, &scan_attr)) {
-		assert(attr->at_pxrl == scan_attr->at_pxrl);
-
-		iter->it_compar = joincompar;
-		iter->it_scanattr = scan_attr;
-		iter->it_ixattr = ix_attr;
-
-		iter->it_iter[0] = NULL; /* later from rl_ix_iterator() */
-		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
-
-		iter->it_iter[1] = prl->rl_ix_iterator(prl, pattr, compar, val);
-		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
-
-		iter->it_next = join_next_indexed;
-		iter->it_reset = join_reset_indexed;
-	} else {
-		iter->it_iter[0] = other_prl->rl_iterator(other_prl);
-		iter->it_free_iter[0] = (void (*)(void *))xrel_iter_free;
-
-		iter->it_iter[1] = prl->rl_ix_iterator(prl, pattr, compar, val);
-		iter->it_free_iter[1] = (void (*)(void *))xrel_iter_free;
+	iter = prl->rl_ix_iterator(prl, attr->at_pxattr, compar, val);
 
-		iter->it_next = join_next_fullscan;
-		iter->it_reset = join_reset_fullscan;
-	}
-	return iter;
+	e = merge_xexpr(rl);
+	assert(e != NULL);
+	other_attr = (e->ex_left_attr->at_pxrl == other_prl)
+		? e->ex_left_attr : e->ex_right_attr;
+	other_iter = merge_input(other_prl, other_attr->at_pxattr, &ordered);
+	if (prl == rl->rl_rls[0])
+		return merge_join_merge(rl, iter, false, other_iter, ordered);
+	else
+		return merge_join_merge(rl, other_iter, ordered, iter, false);
 }
 
-struct xrel *join_init(struct xrel *r, struct xrel *s,
+bool merge_join_suitable(struct xrel *r, struct xrel *s,
 		struct xexpr **exprs, unsigned short excnt)
 {
-	struct xrel *rl;
 	unsigned short i;
-	size_t offset;
+	bool range;
 
 	assert(r != NULL);
 	assert(s != NULL);
-	assert(r != s);
 	assert(excnt == 0 || exprs != NULL);
 
-	rl = xmalloc(sizeof(struct xrel));
-	rl->rl_type = JOIN;
-	rl->rl_rls[0] = r;
-	rl->rl_rls[1] = s;
-	rl->rl_size = r->rl_size + s->rl_size;
-
-	rl->rl_excnt = excnt;
-	rl->rl_exprs = (rl->rl_excnt > 0)
-		? xmalloc(rl->rl_excnt * sizeof(struct xexpr *))
-		: NULL;
-	for (i = 0; i < rl->rl_excnt; i++) {
-		rl->rl_exprs[i] = xmalloc(sizeof(struct xexpr));
-		memcpy(rl->rl_exprs[i], exprs[i], sizeof(struct xexpr));
-		assert(rl->rl_exprs[i]->ex_type == ATTR_TO_ATTR);
-	}
-
-	rl->rl_atcnt = r->rl_atcnt + s->rl_atcnt;
-	rl->rl_attrs = xmalloc(rl->rl_atcnt * sizeof(struct xattr *));
-	for (i = 0, offset = 0; i < rl->rl_atcnt; i++) {
-		struct xattr *attr;
-		unsigned short j;
-
-		rl->rl_attrs[i] = xmalloc(sizeof(struct xattr));
-		if (i < r->rl_atcnt)
-			attr = r->rl_attrs[i];
-		else
-			attr = s->rl_attrs[i - r->rl_atcnt];
-		memcpy(rl->rl_attrs[i], attr, sizeof(struct xattr));
-		rl->rl_attrs[i]->at_pxrl = (i < r->rl_atcnt) ? r : s;
-		rl->rl_attrs[i]->at_pxattr = attr;
-		rl->rl_attrs[i]->at_offset = offset;
-		offset += attr->at_sattr->at_size;
-
-		for (j = 0; j < excnt; j++) {
-			struct xexpr *expr;
-
-			expr = rl->rl_exprs[j];
-			if (expr->ex_left_attr == attr)
-				expr->ex_left_attr = rl->rl_attrs[i];
-			if (expr->ex_right_attr == attr)
-				expr->ex_right_attr = rl->rl_attrs[i];
-		}
+	range = false;
+	for (i = 0; i < excnt; i++) {
+		assert(exprs[i]->ex_type == ATTR_TO_ATTR);
+		if (exprs[i]->ex_compar == EQ)
+			return false;
+		if (exprs[i]->ex_compar != NEQ)
+			range = true;
 	}
+	return range;
+}
 
-	rl->rl_srtcnt = 0;
-	rl->rl_srtattrs = NULL;
-	rl->rl_srtorders = NULL;
+struct xrel *merge_join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt)
+{
+	struct xrel *rl;
 
-	rl->rl_iterator = join_iterator;
-	rl->rl_ix_iterator = join_ix_iterator;
+	rl = join_init(r, s, exprs, excnt);
+	rl->rl_type = MERGE_JOIN;
+	rl->rl_iterator = merge_join_iterator;
+	rl->rl_ix_iterator = merge_join_ix_iterator;
+	assert(merge_xexpr(rl) != NULL);
 	return rl;
 }
 
@@ -959,6 +2652,34 @@ next_tuple:
 		return tuple;
 }
 
+static unsigned short selection_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	struct xrel_iter *iter0;
+	struct xrel *rl;
+	unsigned short i, n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SELECTION);
+	assert(iter->it_iter[0] != NULL);
+
+	rl = iter->it_rl;
+	iter0 = iter->it_iter[0];
+
+	/* only the selection vector is narrowed, the tuples stay in place */
+	do {
+		if (xrel_next_batch(iter0, batch) == 0)
+			return 0;
+		for (i = 0, n = 0; i < batch->bt_selcnt; i++)
+			if (xexpr_check(batch->bt_tuples[batch->bt_sel[i]],
+						rl->rl_exprs, rl->rl_excnt))
+				batch->bt_sel[n++] = batch->bt_sel[i];
+		batch->bt_selcnt = n;
+	} while (n == 0);
+	return n;
+}
+
 static void selection_reset(struct xrel_iter *iter)
 {
 	struct xrel_iter *xrel_iter;
@@ -968,6 +2689,7 @@ static void selection_reset(struct xrel_iter *iter)
 	assert(iter->it_rl->rl_type == SELECTION);
 
 	iter->it_state = 0;
+	iter->it_eof = false;
 	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
 	xrel_iter->it_reset(xrel_iter);
 }
@@ -976,6 +2698,8 @@ static struct xrel_iter *selection_iterator(struct xrel *rl)
 {
 	struct xrel_iter *iter;
 	struct xattr *ix_attr;
+	struct sindex *six;
+	const char *lo[IX_ATTR_MAX], *hi[IX_ATTR_MAX];
 	int compar;
 	char *val;
 
@@ -987,8 +2711,15 @@ static struct xrel_iter *selection_iterator(struct xrel *rl)
 	iter->it_state = 0;
 	iter->it_tpbuf = NULL;
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
+
+	if ((six = selection_composite_index(rl, lo, hi)) != NULL) {
+		struct xrel *prl;
 
-	if (best_av_xexpr(rl, &ix_attr, &compar, &val)) {
+		prl = (struct xrel *)rl->rl_rls[0];
+		iter->it_iter[0] = wrapper_cix_iterator(prl, six, lo, hi);
+	} else if (best_av_xexpr(rl, &ix_attr, &compar, &val)) {
 		struct xrel *prl;
 		struct xattr *pattr;
 
@@ -1009,6 +2740,7 @@ static struct xrel_iter *selection_iterator(struct xrel *rl)
 
 	iter->it_next = selection_next;
 	iter->it_reset = selection_reset;
+	iter->it_next_batch = selection_next_batch;
 	return iter;
 }
 
@@ -1030,6 +2762,8 @@ static struct xrel_iter *selection_ix_iterator(struct xrel *rl,
 	iter->it_state = 0;
 	iter->it_tpbuf = NULL;
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	prl = attr->at_pxrl;
 	pattr = attr->at_pxattr;
@@ -1042,6 +2776,7 @@ static struct xrel_iter *selection_ix_iterator(struct xrel *rl,
 
 	iter->it_next = selection_next;
 	iter->it_reset = selection_reset;
+	iter->it_next_batch = selection_next_batch;
 	return iter;
 }
 
@@ -1135,6 +2870,49 @@ static const char *projection_next(struct xrel_iter *iter)
 	return iter->it_tpbuf;
 }
 
+static unsigned short projection_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	struct xrel_iter *iter0;
+	struct xrel *rl, *prl;
+	unsigned short i, j, k, n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == PROJECTION);
+	assert(iter->it_iter[0] != NULL);
+
+	rl = iter->it_rl;
+	iter0 = iter->it_iter[0];
+
+	if ((n = xrel_next_batch(iter0, batch)) == 0)
+		return 0;
+	if (iter->it_batchbuf == NULL)
+		iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * rl->rl_size);
+
+	/* the attributes are looked up once per batch, not once per tuple */
+	prl = (struct xrel *)rl->rl_rls[0];
+	for (i = 0; i < rl->rl_atcnt; i++) {
+		for (j = 0; j < prl->rl_atcnt; j++)
+			if (rl->rl_attrs[i]->at_sattr
+					== prl->rl_attrs[j]->at_sattr)
+				break;
+		assert(j < prl->rl_atcnt);
+		for (k = 0; k < n; k++)
+			memcpy(iter->it_batchbuf + k * rl->rl_size
+				+ rl->rl_attrs[i]->at_offset,
+				batch->bt_tuples[batch->bt_sel[k]]
+				+ prl->rl_attrs[j]->at_offset,
+				rl->rl_attrs[i]->at_sattr->at_size);
+	}
+	for (k = 0; k < n; k++) {
+		batch->bt_tuples[k] = iter->it_batchbuf + k * rl->rl_size;
+		batch->bt_sel[k] = k;
+	}
+	batch->bt_cnt = n;
+	return n;
+}
+
 static void projection_reset(struct xrel_iter *iter)
 {
 	struct xrel_iter *xrel_iter;
@@ -1144,6 +2922,7 @@ static void projection_reset(struct xrel_iter *iter)
 	assert(iter->it_rl->rl_type == PROJECTION);
 
 	iter->it_state = 0;
+	iter->it_eof = false;
 	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
 	xrel_iter->it_reset(xrel_iter);
 }
@@ -1161,6 +2940,8 @@ static struct xrel_iter *projection_iterator(struct xrel *rl)
 	iter->it_state = 0;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	r = (struct xrel *)rl->rl_rls[0];
 
@@ -1172,6 +2953,7 @@ static struct xrel_iter *projection_iterator(struct xrel *rl)
 
 	iter->it_next = projection_next;
 	iter->it_reset = projection_reset;
+	iter->it_next_batch = projection_next_batch;
 	return iter;
 }
 
@@ -1193,6 +2975,8 @@ static struct xrel_iter *projection_ix_iterator(struct xrel *rl,
 	iter->it_state = 0;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	prl = attr->at_pxrl;
 	pattr = attr->at_pxattr;
@@ -1205,6 +2989,7 @@ static struct xrel_iter *projection_ix_iterator(struct xrel *rl,
 
 	iter->it_next = projection_next;
 	iter->it_reset = projection_reset;
+	iter->it_next_batch = projection_next_batch;
 	return iter;
 }
 
@@ -1279,6 +3064,29 @@ static const char *union_next(struct xrel_iter *iter)
 	return iter1->it_next(iter1);
 }
 
+static unsigned short union_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	struct xrel_iter *iter0, *iter1;
+	unsigned short n;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == UNION);
+
+	iter0 = iter->it_iter[0];
+	iter1 = iter->it_iter[1];
+
+	assert(iter0 != NULL);
+	assert(iter1 != NULL);
+
+	/* an exhausted iter0 is not polled again, see legacy_next_batch() */
+	if (!iter0->it_eof && (n = xrel_next_batch(iter0, batch)) > 0)
+		return n;
+
+	return xrel_next_batch(iter1, batch);
+}
+
 static void union_reset(struct xrel_iter *iter)
 {
 	struct xrel_iter *xrel_iter;
@@ -1288,6 +3096,7 @@ static void union_reset(struct xrel_iter *iter)
 	assert(iter->it_rl->rl_type == UNION);
 
 	iter->it_state = 0;
+	iter->it_eof = false;
 	xrel_iter = (struct xrel_iter *)iter->it_iter[0];
 	xrel_iter->it_reset(xrel_iter);
 	xrel_iter = (struct xrel_iter *)iter->it_iter[1];
@@ -1307,6 +3116,8 @@ static struct xrel_iter *union_iterator(struct xrel *rl)
 	iter->it_state = 0;
 	iter->it_tpbuf = NULL;
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	r = (struct xrel *)rl->rl_rls[0];
 	iter->it_iter[0] = r->rl_iterator(r);
@@ -1318,6 +3129,7 @@ static struct xrel_iter *union_iterator(struct xrel *rl)
 
 	iter->it_next = union_next;
 	iter->it_reset = union_reset;
+	iter->it_next_batch = union_next_batch;
 	return iter;
 }
 
@@ -1341,6 +3153,8 @@ static struct xrel_iter *union_ix_iterator(struct xrel *rl,
 	iter->it_state = 0;
 	iter->it_tpbuf = NULL;
 	iter->it_fp = NULL;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	for (i = 0; i < rl->rl_atcnt; i++)
 		if (attr->at_sattr == rl->rl_attrs[i]->at_sattr)
@@ -1361,6 +3175,7 @@ static struct xrel_iter *union_ix_iterator(struct xrel *rl,
 
 	iter->it_next = union_next;
 	iter->it_reset = union_reset;
+	iter->it_next_batch = union_next_batch;
 	return iter;
 }
 
@@ -1429,12 +3244,44 @@ static const char *sort_next(struct xrel_iter *iter)
 		return NULL;
 }
 
+static unsigned short sort_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch)
+{
+	struct xrel *rl;
+	FILE *fp;
+	long pos;
+	size_t n, i;
+
+	assert(iter != NULL);
+	assert(iter->it_rl != NULL);
+	assert(iter->it_rl->rl_type == SORT);
+
+	rl = iter->it_rl;
+	fp = iter->it_fp;
+	if (iter->it_batchbuf == NULL)
+		iter->it_batchbuf = xmalloc(XREL_BATCH_MAX * rl->rl_size);
+	pos = (long)iter->it_state * (long)rl->rl_size;
+	fseek(fp, pos, SEEK_SET);
+	n = fread(iter->it_batchbuf, rl->rl_size, XREL_BATCH_MAX, fp);
+	iter->it_state += (int)n;
+	if (n < XREL_BATCH_MAX)
+		iter->it_eof = true;
+	for (i = 0; i < n; i++) {
+		batch->bt_tuples[i] = iter->it_batchbuf + i * rl->rl_size;
+		batch->bt_sel[i] = (unsigned short)i;
+	}
+	batch->bt_cnt = (unsigned short)n;
+	batch->bt_selcnt = (unsigned short)n;
+	return (unsigned short)n;
+}
+
 static void sort_reset(struct xrel_iter *iter)
 {
 	assert(iter != NULL);
 	assert(iter->it_rl != NULL);
 	assert(iter->it_rl->rl_type == SORT);
 
+	iter->it_eof = false;
 	iter->it_state = 0;
 }
 
@@ -1459,6 +3306,8 @@ static struct xrel_iter *sort_iterator(struct xrel *rl)
 	iter->it_state = 0;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = fp;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	iter->it_iter[0] = NULL;
 	iter->it_free_iter[0] = NULL;
@@ -1468,6 +3317,7 @@ static struct xrel_iter *sort_iterator(struct xrel *rl)
 
 	iter->it_next = sort_next;
 	iter->it_reset = sort_reset;
+	iter->it_next_batch = sort_next_batch;
 	return iter;
 }
 
@@ -1499,6 +3349,8 @@ static struct xrel_iter *sort_ix_iterator(struct xrel *rl,
 	iter->it_state = 0;
 	iter->it_tpbuf = xmalloc(rl->rl_size);
 	iter->it_fp = fp;
+	iter->it_batchbuf = NULL;
+	iter->it_eof = false;
 
 	iter->it_iter[0] = NULL;
 	iter->it_free_iter[0] = NULL;
@@ -1508,6 +3360,7 @@ static struct xrel_iter *sort_ix_iterator(struct xrel *rl,
 
 	iter->it_next = sort_next;
 	iter->it_reset = sort_reset;
+	iter->it_next_batch = sort_next_batch;
 	return iter;
 }
 
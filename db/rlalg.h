@@ -34,6 +34,17 @@
 #define ATTR_TO_VAL	1
 #define ATTR_TO_ATTR	2
 
+/* the name of the environment variable that specifies the memory budget of
+ * a hash join or block nested-loop join in bytes (suffixes K, M and G are 
+ * allowed) */
+#define JOIN_MEMORY_ENV		"DB_JOIN_MEMORY"
+
+/* the default memory budget of a join */
+#define JOIN_DEFAULT_MEMORY	(1024 * 1024 * 16)
+
+/* the maximum count of tuples in a batch */
+#define XREL_BATCH_MAX		64
+
 struct xrel { /* expressible relation */
 	int		rl_type;	/* SREL_WRAPPER, CART_PROD, ... */
 	void		*rl_rls[2];	/* the parent relation(s); normally
@@ -78,6 +89,16 @@ struct xexpr { /* expression of an expressible relation */
 	void		*ex_right_val;	/* comparison value (if ATTR_TO_VAL) */
 };
 
+struct xrel_batch { /* batch of tuples read at once from an iterator */
+	unsigned short	bt_cnt;			/* count of tuples */
+	const char	*bt_tuples[XREL_BATCH_MAX]; /* the tuples */
+	unsigned short	bt_selcnt;		/* count of selected tuples */
+	unsigned short	bt_sel[XREL_BATCH_MAX];	/* indices of the selected
+						 * tuples, ascending */
+	unsigned short	bt_pos;			/* next selected tuple to be
+						 * consumed (for the caller) */
+};
+
 struct xrel_iter { /* iteratore over expressible relation */
 	struct xrel	*it_rl;			/* expressible relation */
 	int		it_state;		/* state (for internal use) */
@@ -95,6 +116,16 @@ struct xrel_iter { /* iteratore over expressible relation */
 	void (*it_free_iter[2])(void *);	/* frees the parent iterators */
 	const char *(*it_next)(struct xrel_iter *);/* next tuple or NULL */
 	void (*it_reset)(struct xrel_iter *);	/* resets the iterator */
+	unsigned short (*it_next_batch)(struct xrel_iter *,
+			struct xrel_batch *);	/* fills the batch with up to
+						 * XREL_BATCH_MAX tuples and
+						 * returns the count of selected
+						 * ones; NULL if the iterator
+						 * has no native batches (then
+						 * it_next is used) */
+	char		*it_batchbuf;		/* tuples of the last batch */
+	bool		it_eof;			/* no more batches until the
+						 * iterator is reset */
 };
 
 /* Frees the memory allocated by a xrel structure and all its son-relations. */
@@ -103,6 +134,14 @@ void xrel_free(struct xrel *rl);
 /* Frees the memory allocated by an iterator of an expressible relation. */
 void xrel_iter_free(struct xrel_iter *iter);
 
+/* Reads the next batch of up to XREL_BATCH_MAX tuples from the iterator and
+ * returns the count of selected tuples, which is 0 only at the end and 
+ * stays 0 until the iterator is reset. The tuples stay valid until the next
+ * call. An iterator must be advanced either
+ * by it_next() or by xrel_next_batch(), not by both. */
+unsigned short xrel_next_batch(struct xrel_iter *iter,
+		struct xrel_batch *batch);
+
 /* Initializes an xrel structure (expressible relation) that wraps an srel
  * structure (stored relation. */
 struct xrel *wrapper_init(struct srel *srl);
@@ -115,6 +154,34 @@ struct xrel *wrapper_init(struct srel *srl);
 struct xrel *join_init(struct xrel *r, struct xrel *s,
 		struct xexpr **exprs, unsigned short excnt);
 
+/* Like join_init(), but the tuples are joined by a hash join: the tuples of
+ * the smaller relation are loaded into an in-memory hash table over the 
+ * attributes of the EQ expressions, which is probed with the tuples of the 
+ * other relation. If the table exceeds the memory budget, partitions of both
+ * relations are moved to temporary files and joined one after another. At
+ * least one expression must be an EQ. */
+struct xrel *hash_join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt);
+
+/* Determines whether a join of r and s by the expressions should be a hash
+ * join. This is the case if there is an EQ expression, but none whose 
+ * attributes are indexed; otherwise, join_init() is preferable. */
+bool hash_join_suitable(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt);
+
+/* Like join_init(), but the tuples are joined by a merge join: both
+ * relations are sorted by the attributes of one expression, preferably an EQ
+ * one, or read in the order of their indexes, and then merged. Expressions
+ * other than NEQ are supported. */
+struct xrel *merge_join_init(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt);
+
+/* Determines whether a join of r and s by the expressions should be a merge
+ * join. This is the case if there are LT, LEQ, GT or GEQ expressions, but no
+ * EQ expression. */
+bool merge_join_suitable(struct xrel *r, struct xrel *s,
+		struct xexpr **exprs, unsigned short excnt);
+
 /* Creates a relation that contains selected tuples of the relation r. 
  * These tuples fulfill the expressions exprs. */
 struct xrel *selection_init(struct xrel *r, struct xexpr **exprs,
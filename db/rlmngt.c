@@ -23,6 +23,7 @@
 #include "hashtable.h"
 #include "mem.h"
 #include "str.h"
+#include "wal.h"
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
@@ -64,7 +65,7 @@ static void rl_mkfn(char *filename, const char *name)
 }
 
 struct srel *create_relation(const char *name, const struct sattr *attrs,
-		int atcnt)
+		int atcnt, size_t pgsize)
 {
 	struct srel *rl;
 	char filename[PATH_MAX+1];
@@ -83,6 +84,11 @@ struct srel *create_relation(const char *name, const struct sattr *attrs,
 	for (i = 0; i < atcnt; i++)
 		rl->rl_header.hd_attrs[i] = attrs[i];
 	rl->rl_header.hd_atcnt = i;
+	rl->rl_header.hd_pgsize = pgsize;
+	rl->rl_header.hd_ixcnt = 0;
+	memset(rl->rl_header.hd_ixpgsizes, 0,
+			sizeof(rl->rl_header.hd_ixpgsizes));
+	rl->rl_header.hd_ixdeferred = false;
 	rl->rl_tpbuf = NULL;
 	rl->rl_cache = NULL;
 	rl->rl_ixtable = NULL;
@@ -100,7 +106,7 @@ struct srel *create_relation(const char *name, const struct sattr *attrs,
 			if (rl->rl_header.hd_attrs[i].at_indexed)
 				ok &= create_index(rl,
 						&rl->rl_header.hd_attrs[i],
-						PRIMARY)
+						PRIMARY, pgsize)
 					!= NULL;
 
 		if (!ok) {
@@ -147,6 +153,13 @@ struct srel *open_relation(const char *name)
 
 	if (rl_open(rl)) {
 		init_ixtable(rl);
+		/* the indexes of a converted relation are rebuilt, and so
+		 * are those that lack the tuples of a bulk insertion which
+		 * was interrupted by a crash */
+		if (rl->rl_converted || rl->rl_header.hd_ixdeferred) {
+			rebuild_indexes(rl);
+			rl->rl_header.hd_ixdeferred = false;
+		}
 		open_indexes(rl);
 		table_insert(table, rl->rl_header.hd_name, rl);
 		return rl;
@@ -201,7 +214,68 @@ bool drop_relation(const char *name)
 
 	strntermcpy(buf, rl->rl_name, PATH_MAX+1);
 	close_relation(rl);
-	return unlink(buf) == 0;
+	return rl_unlink(buf);
+}
+
+/* the next tuple address in the order of an index */
+static blkaddr_t index_next(void *ctx)
+{
+	return ix_rnext((struct ix_iter *)ctx);
+}
+
+bool vacuum_relation(const char *name, const char *attr_name)
+{
+	struct srel *rl;
+	struct sattr *attr;
+	struct index *ix;
+	struct ix_iter *iter;
+	char buf[PATH_MAX+1];
+	int i;
+	bool retval;
+
+	assert(name != NULL);
+
+	rl = open_relation(name);
+	if (rl == NULL)
+		return false;
+
+	attr = NULL;
+	if (attr_name != NULL) {
+		for (i = 0; i < rl->rl_header.hd_atcnt; i++)
+			if (!strncmp(rl->rl_header.hd_attrs[i].at_name,
+						attr_name, AT_NAME_MAX))
+				attr = &rl->rl_header.hd_attrs[i];
+		if (attr == NULL) {
+			ERR(E_ATTRIBUTE_NOT_FOUND);
+			return false;
+		}
+	}
+
+	if (attr != NULL) {
+		if ((ix = open_index(rl, attr)) == NULL
+				|| (iter = ix_min(ix)) == NULL) {
+			ERR(E_OPEN_INDEX_FAILED);
+			return false;
+		}
+		retval = rl_compact(rl, index_next, iter);
+		ix_iter_free(iter);
+	} else
+		retval = rl_compact(rl, NULL, NULL);
+	if (!retval) {
+		ERR(E_VACUUM_FAILED);
+		return false;
+	}
+
+	/* the indexes refer to the old addresses; they are removed before the
+	 * files are replaced and rebuilt when the relation is opened again */
+	strntermcpy(buf, rl->rl_name, PATH_MAX+1);
+	retval = remove_indexes(rl);
+	close_relation(rl);
+	if (!retval || !rl_replace(buf)) {
+		ERR(E_VACUUM_FAILED);
+		return false;
+	}
+	return open_relation(name) != NULL;
 }
 
 bool insert_into_relation(struct srel *rl, const char *tuple)
@@ -232,6 +306,85 @@ bool insert_into_relation(struct srel *rl, const char *tuple)
 	return true;
 }
 
+struct deferred_ixs *bulk_insert_begin(struct srel *rl)
+{
+	assert(rl != NULL);
+
+	/* the mark must be on disk before the first tuple is logged */
+	rl->rl_header.hd_ixdeferred = true;
+	if (!wal_checkpoint()) {
+		rl->rl_header.hd_ixdeferred = false;
+		ERR(E_LOG_FAILED);
+		return NULL;
+	}
+	return defer_indexes(rl);
+}
+
+bool bulk_insert_into_relation(struct srel *rl, struct deferred_ixs *dx,
+		const char *tuples, size_t cnt)
+{
+	blkaddr_t addr;
+	size_t i;
+
+	assert(rl != NULL);
+	assert(tuples != NULL || cnt == 0);
+
+	if (cnt == 0)
+		return true;
+
+	if (batch_primary_key_conflict(rl, tuples, cnt)) {
+		ERR(E_PRIMARY_KEY_CONFLICT);
+		return false;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (foreign_key_conflict(rl, tuples + i * RL_TPDATA_SIZE(rl))) {
+			ERR(E_FOREIGN_KEY_CONFLICT);
+			return false;
+		}
+	}
+
+	if ((addr = rl_append(rl, tuples, cnt)) == INVALID_ADDR)
+		return false;
+
+	if (dx != NULL ? !defer_batch(dx, addr, tuples, cnt)
+			: !insert_batch_into_indexes(rl, addr, tuples, cnt)) {
+		ERR(E_INDEX_INSERT_FAILED);
+		return false;
+	}
+
+	return true;
+}
+
+bool bulk_insert_end(struct srel *rl, struct deferred_ixs *dx,
+		size_t *cnt_ptr)
+{
+	blkaddr_t cut, addr, last;
+	bool retval;
+
+	assert(rl != NULL);
+	assert(dx != NULL);
+
+	last = rl->rl_header.hd_tpmax;
+	retval = insert_deferred_into_indexes(dx, &cut, cnt_ptr);
+
+	/* the tuples behind the cut were appended by the bulk insertion */
+	if (cut != INVALID_ADDR) {
+		ERR(E_PRIMARY_KEY_CONFLICT);
+		for (addr = cut; addr <= last; addr++)
+			retval &= rl_delete(rl, addr);
+	}
+
+	/* indexes that could not be brought up to date are rebuilt */
+	if (!retval) {
+		ERR(E_INDEX_INSERT_FAILED);
+		retval = rebuild_indexes(rl);
+	}
+	if (retval)
+		rl->rl_header.hd_ixdeferred = false;
+	return retval && cut == INVALID_ADDR;
+}
+
 bool update_relation(struct srel *rl, blkaddr_t addr, const char *old_tuple,
 		const char *new_tuple, tpcnt_t *tpcnt)
 {
@@ -27,10 +27,15 @@
 
 #include "io.h"
 
-/* Creates a new relation with a given name and attributes. Returns a
- * pointer to the opened relation structure or NULL. */
+/* the maximum size of the tuples that COPY and db_bulk_insert() insert as one
+ * batch with bulk_insert_into_relation() */
+#define BULK_BATCH_SIZE		(1024 * 1024 * 4)
+
+/* Creates a new relation with a given name and attributes. The page size of
+ * the relation and its primary indexes is pgsize or the default if pgsize 
+ * is 0. Returns a pointer to the opened relation structure or NULL. */
 struct srel *create_relation(const char *name, const struct sattr *attrs,
-		int atcnt);
+		int atcnt, size_t pgsize);
 
 /* Opens a relation and returns a pointer to a relation structure or NULL. */
 struct srel *open_relation(const char *name);
@@ -44,9 +49,44 @@ void close_relations(void);
 /* Deletes all files belonging to a relation. */
 bool drop_relation(const char *name);
 
+/* Rewrites a relation densely into a new file, which replaces the old one, 
+ * and rebuilds its indexes. If attr_name is not NULL, the tuples are written
+ * in the order of this attribute's index, which clusters them; otherwise 
+ * they keep their order. Returns true to indicate success. */
+bool vacuum_relation(const char *name, const char *attr_name);
+
 /* Inserts a new tuple into the relation and keeps the indexes up to date. */
 bool insert_into_relation(struct srel *rl, const char *tuple);
 
+struct deferred_ixs; /* see ixmngt.h */
+
+/* Begins a bulk insertion of many batches: the indexes are brought up to 
+ * date by bulk_insert_end() only, once per index for all batches. Until then,
+ * the relation is marked, such that its indexes are rebuilt if it is opened 
+ * after a crash. Returns the collected index entries or NULL if the mark 
+ * could not be written. */
+struct deferred_ixs *bulk_insert_begin(struct srel *rl);
+
+/* Inserts a batch of `cnt' tuples of RL_TPDATA_SIZE() bytes each, which are
+ * stored one after another in `tuples'. The batch is checked completely 
+ * before it is appended behind the last tuple, then the indexes are brought
+ * up to date in one pass per index. With a bulk insertion `dx', the index 
+ * entries are only collected; the primary keys are checked against the 
+ * tuples before the bulk insertion and those of the batch, the ones of the 
+ * earlier batches are checked by bulk_insert_end(). Returns true to indicate 
+ * success; otherwise no tuple was inserted unless an I/O error occured. */
+bool bulk_insert_into_relation(struct srel *rl, struct deferred_ixs *dx,
+		const char *tuples, size_t cnt);
+
+/* Ends a bulk insertion: the collected entries are inserted into the indexes
+ * (see insert_deferred_into_indexes()). If a tuple has the primary key of a 
+ * tuple of an earlier batch, its batch and the later ones are deleted again 
+ * and false is returned; `cnt_ptr' tells the count of tuples of the batches 
+ * before. Indexes that cannot be brought up to date are rebuilt. Returns true
+ * to indicate success. */
+bool bulk_insert_end(struct srel *rl, struct deferred_ixs *dx,
+		size_t *cnt_ptr);
+
 /* Updates a tuple in the relation and keeps the indexes up to date. */
 bool update_relation(struct srel *rl, blkaddr_t addr, const char *old_tuple,
 		const char *new_tuple, tpcnt_t *tpcnt);
@@ -37,21 +37,38 @@
  * invokation */
 #define FILES_MAX		4
 
-#define READ(fp, ptr, size)	((bool)(fread(ptr, sizeof(char), size, fp)\
-					== size))
-#define WRITE(fp, ptr, size)	((bool)(fwrite(ptr, sizeof(char), size, fp)\
-					== size))
-
 enum {
 	S_EMPTY,
 	S_FULL
 };
 
+/* xrel_sort() prefixes each tuple with the normalized values (see
+ * normalize_val()) of the attributes it is sorted by, complemented for 
+ * descending order; hence records are compared with a single memcmp() */
 struct sort_ctx {
 	struct xrel	*sc_rl;
 	struct xattr	**sc_attrs;
 	int		*sc_orders;
 	size_t		sc_atcnt;
+	size_t		sc_keysize;	/* size of the normalized prefix */
+	size_t		sc_size;	/* sc_keysize plus tuple size */
+};
+
+struct xsort {
+	size_t		xs_size;	/* size of a record */
+	int		(*xs_cmp)(const void *, const void *, void *);
+	void		*xs_ctx;	/* third argument of xs_cmp */
+	char		*xs_buf;	/* the current run */
+	size_t		xs_cnt;		/* count of records in xs_buf */
+	size_t		xs_max;		/* capacity of xs_buf */
+	size_t		xs_index;	/* next record of xs_buf to merge */
+	FILE		**xs_runs;	/* runs written before */
+	int		*xs_levels;	/* count of merges of each run */
+	size_t		xs_runcnt;	/* count of written runs */
+	char		*xs_heads;	/* the next record of each written run */
+	bool		*xs_full;	/* is the head of a written run valid? */
+	char		*xs_rec;	/* the record returned by xsort_get() */
+	bool		xs_merging;	/* did xsort_get() start? */
 };
 
 struct file {
@@ -72,36 +89,35 @@ static inline void swap(void **arr, int i, int j)
 	arr[j] = t;
 }
 
-static int tpcmp(const char *tp1, const char *tp2, const struct sort_ctx *ctx)
+static inline int tpcmp(const char *rec1, const char *rec2,
+		const struct sort_ctx *ctx)
 {
-	cmpf_t cmpf;
-	size_t size;
-	const char *v1, *v2;
-	size_t i;
-	int r;
-
-	assert(tp1 != NULL);
-	assert(tp2 != NULL);
+	assert(rec1 != NULL);
+	assert(rec2 != NULL);
 	assert(ctx != NULL);
-	assert(ctx->sc_attrs != NULL);
-	assert(ctx->sc_orders != NULL);
-	assert(ctx->sc_atcnt > 0);
 
-	for (i = 0; i < ctx->sc_atcnt; i++) {
-		cmpf = cmpf_by_sattr(ctx->sc_attrs[i]->at_sattr);
-		v1 = tp1 + ctx->sc_attrs[i]->at_offset;
-		v2 = tp2 + ctx->sc_attrs[i]->at_offset;
-		size = ctx->sc_attrs[i]->at_sattr->at_size;
+	/* the tuple behind the key also breaks ties of the sort attributes, 
+	 * because xrel_sort() is also intended to filter duplicates: two
+	 * completely (!) equal tuples must be next to another */
+	return memcmp(rec1, rec2, ctx->sc_size);
+}
 
-		if ((r = cmpf(v1, v2, size)) != 0)
-			return ctx->sc_orders[i] == ASCENDING ? r : -r;
+static void make_rec(char *rec, const char *tp, const struct sort_ctx *ctx)
+{
+	struct sattr *sattr;
+	char *key;
+	size_t i, j;
+
+	key = rec;
+	for (i = 0; i < ctx->sc_atcnt; i++) {
+		sattr = ctx->sc_attrs[i]->at_sattr;
+		normalize_val(sattr, key, tp + ctx->sc_attrs[i]->at_offset);
+		if (ctx->sc_orders[i] != ASCENDING)
+			for (j = 0; j < sattr->at_size; j++)
+				key[j] = ~key[j];
+		key += sattr->at_size;
 	}
-	/* from the perspective of simple sorting, we now could return zero.
-	 * but xrel_sort() is also inteded to filter duplicates. therefore 
-	 * we should also consider those attributes we don't want to sort by,
-	 * because the effect is that two completely (!) equal tuples are
-	 * next to another. */
-	return memcmp(tp1, tp2, ctx->sc_rl->rl_size);
+	memcpy(rec + ctx->sc_keysize, tp, ctx->sc_rl->rl_size);
 }
 
 static void sort_tps(char **tuples, size_t cnt, const struct sort_ctx *ctx)
@@ -124,7 +140,7 @@ static bool write_run(struct file *file, struct xrel_iter *iter, char **buf,
 
 	tp = NULL;
 	for (i = 0; i < runsize && (tp = iter->it_next(iter)) != NULL; i++)
-		memcpy(buf[i], tp, ctx->sc_rl->rl_size);
+		make_rec(buf[i], tp, ctx);
 	assert(tp != NULL || iter->it_next(iter) == NULL);
 	if ((runsize = i) == 0)
 		return false;
@@ -132,9 +148,9 @@ static bool write_run(struct file *file, struct xrel_iter *iter, char **buf,
 	sort_tps(buf, runsize, ctx);
 
 	for (i = 0; i < runsize; i++) {
-		if (i > 0 && memcmp(buf[i-1], buf[i], ctx->sc_rl->rl_size) == 0)
+		if (i > 0 && tpcmp(buf[i-1], buf[i], ctx) == 0)
 			continue; /* skip dupe */
-		if (!WRITE(file->f_fp, buf[i], ctx->sc_rl->rl_size))
+		if (!TMP_WRITE(file->f_fp, buf[i], ctx->sc_size))
 			return false;
 		file->f_tpcnt++;
 	}
@@ -144,7 +160,7 @@ static bool write_run(struct file *file, struct xrel_iter *iter, char **buf,
 static char *get_min(struct file **src, int srccnt,
 		size_t runsize, const struct sort_ctx *ctx)
 {
-	int i, m;
+	int i, m, r;
 
 	m = -1;
 	for (i = 0; i < srccnt; i++) {
@@ -155,8 +171,8 @@ static char *get_min(struct file **src, int srccnt,
 			continue;
 
 		if (src[i]->f_bufstatus == S_EMPTY) {
-			if (READ(src[i]->f_fp, src[i]->f_buf,
-						ctx->sc_rl->rl_size)) {
+			if (TMP_READ(src[i]->f_fp, src[i]->f_buf,
+						ctx->sc_size)) {
 				src[i]->f_bufstatus = S_FULL;
 			}
 		}
@@ -164,10 +180,10 @@ static char *get_min(struct file **src, int srccnt,
 		if (src[i]->f_bufstatus == S_EMPTY) /* file at end */
 			continue;
 
-		if (m == -1 || tpcmp(src[i]->f_buf, src[m]->f_buf, ctx) < 0)
+		if (m == -1 || (r = tpcmp(src[i]->f_buf, src[m]->f_buf, ctx))
+				< 0)
 			m = i;
-		else if (memcmp(src[i]->f_buf,src[m]->f_buf,
-					ctx->sc_rl->rl_size) == 0)
+		else if (r == 0)
 			src[i]->f_bufstatus = S_EMPTY; /* skip dupe */
 	}
 
@@ -194,7 +210,7 @@ static bool merge_runs(struct file **src, int srccnt, struct file *dst,
 
 	retval = false;
 	while ((tp = get_min(src, srccnt, runsize, ctx)) != NULL) {
-		if (!WRITE(dst->f_fp, tp, ctx->sc_rl->rl_size))
+		if (!TMP_WRITE(dst->f_fp, tp, ctx->sc_size))
 			return false;
 		dst->f_tpcnt++;
 		retval = true;
@@ -223,6 +239,28 @@ static size_t merge_all_runs(struct file **src, size_t srccnt,
 	return (i < srccnt) ? i : srccnt;
 }
 
+/* Copies the tuples of the `cnt' sorted records into a new temporary file. */
+static FILE *strip_keys(FILE *fp, tpcnt_t cnt, const struct sort_ctx *ctx)
+{
+	FILE *out;
+	char *buf;
+	tpcnt_t i;
+
+	rewind(fp);
+	if ((out = tmpfile()) == NULL) {
+		fclose(fp);
+		return NULL;
+	}
+	buf = xmalloc(ctx->sc_size);
+	for (i = 0; i < cnt && TMP_READ(fp, buf, ctx->sc_size); i++)
+		if (!TMP_WRITE(out, buf + ctx->sc_keysize, ctx->sc_rl->rl_size))
+			break;
+	free(buf);
+	fclose(fp);
+	rewind(out);
+	return out;
+}
+
 FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 		struct xattr **attrs, int *orders, int atcnt)
 {
@@ -231,6 +269,7 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 	char **buf;
 	struct sort_ctx ctx;
 	FILE *fp;
+	tpcnt_t tpcnt;
 
 	assert(rl != NULL);
 
@@ -238,6 +277,10 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 	ctx.sc_attrs = attrs;
 	ctx.sc_orders = orders;
 	ctx.sc_atcnt = atcnt;
+	ctx.sc_keysize = 0;
+	for (i = 0; i < ctx.sc_atcnt; i++)
+		ctx.sc_keysize += attrs[i]->at_sattr->at_size;
+	ctx.sc_size = ctx.sc_keysize + rl->rl_size;
 
 	runsize = FIRST_RUN_SIZE;
 
@@ -260,7 +303,7 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 	/* distribute relation in runs over files */
 	buf = xmalloc(runsize * sizeof(char *));
 	for (i = 0; i < runsize; i++)
-		buf[i] = xmalloc(ctx.sc_rl->rl_size);
+		buf[i] = xmalloc(ctx.sc_size);
 
 	i = 0;
 	while (write_run(src[i], iter, buf, runsize, &ctx))
@@ -272,9 +315,9 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 
 	/* merge the runs */
 	for (i = 0; i < srccnt; i++)
-		src[i]->f_buf = xmalloc(ctx.sc_rl->rl_size);
+		src[i]->f_buf = xmalloc(ctx.sc_size);
 	for (i = 0; i < dstcnt; i++)
-		dst[i]->f_buf = xmalloc(ctx.sc_rl->rl_size);
+		dst[i]->f_buf = xmalloc(ctx.sc_size);
 
 	while ((cnt = merge_all_runs(src, srccnt, dst, dstcnt, runsize, &ctx))
 			> 1) {
@@ -289,6 +332,7 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 	}
 
 	fp = NULL;
+	tpcnt = 0;
 	for (i = 0; i < FILES_MAX / 2; i++) {
 		fclose(src[i]->f_fp);
 		free(src[i]->f_buf);
@@ -296,14 +340,318 @@ FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 	}
 	free(src);
 	for (i = 0; i < FILES_MAX / 2; i++) {
-		if (i == 0)
+		if (i == 0) {
 			fp = dst[i]->f_fp;
-		else
+			tpcnt = dst[i]->f_tpcnt;
+		} else
 			fclose(dst[i]->f_fp);
 		free(dst[i]->f_buf);
 		free(dst[i]);
 	}
 	free(dst);
+	return strip_keys(fp, tpcnt, &ctx);
+}
+
+/* the sorting whose records are compared by xsort_cmp() in qsort() */
+static struct xsort *cmp_xs = NULL;
+
+static int xsort_cmp(const void *p, const void *q)
+{
+	return cmp_xs->xs_cmp(p, q, cmp_xs->xs_ctx);
+}
+
+static void sort_run(struct xsort *xs)
+{
+	if (xs->xs_cnt == 0)
+		return;
+	cmp_xs = xs;
+	qsort(xs->xs_buf, xs->xs_cnt, xs->xs_size, xsort_cmp);
+	cmp_xs = NULL;
+}
+
+/* returns the index of the written run whose head is the least one or 
+ * `cnt' if all runs are exhausted */
+static size_t min_head(struct xsort *xs, size_t first, size_t cnt)
+{
+	const char *min, *head;
+	size_t i, m;
+
+	min = NULL;
+	m = cnt;
+	for (i = first; i < cnt; i++) {
+		if (!xs->xs_full[i])
+			continue;
+		head = xs->xs_heads + i * xs->xs_size;
+		if (min == NULL || xs->xs_cmp(head, min, xs->xs_ctx) < 0) {
+			min = head;
+			m = i;
+		}
+	}
+	return m;
+}
+
+/* reads the next record of the i-th written run into its head */
+static void read_head(struct xsort *xs, size_t i)
+{
+	xs->xs_full[i] = TMP_READ(xs->xs_runs[i],
+			xs->xs_heads + i * xs->xs_size, xs->xs_size);
+}
+
+/* merges the written runs from the `first' on into a single one, which 
+ * replaces them */
+static bool merge_xruns(struct xsort *xs, size_t first)
+{
+	FILE *fp;
+	size_t i, m;
+	bool retval;
+
+	assert(first < xs->xs_runcnt);
+
+	if ((fp = tmpfile()) == NULL)
+		return false;
+	for (i = first; i < xs->xs_runcnt; i++)
+		read_head(xs, i);
+	retval = true;
+	while (retval && (m = min_head(xs, first, xs->xs_runcnt))
+			< xs->xs_runcnt) {
+		retval = TMP_WRITE(fp, xs->xs_heads + m * xs->xs_size,
+				xs->xs_size);
+		read_head(xs, m);
+	}
+	if (!retval) {
+		fclose(fp);
+		return false;
+	}
+	rewind(fp);
+
+	for (i = first; i < xs->xs_runcnt; i++)
+		fclose(xs->xs_runs[i]);
+	xs->xs_runs[first] = fp;
+	xs->xs_levels[first]++;
+	xs->xs_runcnt = first + 1;
+	return true;
+}
+
+/* sorts the current run and writes it into a temporary file; as soon as
+ * there are XSORT_FAN_IN runs which have been merged equally often, they are
+ * merged, so at most XSORT_FAN_IN - 1 runs per level are open */
+static bool write_xrun(struct xsort *xs)
+{
+	FILE *fp;
+
+	if ((fp = tmpfile()) == NULL)
+		return false;
+	sort_run(xs);
+	if (!TMP_WRITE(fp, xs->xs_buf, xs->xs_cnt * xs->xs_size)) {
+		fclose(fp);
+		return false;
+	}
+	rewind(fp);
+	if (xs->xs_runcnt % XSORT_FAN_IN == 0) {
+		xs->xs_runs = xrealloc(xs->xs_runs,
+				(xs->xs_runcnt + XSORT_FAN_IN)
+				* sizeof(FILE *));
+		xs->xs_levels = xrealloc(xs->xs_levels,
+				(xs->xs_runcnt + XSORT_FAN_IN)
+				* sizeof(int));
+		xs->xs_heads = xrealloc(xs->xs_heads,
+				(xs->xs_runcnt + XSORT_FAN_IN)
+				* xs->xs_size);
+		xs->xs_full = xrealloc(xs->xs_full,
+				(xs->xs_runcnt + XSORT_FAN_IN)
+				* sizeof(bool));
+	}
+	xs->xs_runs[xs->xs_runcnt] = fp;
+	xs->xs_levels[xs->xs_runcnt] = 0;
+	xs->xs_runcnt++;
+	xs->xs_cnt = 0;
+
+	/* the levels of the runs descend */
+	while (xs->xs_runcnt >= XSORT_FAN_IN
+			&& xs->xs_levels[xs->xs_runcnt - XSORT_FAN_IN]
+			== xs->xs_levels[xs->xs_runcnt - 1])
+		if (!merge_xruns(xs, xs->xs_runcnt - XSORT_FAN_IN))
+			return false;
+	return true;
+}
+
+struct xsort *xsort_init(size_t size,
+		int (*cmp)(const void *p, const void *q, void *ctx), void *ctx)
+{
+	struct xsort *xs;
+
+	assert(size > 0);
+	assert(cmp != NULL);
+
+	xs = xmalloc(sizeof(struct xsort));
+	xs->xs_size = size;
+	xs->xs_cmp = cmp;
+	xs->xs_ctx = ctx;
+	xs->xs_buf = NULL;
+	xs->xs_cnt = 0;
+	xs->xs_max = 0;
+	xs->xs_index = 0;
+	xs->xs_runs = NULL;
+	xs->xs_levels = NULL;
+	xs->xs_runcnt = 0;
+	xs->xs_heads = NULL;
+	xs->xs_full = NULL;
+	xs->xs_rec = NULL;
+	xs->xs_merging = false;
+	return xs;
+}
+
+bool xsort_put(struct xsort *xs, const void *rec)
+{
+	assert(xs != NULL);
+	assert(rec != NULL);
+	assert(!xs->xs_merging);
+
+	if (xs->xs_cnt == xs->xs_max) {
+		if ((xs->xs_cnt + 1) * xs->xs_size > XSORT_RUN_SIZE
+				&& xs->xs_cnt > 0) {
+			if (!write_xrun(xs))
+				return false;
+		} else {
+			/* the run grows up to XSORT_RUN_SIZE bytes */
+			xs->xs_max = (xs->xs_max > 0) ? 2 * xs->xs_max : 64;
+			if (xs->xs_max * xs->xs_size > XSORT_RUN_SIZE)
+				xs->xs_max = XSORT_RUN_SIZE / xs->xs_size;
+			if (xs->xs_max <= xs->xs_cnt)
+				xs->xs_max = xs->xs_cnt + 1;
+			xs->xs_buf = xrealloc(xs->xs_buf,
+					xs->xs_max * xs->xs_size);
+		}
+	}
+	memcpy(xs->xs_buf + xs->xs_cnt * xs->xs_size, rec, xs->xs_size);
+	xs->xs_cnt++;
+	return true;
+}
+
+bool xsort_finish(struct xsort *xs)
+{
+	size_t i, cnt;
+
+	assert(xs != NULL);
+	assert(!xs->xs_merging);
+
+	/* the smallest runs are merged until the written runs and the last 
+	 * run, which remains in memory, are at most XSORT_FAN_IN */
+	while (xs->xs_runcnt > XSORT_FAN_IN - 1) {
+		cnt = xs->xs_runcnt - (XSORT_FAN_IN - 1) + 1;
+		if (cnt > XSORT_FAN_IN)
+			cnt = XSORT_FAN_IN;
+		if (!merge_xruns(xs, xs->xs_runcnt - cnt))
+			return false;
+	}
+	sort_run(xs);
+	for (i = 0; i < xs->xs_runcnt; i++)
+		read_head(xs, i);
+	xs->xs_rec = xmalloc(xs->xs_size);
+	xs->xs_merging = true;
+	return true;
+}
+
+const void *xsort_get(struct xsort *xs)
+{
+	const char *min, *head;
+	size_t m;
+
+	assert(xs != NULL);
+	assert(xs->xs_merging);
+
+	/* the memory run is the xs_runcnt-th source */
+	m = min_head(xs, 0, xs->xs_runcnt);
+	min = (m < xs->xs_runcnt) ? xs->xs_heads + m * xs->xs_size : NULL;
+	if (xs->xs_index < xs->xs_cnt) {
+		head = xs->xs_buf + xs->xs_index * xs->xs_size;
+		if (min == NULL || xs->xs_cmp(head, min, xs->xs_ctx) < 0) {
+			min = head;
+			m = xs->xs_runcnt;
+		}
+	}
+
+	if (min == NULL)
+		return NULL;
+	if (m == xs->xs_runcnt) {
+		xs->xs_index++;
+		return min;
+	}
+
+	/* the run's head is refilled, so the record is returned in xs_rec */
+	memcpy(xs->xs_rec, min, xs->xs_size);
+	read_head(xs, m);
+	return xs->xs_rec;
+}
+
+void xsort_free(struct xsort *xs)
+{
+	size_t i;
+
+	assert(xs != NULL);
+
+	for (i = 0; i < xs->xs_runcnt; i++)
+		fclose(xs->xs_runs[i]);
+	if (xs->xs_runs != NULL)
+		free(xs->xs_runs);
+	if (xs->xs_levels != NULL)
+		free(xs->xs_levels);
+	if (xs->xs_heads != NULL)
+		free(xs->xs_heads);
+	if (xs->xs_full != NULL)
+		free(xs->xs_full);
+	if (xs->xs_rec != NULL)
+		free(xs->xs_rec);
+	if (xs->xs_buf != NULL)
+		free(xs->xs_buf);
+	free(xs);
+}
+
+static int keycmp(const void *p, const void *q, void *ctx)
+{
+	return memcmp(p, q, *(size_t *)ctx);
+}
+
+FILE *xrel_sort_by_key(struct xrel *rl, struct xrel_iter *iter,
+		struct xattr *attr, bool ordered)
+{
+	struct xsort *xs;
+	const char *tp, *rec;
+	char *buf;
+	size_t keysize, size;
+	bool retval;
+	FILE *fp;
+
+	assert(rl != NULL);
+	assert(iter != NULL);
+	assert(attr != NULL);
+
+	if ((fp = tmpfile()) == NULL)
+		return NULL;
+
+	keysize = attr->at_sattr->at_size;
+	size = keysize + rl->rl_size;
+	buf = xmalloc(size);
+	xs = ordered ? NULL : xsort_init(size, keycmp, &keysize);
+
+	retval = true;
+	while (retval && (tp = iter->it_next(iter)) != NULL) {
+		normalize_val(attr->at_sattr, buf, tp + attr->at_offset);
+		memcpy(buf + keysize, tp, rl->rl_size);
+		retval = ordered ? TMP_WRITE(fp, buf, size) : xsort_put(xs, buf);
+	}
+	if (!ordered) {
+		retval = retval && xsort_finish(xs);
+		while (retval && (rec = xsort_get(xs)) != NULL)
+			retval = TMP_WRITE(fp, rec, size);
+		xsort_free(xs);
+	}
+	free(buf);
+
+	if (!retval) {
+		fclose(fp);
+		return NULL;
+	}
 	rewind(fp);
 	return fp;
 }
@@ -26,21 +26,69 @@
  * The used balanced two-way merging is described in
  * Donald Knuth. The Art of Computer Programming, Volume 3: Sorting and 
  * Searching. Section 5.4: External Sorting, pp. 248 - 251
+ * The xsort functions sort large amounts of fixed-size records, e.g. the 
+ * entries of an index that is built (see btree.h): runs of XSORT_RUN_SIZE 
+ * bytes are sorted in memory and written to temporary files. XSORT_FAN_IN 
+ * runs are merged into one as soon as they are written, and the remaining 
+ * runs are finally merged in a single pass.
  */
 
 #ifndef __SORT_H__
 #define __SORT_H__
 
 #include "rlalg.h"
+#include <stdbool.h>
 #include <stdio.h>
 
 #define ASCENDING	1
 #define DESCENDING	2
 
+/* read and write records of temporary files; true on success */
+#define TMP_READ(fp, ptr, size)	((bool)(fread(ptr, sizeof(char), size,\
+					fp) == size))
+#define TMP_WRITE(fp, ptr, size) ((bool)(fwrite(ptr, sizeof(char), size,\
+					fp) == size))
+
+/* the maximum size of a run of records that is sorted in memory */
+#define XSORT_RUN_SIZE	(1024 * 1024 * 32)
+
+/* the maximum count of runs that are merged at once */
+#define XSORT_FAN_IN	16
+
+struct xsort;
+
 /* Sorts a relation. */
 FILE *xrel_sort(struct xrel *rl, struct xrel_iter *iter,
 		struct xattr **attrs, int *orders, int atcnt);
 
+/* Writes the tuples of iter into a temporary file in ascending order of
+ * attr, each one preceded by the normalized value of attr (see
+ * normalize_val()). Unlike xrel_sort(), duplicates are kept. If `ordered',
+ * iter returns the tuples in this order anyway (e.g. from an index), so they
+ * are just copied. Returns the rewound file or NULL. */
+FILE *xrel_sort_by_key(struct xrel *rl, struct xrel_iter *iter,
+		struct xattr *attr, bool ordered);
+
+/* Initializes the sorting of records of `size' bytes which are compared by
+ * `cmp'; its third argument is `ctx'. */
+struct xsort *xsort_init(size_t size,
+		int (*cmp)(const void *p, const void *q, void *ctx), void *ctx);
+
+/* Adds a record. Returns true to indicate success. */
+bool xsort_put(struct xsort *xs, const void *rec);
+
+/* Ends the adding of records: the written runs are merged until at most 
+ * XSORT_FAN_IN runs are left. Must be invoked before xsort_get(). Returns
+ * true to indicate success. */
+bool xsort_finish(struct xsort *xs);
+
+/* Returns the records in ascending order, one per call, or NULL if there are
+ * no more records. The record is valid until the next call. */
+const void *xsort_get(struct xsort *xs);
+
+/* Frees the sorting structure and removes its temporary files. */
+void xsort_free(struct xsort *xs);
+
 /* Selection sort. */
 void selection_sort(void **arr, int len,
 		int (*cmp)(const void *p, const void *q));
@@ -118,45 +118,93 @@ static bool drp_view_verify(struct drp_view *ptr)
 	return true;
 }
 
+/* looks up the `cnt' attributes named `names' of `rl', which must be 
+ * distinct */
+static bool ix_attrs_verify(struct srel *rl, char **names, int cnt,
+		struct sattr *attrs[])
+{
+	int i, j;
+
+	CHECK(names != NULL);
+	CHECK(cnt > 0);
+	CHECK(cnt <= IX_ATTR_MAX);
+	for (i = 0; i < cnt; i++) {
+		CHECK(names[i] != NULL);
+		CHECK(strlen(names[i]) <= AT_NAME_MAX);
+		attrs[i] = NULL;
+		for (j = 0; j < rl->rl_header.hd_atcnt; j++)
+			if (!strncmp(rl->rl_header.hd_attrs[j].at_name,
+						names[i], AT_NAME_MAX))
+				attrs[i] = &rl->rl_header.hd_attrs[j];
+		CHECK(attrs[i] != NULL);
+		for (j = 0; j < i; j++)
+			CHECK(attrs[j] != attrs[i]);
+	}
+	return true;
+}
+
 static bool crt_ix_verify(struct crt_ix *ptr)
 {
 	struct srel *rl;
-	struct sattr *sattr;
-	int i;
+	struct sattr *sattrs[IX_ATTR_MAX];
 
 	assert(ptr != NULL);
 
 	CHECK(ptr->tbl_name != NULL);
 	CHECK(strlen(ptr->tbl_name) <= RL_NAME_MAX);
-	CHECK(ptr->attr_name != NULL);
-	CHECK(strlen(ptr->attr_name) <= AT_NAME_MAX);
 	rl = open_relation(ptr->tbl_name);
 	CHECK(rl != NULL);
-	sattr = NULL;
-	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
-		if (!strncmp(rl->rl_header.hd_attrs[i].at_name,
-					ptr->attr_name, AT_NAME_MAX))
-			sattr = &rl->rl_header.hd_attrs[i];
-	CHECK(sattr != NULL);
-	CHECK(sattr->at_indexed == NOT_INDEXED);
+	CHECK(ix_attrs_verify(rl, ptr->attr_names, ptr->cnt, sattrs));
+	if (ptr->cnt == 1) {
+		CHECK(sattrs[0]->at_indexed == NOT_INDEXED);
+	} else {
+		CHECK(composite_index(rl, sattrs, ptr->cnt) == NULL);
+		CHECK(rl->rl_header.hd_ixcnt < IX_MAX);
+	}
 	return true;
 }
 
 static bool drp_ix_verify(struct drp_ix *ptr)
 {
 	struct srel *rl;
-	struct sattr *sattr;
+	struct sattr *sattrs[IX_ATTR_MAX];
+	struct sindex *six;
 	struct index *ix;
+
+	assert(ptr != NULL);
+
+	CHECK(ptr->tbl_name != NULL);
+	CHECK(strlen(ptr->tbl_name) <= RL_NAME_MAX);
+	rl = open_relation(ptr->tbl_name);
+	CHECK(rl != NULL);
+	CHECK(ix_attrs_verify(rl, ptr->attr_names, ptr->cnt, sattrs));
+	if (ptr->cnt == 1) {
+		CHECK(sattrs[0]->at_indexed != NOT_INDEXED);
+		ix = open_index(rl, sattrs[0]);
+	} else {
+		six = composite_index(rl, sattrs, ptr->cnt);
+		CHECK(six != NULL);
+		ix = open_composite_index(rl, six);
+	}
+	CHECK(ix != NULL);
+	return true;
+}
+
+static bool vac_tbl_verify(struct vac_tbl *ptr)
+{
+	struct srel *rl;
+	struct sattr *sattr;
 	int i;
 
 	assert(ptr != NULL);
 
 	CHECK(ptr->tbl_name != NULL);
 	CHECK(strlen(ptr->tbl_name) <= RL_NAME_MAX);
-	CHECK(ptr->attr_name != NULL);
-	CHECK(strlen(ptr->attr_name) <= AT_NAME_MAX);
 	rl = open_relation(ptr->tbl_name);
 	CHECK(rl != NULL);
+	if (ptr->attr_name == NULL)
+		return true;
+	CHECK(strlen(ptr->attr_name) <= AT_NAME_MAX);
 	sattr = NULL;
 	for (i = 0; i < rl->rl_header.hd_atcnt; i++)
 		if (!strncmp(rl->rl_header.hd_attrs[i].at_name,
@@ -164,8 +212,6 @@ static bool drp_ix_verify(struct drp_ix *ptr)
 			sattr = &rl->rl_header.hd_attrs[i];
 	CHECK(sattr != NULL);
 	CHECK(sattr->at_indexed != NOT_INDEXED);
-	ix = open_index(rl, sattr);
-	CHECK(ix != NULL);
 	return true;
 }
 
@@ -192,6 +238,9 @@ bool ddl_stmt_verify(struct ddl_stmt *ptr)
 		case DROP_INDEX:
 			CHECK(drp_ix_verify(ptr->ptr.drp_ix));
 			break;
+		case VACUUM_TABLE:
+			CHECK(vac_tbl_verify(ptr->ptr.vac_tbl));
+			break;
 	}
 	return true;
 }
@@ -708,6 +757,20 @@ static bool update_verify(struct update *u)
 	return true;
 }
 
+static bool copy_verify(struct copy *c)
+{
+	struct srel *rl;
+
+	assert(c != NULL);
+
+	CHECK(c->tbl_name != NULL);
+	CHECK(strlen(c->tbl_name) <= RL_NAME_MAX);
+	rl = open_relation(c->tbl_name);
+	CHECK(rl != NULL);
+	CHECK(c->filename != NULL);
+	return true;
+}
+
 bool dml_modi_verify(struct dml_modi *ptr)
 {
 	assert(ptr != NULL);
@@ -722,6 +785,9 @@ bool dml_modi_verify(struct dml_modi *ptr)
 		case UPDATE:
 			CHECK(update_verify(ptr->ptr.update));
 			break;
+		case COPY:
+			CHECK(copy_verify(ptr->ptr.copy));
+			break;
 	}
 	return true;
 }
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2006, 2007 Christoph Schwering <schwering@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 500	/* ftruncate(), fsync(), pread(), pwrite() */
+
+#include "wal.h"
+#include "cache.h"
+#include "constants.h"
+#include "mem.h"
+#include "str.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* record types: WAL_FILE assigns a file name to a file id, WAL_WRITE holds
+ * bytes written into a file */
+#define WAL_FILE		1
+#define WAL_WRITE		2
+
+/* the count of zero bytes written at once by redo */
+#define ZERO_SIZE		4096
+
+/* reads a given amount of bytes from a file position into a pointer */
+#define PREAD(fd, ptr, size, pos) (pread((fd),(ptr),(size),(pos))\
+				== (ssize_t)(size))
+
+/* writes a given amount of bytes from a pointer to a file position */
+#define PWRITE(fd, ptr, size, pos) (pwrite((fd),(ptr),(size),(pos))\
+				== (ssize_t)(size))
+
+struct wal_rec { /* header of a log record, followed by rc_len bytes */
+	uint32_t	rc_sum;		/* checksum of the rest of the record */
+	uint16_t	rc_type;	/* WAL_FILE or WAL_WRITE */
+	uint16_t	rc_link;	/* count of following linked records */
+	int32_t		rc_id;		/* file id */
+	uint32_t	rc_len;		/* count of following bytes */
+	uint64_t	rc_size;	/* written bytes (rc_len plus zeros) */
+	int64_t		rc_pos;		/* position in the file */
+};
+
+struct wal_file { /* registered file */
+	char		*fl_name;	/* file name or NULL if unused */
+	int		fl_fd;		/* file descriptor */
+	bool		fl_logged;	/* WAL_FILE record in the log? */
+	bool		(*fl_checkpointf)(void *); /* writes the header */
+	void		*fl_ctx;	/* argument of fl_checkpointf */
+};
+
+static struct { /* the log */
+	bool		opened;		/* log opened and redone? */
+	int		fd;		/* file descriptor of log */
+	char		*buf;		/* records not yet written */
+	size_t		buflen;		/* count of bytes in buf */
+	off_t		size;		/* count of bytes in log file */
+	off_t		synced;		/* count of bytes synced to disk */
+	bool		modified;	/* records since last commit? */
+	unsigned int	group;		/* statements per group commit */
+	unsigned int	pending;	/* statements since last sync */
+	unsigned int	link;		/* count of records to be linked */
+	off_t		linkpos;	/* position of the linked records */
+	struct wal_file	*files;		/* registered files */
+	int		filecnt;	/* size of files */
+	int		used;		/* count of registered files */
+} wal = { false, -1, NULL, 0, 0, 0, false, 0, 0, 0, -1, NULL, 0, 0 };
+
+/* FNV-1a hash, continued from `sum' */
+static uint32_t checksum(uint32_t sum, const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		sum ^= (unsigned char)buf[i];
+		sum *= 16777619U;
+	}
+	return sum;
+}
+
+static uint32_t rec_checksum(const struct wal_rec *rc, const char *data)
+{
+	uint32_t sum = 2166136261U;
+
+	sum = checksum(sum, (const char *)rc + sizeof(rc->rc_sum),
+			sizeof(struct wal_rec) - sizeof(rc->rc_sum));
+	return checksum(sum, data, rc->rc_len);
+}
+
+/* writes the log buffer into the log file */
+static bool write_buf(void)
+{
+	if (wal.buflen == 0)
+		return true;
+	if (!PWRITE(wal.fd, wal.buf, wal.buflen, wal.size))
+		return false;
+	wal.size += wal.buflen;
+	wal.buflen = 0;
+	return true;
+}
+
+/* appends `len' bytes to the log */
+static bool append(const char *buf, size_t len)
+{
+	if (wal.buflen + len > WAL_BUF_SIZE && !write_buf())
+		return false;
+	if (len > WAL_BUF_SIZE) {
+		if (!PWRITE(wal.fd, buf, len, wal.size))
+			return false;
+		wal.size += len;
+		return true;
+	}
+	memcpy(wal.buf + wal.buflen, buf, len);
+	wal.buflen += len;
+	return true;
+}
+
+static bool append_rec(int type, int link, int id, off_t pos,
+		const char *data, size_t len, size_t size)
+{
+	struct wal_rec rc;
+
+	memset(&rc, 0, sizeof(struct wal_rec));
+	rc.rc_type = type;
+	rc.rc_link = link;
+	rc.rc_id = id;
+	rc.rc_len = len;
+	rc.rc_size = size;
+	rc.rc_pos = pos;
+	rc.rc_sum = rec_checksum(&rc, data);
+	return append((const char *)&rc, sizeof(struct wal_rec))
+		&& append(data, len);
+}
+
+/* empties the log file */
+static bool truncate_log(void)
+{
+	int i;
+
+	wal.buflen = 0;
+	wal.size = 0;
+	wal.synced = 0;
+	wal.pending = 0;
+	wal.link = 0;
+	wal.linkpos = -1;
+	wal.modified = false;
+	for (i = 0; i < wal.filecnt; i++)
+		wal.files[i].fl_logged = false;
+	return ftruncate(wal.fd, 0) == 0 && fsync(wal.fd) == 0;
+}
+
+/* writes the zero bytes of a record behind its data */
+static bool write_zeros(int fd, off_t pos, size_t cnt)
+{
+	char zeros[ZERO_SIZE];
+	size_t n;
+
+	memset(zeros, 0, ZERO_SIZE);
+	for (; cnt > 0; cnt -= n, pos += n) {
+		n = (cnt < ZERO_SIZE) ? cnt : ZERO_SIZE;
+		if (!PWRITE(fd, zeros, n, pos))
+			return false;
+	}
+	return true;
+}
+
+/* reads the record at `pos' and its data; returns false if it is 
+ * incomplete or invalid */
+static bool read_rec(off_t pos, struct wal_rec *rc, char **data,
+		size_t *datasize)
+{
+	if (!PREAD(wal.fd, rc, sizeof(struct wal_rec), pos)
+			|| (rc->rc_type != WAL_FILE && rc->rc_type != WAL_WRITE)
+			|| rc->rc_id < 0 || rc->rc_len > rc->rc_size)
+		return false;
+	if (rc->rc_len > *datasize) {
+		*datasize = rc->rc_len;
+		*data = xrealloc(*data, *datasize);
+	}
+	return PREAD(wal.fd, *data, rc->rc_len,
+			pos + (off_t)sizeof(struct wal_rec))
+		&& rec_checksum(rc, *data) == rc->rc_sum;
+}
+
+/* applies the records of the log to the files until the end of the log or
+ * an incomplete record; linked records whose last record is missing are 
+ * not applied; files that do not exist anymore are skipped */
+static bool redo(void)
+{
+	struct wal_rec rc;
+	int *fds = NULL, fdcnt = 0, i;
+	char *data = NULL;
+	size_t datasize = 0;
+	off_t pos, end;
+	bool retval = true;
+
+	/* the log ends behind the last record that is not linked with a
+	 * following one */
+	end = 0;
+	for (pos = 0; read_rec(pos, &rc, &data, &datasize);
+			pos += sizeof(struct wal_rec) + rc.rc_len)
+		if (rc.rc_type == WAL_WRITE && rc.rc_link == 0)
+			end = pos + sizeof(struct wal_rec) + rc.rc_len;
+
+	for (pos = 0; pos < end && read_rec(pos, &rc, &data, &datasize);
+			pos += sizeof(struct wal_rec) + rc.rc_len) {
+
+		if (rc.rc_id >= fdcnt) {
+			fds = xrealloc(fds, (rc.rc_id + 1) * sizeof(int));
+			for (; fdcnt <= rc.rc_id; fdcnt++)
+				fds[fdcnt] = -1;
+		}
+		if (rc.rc_type == WAL_FILE) {
+			if (rc.rc_len == 0)
+				break;
+			if (fds[rc.rc_id] != -1) {
+				retval &= fsync(fds[rc.rc_id]) == 0;
+				close(fds[rc.rc_id]);
+			}
+			data[rc.rc_len - 1] = '\0';
+			fds[rc.rc_id] = open(data, OPEN_RW_FLAGS, FILE_MODE);
+		} else if (fds[rc.rc_id] != -1) {
+			retval &= PWRITE(fds[rc.rc_id], data, rc.rc_len,
+					rc.rc_pos)
+				&& write_zeros(fds[rc.rc_id],
+						rc.rc_pos + rc.rc_len,
+						rc.rc_size - rc.rc_len);
+		}
+	}
+
+	for (i = 0; i < fdcnt; i++) {
+		if (fds[i] != -1) {
+			retval &= fsync(fds[i]) == 0;
+			close(fds[i]);
+		}
+	}
+	if (fds != NULL)
+		free(fds);
+	if (data != NULL)
+		free(data);
+	return retval;
+}
+
+bool wal_open(void)
+{
+	const char *env;
+
+	if (wal.opened)
+		return true;
+
+	wal.fd = open(WAL_BASEDIR WAL_FILENAME, OPEN_RW_FLAGS | O_CREAT,
+			FILE_MODE);
+	if (wal.fd == -1)
+		return false;
+	if (!redo() || !truncate_log()) {
+		close(wal.fd);
+		wal.fd = -1;
+		return false;
+	}
+
+	wal.buf = xmalloc(WAL_BUF_SIZE);
+	if (wal.group == 0) {
+		env = getenv(WAL_GROUP_COMMIT_ENV);
+		wal.group = (env != NULL) ? strtoul(env, NULL, 10)
+			: WAL_DEFAULT_GROUP_COMMIT;
+	}
+	wal.opened = true;
+	return true;
+}
+
+void wal_close(void)
+{
+	if (!wal.opened)
+		return;
+
+	assert(wal.used == 0);
+	close(wal.fd);
+	wal.fd = -1;
+	free(wal.buf);
+	wal.buf = NULL;
+	if (wal.files != NULL)
+		free(wal.files);
+	wal.files = NULL;
+	wal.filecnt = 0;
+	wal.opened = false;
+}
+
+int wal_register(const char *filename, int fd,
+		bool (*checkpointf)(void *ctx), void *ctx)
+{
+	int id;
+
+	assert(filename != NULL);
+
+	if (!wal_open())
+		return -1;
+
+	for (id = 0; id < wal.filecnt && wal.files[id].fl_name != NULL; id++)
+		;
+	if (id == wal.filecnt) {
+		wal.filecnt = (wal.filecnt == 0) ? 8 : 2 * wal.filecnt;
+		wal.files = xrealloc(wal.files,
+				wal.filecnt * sizeof(struct wal_file));
+		memset(wal.files + id, 0,
+				(wal.filecnt - id) * sizeof(struct wal_file));
+	}
+	wal.files[id].fl_name = copy(filename, strsize(filename));
+	wal.files[id].fl_fd = fd;
+	wal.files[id].fl_logged = false;
+	wal.files[id].fl_checkpointf = checkpointf;
+	wal.files[id].fl_ctx = ctx;
+	wal.used++;
+	fsync(fd);
+	return id;
+}
+
+void wal_unregister(int id)
+{
+	assert(id >= 0 && id < wal.filecnt);
+	assert(wal.files[id].fl_name != NULL);
+
+	fsync(wal.files[id].fl_fd);
+	free(wal.files[id].fl_name);
+	wal.files[id].fl_name = NULL;
+	wal.files[id].fl_fd = -1;
+	wal.files[id].fl_checkpointf = NULL;
+	if (--wal.used == 0)
+		wal_checkpoint();
+}
+
+/* drops the records of the linked group that failed to be logged, because
+ * the caller gives up on the group: otherwise redo would link them with the
+ * records that follow; the records are still buffered unless the buffer was
+ * written in between */
+static void drop_group(void)
+{
+	if (wal.linkpos != -1) {
+		if (wal.linkpos >= wal.size)
+			wal.buflen = (size_t)(wal.linkpos - wal.size);
+		else if (ftruncate(wal.fd, wal.linkpos) == 0) {
+			wal.size = wal.linkpos;
+			wal.buflen = 0;
+			if (wal.synced > wal.size)
+				wal.synced = wal.size;
+		}
+	}
+	wal.link = 0;
+	wal.linkpos = -1;
+}
+
+bool wal_write(int id, off_t pos, const char *buf, size_t len, size_t size)
+{
+	struct wal_file *fl;
+	unsigned int link;
+
+	assert(wal.opened);
+	assert(id >= 0 && id < wal.filecnt);
+	assert(len <= size);
+
+	fl = &wal.files[id];
+	if (!fl->fl_logged) {
+		if (!append_rec(WAL_FILE, 0, id, 0, fl->fl_name,
+					strsize(fl->fl_name),
+					strsize(fl->fl_name))) {
+			drop_group();
+			return false;
+		}
+		fl->fl_logged = true;
+	}
+	wal.modified = true;
+	link = wal.link;
+	if (link > 0 && wal.linkpos == -1)
+		wal.linkpos = wal.size + (off_t)wal.buflen;
+	if (wal.link > 0)
+		wal.link--;
+	if (!append_rec(WAL_WRITE, link, id, pos, buf, len, size)) {
+		drop_group();
+		return false;
+	}
+	if (link == 0)
+		wal.linkpos = -1;
+	return true;
+}
+
+void wal_link(unsigned int cnt)
+{
+	assert(wal.link == 0);
+	assert(cnt <= UINT16_MAX);
+
+	wal.link = cnt;
+}
+
+bool wal_force(void)
+{
+	if (!wal.opened || (wal.buflen == 0 && wal.synced == wal.size))
+		return true;
+	if (!write_buf() || fsync(wal.fd) != 0)
+		return false;
+	wal.synced = wal.size;
+	wal.pending = 0;
+	return true;
+}
+
+bool wal_commit(void)
+{
+	if (!wal.opened || !wal.modified)
+		return true;
+
+	/* the records survive a crash of the process once they are written,
+	 * a crash of the system once they are synced */
+	wal.modified = false;
+	if (wal.size + (off_t)wal.buflen > WAL_MAX_SIZE)
+		return wal_checkpoint();
+	if (++wal.pending >= wal.group)
+		return wal_force();
+	return write_buf();
+}
+
+bool wal_checkpoint(void)
+{
+	bool retval;
+	int i;
+
+	if (!wal.opened)
+		return true;
+
+	assert(wal.link == 0);
+
+	/* the headers are written behind the pages, because they must not 
+	 * refer to pages which are not in the files */
+	retval = cache_flush_all();
+	for (i = 0; i < wal.filecnt; i++)
+		if (wal.files[i].fl_name != NULL
+				&& wal.files[i].fl_checkpointf != NULL)
+			retval &= wal.files[i].fl_checkpointf(
+					wal.files[i].fl_ctx);
+	for (i = 0; i < wal.filecnt; i++)
+		if (wal.files[i].fl_name != NULL)
+			retval &= fsync(wal.files[i].fl_fd) == 0;
+	if (!retval)
+		return false;
+	return truncate_log();
+}
+
+bool wal_unlink(const char *filename)
+{
+	assert(filename != NULL);
+
+	return wal_checkpoint() && unlink(filename) == 0;
+}
+
+bool wal_rename(const char *from, const char *to)
+{
+	assert(from != NULL);
+	assert(to != NULL);
+
+	return wal_checkpoint() && rename(from, to) == 0;
+}
+
+void wal_set_group_commit(unsigned int cnt)
+{
+	wal.group = (cnt > 0) ? cnt : 1;
+}
+
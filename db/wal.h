@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2006, 2007 Christoph Schwering <schwering@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Write-ahead log (WAL) of the relation and index files. Each change of a
+ * tuple, a page or a B+-tree node is logged as a redo record before it is
+ * written into the buffer pool or the file: the record holds the file, the
+ * position and the new bytes. The buffer pool thus may keep dirty blocks as
+ * long as it likes; it only has to force the log to disk with wal_force()
+ * before it writes a dirty block to the file.
+ * The log is written at the end of each statement, but synced to disk only
+ * once per group of statements (group commit, see wal_commit()). A crash of
+ * the system may thus lose the statements of the last group, but the files
+ * never contain changes which are not in the log.
+ * The headers of the files are logged like pages whenever their counters or
+ * roots change; such a header record is linked with the records of the page
+ * it belongs to (see wal_link()).
+ * After a crash, wal_open() redoes the log, i.e. it writes the logged bytes
+ * into the files again in the order in which they were logged; linked
+ * records are redone all or none. The headers thus need not be rebuilt by
+ * scanning the files. Note that statements are not atomic: redo also
+ * restores the changes of a statement that was interrupted by the crash.
+ * The log is truncated at checkpoints: when it grows larger than WAL_MAX_SIZE,
+ * when files are removed or renamed and when the last file is closed. A
+ * checkpoint flushes the buffer pool, writes the headers and syncs all files
+ * before; redo thus starts at the last checkpoint.
+ * With USE_MMAP, the operating system writes the mapped pages whenever it
+ * likes, i.e. the log cannot precede them; redo then still restores all
+ * logged changes, but the headers are rebuilt after a crash.
+ */
+
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* the name of the environment variable that specifies the count of
+ * statements per group commit */
+#define WAL_GROUP_COMMIT_ENV	"DB_GROUP_COMMIT"
+
+/* the default count of statements per group commit */
+#define WAL_DEFAULT_GROUP_COMMIT 16
+
+/* the size of the log buffer */
+#define WAL_BUF_SIZE		(1024 * 256)
+
+/* the size of the log that triggers a checkpoint */
+#define WAL_MAX_SIZE		(1024 * 1024 * 64)
+
+/* Opens the log; if it contains records of a crashed process, they are
+ * redone and the log is truncated. Must be invoked before any relation or
+ * index file is created or read. Returns true to indicate success. */
+bool wal_open(void);
+
+/* Closes the log. All files must be closed before. */
+void wal_close(void);
+
+/* Registers an open file whose changes are logged and returns its file id or
+ * -1 if the log could not be opened. The file is synced to disk such that
+ * its header is durable. If checkpointf is not NULL, it is invoked with ctx
+ * at each checkpoint to write the file's header. */
+int wal_register(const char *filename, int fd,
+		bool (*checkpointf)(void *ctx), void *ctx);
+
+/* Syncs the file to disk and unregisters it. The file's dirty blocks must
+ * have been flushed before. */
+void wal_unregister(int id);
+
+/* Logs that `len' bytes of `buf' followed by `size - len' zero bytes are
+ * written at position `pos' of the file `id'. Returns true to indicate
+ * success. If it fails, the records that are linked with the record are 
+ * dropped from the log and the link ends, i.e. the caller must not write
+ * the remaining records of the group. */
+bool wal_write(int id, off_t pos, const char *buf, size_t len, size_t size);
+
+/* Links the next record with the following `cnt' records: redo applies 
+ * either all or none of them. */
+void wal_link(unsigned int cnt);
+
+/* Writes all log records to disk and syncs the log. Invoked before dirty
+ * blocks are written to the files. Returns true to indicate success. */
+bool wal_force(void);
+
+/* Ends a statement: the log records are written to the log file. The log is
+ * forced after each group of statements that modified any file (see
+ * wal_set_group_commit()) and a checkpoint is made if the log is too large.
+ * Returns true to indicate success. */
+bool wal_commit(void);
+
+/* Flushes the buffer pool, syncs all files and truncates the log. Returns
+ * true to indicate success. */
+bool wal_checkpoint(void);
+
+/* Removes respectively renames a file whose changes are logged. Both are
+ * preceded by a checkpoint, because the log refers to files by their names:
+ * redo must not apply records of the old file to the new one. If the 
+ * checkpoint fails, the file is left as it is. Return true to indicate 
+ * success. */
+bool wal_unlink(const char *filename);
+bool wal_rename(const char *from, const char *to);
+
+/* Sets the count of statements per group commit. The default is taken from
+ * the environment variable DB_GROUP_COMMIT or WAL_DEFAULT_GROUP_COMMIT. A
+ * count of 0 or 1 syncs the log after each statement. */
+void wal_set_group_commit(unsigned int cnt);
+
+#endif
+
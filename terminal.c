@@ -37,6 +37,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #ifdef MALLOC_TRACE
 #include <mcheck.h>
@@ -126,7 +127,8 @@ static void print_general_help(void)
 	printf("\t* CREATE and DROP TABLE\n");
 	printf("\t* CREATE and DROP INDEX\n");
 	printf("\t* CREATE and DROP VIEW\n");
-	printf("\t* INSERT\n");
+	printf("\t* VACUUM\n");
+	printf("\t* INSERT and COPY\n");
 	printf("\t* UPDATE\n");
 	printf("\t* DELETE\n");
 	printf("\t* SELECT\n");
@@ -148,6 +150,7 @@ static void print_general_help(void)
 	printf("\t* copying\tlicense information\n");
 	printf("\t* store V\tstore the count of affected tuples of the "\
 			"last statement\n");
+	printf("\t* filesize V F\tstore the size of the file F in bytes\n");
 	printf("\t* echo V\tprint the value of the respective variable\n");
 	printf("\t* assert V R W\tcheck that V and W stand "\
 			"in relation R\n");
@@ -282,6 +285,25 @@ static void store_count(char *cmd)
 	db_free_result(result);
 }
 
+static void store_filesize(char *cmd)
+{
+	char *symbol, *filename;
+	struct stat st;
+
+	symbol = cmd;
+	for (filename = cmd; *filename; filename++)
+		if (IS_WHITE(*filename))
+			break;
+	if (*filename != '\0')
+		*filename++ = '\0';
+
+	if (stat(filename, &st) == 0) {
+		last_tpcnt = (unsigned long)st.st_size;
+		store_symbol(symbol);
+	} else
+		perror("Error");
+}
+
 static bool load_symbol(char *symbol, unsigned long *dest)
 {
 	unsigned long *ptr;
@@ -500,6 +522,8 @@ static bool interpret(char *cmd)
 		store_symbol(cmd + strlen("store "));
 	else if (strstr(cmd, "count ") == cmd)
 		store_count(cmd + strlen("count "));
+	else if (strstr(cmd, "filesize ") == cmd)
+		store_filesize(cmd + strlen("filesize "));
 	else if (strstr(cmd, "echo ") == cmd)
 		echo_symbol(cmd + strlen("echo "));
 	else if (strstr(cmd, "assert ") == cmd)